@@ -0,0 +1,238 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file base64_bench.c
+ * @brief Throughput of the base64 decoders on JSON data blocks.
+ *
+ * Each decoder the CPU supports decodes the payload of a data block, as it
+ * arrives over the JSON stream, into a buffer as large as the payload, as
+ * the demos do when they decode in place. The decoded blocks are checked
+ * against those of the scalar decoder. Throughput counts the encoded bytes.
+ *
+ * Usage: coreOTA_Base64Bench [-s blockSizeBytes] [-n iterations]
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "utils/base64.h"
+
+#define DEFAULT_BLOCK_SIZE    4096U
+#define DEFAULT_ITERATIONS    100000U
+
+/*-----------------------------------------------------------*/
+
+static const char alphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static const struct
+{
+    Base64Decoder_t decoder;
+    const char * name;
+} decoders[] =
+{
+    { BASE64_DECODER_SCALAR, "scalar" },
+    { BASE64_DECODER_SSSE3,  "SSSE3"  },
+    { BASE64_DECODER_AVX2,   "AVX2"   },
+    { BASE64_DECODER_NEON,   "NEON"   }
+};
+
+static size_t blockSize = DEFAULT_BLOCK_SIZE;
+static unsigned iterations = DEFAULT_ITERATIONS;
+
+/*-----------------------------------------------------------*/
+
+static double nowSeconds( void )
+{
+    struct timespec now;
+
+    ( void ) clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return ( double ) now.tv_sec + ( ( double ) now.tv_nsec / 1e9 );
+}
+/*-----------------------------------------------------------*/
+
+/* Encodes blockSize random bytes, padded as base64 pads them. */
+static size_t encodeBlock( uint8_t * encoded )
+{
+    uint32_t quantum = 0U;
+    size_t length = 0U;
+    size_t remaining = 0U;
+
+    for( size_t i = 0U; i < blockSize; i += 3U )
+    {
+        remaining = blockSize - i;
+        quantum = ( uint32_t ) ( rand() & 0xFFFFFF );
+
+        for( size_t j = 0U; j < 4U; j++ )
+        {
+            encoded[ length + j ] = ( j <= remaining ) ?
+                                    ( uint8_t ) alphabet[ ( quantum >> ( 18U - ( 6U * j ) ) ) & 0x3FU ] :
+                                    ( uint8_t ) '=';
+        }
+
+        length += 4U;
+    }
+
+    return length;
+}
+/*-----------------------------------------------------------*/
+
+/* Decodes the block iterations times and returns the elapsed seconds. */
+static double decodeBlocks( Base64Decoder_t decoder,
+                            const uint8_t * encoded,
+                            size_t encodedLength,
+                            uint8_t * buffer,
+                            size_t * decodedLength,
+                            bool * valid )
+{
+    double start = 0.0;
+
+    *valid = true;
+
+    start = nowSeconds();
+
+    for( unsigned i = 0U; i < iterations; i++ )
+    {
+        *valid = base64_decodeWith( decoder,
+                                    encoded,
+                                    encodedLength,
+                                    buffer,
+                                    encodedLength,
+                                    decodedLength ) && *valid;
+    }
+
+    return nowSeconds() - start;
+}
+/*-----------------------------------------------------------*/
+
+static bool parseArguments( int argc, char * argv[] )
+{
+    int option = 0;
+    char * end = NULL;
+    unsigned long value = 0U;
+    bool valid = true;
+
+    while( valid && ( ( option = getopt( argc, argv, "s:n:" ) ) != -1 ) )
+    {
+        value = ( optarg != NULL ) ? strtoul( optarg, &end, 10 ) : 0U;
+        valid = ( optarg != NULL ) && ( *end == '\0' ) && ( value > 0U ) &&
+                ( value <= UINT32_MAX );
+
+        if( !valid )
+        {
+            /* Empty if. */
+        }
+        else if( option == 's' )
+        {
+            blockSize = ( size_t ) value;
+        }
+        else if( option == 'n' )
+        {
+            iterations = ( unsigned ) value;
+        }
+        else
+        {
+            valid = false;
+        }
+    }
+
+    return valid && ( optind == argc );
+}
+/*-----------------------------------------------------------*/
+
+int main( int argc, char * argv[] )
+{
+    uint8_t * encoded = NULL;
+    uint8_t * buffer = NULL;
+    uint8_t * reference = NULL;
+    size_t encodedLength = 0U;
+    size_t decodedLength = 0U;
+    size_t referenceLength = 0U;
+    double seconds = 0.0;
+    double scalarSeconds = 0.0;
+    bool valid = true;
+    bool consistent = true;
+
+    if( !parseArguments( argc, argv ) )
+    {
+        printf( "Usage: %s [-s blockSizeBytes] [-n iterations]\n", argv[ 0 ] );
+        return 1;
+    }
+
+    encoded = malloc( ( ( blockSize + 2U ) / 3U ) * 4U );
+    buffer = malloc( ( ( blockSize + 2U ) / 3U ) * 4U );
+    reference = malloc( blockSize );
+
+    if( ( encoded == NULL ) || ( buffer == NULL ) || ( reference == NULL ) )
+    {
+        printf( "Out of memory.\n" );
+        return 1;
+    }
+
+    srand( 1U );
+    encodedLength = encodeBlock( encoded );
+
+    printf( "%zu byte blocks, %zu bytes encoded, %u iterations\n",
+            blockSize,
+            encodedLength,
+            iterations );
+    printf( "%-8s %12s %10s\n", "decoder", "MB/s", "speedup" );
+
+    for( size_t d = 0U; d < ( sizeof( decoders ) / sizeof( decoders[ 0 ] ) ); d++ )
+    {
+        if( !base64_isSupported( decoders[ d ].decoder ) )
+        {
+            printf( "%-8s %12s\n", decoders[ d ].name, "unsupported" );
+            continue;
+        }
+
+        seconds = decodeBlocks( decoders[ d ].decoder,
+                                encoded,
+                                encodedLength,
+                                buffer,
+                                &decodedLength,
+                                &valid );
+
+        /* The scalar decoder comes first and gives the reference block. */
+        if( decoders[ d ].decoder == BASE64_DECODER_SCALAR )
+        {
+            scalarSeconds = seconds;
+            referenceLength = decodedLength;
+            memcpy( reference, buffer, decodedLength );
+        }
+
+        consistent = consistent && valid &&
+                     ( decodedLength == referenceLength ) &&
+                     ( memcmp( buffer, reference, decodedLength ) == 0 );
+
+        printf( "%-8s %12.1f %9.2fx\n",
+                decoders[ d ].name,
+                ( ( double ) encodedLength * ( double ) iterations ) /
+                ( seconds * 1e6 ),
+                scalarSeconds / seconds );
+    }
+
+    if( !consistent )
+    {
+        printf( "The decoders do not agree on the decoded block.\n" );
+    }
+
+    free( encoded );
+    free( buffer );
+    free( reference );
+
+    return consistent ? 0 : 1;
+}
+/*-----------------------------------------------------------*/
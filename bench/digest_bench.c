@@ -0,0 +1,259 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file digest_bench.c
+ * @brief SHA-256 throughput of the image digest backends.
+ *
+ * Each backend hashes one image, then #IMAGE_DIGEST_LANES images at once,
+ * fed in blocks of the size the downloader uses, the way images are hashed
+ * while they download. The digests of both runs are checked against each
+ * other and against the other backend. Throughput counts the bytes of all
+ * images.
+ *
+ * Usage: coreOTA_DigestBench [-s imageSizeBytes] [-n runs]
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "digest/image_digest.h"
+
+#define DEFAULT_IMAGE_SIZE     ( 4U * 1024U * 1024U )
+#define DEFAULT_RUNS           5U
+
+/* Bytes given to the backend per call, a block of the downloader. */
+#ifndef DIGEST_BENCH_CHUNK_SIZE
+    #define DIGEST_BENCH_CHUNK_SIZE 4096U
+#endif
+
+/*-----------------------------------------------------------*/
+
+static size_t imageSize = DEFAULT_IMAGE_SIZE;
+static unsigned runs = DEFAULT_RUNS;
+
+/*-----------------------------------------------------------*/
+
+static double nowSeconds( void )
+{
+    struct timespec now;
+
+    ( void ) clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return ( double ) now.tv_sec + ( ( double ) now.tv_nsec / 1e9 );
+}
+/*-----------------------------------------------------------*/
+
+/* Hashes count images together, chunk by chunk, and returns the best time
+ * of the runs. */
+static double hashImages( const ImageDigest_t * digest,
+                          uint8_t * const images[],
+                          size_t count,
+                          uint8_t digests[][ IMAGE_DIGEST_LENGTH ] )
+{
+    ImageDigestContext_t contexts[ IMAGE_DIGEST_LANES ];
+    ImageDigestContext_t * contextList[ IMAGE_DIGEST_LANES ];
+    const uint8_t * data[ IMAGE_DIGEST_LANES ];
+    size_t lengths[ IMAGE_DIGEST_LANES ];
+    size_t chunk = 0U;
+    double start = 0.0;
+    double elapsed = 0.0;
+    double best = 0.0;
+
+    memset( contexts, 0, sizeof( contexts ) );
+
+    for( unsigned run = 0U; run < runs; run++ )
+    {
+        start = nowSeconds();
+
+        for( size_t i = 0U; i < count; i++ )
+        {
+            contextList[ i ] = &contexts[ i ];
+            ( void ) digest->init( &contexts[ i ] );
+        }
+
+        for( size_t offset = 0U; offset < imageSize; offset += chunk )
+        {
+            chunk = imageSize - offset;
+
+            if( chunk > DIGEST_BENCH_CHUNK_SIZE )
+            {
+                chunk = DIGEST_BENCH_CHUNK_SIZE;
+            }
+
+            if( count == 1U )
+            {
+                ( void ) digest->update( &contexts[ 0 ],
+                                         &images[ 0 ][ offset ],
+                                         chunk );
+            }
+            else
+            {
+                for( size_t i = 0U; i < count; i++ )
+                {
+                    data[ i ] = &images[ i ][ offset ];
+                    lengths[ i ] = chunk;
+                }
+
+                ( void ) digest->updateMany( contextList,
+                                             data,
+                                             lengths,
+                                             count );
+            }
+        }
+
+        for( size_t i = 0U; i < count; i++ )
+        {
+            ( void ) digest->final( &contexts[ i ], digests[ i ] );
+        }
+
+        elapsed = nowSeconds() - start;
+
+        if( ( run == 0U ) || ( elapsed < best ) )
+        {
+            best = elapsed;
+        }
+    }
+
+    for( size_t i = 0U; i < count; i++ )
+    {
+        digest->cleanup( &contexts[ i ] );
+    }
+
+    return best;
+}
+/*-----------------------------------------------------------*/
+
+static bool parseArguments( int argc, char * argv[] )
+{
+    int option = 0;
+    char * end = NULL;
+    unsigned long value = 0U;
+    bool valid = true;
+
+    while( valid && ( ( option = getopt( argc, argv, "s:n:" ) ) != -1 ) )
+    {
+        value = ( optarg != NULL ) ? strtoul( optarg, &end, 10 ) : 0U;
+        valid = ( optarg != NULL ) && ( *end == '\0' ) && ( value > 0U ) &&
+                ( value <= UINT32_MAX );
+
+        if( !valid )
+        {
+            /* Empty if. */
+        }
+        else if( option == 's' )
+        {
+            imageSize = ( size_t ) value;
+        }
+        else if( option == 'n' )
+        {
+            runs = ( unsigned ) value;
+        }
+        else
+        {
+            valid = false;
+        }
+    }
+
+    return valid && ( optind == argc );
+}
+/*-----------------------------------------------------------*/
+
+int main( int argc, char * argv[] )
+{
+    ImageDigest_t backends[ 2 ];
+    uint8_t * images[ IMAGE_DIGEST_LANES ];
+    uint8_t reference[ IMAGE_DIGEST_LANES ][ IMAGE_DIGEST_LENGTH ];
+    uint8_t digests[ IMAGE_DIGEST_LANES ][ IMAGE_DIGEST_LENGTH ];
+    double megabytes = 0.0;
+    double seconds = 0.0;
+    bool consistent = true;
+
+    if( !parseArguments( argc, argv ) )
+    {
+        printf( "Usage: %s [-s imageSizeBytes] [-n runs]\n", argv[ 0 ] );
+        return 1;
+    }
+
+    srand( 1U );
+
+    for( size_t i = 0U; i < IMAGE_DIGEST_LANES; i++ )
+    {
+        images[ i ] = malloc( imageSize );
+
+        if( images[ i ] == NULL )
+        {
+            printf( "Out of memory.\n" );
+            return 1;
+        }
+
+        for( size_t j = 0U; j < imageSize; j++ )
+        {
+            images[ i ][ j ] = ( uint8_t ) rand();
+        }
+    }
+
+    imageDigest_initOpenssl( &backends[ 0 ] );
+    imageDigest_initPortable( &backends[ 1 ] );
+
+    printf( "%zu byte images, %u byte chunks, best of %u runs\n",
+            imageSize,
+            DIGEST_BENCH_CHUNK_SIZE,
+            runs );
+    printf( "%-10s %10s %12s %10s\n", "backend", "images", "MB/s", "self test" );
+
+    for( size_t b = 0U; b < 2U; b++ )
+    {
+        for( size_t count = 1U; count <= IMAGE_DIGEST_LANES;
+             count += IMAGE_DIGEST_LANES - 1U )
+        {
+            seconds = hashImages( &backends[ b ], images, count, digests );
+            megabytes = ( ( double ) imageSize * ( double ) count ) / 1e6;
+
+            /* The digests OpenSSL gives for all images are the
+             * reference. */
+            if( ( b == 0U ) && ( count == IMAGE_DIGEST_LANES ) )
+            {
+                memcpy( reference, digests, sizeof( reference ) );
+            }
+
+            for( size_t i = 0U; ( b > 0U ) && ( i < count ); i++ )
+            {
+                consistent = consistent &&
+                             ( memcmp( digests[ i ],
+                                       reference[ i ],
+                                       IMAGE_DIGEST_LENGTH ) == 0 );
+            }
+
+            printf( "%-10s %10zu %12.1f %10s\n",
+                    backends[ b ].name,
+                    count,
+                    megabytes / seconds,
+                    imageDigest_selfTest( &backends[ b ] ) ? "passed" :
+                    "FAILED" );
+        }
+    }
+
+    if( !consistent )
+    {
+        printf( "The backends do not agree on the digests.\n" );
+    }
+
+    for( size_t i = 0U; i < IMAGE_DIGEST_LANES; i++ )
+    {
+        free( images[ i ] );
+    }
+
+    return consistent ? 0 : 1;
+}
+/*-----------------------------------------------------------*/
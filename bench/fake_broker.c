@@ -0,0 +1,1039 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file fake_broker.c
+ * @brief Stand-in for AWS IoT Core used by the download benchmark.
+ *
+ * Client packets are handled as soon as they are read. Responses are queued
+ * with the time they are due and written in order, which adds the same round
+ * trip time to every request without holding up the ones behind it.
+ */
+
+/* Standard includes. */
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "core_json.h"
+
+#include "fake_broker.h"
+
+/**
+ * @brief MQTT control packet types handled by the broker.
+ */
+#define MQTT_CONNECT     1U
+#define MQTT_CONNACK     2U
+#define MQTT_PUBLISH     3U
+#define MQTT_PUBACK      4U
+#define MQTT_SUBSCRIBE   8U
+#define MQTT_SUBACK      9U
+#define MQTT_PINGREQ     12U
+#define MQTT_PINGRESP    13U
+
+/**
+ * @brief Size of the buffer client packets are assembled in.
+ */
+#define RECEIVE_BUFFER_SIZE   8192U
+
+/**
+ * @brief Data block deliveries tracked for latency, must be a power of two.
+ */
+#define MAX_DELIVERIES        4096U
+
+/**
+ * @brief Largest topic the broker builds a response topic from.
+ */
+#define MAX_TOPIC_LENGTH      256U
+
+/**
+ * @brief Largest data block message, a base64 encoded block plus its keys.
+ */
+#define MAX_BLOCK_MESSAGE_SIZE \
+    ( ( ( FAKE_BROKER_MAX_BLOCK_SIZE + 2U ) / 3U ) * 4U + 64U )
+
+#define JOBS_TOPIC_PREFIX     "$aws/things/"
+#define START_NEXT_SUFFIX     "/jobs/start-next"
+#define UPDATE_SUFFIX         "/update"
+#define GET_JSON_SUFFIX       "/get/json"
+#define GET_CBOR_SUFFIX       "/get/cbor"
+#define DATA_JSON_SUFFIX      "/data/json"
+#define DATA_CBOR_SUFFIX      "/data/cbor"
+#define STREAM_NAME           "ota-bench-stream"
+
+/**
+ * @brief A response waiting for its delivery time.
+ */
+typedef struct PendingPacket
+{
+    struct PendingPacket * next;
+    uint64_t deliverAtNs;
+    size_t length;
+    size_t written;
+    uint8_t data[];
+} PendingPacket_t;
+
+/**
+ * @brief Where a data block message ends in the stream to the client.
+ */
+typedef struct Delivery
+{
+    uint64_t endOffset;
+    uint64_t requestTimeNs;
+} Delivery_t;
+
+/**
+ * @brief Fields of a stream get request.
+ */
+typedef struct GetRequest
+{
+    uint32_t fileId;
+    uint32_t blockSize;
+    uint32_t blockOffset;
+    uint32_t numBlocks;
+} GetRequest_t;
+
+/*-----------------------------------------------------------*/
+
+static FakeBrokerConfig_t brokerConfig = { 0 };
+static int brokerSocket = -1;
+static pthread_t brokerThread;
+
+static uint8_t receiveBuffer[ RECEIVE_BUFFER_SIZE ];
+static size_t receiveLength = 0U;
+
+static PendingPacket_t * pendingHead = NULL;
+static PendingPacket_t * pendingTail = NULL;
+static uint64_t bytesQueued = 0U;
+
+/* Written by the broker thread, read by the client. */
+static Delivery_t deliveries[ MAX_DELIVERIES ];
+static atomic_uint deliveriesHead = 0U;
+static atomic_uint deliveriesTail = 0U;
+
+static atomic_uint getRequests = 0U;
+static atomic_uint blocksSent = 0U;
+static atomic_ullong blockBytesSent = 0U;
+static atomic_uint jobUpdates = 0U;
+static atomic_ullong bytesSent = 0U;
+
+static uint8_t blockBuffer[ FAKE_BROKER_MAX_BLOCK_SIZE ];
+static uint8_t messageBuffer[ MAX_BLOCK_MESSAGE_SIZE ];
+
+_Static_assert( ( MAX_DELIVERIES & ( MAX_DELIVERIES - 1U ) ) == 0U,
+                "MAX_DELIVERIES must be a power of two" );
+
+/*-----------------------------------------------------------*/
+
+uint64_t fakeBroker_timeNs( void )
+{
+    struct timespec now;
+
+    ( void ) clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return ( ( uint64_t ) now.tv_sec * 1000000000U ) + ( uint64_t ) now.tv_nsec;
+}
+/*-----------------------------------------------------------*/
+
+uint8_t fakeBroker_imageByte( uint32_t offset )
+{
+    /* Knuth's multiplicative hash, so that a block stored at the wrong offset
+     * is caught when the image is checked. */
+    return ( uint8_t ) ( ( offset * 2654435761U ) >> 24 );
+}
+/*-----------------------------------------------------------*/
+
+static bool hasSuffix( const char * topic,
+                       size_t topicLength,
+                       const char * suffix )
+{
+    size_t suffixLength = strlen( suffix );
+
+    return ( topicLength >= suffixLength ) &&
+           ( memcmp( &topic[ topicLength - suffixLength ],
+                     suffix,
+                     suffixLength ) == 0 );
+}
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Queue a response to be written once the round trip time is up.
+ */
+static void queuePacket( const uint8_t * header,
+                         size_t headerLength,
+                         const uint8_t * body,
+                         size_t bodyLength,
+                         uint64_t receivedAtNs )
+{
+    PendingPacket_t * packet = malloc( sizeof( PendingPacket_t ) +
+                                       headerLength + bodyLength );
+
+    if( packet == NULL )
+    {
+        fprintf( stderr, "Fake broker: out of memory.\n" );
+        exit( 1 );
+    }
+
+    packet->next = NULL;
+    packet->deliverAtNs = receivedAtNs +
+                          ( ( uint64_t ) brokerConfig.rttMs * 1000000U );
+    packet->length = headerLength + bodyLength;
+    packet->written = 0U;
+    memcpy( packet->data, header, headerLength );
+
+    if( bodyLength > 0U )
+    {
+        memcpy( &packet->data[ headerLength ], body, bodyLength );
+    }
+
+    if( pendingTail == NULL )
+    {
+        pendingHead = packet;
+    }
+    else
+    {
+        pendingTail->next = packet;
+    }
+
+    pendingTail = packet;
+    bytesQueued += packet->length;
+}
+/*-----------------------------------------------------------*/
+
+static size_t encodeRemainingLength( uint8_t * buffer, size_t length )
+{
+    size_t encodedLength = 0U;
+
+    do
+    {
+        buffer[ encodedLength ] = ( uint8_t ) ( length & 0x7FU );
+        length >>= 7;
+        buffer[ encodedLength ] |= ( length > 0U ) ? 0x80U : 0U;
+        encodedLength++;
+    } while( length > 0U );
+
+    return encodedLength;
+}
+/*-----------------------------------------------------------*/
+
+/* Returns the size of the packet on the wire. */
+static size_t queuePublish( const char * topic,
+                            size_t topicLength,
+                            const uint8_t * payload,
+                            size_t payloadLength,
+                            uint64_t receivedAtNs )
+{
+    uint8_t header[ 5U + 2U + MAX_TOPIC_LENGTH ];
+    size_t headerLength = 0U;
+
+    header[ headerLength++ ] = ( uint8_t ) ( MQTT_PUBLISH << 4 );
+    headerLength += encodeRemainingLength( &header[ headerLength ],
+                                           2U + topicLength + payloadLength );
+    header[ headerLength++ ] = ( uint8_t ) ( topicLength >> 8 );
+    header[ headerLength++ ] = ( uint8_t ) topicLength;
+    memcpy( &header[ headerLength ], topic, topicLength );
+    headerLength += topicLength;
+
+    queuePacket( header, headerLength, payload, payloadLength, receivedAtNs );
+
+    return headerLength + payloadLength;
+}
+/*-----------------------------------------------------------*/
+
+static void recordDelivery( uint64_t requestTimeNs )
+{
+    unsigned int head = atomic_load_explicit( &deliveriesHead,
+                                              memory_order_relaxed );
+    unsigned int tail = atomic_load_explicit( &deliveriesTail,
+                                              memory_order_acquire );
+
+    /* Latency is sampled, not required, so a full ring skips the block. */
+    if( ( head - tail ) < MAX_DELIVERIES )
+    {
+        deliveries[ head & ( MAX_DELIVERIES - 1U ) ].endOffset = bytesQueued;
+        deliveries[ head & ( MAX_DELIVERIES - 1U ) ].requestTimeNs =
+            requestTimeNs;
+        atomic_store_explicit( &deliveriesHead,
+                               head + 1U,
+                               memory_order_release );
+    }
+}
+/*-----------------------------------------------------------*/
+
+bool fakeBroker_takeDelivery( uint64_t bytesReceived,
+                              uint64_t * requestTimeNs )
+{
+    unsigned int tail = atomic_load_explicit( &deliveriesTail,
+                                              memory_order_relaxed );
+    unsigned int head = atomic_load_explicit( &deliveriesHead,
+                                              memory_order_acquire );
+    bool taken = false;
+
+    if( ( tail != head ) &&
+        ( deliveries[ tail & ( MAX_DELIVERIES - 1U ) ].endOffset <=
+          bytesReceived ) )
+    {
+        *requestTimeNs = deliveries[ tail & ( MAX_DELIVERIES - 1U ) ]
+                             .requestTimeNs;
+        atomic_store_explicit( &deliveriesTail,
+                               tail + 1U,
+                               memory_order_release );
+        taken = true;
+    }
+
+    return taken;
+}
+/*-----------------------------------------------------------*/
+
+static size_t writeCborHead( uint8_t * buffer,
+                             uint8_t majorType,
+                             uint32_t value )
+{
+    size_t length = 0U;
+
+    if( value < 24U )
+    {
+        buffer[ length++ ] = ( uint8_t ) ( ( majorType << 5 ) | value );
+    }
+    else if( value <= UINT8_MAX )
+    {
+        buffer[ length++ ] = ( uint8_t ) ( ( majorType << 5 ) | 24U );
+        buffer[ length++ ] = ( uint8_t ) value;
+    }
+    else if( value <= UINT16_MAX )
+    {
+        buffer[ length++ ] = ( uint8_t ) ( ( majorType << 5 ) | 25U );
+        buffer[ length++ ] = ( uint8_t ) ( value >> 8 );
+        buffer[ length++ ] = ( uint8_t ) value;
+    }
+    else
+    {
+        buffer[ length++ ] = ( uint8_t ) ( ( majorType << 5 ) | 26U );
+        buffer[ length++ ] = ( uint8_t ) ( value >> 24 );
+        buffer[ length++ ] = ( uint8_t ) ( value >> 16 );
+        buffer[ length++ ] = ( uint8_t ) ( value >> 8 );
+        buffer[ length++ ] = ( uint8_t ) value;
+    }
+
+    return length;
+}
+/*-----------------------------------------------------------*/
+
+static size_t encodeBase64( const uint8_t * data,
+                            size_t dataLength,
+                            uint8_t * encoded )
+{
+    static const char alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t encodedLength = 0U;
+    uint32_t quantum = 0U;
+
+    for( size_t i = 0U; i < dataLength; i += 3U )
+    {
+        quantum = ( uint32_t ) data[ i ] << 16;
+        quantum |= ( i + 1U < dataLength ) ? ( uint32_t ) data[ i + 1U ] << 8 : 0U;
+        quantum |= ( i + 2U < dataLength ) ? ( uint32_t ) data[ i + 2U ] : 0U;
+
+        encoded[ encodedLength++ ] = ( uint8_t ) alphabet[ ( quantum >> 18 ) & 0x3FU ];
+        encoded[ encodedLength++ ] = ( uint8_t ) alphabet[ ( quantum >> 12 ) & 0x3FU ];
+        encoded[ encodedLength++ ] = ( i + 1U < dataLength ) ?
+                                     ( uint8_t ) alphabet[ ( quantum >> 6 ) & 0x3FU ] :
+                                     ( uint8_t ) '=';
+        encoded[ encodedLength++ ] = ( i + 2U < dataLength ) ?
+                                     ( uint8_t ) alphabet[ quantum & 0x3FU ] :
+                                     ( uint8_t ) '=';
+    }
+
+    return encodedLength;
+}
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Build the data block message for one block of the image.
+ */
+static size_t encodeBlockMessage( bool cbor,
+                                  uint32_t fileId,
+                                  uint32_t blockId,
+                                  const uint8_t * block,
+                                  uint32_t blockLength )
+{
+    size_t length = 0U;
+    int written = 0;
+
+    if( cbor )
+    {
+        length += writeCborHead( &messageBuffer[ length ], 5U, 4U );
+        length += writeCborHead( &messageBuffer[ length ], 3U, 1U );
+        messageBuffer[ length++ ] = 'f';
+        length += writeCborHead( &messageBuffer[ length ], 0U, fileId );
+        length += writeCborHead( &messageBuffer[ length ], 3U, 1U );
+        messageBuffer[ length++ ] = 'i';
+        length += writeCborHead( &messageBuffer[ length ], 0U, blockId );
+        length += writeCborHead( &messageBuffer[ length ], 3U, 1U );
+        messageBuffer[ length++ ] = 'l';
+        length += writeCborHead( &messageBuffer[ length ], 0U, blockLength );
+        length += writeCborHead( &messageBuffer[ length ], 3U, 1U );
+        messageBuffer[ length++ ] = 'p';
+        length += writeCborHead( &messageBuffer[ length ], 2U, blockLength );
+        memcpy( &messageBuffer[ length ], block, blockLength );
+        length += blockLength;
+    }
+    else
+    {
+        written = snprintf( ( char * ) messageBuffer,
+                            sizeof( messageBuffer ),
+                            "{\"f\":%u,\"i\":%u,\"l\":%u,\"p\":\"",
+                            ( unsigned int ) fileId,
+                            ( unsigned int ) blockId,
+                            ( unsigned int ) blockLength );
+        length = ( size_t ) written;
+        length += encodeBase64( block, blockLength, &messageBuffer[ length ] );
+        messageBuffer[ length++ ] = '"';
+        messageBuffer[ length++ ] = '}';
+    }
+
+    return length;
+}
+/*-----------------------------------------------------------*/
+
+static bool searchJsonUnsigned( char * document,
+                                size_t documentLength,
+                                const char * key,
+                                uint32_t * value )
+{
+    char * digits = NULL;
+    size_t digitsLength = 0U;
+    uint64_t result = 0U;
+    bool valid = JSON_Search( document,
+                              documentLength,
+                              key,
+                              strlen( key ),
+                              &digits,
+                              &digitsLength ) == JSONSuccess;
+
+    valid = valid && ( digitsLength > 0U ) && ( digitsLength <= 10U );
+
+    for( size_t i = 0U; valid && ( i < digitsLength ); i++ )
+    {
+        valid = ( digits[ i ] >= '0' ) && ( digits[ i ] <= '9' );
+        result = ( result * 10U ) + ( uint64_t ) ( digits[ i ] - '0' );
+    }
+
+    *value = ( uint32_t ) result;
+
+    return valid && ( result <= UINT32_MAX );
+}
+/*-----------------------------------------------------------*/
+
+static bool parseJsonRequest( uint8_t * payload,
+                              size_t payloadLength,
+                              GetRequest_t * request )
+{
+    char * document = ( char * ) payload;
+
+    return ( JSON_Validate( document, payloadLength ) == JSONSuccess ) &&
+           searchJsonUnsigned( document,
+                               payloadLength,
+                               "f",
+                               &request->fileId ) &&
+           searchJsonUnsigned( document,
+                               payloadLength,
+                               "l",
+                               &request->blockSize ) &&
+           searchJsonUnsigned( document,
+                               payloadLength,
+                               "o",
+                               &request->blockOffset ) &&
+           searchJsonUnsigned( document,
+                               payloadLength,
+                               "n",
+                               &request->numBlocks );
+}
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Read the unsigned argument of the next CBOR item.
+ */
+static bool readCborUnsigned( const uint8_t * data,
+                              size_t length,
+                              size_t * offset,
+                              uint8_t * majorType,
+                              uint64_t * value )
+{
+    bool valid = *offset < length;
+    uint8_t additionalInfo = 0U;
+    size_t argumentLength = 0U;
+
+    if( valid )
+    {
+        *majorType = data[ *offset ] >> 5;
+        additionalInfo = data[ *offset ] & 0x1FU;
+        ( *offset )++;
+        *value = additionalInfo;
+
+        if( ( additionalInfo >= 24U ) && ( additionalInfo <= 27U ) )
+        {
+            argumentLength = ( size_t ) 1U << ( additionalInfo - 24U );
+            valid = argumentLength <= ( length - *offset );
+            *value = 0U;
+
+            for( size_t i = 0U; valid && ( i < argumentLength ); i++ )
+            {
+                *value = ( *value << 8 ) | data[ *offset + i ];
+            }
+
+            *offset += valid ? argumentLength : 0U;
+        }
+        else
+        {
+            valid = additionalInfo < 24U;
+        }
+    }
+
+    return valid;
+}
+/*-----------------------------------------------------------*/
+
+static bool parseCborRequest( const uint8_t * payload,
+                              size_t payloadLength,
+                              GetRequest_t * request )
+{
+    size_t offset = 0U;
+    uint8_t majorType = 0U;
+    uint64_t pairCount = 0U;
+    uint64_t value = 0U;
+    char key = '\0';
+    uint32_t found = 0U;
+    bool valid = readCborUnsigned( payload,
+                                   payloadLength,
+                                   &offset,
+                                   &majorType,
+                                   &pairCount ) &&
+                 ( majorType == 5U );
+
+    for( uint64_t pair = 0U; valid && ( pair < pairCount ); pair++ )
+    {
+        valid = readCborUnsigned( payload,
+                                  payloadLength,
+                                  &offset,
+                                  &majorType,
+                                  &value ) &&
+                ( majorType == 3U ) && ( value == 1U ) &&
+                ( offset < payloadLength );
+
+        if( valid )
+        {
+            key = ( char ) payload[ offset ];
+            offset++;
+            valid = readCborUnsigned( payload,
+                                      payloadLength,
+                                      &offset,
+                                      &majorType,
+                                      &value );
+        }
+
+        if( !valid )
+        {
+            /* Empty if. */
+        }
+        else if( majorType == 0U )
+        {
+            switch( key )
+            {
+                case 'f':
+                    request->fileId = ( uint32_t ) value;
+                    found |= 1U;
+                    break;
+
+                case 'l':
+                    request->blockSize = ( uint32_t ) value;
+                    found |= 2U;
+                    break;
+
+                case 'o':
+                    request->blockOffset = ( uint32_t ) value;
+                    found |= 4U;
+                    break;
+
+                case 'n':
+                    request->numBlocks = ( uint32_t ) value;
+                    found |= 8U;
+                    break;
+
+                default:
+                    break;
+            }
+        }
+        else if( ( majorType == 2U ) || ( majorType == 3U ) )
+        {
+            /* The optional block bitmap and the client token. */
+            valid = value <= ( payloadLength - offset );
+            offset += valid ? ( size_t ) value : 0U;
+        }
+        else
+        {
+            valid = false;
+        }
+    }
+
+    return valid && ( found == 15U );
+}
+/*-----------------------------------------------------------*/
+
+static void handleGetRequest( const char * topic,
+                              size_t topicLength,
+                              uint8_t * payload,
+                              size_t payloadLength,
+                              bool cbor,
+                              uint64_t receivedAtNs )
+{
+    char dataTopic[ MAX_TOPIC_LENGTH ];
+    size_t dataTopicLength = topicLength - strlen( GET_JSON_SUFFIX );
+    const char * dataSuffix = cbor ? DATA_CBOR_SUFFIX : DATA_JSON_SUFFIX;
+    GetRequest_t request = { 0 };
+    uint32_t totalBlocks = 0U;
+    uint32_t blockLength = 0U;
+    uint32_t blockStart = 0U;
+    size_t messageLength = 0U;
+    size_t packetLength = 0U;
+    bool valid = cbor ? parseCborRequest( payload, payloadLength, &request ) :
+                 parseJsonRequest( payload, payloadLength, &request );
+
+    valid = valid && ( request.blockSize > 0U ) &&
+            ( request.blockSize <= FAKE_BROKER_MAX_BLOCK_SIZE ) &&
+            ( ( dataTopicLength + strlen( dataSuffix ) ) <= MAX_TOPIC_LENGTH );
+
+    if( valid )
+    {
+        atomic_fetch_add_explicit( &getRequests, 1U, memory_order_relaxed );
+        memcpy( dataTopic, topic, dataTopicLength );
+        memcpy( &dataTopic[ dataTopicLength ], dataSuffix, strlen( dataSuffix ) );
+        dataTopicLength += strlen( dataSuffix );
+        totalBlocks = ( brokerConfig.imageSize + request.blockSize - 1U ) /
+                      request.blockSize;
+
+        for( uint32_t blockId = request.blockOffset;
+             ( blockId < totalBlocks ) &&
+             ( ( blockId - request.blockOffset ) < request.numBlocks );
+             blockId++ )
+        {
+            blockStart = blockId * request.blockSize;
+            blockLength = brokerConfig.imageSize - blockStart;
+            blockLength = ( blockLength < request.blockSize ) ?
+                          blockLength : request.blockSize;
+
+            for( uint32_t i = 0U; i < blockLength; i++ )
+            {
+                blockBuffer[ i ] = fakeBroker_imageByte( blockStart + i );
+            }
+
+            messageLength = encodeBlockMessage( cbor,
+                                                request.fileId,
+                                                blockId,
+                                                blockBuffer,
+                                                blockLength );
+            packetLength = queuePublish( dataTopic,
+                                         dataTopicLength,
+                                         messageBuffer,
+                                         messageLength,
+                                         receivedAtNs );
+            recordDelivery( receivedAtNs );
+            atomic_fetch_add_explicit( &blocksSent, 1U, memory_order_relaxed );
+            atomic_fetch_add_explicit( &blockBytesSent,
+                                       packetLength,
+                                       memory_order_relaxed );
+        }
+    }
+    else
+    {
+        fprintf( stderr, "Fake broker: ignoring malformed get request.\n" );
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void handleStartNext( const char * topic,
+                             size_t topicLength,
+                             uint64_t receivedAtNs )
+{
+    static const char acceptedSuffix[] = "/accepted";
+    char acceptedTopic[ MAX_TOPIC_LENGTH ];
+    char jobDocument[ 512 ];
+    int jobDocumentLength = 0;
+
+    if( ( topicLength + sizeof( acceptedSuffix ) - 1U ) <= MAX_TOPIC_LENGTH )
+    {
+        memcpy( acceptedTopic, topic, topicLength );
+        memcpy( &acceptedTopic[ topicLength ],
+                acceptedSuffix,
+                sizeof( acceptedSuffix ) - 1U );
+
+        jobDocumentLength = snprintf(
+            jobDocument,
+            sizeof( jobDocument ),
+            "{\"execution\":{\"jobId\":\"AFR_OTA-bench\","
+            "\"jobDocument\":{\"afr_ota\":{\"protocols\":[\"MQTT\"],"
+            "\"streamname\":\"" STREAM_NAME "\",\"files\":[{"
+            "\"filepath\":\"" FAKE_BROKER_IMAGE_PATH "\","
+            "\"filesize\":%u,\"fileid\":0,\"certfile\":\"bench.crt\","
+            "\"fileType\":0,\"sig-sha256-ecdsa\":\"MEUCIQ==\"}]}}}}",
+            ( unsigned int ) brokerConfig.imageSize );
+
+        ( void ) queuePublish( acceptedTopic,
+                               topicLength + sizeof( acceptedSuffix ) - 1U,
+                               ( const uint8_t * ) jobDocument,
+                               ( size_t ) jobDocumentLength,
+                               receivedAtNs );
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void handlePublish( uint8_t flags,
+                           uint8_t * body,
+                           size_t bodyLength,
+                           uint64_t receivedAtNs )
+{
+    uint8_t qos = ( flags >> 1 ) & 0x03U;
+    size_t topicLength = 0U;
+    size_t offset = 2U;
+    const char * topic = ( const char * ) &body[ 2 ];
+    uint8_t puback[ 4 ] = { MQTT_PUBACK << 4, 2U, 0U, 0U };
+
+    if( bodyLength >= 2U )
+    {
+        topicLength = ( ( size_t ) body[ 0 ] << 8 ) | body[ 1 ];
+        offset += topicLength;
+    }
+
+    if( ( bodyLength >= 2U ) &&
+        ( ( offset + ( ( qos > 0U ) ? 2U : 0U ) ) <= bodyLength ) )
+    {
+        if( qos > 0U )
+        {
+            puback[ 2 ] = body[ offset ];
+            puback[ 3 ] = body[ offset + 1U ];
+            offset += 2U;
+            queuePacket( puback, sizeof( puback ), NULL, 0U, receivedAtNs );
+        }
+
+        if( hasSuffix( topic, topicLength, START_NEXT_SUFFIX ) )
+        {
+            handleStartNext( topic, topicLength, receivedAtNs );
+        }
+        else if( hasSuffix( topic, topicLength, GET_JSON_SUFFIX ) ||
+                 hasSuffix( topic, topicLength, GET_CBOR_SUFFIX ) )
+        {
+            handleGetRequest( topic,
+                              topicLength,
+                              &body[ offset ],
+                              bodyLength - offset,
+                              hasSuffix( topic, topicLength, GET_CBOR_SUFFIX ),
+                              receivedAtNs );
+        }
+        else if( hasSuffix( topic, topicLength, UPDATE_SUFFIX ) )
+        {
+            atomic_fetch_add_explicit( &jobUpdates, 1U, memory_order_relaxed );
+        }
+        else
+        {
+            /* Publishes to any other topic have no subscribers. */
+        }
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void handleSubscribe( uint8_t * body,
+                             size_t bodyLength,
+                             uint64_t receivedAtNs )
+{
+    uint8_t suback[ 4U + 64U ] = { MQTT_SUBACK << 4 };
+    size_t subackLength = 4U;
+    size_t offset = 2U;
+    size_t filterLength = 0U;
+
+    if( bodyLength >= 2U )
+    {
+        suback[ 2 ] = body[ 0 ];
+        suback[ 3 ] = body[ 1 ];
+
+        /* Every filter is granted the QoS it asked for. */
+        while( ( ( offset + 2U ) < bodyLength ) &&
+               ( subackLength < sizeof( suback ) ) )
+        {
+            filterLength = ( ( size_t ) body[ offset ] << 8 ) |
+                           body[ offset + 1U ];
+            offset += 2U + filterLength;
+
+            if( offset < bodyLength )
+            {
+                suback[ subackLength++ ] = body[ offset ] & 0x03U;
+            }
+
+            offset++;
+        }
+
+        suback[ 1 ] = ( uint8_t ) ( subackLength - 2U );
+        queuePacket( suback, subackLength, NULL, 0U, receivedAtNs );
+    }
+}
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Handle every complete packet in the receive buffer.
+ */
+static void handleReceivedPackets( uint64_t receivedAtNs )
+{
+    static const uint8_t connack[ 4 ] = { MQTT_CONNACK << 4, 2U, 0U, 0U };
+    static const uint8_t pingresp[ 2 ] = { MQTT_PINGRESP << 4, 0U };
+    size_t offset = 0U;
+    size_t headerLength = 0U;
+    size_t remainingLength = 0U;
+    uint8_t type = 0U;
+    bool complete = true;
+
+    while( complete && ( offset < receiveLength ) )
+    {
+        remainingLength = 0U;
+        headerLength = 1U;
+        complete = false;
+
+        /* The remaining length is a variable length integer of at most four
+         * bytes. */
+        while( ( headerLength <= 4U ) &&
+               ( ( offset + headerLength ) < receiveLength ) )
+        {
+            remainingLength |= ( size_t ) ( receiveBuffer[ offset + headerLength ] &
+                                            0x7FU ) << ( 7U * ( headerLength - 1U ) );
+            headerLength++;
+
+            if( ( receiveBuffer[ offset + headerLength - 1U ] & 0x80U ) == 0U )
+            {
+                complete = ( offset + headerLength + remainingLength ) <=
+                           receiveLength;
+                break;
+            }
+        }
+
+        if( complete )
+        {
+            type = receiveBuffer[ offset ] >> 4;
+
+            switch( type )
+            {
+                case MQTT_CONNECT:
+                    queuePacket( connack, sizeof( connack ), NULL, 0U, receivedAtNs );
+                    break;
+
+                case MQTT_PUBLISH:
+                    handlePublish( receiveBuffer[ offset ] & 0x0FU,
+                                   &receiveBuffer[ offset + headerLength ],
+                                   remainingLength,
+                                   receivedAtNs );
+                    break;
+
+                case MQTT_SUBSCRIBE:
+                    handleSubscribe( &receiveBuffer[ offset + headerLength ],
+                                     remainingLength,
+                                     receivedAtNs );
+                    break;
+
+                case MQTT_PINGREQ:
+                    queuePacket( pingresp, sizeof( pingresp ), NULL, 0U, receivedAtNs );
+                    break;
+
+                default:
+                    /* DISCONNECT and acknowledgements need no response. */
+                    break;
+            }
+
+            offset += headerLength + remainingLength;
+        }
+    }
+
+    memmove( receiveBuffer, &receiveBuffer[ offset ], receiveLength - offset );
+    receiveLength -= offset;
+
+    if( receiveLength == sizeof( receiveBuffer ) )
+    {
+        fprintf( stderr, "Fake broker: client packet too large.\n" );
+        exit( 1 );
+    }
+}
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Write the responses that are due, as far as the socket takes them.
+ *
+ * @return false once the client has gone away.
+ */
+static bool sendDuePackets( void )
+{
+    PendingPacket_t * packet = NULL;
+    uint64_t now = fakeBroker_timeNs();
+    ssize_t sent = 0;
+    bool connected = true;
+
+    while( connected && ( pendingHead != NULL ) &&
+           ( pendingHead->deliverAtNs <= now ) )
+    {
+        packet = pendingHead;
+        sent = send( brokerSocket,
+                     &packet->data[ packet->written ],
+                     packet->length - packet->written,
+                     MSG_DONTWAIT | MSG_NOSIGNAL );
+
+        if( sent > 0 )
+        {
+            packet->written += ( size_t ) sent;
+            atomic_fetch_add_explicit( &bytesSent,
+                                       ( unsigned long long ) sent,
+                                       memory_order_relaxed );
+        }
+        else if( ( sent < 0 ) && ( ( errno == EAGAIN ) || ( errno == EINTR ) ) )
+        {
+            break;
+        }
+        else
+        {
+            connected = false;
+        }
+
+        if( packet->written == packet->length )
+        {
+            pendingHead = packet->next;
+            pendingTail = ( pendingHead == NULL ) ? NULL : pendingTail;
+            free( packet );
+        }
+    }
+
+    return connected;
+}
+/*-----------------------------------------------------------*/
+
+static void * brokerLoop( void * parameters )
+{
+    struct pollfd pollSocket = { 0 };
+    uint64_t now = 0U;
+    int timeoutMs = -1;
+    ssize_t received = 0;
+    bool connected = true;
+
+    ( void ) parameters;
+
+    pollSocket.fd = brokerSocket;
+
+    while( connected )
+    {
+        now = fakeBroker_timeNs();
+        timeoutMs = -1;
+        pollSocket.events = POLLIN;
+
+        if( ( pendingHead != NULL ) && ( pendingHead->deliverAtNs > now ) )
+        {
+            /* Round up so the response is never written early. */
+            timeoutMs = ( int ) ( ( pendingHead->deliverAtNs - now + 999999U ) /
+                                  1000000U );
+        }
+        else if( pendingHead != NULL )
+        {
+            /* A due response is waiting for room in the socket. */
+            pollSocket.events |= POLLOUT;
+        }
+        else
+        {
+            /* Empty else. */
+        }
+
+        if( poll( &pollSocket, 1, timeoutMs ) > 0 )
+        {
+            if( ( pollSocket.revents & POLLIN ) != 0 )
+            {
+                received = recv( brokerSocket,
+                                 &receiveBuffer[ receiveLength ],
+                                 sizeof( receiveBuffer ) - receiveLength,
+                                 MSG_DONTWAIT );
+                connected = ( received > 0 ) ||
+                            ( ( received < 0 ) && ( errno == EAGAIN ) );
+
+                if( received > 0 )
+                {
+                    receiveLength += ( size_t ) received;
+                    handleReceivedPackets( fakeBroker_timeNs() );
+                }
+            }
+            else if( ( pollSocket.revents & ( POLLHUP | POLLERR ) ) != 0 )
+            {
+                connected = false;
+            }
+            else
+            {
+                /* Empty else. */
+            }
+        }
+
+        connected = connected && sendDuePackets();
+    }
+
+    return NULL;
+}
+/*-----------------------------------------------------------*/
+
+bool fakeBroker_start( const FakeBrokerConfig_t * config,
+                       int32_t * clientSocket )
+{
+    int sockets[ 2 ] = { -1, -1 };
+    sigset_t allSignals;
+    sigset_t previousSignals;
+    bool started = socketpair( AF_UNIX, SOCK_STREAM, 0, sockets ) == 0;
+
+    if( started )
+    {
+        brokerConfig = *config;
+        brokerSocket = sockets[ 0 ];
+        *clientSocket = sockets[ 1 ];
+
+        /* The new thread inherits the mask, so it never takes the tick
+         * signal meant for the FreeRTOS threads. */
+        ( void ) sigfillset( &allSignals );
+        ( void ) pthread_sigmask( SIG_SETMASK, &allSignals, &previousSignals );
+        started = pthread_create( &brokerThread, NULL, brokerLoop, NULL ) == 0;
+        ( void ) pthread_sigmask( SIG_SETMASK, &previousSignals, NULL );
+    }
+
+    return started;
+}
+/*-----------------------------------------------------------*/
+
+void fakeBroker_getStats( FakeBrokerStats_t * stats )
+{
+    clockid_t threadClock;
+    struct timespec cpuTime = { 0 };
+
+    stats->getRequests = atomic_load( &getRequests );
+    stats->blocksSent = atomic_load( &blocksSent );
+    stats->blockBytesSent = atomic_load( &blockBytesSent );
+    stats->jobUpdates = atomic_load( &jobUpdates );
+    stats->bytesSent = atomic_load( &bytesSent );
+    stats->cpuTimeNs = 0U;
+
+    if( ( pthread_getcpuclockid( brokerThread, &threadClock ) == 0 ) &&
+        ( clock_gettime( threadClock, &cpuTime ) == 0 ) )
+    {
+        stats->cpuTimeNs = ( ( uint64_t ) cpuTime.tv_sec * 1000000000U ) +
+                           ( uint64_t ) cpuTime.tv_nsec;
+    }
+}
+/*-----------------------------------------------------------*/
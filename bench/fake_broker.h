@@ -0,0 +1,128 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file fake_broker.h
+ * @brief Stand-in for AWS IoT Core used by the download benchmark.
+ *
+ * The broker runs on its own thread at the far end of a socket pair and
+ * speaks just enough MQTT 3.1.1 for the OTA demos. It answers Jobs
+ * start-next requests with an OTA job for a generated image, and MQTT
+ * stream get requests with the requested data blocks. Every response is held
+ * back for the configured round trip time.
+ */
+
+#ifndef FAKE_BROKER_H_
+#define FAKE_BROKER_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* *INDENT-ON* */
+
+/**
+ * @brief Largest block size a get request may ask for.
+ */
+#ifndef FAKE_BROKER_MAX_BLOCK_SIZE
+    #define FAKE_BROKER_MAX_BLOCK_SIZE 16384U
+#endif
+
+/**
+ * @brief File path of the image in the job document.
+ */
+#define FAKE_BROKER_IMAGE_PATH     "ota_bench.bin"
+
+/**
+ * @brief Settings of a benchmark run.
+ */
+typedef struct FakeBrokerConfig
+{
+    uint32_t imageSize; /**< @brief Size of the image offered by the job. */
+    uint32_t rttMs;     /**< @brief Delay before every response is sent. */
+} FakeBrokerConfig_t;
+
+/**
+ * @brief Counters kept by the broker.
+ */
+typedef struct FakeBrokerStats
+{
+    uint32_t getRequests;    /**< @brief Stream get requests received. */
+    uint32_t blocksSent;     /**< @brief Data block messages sent. */
+    uint64_t blockBytesSent; /**< @brief Bytes of the data block PUBLISH
+                              * packets, headers included. */
+    uint32_t jobUpdates;     /**< @brief Job execution updates received. */
+    uint64_t bytesSent;      /**< @brief Bytes written to the client. */
+    uint64_t cpuTimeNs;      /**< @brief CPU time used by the broker thread. */
+} FakeBrokerStats_t;
+
+/**
+ * @brief Start the broker thread.
+ *
+ * The thread is created with every signal blocked so the FreeRTOS tick is
+ * only delivered to scheduler threads.
+ *
+ * @param[in] config Settings of the run.
+ * @param[out] clientSocket Connected socket for the MQTT client.
+ *
+ * @return true if the broker is running; false otherwise.
+ */
+bool fakeBroker_start( const FakeBrokerConfig_t * config,
+                       int32_t * clientSocket );
+
+/**
+ * @brief Take the request time of the next data block the client received.
+ *
+ * The broker records where each data block message ends in the byte stream
+ * sent to the client. Once the client has read @p bytesReceived bytes, every
+ * block ending within them has arrived.
+ *
+ * @param[in] bytesReceived Bytes read from the client socket so far.
+ * @param[out] requestTimeNs Time the block was requested.
+ *
+ * @return true if a block was taken; false if no further block has arrived.
+ */
+bool fakeBroker_takeDelivery( uint64_t bytesReceived,
+                              uint64_t * requestTimeNs );
+
+/**
+ * @brief Get the content of the generated image at an offset.
+ *
+ * @param[in] offset Byte offset in the image.
+ *
+ * @return The byte the broker serves at @p offset.
+ */
+uint8_t fakeBroker_imageByte( uint32_t offset );
+
+/**
+ * @brief Read the broker counters.
+ *
+ * @param[out] stats Current counters.
+ */
+void fakeBroker_getStats( FakeBrokerStats_t * stats );
+
+/**
+ * @brief Monotonic time used for all benchmark measurements.
+ *
+ * @return Time in nanoseconds.
+ */
+uint64_t fakeBroker_timeNs( void );
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+}
+#endif
+/* *INDENT-ON* */
+
+#endif /* ifndef FAKE_BROKER_H_ */
@@ -0,0 +1,521 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file ota_bench.c
+ * @brief Download benchmark for the OTA agent demo.
+ *
+ * Runs the agent orchestrator against the in-process fake broker and reports
+ * throughput, per-block latency and CPU time. The latency of a block is the
+ * time from its get request reaching the broker to the MQTT client reading
+ * the last byte of the block, so it includes the injected round trip time
+ * and any time the block waited for the client.
+ *
+ * The image size, round trip time and stream encoding are set on the command
+ * line. The block size and the window are compile time settings of the agent,
+ * see the OTA_BENCH_* CMake cache variables. Bytes on the wire and client CPU
+ * time are also given per block, to compare the CBOR and JSON encodings.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "MQTTFileDownloader.h"
+#include "core_mqtt.h"
+#include "download/download_checkpoint.h"
+#include "mqtt_wrapper.h"
+#include "ota_demo.h"
+#include "storage/image_sink.h"
+#include "utils/clock.h"
+#include "utils/ota_topics.h"
+
+#include "fake_broker.h"
+
+#ifdef LOGGING_ASYNC
+    #include "csdk_logging/async_log.h"
+#endif
+
+#define BENCH_THING_NAME           "ota-bench-thing"
+#define DEFAULT_IMAGE_SIZE         ( 1024U * 1024U )
+#define DEFAULT_RTT_MS             0U
+#define MAX_LATENCY_SAMPLES        65536U
+#define NETWORK_BUFFER_SIZE        32768U
+
+/* Longest time the MQTT task waits in the socket before blocking for a tick,
+ * as in the demos. */
+#define MQTT_RECV_WAIT_MS          5U
+
+/* Stack depth of each task, in words */
+#define TASK_STACK_DEPTH           6000U
+
+/* Defaults of the agent, only used to label the report. */
+#ifndef NUM_OF_BLOCKS_REQUESTED
+    #define NUM_OF_BLOCKS_REQUESTED     4U
+#endif
+#ifndef MAX_NUM_OF_OTA_DATA_BUFFERS
+    #define MAX_NUM_OF_OTA_DATA_BUFFERS 8U
+#endif
+
+/**
+ * @brief Client end of the socket pair to the fake broker.
+ */
+struct NetworkContext
+{
+    int32_t socket;
+};
+
+static NetworkContext_t networkContext = { -1 };
+static TransportInterface_t transport = { 0 };
+static MQTTContext_t mqttContext = { 0 };
+static uint8_t networkBuffer[ NETWORK_BUFFER_SIZE ];
+static FakeBrokerConfig_t brokerConfig = { DEFAULT_IMAGE_SIZE, DEFAULT_RTT_MS };
+static DataType_t dataType = OTA_STREAM_DATA_TYPE;
+
+static StaticTask_t benchTaskBuffer;
+static StaticTask_t mqttProcessLoopTaskBuffer;
+static StackType_t benchTaskStack[ TASK_STACK_DEPTH ];
+static StackType_t mqttProcessLoopTaskStack[ TASK_STACK_DEPTH ];
+
+/* Only touched by the MQTT task while the download runs. */
+static uint64_t bytesReceived = 0U;
+static uint32_t latencySamplesUs[ MAX_LATENCY_SAMPLES ];
+static uint32_t latencySampleCount = 0U;
+
+static void benchTask( void * parameters );
+
+static void mqttProcessLoopTask( void * parameters );
+
+static void mqttEventCallback( MQTTContext_t * mqttContext,
+                               MQTTPacketInfo_t * packetInfo,
+                               MQTTDeserializedInfo_t * deserializedInfo );
+
+/*-----------------------------------------------------------*/
+
+static int32_t benchSend( NetworkContext_t * context,
+                          const void * buffer,
+                          size_t bytesToSend )
+{
+    ssize_t sent = send( context->socket, buffer, bytesToSend, MSG_NOSIGNAL );
+
+    return ( sent >= 0 ) ? ( int32_t ) sent : -1;
+}
+/*-----------------------------------------------------------*/
+
+static int32_t benchRecv( NetworkContext_t * context,
+                          void * buffer,
+                          size_t bytesToRecv )
+{
+    ssize_t received = recv( context->socket,
+                             buffer,
+                             bytesToRecv,
+                             MSG_DONTWAIT );
+    uint64_t now = 0U;
+    uint64_t requestTimeNs = 0U;
+    int32_t result = -1;
+
+    if( received > 0 )
+    {
+        result = ( int32_t ) received;
+        bytesReceived += ( uint64_t ) received;
+        now = fakeBroker_timeNs();
+
+        while( fakeBroker_takeDelivery( bytesReceived, &requestTimeNs ) )
+        {
+            if( latencySampleCount < MAX_LATENCY_SAMPLES )
+            {
+                latencySamplesUs[ latencySampleCount ] =
+                    ( uint32_t ) ( ( now - requestTimeNs ) / 1000U );
+                latencySampleCount++;
+            }
+        }
+    }
+    else if( ( received < 0 ) && ( ( errno == EAGAIN ) || ( errno == EINTR ) ) )
+    {
+        result = 0;
+    }
+    else
+    {
+        /* The broker closed the connection or the socket failed. */
+    }
+
+    return result;
+}
+/*-----------------------------------------------------------*/
+
+static bool benchWaitForData( uint32_t timeoutMs )
+{
+    struct pollfd pollSocket = { networkContext.socket, POLLIN, 0 };
+
+    /* Errors count as data so the next receive reports them. */
+    return poll( &pollSocket, 1, ( int ) timeoutMs ) != 0;
+}
+/*-----------------------------------------------------------*/
+
+static int compareSamples( const void * first, const void * second )
+{
+    uint32_t a = *( const uint32_t * ) first;
+    uint32_t b = *( const uint32_t * ) second;
+
+    return ( a > b ) - ( a < b );
+}
+/*-----------------------------------------------------------*/
+
+static double percentileMs( uint32_t percentile )
+{
+    size_t index = 0U;
+
+    if( latencySampleCount > 0U )
+    {
+        index = ( ( ( size_t ) latencySampleCount * percentile ) + 99U ) / 100U;
+        index = ( index > 0U ) ? index - 1U : 0U;
+    }
+
+    return ( latencySampleCount > 0U ) ?
+           ( double ) latencySamplesUs[ index ] / 1000.0 : 0.0;
+}
+/*-----------------------------------------------------------*/
+
+static double cpuTimeMs( const struct timeval * time )
+{
+    return ( ( double ) time->tv_sec * 1000.0 ) +
+           ( ( double ) time->tv_usec / 1000.0 );
+}
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Check the downloaded image against the one the broker served.
+ */
+static bool verifyImage( const char * path )
+{
+    uint8_t buffer[ 4096 ];
+    size_t length = 0U;
+    uint32_t offset = 0U;
+    bool matches = true;
+    FILE * image = fopen( path, "rb" );
+
+    matches = image != NULL;
+
+    while( matches &&
+           ( ( length = fread( buffer, 1U, sizeof( buffer ), image ) ) > 0U ) )
+    {
+        for( size_t i = 0U; matches && ( i < length ); i++ )
+        {
+            matches = buffer[ i ] == fakeBroker_imageByte( offset + ( uint32_t ) i );
+        }
+
+        offset += ( uint32_t ) length;
+    }
+
+    if( image != NULL )
+    {
+        ( void ) fclose( image );
+    }
+
+    return matches && ( offset == brokerConfig.imageSize );
+}
+/*-----------------------------------------------------------*/
+
+static void printReport( uint64_t elapsedNs,
+                         const struct rusage * before,
+                         const struct rusage * after,
+                         uint64_t brokerCpuBeforeNs,
+                         bool imageValid )
+{
+    FakeBrokerStats_t stats = { 0 };
+    uint32_t totalBlocks = ( brokerConfig.imageSize +
+                             mqttFileDownloader_CONFIG_BLOCK_SIZE - 1U ) /
+                           mqttFileDownloader_CONFIG_BLOCK_SIZE;
+    double elapsedS = ( double ) elapsedNs / 1e9;
+    double userMs = cpuTimeMs( &after->ru_utime ) - cpuTimeMs( &before->ru_utime );
+    double systemMs = cpuTimeMs( &after->ru_stime ) - cpuTimeMs( &before->ru_stime );
+    double brokerMs = 0.0;
+    double clientMs = 0.0;
+
+    fakeBroker_getStats( &stats );
+    brokerMs = ( double ) ( stats.cpuTimeNs - brokerCpuBeforeNs ) / 1e6;
+
+    /* The broker thread is part of the process, so its time is taken out
+     * of the client figure. */
+    clientMs = userMs + systemMs - brokerMs;
+    qsort( latencySamplesUs,
+           latencySampleCount,
+           sizeof( latencySamplesUs[ 0 ] ),
+           compareSamples );
+
+    printf( "Image:          %u bytes in %u blocks of %u bytes\n",
+            brokerConfig.imageSize,
+            totalBlocks,
+            ( unsigned int ) mqttFileDownloader_CONFIG_BLOCK_SIZE );
+    printf( "Window:         up to %u blocks in flight, %u per request\n",
+            ( unsigned int ) MAX_NUM_OF_OTA_DATA_BUFFERS,
+            ( unsigned int ) NUM_OF_BLOCKS_REQUESTED );
+    printf( "Encoding:       %s\n", otaTopics_dataTypeName( dataType ) );
+    printf( "Injected RTT:   %u ms\n", brokerConfig.rttMs );
+    printf( "Elapsed:        %.3f ms\n", elapsedS * 1000.0 );
+    printf( "Throughput:     %.1f blocks/s, %.1f KiB/s\n",
+            ( double ) totalBlocks / elapsedS,
+            ( double ) brokerConfig.imageSize / 1024.0 / elapsedS );
+    printf( "Block latency:  p50 %.3f ms, p99 %.3f ms (%u samples)\n",
+            percentileMs( 50U ),
+            percentileMs( 99U ),
+            latencySampleCount );
+    printf( "CPU time:       client %.3f ms, broker %.3f ms\n",
+            clientMs,
+            brokerMs );
+    printf( "Broker:         %u get requests, %u blocks sent, %llu bytes\n",
+            stats.getRequests,
+            stats.blocksSent,
+            ( unsigned long long ) stats.bytesSent );
+
+    if( stats.blocksSent > 0U )
+    {
+        printf( "Per block:      %.1f bytes on the wire, client CPU %.3f us\n",
+                ( double ) stats.blockBytesSent / ( double ) stats.blocksSent,
+                ( clientMs * 1000.0 ) / ( double ) stats.blocksSent );
+    }
+    printf( "Image check:    %s\n", imageValid ? "passed" : "FAILED" );
+}
+/*-----------------------------------------------------------*/
+
+static bool parseArguments( int argc, char * argv[] )
+{
+    int option = 0;
+    char * end = NULL;
+    unsigned long value = 0U;
+    bool valid = true;
+
+    while( valid && ( ( option = getopt( argc, argv, "s:r:e:" ) ) != -1 ) )
+    {
+        value = ( optarg != NULL ) ? strtoul( optarg, &end, 10 ) : 0U;
+        valid = ( optarg != NULL ) && ( *end == '\0' ) && ( value <= UINT32_MAX );
+
+        if( option == 'e' )
+        {
+            valid = ( optarg != NULL ) &&
+                    otaTopics_parseDataType( optarg, &dataType );
+        }
+        else if( !valid )
+        {
+            /* Empty if. */
+        }
+        else if( option == 's' )
+        {
+            brokerConfig.imageSize = ( uint32_t ) value;
+            valid = value > 0U;
+        }
+        else if( option == 'r' )
+        {
+            brokerConfig.rttMs = ( uint32_t ) value;
+        }
+        else
+        {
+            valid = false;
+        }
+    }
+
+    return valid && ( optind == argc );
+}
+/*-----------------------------------------------------------*/
+
+int main( int argc, char * argv[] )
+{
+    MQTTStatus_t mqttResult;
+    MQTTFixedBuffer_t fixedBuffer = { 0 };
+
+    if( !parseArguments( argc, argv ) )
+    {
+        printf( "Usage: %s [-s imageSizeBytes] [-r rttMs] [-e cbor|json]\n",
+                argv[ 0 ] );
+        return 1;
+    }
+
+    otaDemo_setDataType( dataType );
+
+    if( !fakeBroker_start( &brokerConfig, &networkContext.socket ) )
+    {
+        printf( "Failed to start the fake broker.\n" );
+        return 1;
+    }
+
+    transport.send = benchSend;
+    transport.recv = benchRecv;
+    transport.pNetworkContext = &networkContext;
+
+    fixedBuffer.pBuffer = networkBuffer;
+    fixedBuffer.size = NETWORK_BUFFER_SIZE;
+
+    mqttResult = MQTT_Init( &mqttContext,
+                            &transport,
+                            Clock_GetTimeMs,
+                            mqttEventCallback,
+                            &fixedBuffer );
+    assert( mqttResult == MQTTSuccess );
+
+    xTaskCreateStatic( benchTask,
+                       "T_OTA",
+                       TASK_STACK_DEPTH,
+                       NULL,
+                       1,
+                       benchTaskStack,
+                       &benchTaskBuffer );
+    /* Above the OTA task, as in the demos. */
+    xTaskCreateStatic( mqttProcessLoopTask,
+                       "T_MQTT",
+                       TASK_STACK_DEPTH,
+                       NULL,
+                       2,
+                       mqttProcessLoopTaskStack,
+                       &mqttProcessLoopTaskBuffer );
+
+    mqttWrapper_setCoreMqttContext( &mqttContext );
+    mqttWrapper_setThingName( BENCH_THING_NAME,
+                              strlen( BENCH_THING_NAME ) );
+
+#ifdef LOGGING_ASYNC
+    ( void ) asyncLog_start( 1 );
+#endif
+
+    vTaskStartScheduler();
+
+    return 0;
+}
+/*-----------------------------------------------------------*/
+
+static void mqttProcessLoopTask( void * parameters )
+{
+    ( void ) parameters;
+
+    while( true )
+    {
+        if( mqttWrapper_isConnected() )
+        {
+            MQTTStatus_t status = MQTTSuccess;
+
+            ( void ) benchWaitForData( MQTT_RECV_WAIT_MS );
+
+            do
+            {
+                status = MQTT_ProcessLoop( &mqttContext );
+            } while( ( ( status == MQTTSuccess ) ||
+                       ( status == MQTTNeedMoreBytes ) ) &&
+                     benchWaitForData( 0U ) );
+
+            if( status == MQTTRecvFailed )
+            {
+                printf( "ERROR: MQTT Receive failed. Closing connection.\n" );
+                exit( 1 );
+            }
+
+            vTaskDelay( 1 );
+        }
+        else
+        {
+            vTaskDelay( 10 );
+        }
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void mqttEventCallback( MQTTContext_t * mqttContext,
+                               MQTTPacketInfo_t * packetInfo,
+                               MQTTDeserializedInfo_t * deserializedInfo )
+{
+    ( void ) mqttContext;
+
+    if( ( packetInfo->type & 0xF0U ) == MQTT_PACKET_TYPE_PUBLISH )
+    {
+        assert( deserializedInfo->pPublishInfo != NULL );
+        ( void ) otaDemo_handleIncomingMQTTMessage(
+            ( char * ) deserializedInfo->pPublishInfo->pTopicName,
+            deserializedInfo->pPublishInfo->topicNameLength,
+            ( uint8_t * ) deserializedInfo->pPublishInfo->pPayload,
+            deserializedInfo->pPublishInfo->payloadLength );
+    }
+    else if( packetInfo->type == MQTT_PACKET_TYPE_SUBACK )
+    {
+        mqttWrapper_handleSubAck( packetInfo,
+                                  deserializedInfo->packetIdentifier );
+    }
+    else
+    {
+        /* Empty else. */
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void benchTask( void * parameters )
+{
+    char imagePath[ IMAGE_SINK_MAX_PATH_LENGTH + 1U ] = { 0 };
+    char checkpointPath[ DOWNLOAD_CHECKPOINT_MAX_PATH_LENGTH + 1U ] = { 0 };
+    struct rusage usageBefore;
+    struct rusage usageAfter;
+    FakeBrokerStats_t brokerBefore = { 0 };
+    uint64_t startNs = 0U;
+    uint64_t elapsedNs = 0U;
+    bool imageValid = false;
+
+    ( void ) parameters;
+
+    if( !mqttWrapper_connect( BENCH_THING_NAME, strlen( BENCH_THING_NAME ) ) )
+    {
+        printf( "Failed to connect to the fake broker.\n" );
+        exit( 1 );
+    }
+
+    /* A run that died half way must not be resumed by this one. */
+    if( imageSink_getDownloadPath( FAKE_BROKER_IMAGE_PATH,
+                                   strlen( FAKE_BROKER_IMAGE_PATH ),
+                                   imagePath,
+                                   sizeof( imagePath ) ) &&
+        downloadCheckpoint_getPath( imagePath,
+                                    checkpointPath,
+                                    sizeof( checkpointPath ) ) )
+    {
+        ( void ) unlink( imagePath );
+        ( void ) unlink( checkpointPath );
+    }
+
+    ( void ) getrusage( RUSAGE_SELF, &usageBefore );
+    fakeBroker_getStats( &brokerBefore );
+    startNs = fakeBroker_timeNs();
+
+    /* Returns once the job is done, including the job document round trip. */
+    otaDemo_start();
+
+    elapsedNs = fakeBroker_timeNs() - startNs;
+    ( void ) getrusage( RUSAGE_SELF, &usageAfter );
+
+    if( imageSink_getDownloadPath( FAKE_BROKER_IMAGE_PATH,
+                                   strlen( FAKE_BROKER_IMAGE_PATH ),
+                                   imagePath,
+                                   sizeof( imagePath ) ) )
+    {
+        imageValid = verifyImage( imagePath );
+        ( void ) unlink( imagePath );
+    }
+
+    printReport( elapsedNs,
+                 &usageBefore,
+                 &usageAfter,
+                 brokerBefore.cpuTimeNs,
+                 imageValid );
+    exit( imageValid ? 0 : 1 );
+}
+/*-----------------------------------------------------------*/
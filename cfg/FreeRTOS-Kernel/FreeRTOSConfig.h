@@ -30,6 +30,19 @@
 #define configTIMER_QUEUE_LENGTH             20
 #define configTIMER_TASK_STACK_DEPTH         ( configMINIMAL_STACK_SIZE * 2 )
 #define configSUPPORT_STATIC_ALLOCATION      1
+
+/* Set by the STATIC_ALLOCATION build option. Every kernel object of the
+ * demos is created statically, so without the heap a call to a dynamic
+ * creation function fails to link instead of allocating at run time. */
+#ifndef OTA_STATIC_ALLOCATION
+    #define OTA_STATIC_ALLOCATION 0
+#endif
+
+#if OTA_STATIC_ALLOCATION
+    #define configSUPPORT_DYNAMIC_ALLOCATION 0
+#else
+    #define configSUPPORT_DYNAMIC_ALLOCATION 1
+#endif
 #define configSTACK_DEPTH_TYPE               uint32_t
 #define configTICK_RATE_HZ                   ( 100 )
 
@@ -0,0 +1,18 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/* Heap of the STATIC_ALLOCATION build: there is none. Every task, queue and
+ * semaphore is created from a static buffer, so pvPortMalloc() and
+ * vPortFree() are left undefined and any use of them fails to link. */
+
+#include "FreeRTOS.h"
+
+#if ( configSUPPORT_DYNAMIC_ALLOCATION != 0 )
+    #error "heap_none.c requires OTA_STATIC_ALLOCATION"
+#endif
@@ -0,0 +1,982 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file async_log.c
+ * @brief Deferred logging backend used when LOGGING_ASYNC is defined.
+ *
+ * Every thread that logs claims a ring of fixed size records on its first
+ * message. The thread is the only producer of its ring and the log task the
+ * only consumer, so records are published with a release store of the head
+ * index and no lock is taken.
+ *
+ * The format string is walked once when a message is recorded, to learn the
+ * type of each argument, and the arguments are stored in their widest form.
+ * String arguments are copied because the buffers they point to rarely
+ * outlive the call. The log task walks the format string again to rebuild
+ * each conversion.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "async_log.h"
+
+/**
+ * @brief Size of the buffer a record is formatted into.
+ */
+#define LINE_BUFFER_SIZE  512U
+
+/**
+ * @brief Size of the buffer formatted lines are batched in before writing.
+ */
+#define BATCH_BUFFER_SIZE 4096U
+
+/**
+ * @brief Longest conversion specification that is rebuilt for snprintf().
+ */
+#define SPEC_BUFFER_SIZE  32U
+
+/**
+ * @brief Appended to a message whose arguments did not fit in its record.
+ */
+#define TRUNCATION_MARKER "[...]"
+
+/**
+ * @brief Terminates every line, matching the synchronous backend.
+ */
+#define LINE_SUFFIX       "\033[0m\n"
+
+/**
+ * @brief Stack depth of the logging task, in words.
+ */
+#define LOG_TASK_STACK_DEPTH ( configMINIMAL_STACK_SIZE * 2U )
+
+/**
+ * @brief Length modifier of a conversion specification.
+ */
+typedef enum LengthModifier
+{
+    LENGTH_NONE = 0,
+    LENGTH_HH,
+    LENGTH_H,
+    LENGTH_L,
+    LENGTH_LL,
+    LENGTH_J,
+    LENGTH_Z,
+    LENGTH_T,
+    LENGTH_LONG_DOUBLE
+} LengthModifier_t;
+
+/**
+ * @brief One parsed conversion specification of a format string.
+ */
+typedef struct FormatSpec
+{
+    const char * start;           /**< @brief The '%' that opens it. */
+    size_t length;                /**< @brief Length through the conversion. */
+    size_t flagsWidthLength;      /**< @brief Flags and width after the '%'. */
+    size_t precisionLength;       /**< @brief Precision, including the '.'. */
+    bool widthFromArgument;       /**< @brief Width is '*'. */
+    bool precisionFromArgument;   /**< @brief Precision is ".*". */
+    LengthModifier_t modifier;    /**< @brief Length modifier. */
+    char conversion;              /**< @brief Conversion character. */
+} FormatSpec_t;
+
+/**
+ * @brief A recorded message.
+ */
+typedef struct AsyncLogRecord
+{
+    const char * prefix;
+    const char * module;
+    const char * format;
+    uint16_t argsLength;
+    bool truncated;
+    uint8_t args[ ASYNC_LOG_ARGS_SIZE ];
+} AsyncLogRecord_t;
+
+/**
+ * @brief Records logged by one thread.
+ */
+typedef struct AsyncLogRing
+{
+    atomic_uint head;        /**< @brief Next record to fill, producer. */
+    atomic_uint tail;        /**< @brief Oldest unread record, consumer. */
+    atomic_uint dropped;     /**< @brief Records lost to a full ring. */
+    uint32_t droppedReported;
+    AsyncLogRecord_t records[ ASYNC_LOG_RING_RECORDS ];
+} AsyncLogRing_t;
+
+_Static_assert( ( ASYNC_LOG_RING_RECORDS &
+                  ( ASYNC_LOG_RING_RECORDS - 1U ) ) == 0U,
+                "ASYNC_LOG_RING_RECORDS must be a power of two" );
+
+/*-----------------------------------------------------------*/
+
+static AsyncLogRing_t rings[ ASYNC_LOG_MAX_RINGS ];
+static atomic_uint ringsClaimed = 0U;
+static atomic_uint droppedWithoutRing = 0U;
+static uint32_t droppedWithoutRingReported = 0U;
+static atomic_flag flushing = ATOMIC_FLAG_INIT;
+
+static _Thread_local AsyncLogRing_t * threadRing = NULL;
+static _Thread_local bool threadRingClaimed = false;
+
+static char batch[ BATCH_BUFFER_SIZE ];
+
+static StaticTask_t logTaskBuffer;
+static StackType_t logTaskStack[ LOG_TASK_STACK_DEPTH ];
+static size_t batchLength = 0U;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Find the next conversion specification in a format string.
+ *
+ * @return Pointer just past the specification, or NULL if there is none.
+ */
+static const char * nextFormatSpec( const char * format, FormatSpec_t * spec )
+{
+    const char * cursor = strchr( format, '%' );
+
+    if( cursor != NULL )
+    {
+        memset( spec, 0, sizeof( FormatSpec_t ) );
+        spec->start = cursor;
+        cursor++;
+
+        while( ( *cursor != '\0' ) && ( strchr( "-+ #0'", *cursor ) != NULL ) )
+        {
+            cursor++;
+        }
+
+        if( *cursor == '*' )
+        {
+            spec->widthFromArgument = true;
+            cursor++;
+        }
+        else
+        {
+            while( ( *cursor >= '0' ) && ( *cursor <= '9' ) )
+            {
+                cursor++;
+            }
+        }
+
+        spec->flagsWidthLength = ( size_t ) ( cursor - spec->start ) - 1U;
+
+        if( *cursor == '.' )
+        {
+            const char * precisionStart = cursor;
+
+            cursor++;
+
+            if( *cursor == '*' )
+            {
+                spec->precisionFromArgument = true;
+                cursor++;
+            }
+            else
+            {
+                while( ( *cursor >= '0' ) && ( *cursor <= '9' ) )
+                {
+                    cursor++;
+                }
+            }
+
+            spec->precisionLength = ( size_t ) ( cursor - precisionStart );
+        }
+
+        switch( *cursor )
+        {
+            case 'h':
+                cursor++;
+                spec->modifier = ( *cursor == 'h' ) ? LENGTH_HH : LENGTH_H;
+                cursor += ( spec->modifier == LENGTH_HH ) ? 1 : 0;
+                break;
+
+            case 'l':
+                cursor++;
+                spec->modifier = ( *cursor == 'l' ) ? LENGTH_LL : LENGTH_L;
+                cursor += ( spec->modifier == LENGTH_LL ) ? 1 : 0;
+                break;
+
+            case 'j':
+                spec->modifier = LENGTH_J;
+                cursor++;
+                break;
+
+            case 'z':
+                spec->modifier = LENGTH_Z;
+                cursor++;
+                break;
+
+            case 't':
+                spec->modifier = LENGTH_T;
+                cursor++;
+                break;
+
+            case 'L':
+                spec->modifier = LENGTH_LONG_DOUBLE;
+                cursor++;
+                break;
+
+            default:
+                break;
+        }
+
+        spec->conversion = *cursor;
+
+        if( *cursor != '\0' )
+        {
+            cursor++;
+        }
+
+        spec->length = ( size_t ) ( cursor - spec->start );
+    }
+
+    return cursor;
+}
+/*-----------------------------------------------------------*/
+
+static bool putBytes( AsyncLogRecord_t * record,
+                      const void * data,
+                      size_t length )
+{
+    bool fits = length <= ( ASYNC_LOG_ARGS_SIZE - record->argsLength );
+
+    if( fits )
+    {
+        memcpy( &record->args[ record->argsLength ], data, length );
+        record->argsLength += ( uint16_t ) length;
+    }
+    else
+    {
+        record->truncated = true;
+    }
+
+    return fits;
+}
+/*-----------------------------------------------------------*/
+
+static int64_t readSigned( va_list * args, LengthModifier_t modifier )
+{
+    int64_t value = 0;
+
+    switch( modifier )
+    {
+        case LENGTH_HH:
+            value = ( signed char ) va_arg( *args, int );
+            break;
+
+        case LENGTH_H:
+            value = ( short ) va_arg( *args, int );
+            break;
+
+        case LENGTH_L:
+            value = va_arg( *args, long );
+            break;
+
+        case LENGTH_LL:
+            value = va_arg( *args, long long );
+            break;
+
+        case LENGTH_J:
+            value = va_arg( *args, intmax_t );
+            break;
+
+        case LENGTH_Z:
+            value = ( int64_t ) va_arg( *args, size_t );
+            break;
+
+        case LENGTH_T:
+            value = va_arg( *args, ptrdiff_t );
+            break;
+
+        default:
+            value = va_arg( *args, int );
+            break;
+    }
+
+    return value;
+}
+/*-----------------------------------------------------------*/
+
+static uint64_t readUnsigned( va_list * args, LengthModifier_t modifier )
+{
+    uint64_t value = 0U;
+
+    switch( modifier )
+    {
+        case LENGTH_HH:
+            value = ( unsigned char ) va_arg( *args, unsigned int );
+            break;
+
+        case LENGTH_H:
+            value = ( unsigned short ) va_arg( *args, unsigned int );
+            break;
+
+        case LENGTH_L:
+            value = va_arg( *args, unsigned long );
+            break;
+
+        case LENGTH_LL:
+            value = va_arg( *args, unsigned long long );
+            break;
+
+        case LENGTH_J:
+            value = va_arg( *args, uintmax_t );
+            break;
+
+        case LENGTH_Z:
+            value = va_arg( *args, size_t );
+            break;
+
+        case LENGTH_T:
+            value = ( uint64_t ) va_arg( *args, ptrdiff_t );
+            break;
+
+        default:
+            value = va_arg( *args, unsigned int );
+            break;
+    }
+
+    return value;
+}
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Copy the arguments of a message into its record.
+ *
+ * Stops at the first argument that does not fit, or at a conversion this
+ * backend does not support, and marks the record as truncated.
+ */
+static void encodeArguments( AsyncLogRecord_t * record,
+                             const char * format,
+                             va_list * args )
+{
+    FormatSpec_t spec;
+    const char * cursor = format;
+    const char * string = NULL;
+    int32_t star = 0;
+    int32_t precision = -1;
+    int64_t signedValue = 0;
+    uint64_t unsignedValue = 0U;
+    double floatValue = 0.0;
+    size_t stringLength = 0U;
+    uint16_t storedLength = 0U;
+
+    while( !record->truncated &&
+           ( ( cursor = nextFormatSpec( cursor, &spec ) ) != NULL ) )
+    {
+        precision = -1;
+
+        if( spec.widthFromArgument )
+        {
+            star = va_arg( *args, int );
+            ( void ) putBytes( record, &star, sizeof( star ) );
+        }
+
+        if( spec.precisionFromArgument )
+        {
+            star = va_arg( *args, int );
+            precision = star;
+            ( void ) putBytes( record, &star, sizeof( star ) );
+        }
+        else if( spec.precisionLength > 1U )
+        {
+            precision = atoi( spec.start + 1U + spec.flagsWidthLength + 1U );
+        }
+        else
+        {
+            /* Empty else. */
+        }
+
+        switch( spec.conversion )
+        {
+            case 'd':
+            case 'i':
+            case 'c':
+                signedValue = readSigned( args, spec.modifier );
+                ( void ) putBytes( record, &signedValue, sizeof( signedValue ) );
+                break;
+
+            case 'u':
+            case 'o':
+            case 'x':
+            case 'X':
+                unsignedValue = readUnsigned( args, spec.modifier );
+                ( void ) putBytes( record,
+                                   &unsignedValue,
+                                   sizeof( unsignedValue ) );
+                break;
+
+            case 'f':
+            case 'F':
+            case 'e':
+            case 'E':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+                floatValue = ( spec.modifier == LENGTH_LONG_DOUBLE ) ?
+                             ( double ) va_arg( *args, long double ) :
+                             va_arg( *args, double );
+                ( void ) putBytes( record, &floatValue, sizeof( floatValue ) );
+                break;
+
+            case 'p':
+                unsignedValue = ( uintptr_t ) va_arg( *args, void * );
+                ( void ) putBytes( record,
+                                   &unsignedValue,
+                                   sizeof( unsignedValue ) );
+                break;
+
+            case 's':
+                string = va_arg( *args, const char * );
+                string = ( string != NULL ) ? string : "(null)";
+                stringLength = strnlen( string,
+                                        ( precision >= 0 ) ?
+                                        ( size_t ) precision :
+                                        ASYNC_LOG_ARGS_SIZE );
+
+                /* Keep as much of a long string as fits, the record is
+                 * marked truncated so the reader can tell. */
+                if( stringLength + sizeof( storedLength ) >
+                    ( size_t ) ( ASYNC_LOG_ARGS_SIZE - record->argsLength ) )
+                {
+                    stringLength = ( record->argsLength + sizeof( storedLength ) <
+                                     ASYNC_LOG_ARGS_SIZE ) ?
+                                   ( ASYNC_LOG_ARGS_SIZE - record->argsLength -
+                                     sizeof( storedLength ) ) : 0U;
+                    record->truncated = true;
+                }
+
+                storedLength = ( uint16_t ) stringLength;
+
+                if( ( record->argsLength + sizeof( storedLength ) ) <=
+                    ASYNC_LOG_ARGS_SIZE )
+                {
+                    memcpy( &record->args[ record->argsLength ],
+                            &storedLength,
+                            sizeof( storedLength ) );
+                    memcpy( &record->args[ record->argsLength +
+                                           sizeof( storedLength ) ],
+                            string,
+                            stringLength );
+                    record->argsLength += ( uint16_t ) ( sizeof( storedLength ) +
+                                                         stringLength );
+                }
+                else
+                {
+                    record->truncated = true;
+                }
+
+                break;
+
+            case '%':
+                break;
+
+            default:
+                /* %n and unknown conversions are not supported. */
+                record->truncated = true;
+                break;
+        }
+    }
+}
+/*-----------------------------------------------------------*/
+
+static AsyncLogRing_t * getThreadRing( void )
+{
+    unsigned int index = 0U;
+
+    if( !threadRingClaimed )
+    {
+        threadRingClaimed = true;
+        index = atomic_fetch_add_explicit( &ringsClaimed,
+                                           1U,
+                                           memory_order_relaxed );
+
+        if( index < ASYNC_LOG_MAX_RINGS )
+        {
+            threadRing = &rings[ index ];
+        }
+    }
+
+    return threadRing;
+}
+/*-----------------------------------------------------------*/
+
+void asyncLog_record( const char * prefix,
+                      const char * module,
+                      const char * format,
+                      ... )
+{
+    AsyncLogRing_t * ring = getThreadRing();
+    AsyncLogRecord_t * record = NULL;
+    unsigned int head = 0U;
+    unsigned int tail = 0U;
+    va_list args;
+
+    if( ring == NULL )
+    {
+        atomic_fetch_add_explicit( &droppedWithoutRing,
+                                   1U,
+                                   memory_order_relaxed );
+    }
+    else
+    {
+        head = atomic_load_explicit( &ring->head, memory_order_relaxed );
+        tail = atomic_load_explicit( &ring->tail, memory_order_acquire );
+
+        if( ( head - tail ) >= ASYNC_LOG_RING_RECORDS )
+        {
+            atomic_fetch_add_explicit( &ring->dropped,
+                                       1U,
+                                       memory_order_relaxed );
+        }
+        else
+        {
+            record = &ring->records[ head & ( ASYNC_LOG_RING_RECORDS - 1U ) ];
+            record->prefix = prefix;
+            record->module = module;
+            record->format = format;
+            record->argsLength = 0U;
+            record->truncated = false;
+
+            va_start( args, format );
+            encodeArguments( record, format, &args );
+            va_end( args );
+
+            atomic_store_explicit( &ring->head,
+                                   head + 1U,
+                                   memory_order_release );
+        }
+    }
+}
+/*-----------------------------------------------------------*/
+
+static bool getBytes( const AsyncLogRecord_t * record,
+                      size_t * offset,
+                      void * data,
+                      size_t length )
+{
+    bool available = length <= ( size_t ) ( record->argsLength - *offset );
+
+    if( available )
+    {
+        memcpy( data, &record->args[ *offset ], length );
+        *offset += length;
+    }
+
+    return available;
+}
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Format a value with 0, 1 or 2 '*' arguments in front of it.
+ */
+#define FORMAT_WITH_STARS( out, size, spec, stars, starCount, ... )          \
+    ( ( ( starCount ) == 0U ) ?                                               \
+      snprintf( out, size, spec, __VA_ARGS__ ) :                              \
+      ( ( ( starCount ) == 1U ) ?                                             \
+        snprintf( out, size, spec, ( stars )[ 0 ], __VA_ARGS__ ) :            \
+        snprintf( out, size, spec, ( stars )[ 0 ], ( stars )[ 1 ], __VA_ARGS__ ) ) )
+
+/**
+ * @brief Rebuild one conversion from a record.
+ *
+ * @return Number of characters snprintf() wanted to write, or -1 if the
+ * record holds no value for the conversion.
+ */
+static int formatSpec( const AsyncLogRecord_t * record,
+                       const FormatSpec_t * spec,
+                       size_t * offset,
+                       char * out,
+                       size_t outSize )
+{
+    char specBuffer[ SPEC_BUFFER_SIZE ];
+    size_t specLength = 0U;
+    int stars[ 2 ] = { 0 };
+    size_t starCount = 0U;
+    int32_t star = 0;
+    int64_t signedValue = 0;
+    uint64_t unsignedValue = 0U;
+    double floatValue = 0.0;
+    uint16_t stringLength = 0U;
+    int written = -1;
+    bool valid = ( spec->flagsWidthLength + spec->precisionLength + 6U ) <
+                 SPEC_BUFFER_SIZE;
+
+    /* Keep the flags, width and precision, and replace the length modifier
+     * with the one matching the stored value. */
+    if( valid )
+    {
+        specBuffer[ specLength++ ] = '%';
+        memcpy( &specBuffer[ specLength ],
+                spec->start + 1U,
+                spec->flagsWidthLength );
+        specLength += spec->flagsWidthLength;
+    }
+
+    if( valid && spec->widthFromArgument )
+    {
+        valid = getBytes( record, offset, &star, sizeof( star ) );
+        stars[ starCount++ ] = star;
+    }
+
+    if( valid && spec->precisionFromArgument )
+    {
+        valid = getBytes( record, offset, &star, sizeof( star ) );
+
+        if( spec->conversion != 's' )
+        {
+            stars[ starCount++ ] = star;
+        }
+    }
+
+    /* A string was cut when it was stored, so its precision is replaced by
+     * the stored length. */
+    if( valid && ( spec->conversion != 's' ) )
+    {
+        memcpy( &specBuffer[ specLength ],
+                spec->start + 1U + spec->flagsWidthLength,
+                spec->precisionLength );
+        specLength += spec->precisionLength;
+    }
+
+    if( !valid )
+    {
+        /* Empty if. */
+    }
+    else if( strchr( "di", spec->conversion ) != NULL )
+    {
+        memcpy( &specBuffer[ specLength ], "ll", 2U );
+        specLength += 2U;
+        specBuffer[ specLength++ ] = spec->conversion;
+        specBuffer[ specLength ] = '\0';
+
+        if( getBytes( record, offset, &signedValue, sizeof( signedValue ) ) )
+        {
+            written = FORMAT_WITH_STARS( out,
+                                         outSize,
+                                         specBuffer,
+                                         stars,
+                                         starCount,
+                                         ( long long ) signedValue );
+        }
+    }
+    else if( spec->conversion == 'c' )
+    {
+        specBuffer[ specLength++ ] = 'c';
+        specBuffer[ specLength ] = '\0';
+
+        if( getBytes( record, offset, &signedValue, sizeof( signedValue ) ) )
+        {
+            written = FORMAT_WITH_STARS( out,
+                                         outSize,
+                                         specBuffer,
+                                         stars,
+                                         starCount,
+                                         ( int ) signedValue );
+        }
+    }
+    else if( strchr( "uoxX", spec->conversion ) != NULL )
+    {
+        memcpy( &specBuffer[ specLength ], "ll", 2U );
+        specLength += 2U;
+        specBuffer[ specLength++ ] = spec->conversion;
+        specBuffer[ specLength ] = '\0';
+
+        if( getBytes( record, offset, &unsignedValue, sizeof( unsignedValue ) ) )
+        {
+            written = FORMAT_WITH_STARS( out,
+                                         outSize,
+                                         specBuffer,
+                                         stars,
+                                         starCount,
+                                         ( unsigned long long ) unsignedValue );
+        }
+    }
+    else if( strchr( "fFeEgGaA", spec->conversion ) != NULL )
+    {
+        specBuffer[ specLength++ ] = spec->conversion;
+        specBuffer[ specLength ] = '\0';
+
+        if( getBytes( record, offset, &floatValue, sizeof( floatValue ) ) )
+        {
+            written = FORMAT_WITH_STARS( out,
+                                         outSize,
+                                         specBuffer,
+                                         stars,
+                                         starCount,
+                                         floatValue );
+        }
+    }
+    else if( spec->conversion == 'p' )
+    {
+        specBuffer[ specLength++ ] = 'p';
+        specBuffer[ specLength ] = '\0';
+
+        if( getBytes( record, offset, &unsignedValue, sizeof( unsignedValue ) ) )
+        {
+            written = FORMAT_WITH_STARS( out,
+                                         outSize,
+                                         specBuffer,
+                                         stars,
+                                         starCount,
+                                         ( void * ) ( uintptr_t ) unsignedValue );
+        }
+    }
+    else if( spec->conversion == 's' )
+    {
+        memcpy( &specBuffer[ specLength ], ".*s", 4U );
+
+        if( getBytes( record, offset, &stringLength, sizeof( stringLength ) ) &&
+            ( stringLength <= ( record->argsLength - *offset ) ) )
+        {
+            stars[ starCount++ ] = ( int ) stringLength;
+            written = FORMAT_WITH_STARS( out,
+                                         outSize,
+                                         specBuffer,
+                                         stars,
+                                         starCount,
+                                         ( const char * ) &record->args[ *offset ] );
+            *offset += stringLength;
+        }
+    }
+    else if( spec->conversion == '%' )
+    {
+        written = snprintf( out, outSize, "%%" );
+    }
+    else
+    {
+        /* Empty else. */
+    }
+
+    return written;
+}
+/*-----------------------------------------------------------*/
+
+static size_t appendText( char * line,
+                          size_t lineLength,
+                          const char * text,
+                          size_t textLength )
+{
+    size_t room = LINE_BUFFER_SIZE - 1U - lineLength;
+    size_t copied = ( textLength < room ) ? textLength : room;
+
+    memcpy( &line[ lineLength ], text, copied );
+
+    return lineLength + copied;
+}
+/*-----------------------------------------------------------*/
+
+static size_t formatRecord( const AsyncLogRecord_t * record, char * line )
+{
+    FormatSpec_t spec;
+    const char * cursor = record->format;
+    const char * next = NULL;
+    size_t lineLength = 0U;
+    size_t offset = 0U;
+    int written = 0;
+    bool complete = true;
+
+    written = snprintf( line,
+                        LINE_BUFFER_SIZE,
+                        "%s %s: ",
+                        record->prefix,
+                        record->module );
+    lineLength = ( written > 0 ) ?
+                 ( ( ( size_t ) written < LINE_BUFFER_SIZE ) ?
+                   ( size_t ) written : LINE_BUFFER_SIZE - 1U ) : 0U;
+
+    while( complete && ( ( next = nextFormatSpec( cursor, &spec ) ) != NULL ) )
+    {
+        lineLength = appendText( line,
+                                 lineLength,
+                                 cursor,
+                                 ( size_t ) ( spec.start - cursor ) );
+        written = formatSpec( record,
+                              &spec,
+                              &offset,
+                              &line[ lineLength ],
+                              LINE_BUFFER_SIZE - lineLength );
+
+        if( written < 0 )
+        {
+            complete = false;
+        }
+        else
+        {
+            lineLength += ( ( size_t ) written < ( LINE_BUFFER_SIZE - lineLength ) ) ?
+                          ( size_t ) written :
+                          ( LINE_BUFFER_SIZE - 1U - lineLength );
+            cursor = next;
+        }
+    }
+
+    if( complete )
+    {
+        lineLength = appendText( line, lineLength, cursor, strlen( cursor ) );
+    }
+
+    if( !complete || record->truncated )
+    {
+        lineLength = appendText( line,
+                                 lineLength,
+                                 TRUNCATION_MARKER,
+                                 sizeof( TRUNCATION_MARKER ) - 1U );
+    }
+
+    /* The suffix is always kept so a long line still resets the color. */
+    if( lineLength > ( LINE_BUFFER_SIZE - sizeof( LINE_SUFFIX ) ) )
+    {
+        lineLength = LINE_BUFFER_SIZE - sizeof( LINE_SUFFIX );
+    }
+
+    memcpy( &line[ lineLength ], LINE_SUFFIX, sizeof( LINE_SUFFIX ) - 1U );
+
+    return lineLength + sizeof( LINE_SUFFIX ) - 1U;
+}
+/*-----------------------------------------------------------*/
+
+static void writeLine( const char * line, size_t lineLength )
+{
+    if( lineLength > ( BATCH_BUFFER_SIZE - batchLength ) )
+    {
+        ( void ) fwrite( batch, 1U, batchLength, stderr );
+        batchLength = 0U;
+    }
+
+    memcpy( &batch[ batchLength ], line, lineLength );
+    batchLength += lineLength;
+}
+/*-----------------------------------------------------------*/
+
+static void reportDrops( const char * owner,
+                         uint32_t dropped,
+                         uint32_t * droppedReported )
+{
+    char line[ LINE_BUFFER_SIZE ];
+    int written = 0;
+
+    if( dropped != *droppedReported )
+    {
+        written = snprintf( line,
+                            sizeof( line ),
+                            "\033[1;33mW AsyncLog: %u messages dropped, %s"
+                            LINE_SUFFIX,
+                            ( unsigned int ) ( dropped - *droppedReported ),
+                            owner );
+        *droppedReported = dropped;
+
+        if( ( written > 0 ) && ( ( size_t ) written < sizeof( line ) ) )
+        {
+            writeLine( line, ( size_t ) written );
+        }
+    }
+}
+/*-----------------------------------------------------------*/
+
+void asyncLog_flush( void )
+{
+    char line[ LINE_BUFFER_SIZE ];
+    AsyncLogRing_t * ring = NULL;
+    unsigned int ringCount = 0U;
+    unsigned int head = 0U;
+    unsigned int tail = 0U;
+    size_t lineLength = 0U;
+
+    /* Only one consumer may read the rings at a time. */
+    if( !atomic_flag_test_and_set_explicit( &flushing, memory_order_acquire ) )
+    {
+        ringCount = atomic_load_explicit( &ringsClaimed, memory_order_relaxed );
+        ringCount = ( ringCount < ASYNC_LOG_MAX_RINGS ) ?
+                    ringCount : ASYNC_LOG_MAX_RINGS;
+
+        for( unsigned int i = 0U; i < ringCount; i++ )
+        {
+            ring = &rings[ i ];
+            head = atomic_load_explicit( &ring->head, memory_order_acquire );
+            tail = atomic_load_explicit( &ring->tail, memory_order_relaxed );
+
+            while( tail != head )
+            {
+                lineLength = formatRecord(
+                    &ring->records[ tail & ( ASYNC_LOG_RING_RECORDS - 1U ) ],
+                    line );
+                writeLine( line, lineLength );
+                tail++;
+                atomic_store_explicit( &ring->tail,
+                                       tail,
+                                       memory_order_release );
+            }
+
+            reportDrops( "ring full",
+                         atomic_load_explicit( &ring->dropped,
+                                               memory_order_relaxed ),
+                         &ring->droppedReported );
+        }
+
+        reportDrops( "no ring left for the logging thread",
+                     atomic_load_explicit( &droppedWithoutRing,
+                                           memory_order_relaxed ),
+                     &droppedWithoutRingReported );
+
+        if( batchLength > 0U )
+        {
+            ( void ) fwrite( batch, 1U, batchLength, stderr );
+            batchLength = 0U;
+        }
+
+        ( void ) fflush( stderr );
+        atomic_flag_clear_explicit( &flushing, memory_order_release );
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void logTask( void * parameters )
+{
+    ( void ) parameters;
+
+    for( ; ; )
+    {
+        asyncLog_flush();
+        vTaskDelay( pdMS_TO_TICKS( ASYNC_LOG_FLUSH_PERIOD_MS ) );
+    }
+}
+/*-----------------------------------------------------------*/
+
+bool asyncLog_start( uint32_t taskPriority )
+{
+    /* Whatever is still in the rings is written if the demo exits, for
+     * example after a fatal MQTT error. */
+    ( void ) atexit( asyncLog_flush );
+
+    return xTaskCreateStatic( logTask,
+                              "T_LOG",
+                              LOG_TASK_STACK_DEPTH,
+                              NULL,
+                              ( UBaseType_t ) taskPriority,
+                              logTaskStack,
+                              &logTaskBuffer ) != NULL;
+}
+/*-----------------------------------------------------------*/
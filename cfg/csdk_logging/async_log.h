@@ -0,0 +1,104 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file async_log.h
+ * @brief Deferred logging backend used when LOGGING_ASYNC is defined.
+ *
+ * A log call only copies the format string pointer and the raw arguments
+ * into a ring owned by the calling thread. A background task formats and
+ * writes the records, so logging never blocks on terminal I/O.
+ */
+
+#ifndef ASYNC_LOG_H_
+#define ASYNC_LOG_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stdint.h>
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* *INDENT-ON* */
+
+/**
+ * @brief Number of threads that can own a log ring.
+ *
+ * Messages from any further thread are dropped and counted.
+ */
+#ifndef ASYNC_LOG_MAX_RINGS
+    #define ASYNC_LOG_MAX_RINGS 8U
+#endif
+
+/**
+ * @brief Records per ring, must be a power of two.
+ */
+#ifndef ASYNC_LOG_RING_RECORDS
+    #define ASYNC_LOG_RING_RECORDS 64U
+#endif
+
+/**
+ * @brief Bytes of argument data a record can hold.
+ *
+ * String arguments are copied and truncated to fit.
+ */
+#ifndef ASYNC_LOG_ARGS_SIZE
+    #define ASYNC_LOG_ARGS_SIZE 232U
+#endif
+
+/**
+ * @brief Time between two drains of the rings by the log task.
+ */
+#ifndef ASYNC_LOG_FLUSH_PERIOD_MS
+    #define ASYNC_LOG_FLUSH_PERIOD_MS 20U
+#endif
+
+/**
+ * @brief Record a log message for deferred formatting.
+ *
+ * @p prefix, @p module and @p format must be string literals, only their
+ * addresses are kept.
+ *
+ * @param[in] prefix Level marker printed before the module name.
+ * @param[in] module Name of the module that logged the message.
+ * @param[in] format printf() style format string.
+ */
+void asyncLog_record( const char * prefix,
+                      const char * module,
+                      const char * format,
+                      ... );
+
+/**
+ * @brief Create the task that formats and writes recorded messages.
+ *
+ * Pending messages are also written when the process exits.
+ *
+ * @param[in] taskPriority FreeRTOS priority of the log task.
+ *
+ * @return true if the task was created; false otherwise.
+ */
+bool asyncLog_start( uint32_t taskPriority );
+
+/**
+ * @brief Format and write every recorded message now.
+ *
+ * Used by the log task and on exit. Does nothing if another thread is
+ * already flushing.
+ */
+void asyncLog_flush( void );
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+}
+#endif
+/* *INDENT-ON* */
+
+#endif /* ifndef ASYNC_LOG_H_ */
@@ -24,10 +24,19 @@
 #endif
 
 #define LOG_UNPACK( ... ) __VA_ARGS__
-#define LOG_GENERIC_INNER( prefix, format, ... )                  \
+
+/* With LOGGING_ASYNC defined, messages are recorded in a per-thread ring and
+ * formatted later by the log task, see async_log.h. */
+#ifdef LOGGING_ASYNC
+    #include "async_log.h"
+    #define LOG_GENERIC_INNER( prefix, format, ... ) \
+    asyncLog_record( prefix, LIBRARY_LOG_NAME, format, ##__VA_ARGS__ )
+#else
+    #define LOG_GENERIC_INNER( prefix, format, ... )                  \
     fprintf( stderr,                                              \
              prefix " " LIBRARY_LOG_NAME ": " format "\033[0m\n", \
              ##__VA_ARGS__ )
+#endif
 #define LOG_GENERIC( ... ) LOG_GENERIC_INNER( __VA_ARGS__ )
 
 #if LIBRARY_LOG_LEVEL >= LOG_DEBUG
@@ -0,0 +1,76 @@
+# Copyright Amazon.com, Inc. or its affiliates. All Rights Reserved.
+# SPDX-License-Identifier: MIT
+
+# Prints the static RAM (.data and .bss) of an executable per component.
+#
+# Run with cmake -P after the link, with:
+#   SIZE      the binutils size tool
+#   TARGET    name of the executable, for the title
+#   OBJECTS   object files of the executable, grouped by source directory
+#   LIBRARIES static libraries linked in, one component each
+
+cmake_minimum_required(VERSION 3.16)
+
+function(static_ram file result)
+  execute_process(
+    COMMAND "${SIZE}" -B "${file}"
+    OUTPUT_VARIABLE output
+    RESULT_VARIABLE status)
+  if(NOT status EQUAL 0)
+    message(FATAL_ERROR "${SIZE} failed on ${file}")
+  endif()
+
+  # One line per object, archive members included, after the header line.
+  set(total 0)
+  string(REPLACE "\n" ";" lines "${output}")
+  foreach(line IN LISTS lines)
+    if(line MATCHES "^[ \t]*([0-9]+)[ \t]+([0-9]+)[ \t]+([0-9]+)[ \t]")
+      math(EXPR total "${total} + ${CMAKE_MATCH_2} + ${CMAKE_MATCH_3}")
+    endif()
+  endforeach()
+  set(${result}
+      ${total}
+      PARENT_SCOPE)
+endfunction()
+
+set(components "")
+set(grandTotal 0)
+
+foreach(object IN LISTS OBJECTS)
+  # Objects are built under <target>.dir/ mirroring the source tree.
+  string(REGEX REPLACE "^.*\\.dir/" "" source "${object}")
+  get_filename_component(component "${source}" DIRECTORY)
+  if(component STREQUAL "")
+    set(component ".")
+  endif()
+  static_ram("${object}" bytes)
+  if(NOT component IN_LIST components)
+    list(APPEND components "${component}")
+    set(ram_${component} 0)
+  endif()
+  math(EXPR ram_${component} "${ram_${component}} + ${bytes}")
+endforeach()
+
+foreach(library IN LISTS LIBRARIES)
+  get_filename_component(component "${library}" NAME_WE)
+  string(REGEX REPLACE "^lib" "" component "${component}")
+  if(NOT component IN_LIST components)
+    static_ram("${library}" bytes)
+    list(APPEND components "${component}")
+    set(ram_${component} ${bytes})
+  endif()
+endforeach()
+
+list(SORT components)
+message("Static RAM of ${TARGET} (.data + .bss, bytes):")
+foreach(component IN LISTS components)
+  string(LENGTH "${component}" length)
+  math(EXPR padding "40 - ${length}")
+  if(padding LESS 1)
+    set(padding 1)
+  endif()
+  string(REPEAT " " ${padding} spaces)
+  message("  ${component}${spaces}${ram_${component}}")
+  math(EXPR grandTotal "${grandTotal} + ${ram_${component}}")
+endforeach()
+message("  total                                   ${grandTotal}")
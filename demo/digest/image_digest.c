@@ -0,0 +1,191 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file image_digest.c
+ * @brief Run time choice of the SHA-256 backend.
+ */
+
+#define LIBRARY_LOG_NAME  "ImageDigest"
+#define LIBRARY_LOG_LEVEL LOG_INFO
+#include "csdk_logging/logging.h"
+
+/* Standard includes. */
+#include <assert.h>
+#include <string.h>
+
+#include "image_digest.h"
+
+/**
+ * @brief Streams hashed by the self test.
+ *
+ * Fewer than #IMAGE_DIGEST_LANES, so that idle lanes are exercised too.
+ */
+#define TEST_STREAMS       3U
+
+/**
+ * @brief Longest test message.
+ */
+#define TEST_MAX_LENGTH    400U
+
+/**
+ * @brief Bytes of each test message given in the first call, so that the
+ * second call starts with partial blocks.
+ */
+#define TEST_SPLIT         10U
+
+/*-----------------------------------------------------------*/
+
+/* Test message i is testLengths[ i ] bytes of ( 7 * j + i ) modulo 256. */
+static const size_t testLengths[ TEST_STREAMS ] = { 200U, 300U, 400U };
+
+static const uint8_t testDigests[ TEST_STREAMS ][ IMAGE_DIGEST_LENGTH ] =
+{
+    {
+        0xb5U, 0x31U, 0xabU, 0xd8U, 0xdaU, 0xe7U, 0x23U, 0x2cU,
+        0x86U, 0x1aU, 0xc9U, 0xf5U, 0x0aU, 0xffU, 0x99U, 0x52U,
+        0xd2U, 0x9cU, 0x8dU, 0x4cU, 0x37U, 0x72U, 0x55U, 0x1cU,
+        0xc5U, 0xbcU, 0xe5U, 0xd3U, 0x9dU, 0x2cU, 0xd0U, 0x8dU
+    },
+    {
+        0xb1U, 0xb3U, 0x6fU, 0x51U, 0xf5U, 0x14U, 0xd1U, 0x1cU,
+        0x6cU, 0xd3U, 0xa9U, 0x65U, 0x63U, 0x27U, 0xf1U, 0x80U,
+        0x20U, 0x9dU, 0x50U, 0x39U, 0x61U, 0xffU, 0x06U, 0x16U,
+        0xdbU, 0x46U, 0xcfU, 0x88U, 0x92U, 0x1dU, 0xebU, 0x28U
+    },
+    {
+        0x91U, 0x51U, 0x8bU, 0x63U, 0x0eU, 0x6aU, 0x47U, 0xa8U,
+        0x8cU, 0xaeU, 0xd4U, 0x37U, 0xd4U, 0x83U, 0xc4U, 0xc1U,
+        0xe3U, 0xa6U, 0xf9U, 0x50U, 0xf8U, 0x63U, 0x2cU, 0x97U,
+        0xf7U, 0x51U, 0x70U, 0x10U, 0x53U, 0x0eU, 0xfdU, 0x4eU
+    }
+};
+
+/*-----------------------------------------------------------*/
+
+static bool finishAndCompare( const ImageDigest_t * digest,
+                              ImageDigestContext_t * context,
+                              const uint8_t * expected )
+{
+    uint8_t actual[ IMAGE_DIGEST_LENGTH ];
+
+    return ( digest->final( context, actual ) == IMAGE_DIGEST_SUCCESS ) &&
+           ( memcmp( actual, expected, IMAGE_DIGEST_LENGTH ) == 0 );
+}
+/*-----------------------------------------------------------*/
+
+bool imageDigest_selfTest( const ImageDigest_t * digest )
+{
+    static uint8_t messages[ TEST_STREAMS ][ TEST_MAX_LENGTH ];
+    ImageDigestContext_t contexts[ TEST_STREAMS ];
+    ImageDigestContext_t * contextList[ TEST_STREAMS ];
+    const uint8_t * data[ TEST_STREAMS ];
+    size_t lengths[ TEST_STREAMS ];
+    bool passed = true;
+
+    assert( digest != NULL );
+
+    memset( contexts, 0, sizeof( contexts ) );
+
+    for( size_t i = 0U; i < TEST_STREAMS; i++ )
+    {
+        for( size_t j = 0U; j < TEST_MAX_LENGTH; j++ )
+        {
+            messages[ i ][ j ] = ( uint8_t ) ( ( 7U * j ) + i );
+        }
+
+        contextList[ i ] = &contexts[ i ];
+        passed = passed &&
+                 ( digest->init( &contexts[ i ] ) == IMAGE_DIGEST_SUCCESS );
+    }
+
+    /* One stream at a time. */
+    passed = passed &&
+             ( digest->update( &contexts[ 0 ],
+                               messages[ 0 ],
+                               testLengths[ 0 ] ) == IMAGE_DIGEST_SUCCESS ) &&
+             finishAndCompare( digest, &contexts[ 0 ], testDigests[ 0 ] ) &&
+             ( digest->init( &contexts[ 0 ] ) == IMAGE_DIGEST_SUCCESS );
+
+    /* All streams together, in two calls. */
+    for( size_t i = 0U; i < TEST_STREAMS; i++ )
+    {
+        data[ i ] = messages[ i ];
+        lengths[ i ] = TEST_SPLIT;
+    }
+
+    passed = passed &&
+             ( digest->updateMany( contextList,
+                                   data,
+                                   lengths,
+                                   TEST_STREAMS ) == IMAGE_DIGEST_SUCCESS );
+
+    for( size_t i = 0U; i < TEST_STREAMS; i++ )
+    {
+        data[ i ] = &messages[ i ][ TEST_SPLIT ];
+        lengths[ i ] = testLengths[ i ] - TEST_SPLIT;
+    }
+
+    passed = passed &&
+             ( digest->updateMany( contextList,
+                                   data,
+                                   lengths,
+                                   TEST_STREAMS ) == IMAGE_DIGEST_SUCCESS );
+
+    for( size_t i = 0U; i < TEST_STREAMS; i++ )
+    {
+        passed = passed &&
+                 finishAndCompare( digest, &contexts[ i ], testDigests[ i ] );
+        digest->cleanup( &contexts[ i ] );
+    }
+
+    return passed;
+}
+/*-----------------------------------------------------------*/
+
+void imageDigest_select( ImageDigest_t * digest )
+{
+    static ImageDigest_t selected;
+    bool portablePassed = false;
+
+    assert( digest != NULL );
+
+    /* The demos only hash from one task, so the first call needs no
+     * lock. */
+    if( selected.name == NULL )
+    {
+        imageDigest_initOpenssl( &selected );
+
+        if( !imageDigest_selfTest( &selected ) )
+        {
+            LogWarn( ( "OpenSSL SHA-256 failed its self test." ) );
+            imageDigest_initPortable( &selected );
+
+            /* Evaluated outside the assert, so NDEBUG builds still run it.
+             * There is nothing left to fall back to, a wrong digest then
+             * fails the verification of every image. */
+            portablePassed = imageDigest_selfTest( &selected );
+
+            if( !portablePassed )
+            {
+                LogError( ( "Portable SHA-256 failed its self test." ) );
+            }
+
+            /* Would be a bug of the portable backend. */
+            assert( portablePassed );
+            ( void ) portablePassed;
+        }
+
+        LogInfo( ( "Images are hashed with the %s SHA-256 backend.",
+                   selected.name ) );
+    }
+
+    *digest = selected;
+}
+/*-----------------------------------------------------------*/
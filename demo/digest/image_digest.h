@@ -0,0 +1,177 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file image_digest.h
+ * @brief Interface of the SHA-256 backends used to hash downloaded images.
+ *
+ * Two backends are provided. The OpenSSL backend goes through EVP, which
+ * picks the SHA extensions of x86 or the ARMv8 crypto extensions when the
+ * CPU has them. The portable backend is plain C and hashes several streams
+ * at once by running their rounds side by side, which the compiler turns
+ * into SIMD instructions. imageDigest_select() picks a backend at run time.
+ */
+
+#ifndef IMAGE_DIGEST_H_
+#define IMAGE_DIGEST_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* *INDENT-ON* */
+
+/**
+ * @brief Length of a SHA-256 digest.
+ */
+#define IMAGE_DIGEST_LENGTH     32U
+
+/**
+ * @brief Size of a SHA-256 block.
+ */
+#define IMAGE_DIGEST_BLOCK_SIZE 64U
+
+/**
+ * @brief Streams the portable backend hashes side by side.
+ *
+ * Four 32-bit lanes fill a 128-bit vector register. updateMany() takes any
+ * number of streams and hashes them this many at a time.
+ */
+#ifndef IMAGE_DIGEST_LANES
+    #define IMAGE_DIGEST_LANES 4U
+#endif
+
+/**
+ * @brief Image digest return status.
+ */
+typedef enum ImageDigestStatus
+{
+    IMAGE_DIGEST_SUCCESS = 0, /**< Function successfully completed. */
+    IMAGE_DIGEST_FAILED       /**< The backend reported an error. */
+} ImageDigestStatus_t;
+
+/* Opaque OpenSSL digest context, see openssl/evp.h. */
+struct evp_md_ctx_st;
+
+/**
+ * @brief State of one digest, shared by the backends.
+ */
+typedef struct ImageDigestContext
+{
+    struct evp_md_ctx_st * evpContext; /**< @brief OpenSSL backend only. */
+    uint32_t state[ 8 ];               /**< @brief Portable backend only. */
+    uint64_t length;                   /**< @brief Bytes hashed, portable
+                                        * backend only. */
+    size_t blockLength;                /**< @brief Bytes in @p block. */
+    uint8_t block[ IMAGE_DIGEST_BLOCK_SIZE ]; /**< @brief Partial block,
+                                               * portable backend only. */
+} ImageDigestContext_t;
+
+/**
+ * @brief Start a new digest.
+ *
+ * A context is zeroed before its first use. A finished context may be
+ * started again without being released.
+ */
+typedef ImageDigestStatus_t ( * ImageDigestInit_t )( ImageDigestContext_t * context );
+
+/**
+ * @brief Hash the next bytes of one stream.
+ */
+typedef ImageDigestStatus_t ( * ImageDigestUpdate_t )( ImageDigestContext_t * context,
+                                                       const uint8_t * data,
+                                                       size_t length );
+
+/**
+ * @brief Hash the next bytes of several streams at once.
+ *
+ * Equivalent to calling update() on each stream in turn. The streams may be
+ * given different lengths.
+ */
+typedef ImageDigestStatus_t ( * ImageDigestUpdateMany_t )( ImageDigestContext_t * const contexts[],
+                                                           const uint8_t * const data[],
+                                                           const size_t lengths[],
+                                                           size_t count );
+
+/**
+ * @brief Write the digest of a stream.
+ *
+ * The context must be started again before it is reused.
+ */
+typedef ImageDigestStatus_t ( * ImageDigestFinal_t )( ImageDigestContext_t * context,
+                                                      uint8_t * digest );
+
+/**
+ * @brief Release a context, finished or not.
+ */
+typedef void ( * ImageDigestCleanup_t )( ImageDigestContext_t * context );
+
+/**
+ * @brief SHA-256 backend.
+ */
+typedef struct ImageDigest
+{
+    const char * name;                  /**< @brief Name used in logs. */
+    ImageDigestInit_t init;             /**< @brief Start a digest. */
+    ImageDigestUpdate_t update;         /**< @brief Hash bytes of a stream. */
+    ImageDigestUpdateMany_t updateMany; /**< @brief Hash bytes of several
+                                         * streams. */
+    ImageDigestFinal_t final;           /**< @brief Write the digest. */
+    ImageDigestCleanup_t cleanup;       /**< @brief Release a context. */
+} ImageDigest_t;
+
+/**
+ * @brief Set up the backend built on OpenSSL EVP.
+ *
+ * @param[out] digest Backend to initialize.
+ */
+void imageDigest_initOpenssl( ImageDigest_t * digest );
+
+/**
+ * @brief Set up the backend in portable C.
+ *
+ * @param[out] digest Backend to initialize.
+ */
+void imageDigest_initPortable( ImageDigest_t * digest );
+
+/**
+ * @brief Set up the backend to hash images with.
+ *
+ * The OpenSSL backend is preferred, as it uses the SHA instructions of the
+ * CPU when there are any. The portable backend is used if OpenSSL does not
+ * give the known SHA-256 of a test message, for instance when its
+ * configuration does not allow SHA-256. The backends are checked on the
+ * first call, and the choice is logged and kept for later calls.
+ *
+ * @param[out] digest Backend to initialize.
+ */
+void imageDigest_select( ImageDigest_t * digest );
+
+/**
+ * @brief Check that a backend gives the known SHA-256 of a test message,
+ * through update() and updateMany().
+ *
+ * @param[in] digest Backend to check.
+ *
+ * @return true if the backend works; false otherwise.
+ */
+bool imageDigest_selfTest( const ImageDigest_t * digest );
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+}
+#endif
+/* *INDENT-ON* */
+
+#endif /* ifndef IMAGE_DIGEST_H_ */
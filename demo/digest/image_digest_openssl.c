@@ -0,0 +1,138 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file image_digest_openssl.c
+ * @brief SHA-256 backend built on OpenSSL EVP.
+ *
+ * OpenSSL chooses its SHA-256 code when the library is loaded, from the SHA
+ * extensions of x86 or the ARMv8 crypto extensions down to plain C. EVP has
+ * no multi-buffer SHA-256, so several streams are hashed one after another.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+
+/* OpenSSL includes. */
+#include <openssl/evp.h>
+
+#include "image_digest.h"
+
+/*-----------------------------------------------------------*/
+
+static ImageDigestStatus_t opensslInit( ImageDigestContext_t * context );
+
+static ImageDigestStatus_t opensslUpdate( ImageDigestContext_t * context,
+                                          const uint8_t * data,
+                                          size_t length );
+
+static ImageDigestStatus_t opensslUpdateMany( ImageDigestContext_t * const contexts[],
+                                              const uint8_t * const data[],
+                                              const size_t lengths[],
+                                              size_t count );
+
+static ImageDigestStatus_t opensslFinal( ImageDigestContext_t * context,
+                                         uint8_t * digest );
+
+static void opensslCleanup( ImageDigestContext_t * context );
+
+/*-----------------------------------------------------------*/
+
+static ImageDigestStatus_t opensslInit( ImageDigestContext_t * context )
+{
+    ImageDigestStatus_t status = IMAGE_DIGEST_SUCCESS;
+
+    assert( context != NULL );
+
+    /* A context is reset rather than allocated again when it is reused. */
+    if( context->evpContext == NULL )
+    {
+        context->evpContext = EVP_MD_CTX_new();
+    }
+
+    if( ( context->evpContext == NULL ) ||
+        ( EVP_DigestInit_ex( context->evpContext,
+                             EVP_sha256(),
+                             NULL ) != 1 ) )
+    {
+        status = IMAGE_DIGEST_FAILED;
+    }
+
+    return status;
+}
+/*-----------------------------------------------------------*/
+
+static ImageDigestStatus_t opensslUpdate( ImageDigestContext_t * context,
+                                          const uint8_t * data,
+                                          size_t length )
+{
+    assert( context != NULL );
+    assert( context->evpContext != NULL );
+
+    return ( EVP_DigestUpdate( context->evpContext, data, length ) == 1 ) ?
+           IMAGE_DIGEST_SUCCESS : IMAGE_DIGEST_FAILED;
+}
+/*-----------------------------------------------------------*/
+
+static ImageDigestStatus_t opensslUpdateMany( ImageDigestContext_t * const contexts[],
+                                              const uint8_t * const data[],
+                                              const size_t lengths[],
+                                              size_t count )
+{
+    ImageDigestStatus_t status = IMAGE_DIGEST_SUCCESS;
+
+    assert( ( contexts != NULL ) && ( data != NULL ) && ( lengths != NULL ) );
+
+    for( size_t i = 0U; ( status == IMAGE_DIGEST_SUCCESS ) && ( i < count ); i++ )
+    {
+        status = opensslUpdate( contexts[ i ], data[ i ], lengths[ i ] );
+    }
+
+    return status;
+}
+/*-----------------------------------------------------------*/
+
+static ImageDigestStatus_t opensslFinal( ImageDigestContext_t * context,
+                                         uint8_t * digest )
+{
+    unsigned int digestLength = 0U;
+
+    assert( context != NULL );
+    assert( context->evpContext != NULL );
+    assert( digest != NULL );
+
+    return ( ( EVP_DigestFinal_ex( context->evpContext,
+                                   digest,
+                                   &digestLength ) == 1 ) &&
+             ( digestLength == IMAGE_DIGEST_LENGTH ) ) ?
+           IMAGE_DIGEST_SUCCESS : IMAGE_DIGEST_FAILED;
+}
+/*-----------------------------------------------------------*/
+
+static void opensslCleanup( ImageDigestContext_t * context )
+{
+    assert( context != NULL );
+
+    EVP_MD_CTX_free( context->evpContext );
+    context->evpContext = NULL;
+}
+/*-----------------------------------------------------------*/
+
+void imageDigest_initOpenssl( ImageDigest_t * digest )
+{
+    assert( digest != NULL );
+
+    digest->name = "OpenSSL";
+    digest->init = opensslInit;
+    digest->update = opensslUpdate;
+    digest->updateMany = opensslUpdateMany;
+    digest->final = opensslFinal;
+    digest->cleanup = opensslCleanup;
+}
+/*-----------------------------------------------------------*/
@@ -0,0 +1,461 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file image_digest_portable.c
+ * @brief SHA-256 backend in portable C, FIPS 180-4.
+ *
+ * Several streams are hashed together by keeping their working variables
+ * in arrays of #IMAGE_DIGEST_LANES words and running each step of a round
+ * over all lanes. The loops over lanes have no dependency between
+ * iterations, so the compiler runs them in vector registers.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <string.h>
+
+#include "image_digest.h"
+
+/*-----------------------------------------------------------*/
+
+#define ROTR( x, n )    ( ( ( x ) >> ( n ) ) | ( ( x ) << ( 32U - ( n ) ) ) )
+#define CH( x, y, z )   ( ( ( x ) & ( y ) ) ^ ( ~( x ) & ( z ) ) )
+#define MAJ( x, y, z )  ( ( ( x ) & ( y ) ) ^ ( ( x ) & ( z ) ) ^ ( ( y ) & ( z ) ) )
+#define BSIG0( x )      ( ROTR( x, 2U ) ^ ROTR( x, 13U ) ^ ROTR( x, 22U ) )
+#define BSIG1( x )      ( ROTR( x, 6U ) ^ ROTR( x, 11U ) ^ ROTR( x, 25U ) )
+#define SSIG0( x )      ( ROTR( x, 7U ) ^ ROTR( x, 18U ) ^ ( ( x ) >> 3U ) )
+#define SSIG1( x )      ( ROTR( x, 17U ) ^ ROTR( x, 19U ) ^ ( ( x ) >> 10U ) )
+
+/*-----------------------------------------------------------*/
+
+static const uint32_t initialState[ 8 ] =
+{
+    0x6a09e667U, 0xbb67ae85U, 0x3c6ef372U, 0xa54ff53aU,
+    0x510e527fU, 0x9b05688cU, 0x1f83d9abU, 0x5be0cd19U
+};
+
+static const uint32_t roundConstants[ 64 ] =
+{
+    0x428a2f98U, 0x71374491U, 0xb5c0fbcfU, 0xe9b5dba5U,
+    0x3956c25bU, 0x59f111f1U, 0x923f82a4U, 0xab1c5ed5U,
+    0xd807aa98U, 0x12835b01U, 0x243185beU, 0x550c7dc3U,
+    0x72be5d74U, 0x80deb1feU, 0x9bdc06a7U, 0xc19bf174U,
+    0xe49b69c1U, 0xefbe4786U, 0x0fc19dc6U, 0x240ca1ccU,
+    0x2de92c6fU, 0x4a7484aaU, 0x5cb0a9dcU, 0x76f988daU,
+    0x983e5152U, 0xa831c66dU, 0xb00327c8U, 0xbf597fc7U,
+    0xc6e00bf3U, 0xd5a79147U, 0x06ca6351U, 0x14292967U,
+    0x27b70a85U, 0x2e1b2138U, 0x4d2c6dfcU, 0x53380d13U,
+    0x650a7354U, 0x766a0abbU, 0x81c2c92eU, 0x92722c85U,
+    0xa2bfe8a1U, 0xa81a664bU, 0xc24b8b70U, 0xc76c51a3U,
+    0xd192e819U, 0xd6990624U, 0xf40e3585U, 0x106aa070U,
+    0x19a4c116U, 0x1e376c08U, 0x2748774cU, 0x34b0bcb5U,
+    0x391c0cb3U, 0x4ed8aa4aU, 0x5b9cca4fU, 0x682e6ff3U,
+    0x748f82eeU, 0x78a5636fU, 0x84c87814U, 0x8cc70208U,
+    0x90befffaU, 0xa4506cebU, 0xbef9a3f7U, 0xc67178f2U
+};
+
+/*-----------------------------------------------------------*/
+
+static ImageDigestStatus_t portableInit( ImageDigestContext_t * context );
+
+static ImageDigestStatus_t portableUpdate( ImageDigestContext_t * context,
+                                           const uint8_t * data,
+                                           size_t length );
+
+static ImageDigestStatus_t portableUpdateMany( ImageDigestContext_t * const contexts[],
+                                               const uint8_t * const data[],
+                                               const size_t lengths[],
+                                               size_t count );
+
+static ImageDigestStatus_t portableFinal( ImageDigestContext_t * context,
+                                          uint8_t * digest );
+
+static void portableCleanup( ImageDigestContext_t * context );
+
+/*-----------------------------------------------------------*/
+
+static uint32_t loadBigEndian( const uint8_t * bytes )
+{
+    return ( ( uint32_t ) bytes[ 0 ] << 24 ) |
+           ( ( uint32_t ) bytes[ 1 ] << 16 ) |
+           ( ( uint32_t ) bytes[ 2 ] << 8 ) |
+           ( uint32_t ) bytes[ 3 ];
+}
+/*-----------------------------------------------------------*/
+
+static void compress( uint32_t * state,
+                      const uint8_t * block )
+{
+    uint32_t schedule[ 64 ];
+    uint32_t a = state[ 0 ], b = state[ 1 ], c = state[ 2 ], d = state[ 3 ];
+    uint32_t e = state[ 4 ], f = state[ 5 ], g = state[ 6 ], h = state[ 7 ];
+    uint32_t t1 = 0U;
+    uint32_t t2 = 0U;
+
+    for( uint32_t t = 0U; t < 16U; t++ )
+    {
+        schedule[ t ] = loadBigEndian( &block[ 4U * t ] );
+    }
+
+    for( uint32_t t = 16U; t < 64U; t++ )
+    {
+        schedule[ t ] = SSIG1( schedule[ t - 2U ] ) + schedule[ t - 7U ] +
+                        SSIG0( schedule[ t - 15U ] ) + schedule[ t - 16U ];
+    }
+
+    for( uint32_t t = 0U; t < 64U; t++ )
+    {
+        t1 = h + BSIG1( e ) + CH( e, f, g ) + roundConstants[ t ] +
+             schedule[ t ];
+        t2 = BSIG0( a ) + MAJ( a, b, c );
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    state[ 0 ] += a;
+    state[ 1 ] += b;
+    state[ 2 ] += c;
+    state[ 3 ] += d;
+    state[ 4 ] += e;
+    state[ 5 ] += f;
+    state[ 6 ] += g;
+    state[ 7 ] += h;
+}
+/*-----------------------------------------------------------*/
+
+/* Compresses one block of every lane. The state of the lanes is kept word
+ * by word, state[ word ][ lane ]. */
+static void compressLanes( uint32_t state[ 8 ][ IMAGE_DIGEST_LANES ],
+                           const uint8_t * const blocks[ IMAGE_DIGEST_LANES ] )
+{
+    uint32_t schedule[ 64 ][ IMAGE_DIGEST_LANES ];
+    uint32_t a[ IMAGE_DIGEST_LANES ], b[ IMAGE_DIGEST_LANES ];
+    uint32_t c[ IMAGE_DIGEST_LANES ], d[ IMAGE_DIGEST_LANES ];
+    uint32_t e[ IMAGE_DIGEST_LANES ], f[ IMAGE_DIGEST_LANES ];
+    uint32_t g[ IMAGE_DIGEST_LANES ], h[ IMAGE_DIGEST_LANES ];
+    uint32_t t1 = 0U;
+    uint32_t t2 = 0U;
+
+    for( uint32_t t = 0U; t < 16U; t++ )
+    {
+        for( uint32_t lane = 0U; lane < IMAGE_DIGEST_LANES; lane++ )
+        {
+            schedule[ t ][ lane ] = loadBigEndian( &blocks[ lane ][ 4U * t ] );
+        }
+    }
+
+    for( uint32_t t = 16U; t < 64U; t++ )
+    {
+        for( uint32_t lane = 0U; lane < IMAGE_DIGEST_LANES; lane++ )
+        {
+            schedule[ t ][ lane ] = SSIG1( schedule[ t - 2U ][ lane ] ) +
+                                    schedule[ t - 7U ][ lane ] +
+                                    SSIG0( schedule[ t - 15U ][ lane ] ) +
+                                    schedule[ t - 16U ][ lane ];
+        }
+    }
+
+    memcpy( a, state[ 0 ], sizeof( a ) );
+    memcpy( b, state[ 1 ], sizeof( b ) );
+    memcpy( c, state[ 2 ], sizeof( c ) );
+    memcpy( d, state[ 3 ], sizeof( d ) );
+    memcpy( e, state[ 4 ], sizeof( e ) );
+    memcpy( f, state[ 5 ], sizeof( f ) );
+    memcpy( g, state[ 6 ], sizeof( g ) );
+    memcpy( h, state[ 7 ], sizeof( h ) );
+
+    /* Each working variable being its own array lets the compiler keep it
+     * in a vector register, so the shifts below cost nothing. */
+    for( uint32_t t = 0U; t < 64U; t++ )
+    {
+        for( uint32_t lane = 0U; lane < IMAGE_DIGEST_LANES; lane++ )
+        {
+            t1 = h[ lane ] + BSIG1( e[ lane ] ) +
+                 CH( e[ lane ], f[ lane ], g[ lane ] ) +
+                 roundConstants[ t ] + schedule[ t ][ lane ];
+            t2 = BSIG0( a[ lane ] ) + MAJ( a[ lane ], b[ lane ], c[ lane ] );
+            h[ lane ] = g[ lane ];
+            g[ lane ] = f[ lane ];
+            f[ lane ] = e[ lane ];
+            e[ lane ] = d[ lane ] + t1;
+            d[ lane ] = c[ lane ];
+            c[ lane ] = b[ lane ];
+            b[ lane ] = a[ lane ];
+            a[ lane ] = t1 + t2;
+        }
+    }
+
+    for( uint32_t lane = 0U; lane < IMAGE_DIGEST_LANES; lane++ )
+    {
+        state[ 0 ][ lane ] += a[ lane ];
+        state[ 1 ][ lane ] += b[ lane ];
+        state[ 2 ][ lane ] += c[ lane ];
+        state[ 3 ][ lane ] += d[ lane ];
+        state[ 4 ][ lane ] += e[ lane ];
+        state[ 5 ][ lane ] += f[ lane ];
+        state[ 6 ][ lane ] += g[ lane ];
+        state[ 7 ][ lane ] += h[ lane ];
+    }
+}
+/*-----------------------------------------------------------*/
+
+/* Completes the partial block of a context from the data, so that the rest
+ * of the data starts on a block boundary. */
+static void fillBlock( ImageDigestContext_t * context,
+                       const uint8_t ** data,
+                       size_t * length )
+{
+    size_t copyLength = 0U;
+
+    if( context->blockLength > 0U )
+    {
+        copyLength = IMAGE_DIGEST_BLOCK_SIZE - context->blockLength;
+
+        if( copyLength > *length )
+        {
+            copyLength = *length;
+        }
+
+        memcpy( &context->block[ context->blockLength ], *data, copyLength );
+        context->blockLength += copyLength;
+        context->length += copyLength;
+        *data += copyLength;
+        *length -= copyLength;
+
+        if( context->blockLength == IMAGE_DIGEST_BLOCK_SIZE )
+        {
+            compress( context->state, context->block );
+            context->blockLength = 0U;
+        }
+    }
+}
+/*-----------------------------------------------------------*/
+
+/* Hashes up to IMAGE_DIGEST_LANES streams. The blocks they all have are
+ * hashed side by side, and the rest of each stream on its own. */
+static void updateLanes( ImageDigestContext_t * const contexts[],
+                         const uint8_t * const data[],
+                         const size_t lengths[],
+                         size_t count )
+{
+    /* Lanes without a stream hash this block into a state nobody reads. */
+    static const uint8_t idleBlock[ IMAGE_DIGEST_BLOCK_SIZE ] = { 0 };
+    uint32_t state[ 8 ][ IMAGE_DIGEST_LANES ] = { { 0U } };
+    const uint8_t * blocks[ IMAGE_DIGEST_LANES ];
+    const uint8_t * next[ IMAGE_DIGEST_LANES ];
+    size_t remaining[ IMAGE_DIGEST_LANES ];
+    size_t laneLength = SIZE_MAX;
+
+    for( size_t i = 0U; i < count; i++ )
+    {
+        next[ i ] = data[ i ];
+        remaining[ i ] = lengths[ i ];
+        fillBlock( contexts[ i ], &next[ i ], &remaining[ i ] );
+
+        /* A stream whose partial block is still not full has no data
+         * left. */
+        if( remaining[ i ] < laneLength )
+        {
+            laneLength = remaining[ i ];
+        }
+    }
+
+    laneLength -= laneLength % IMAGE_DIGEST_BLOCK_SIZE;
+
+    /* A single stream is faster on its own. */
+    if( ( count > 1U ) && ( laneLength > 0U ) )
+    {
+        for( size_t i = 0U; i < count; i++ )
+        {
+            for( uint32_t word = 0U; word < 8U; word++ )
+            {
+                state[ word ][ i ] = contexts[ i ]->state[ word ];
+            }
+        }
+
+        for( size_t offset = 0U; offset < laneLength;
+             offset += IMAGE_DIGEST_BLOCK_SIZE )
+        {
+            for( size_t lane = 0U; lane < IMAGE_DIGEST_LANES; lane++ )
+            {
+                blocks[ lane ] = ( lane < count ) ? &next[ lane ][ offset ] :
+                                 idleBlock;
+            }
+
+            compressLanes( state, blocks );
+        }
+
+        for( size_t i = 0U; i < count; i++ )
+        {
+            for( uint32_t word = 0U; word < 8U; word++ )
+            {
+                contexts[ i ]->state[ word ] = state[ word ][ i ];
+            }
+
+            contexts[ i ]->length += laneLength;
+            next[ i ] += laneLength;
+            remaining[ i ] -= laneLength;
+        }
+    }
+
+    for( size_t i = 0U; i < count; i++ )
+    {
+        ( void ) portableUpdate( contexts[ i ], next[ i ], remaining[ i ] );
+    }
+}
+/*-----------------------------------------------------------*/
+
+static ImageDigestStatus_t portableInit( ImageDigestContext_t * context )
+{
+    assert( context != NULL );
+
+    memcpy( context->state, initialState, sizeof( context->state ) );
+    context->length = 0U;
+    context->blockLength = 0U;
+
+    return IMAGE_DIGEST_SUCCESS;
+}
+/*-----------------------------------------------------------*/
+
+static ImageDigestStatus_t portableUpdate( ImageDigestContext_t * context,
+                                           const uint8_t * data,
+                                           size_t length )
+{
+    const uint8_t * next = data;
+    size_t remaining = length;
+
+    assert( context != NULL );
+    assert( ( data != NULL ) || ( length == 0U ) );
+
+    fillBlock( context, &next, &remaining );
+
+    while( remaining >= IMAGE_DIGEST_BLOCK_SIZE )
+    {
+        compress( context->state, next );
+        context->length += IMAGE_DIGEST_BLOCK_SIZE;
+        next += IMAGE_DIGEST_BLOCK_SIZE;
+        remaining -= IMAGE_DIGEST_BLOCK_SIZE;
+    }
+
+    if( remaining > 0U )
+    {
+        memcpy( context->block, next, remaining );
+        context->blockLength = remaining;
+        context->length += remaining;
+    }
+
+    return IMAGE_DIGEST_SUCCESS;
+}
+/*-----------------------------------------------------------*/
+
+static ImageDigestStatus_t portableUpdateMany( ImageDigestContext_t * const contexts[],
+                                               const uint8_t * const data[],
+                                               const size_t lengths[],
+                                               size_t count )
+{
+    size_t laneCount = 0U;
+
+    assert( ( contexts != NULL ) && ( data != NULL ) && ( lengths != NULL ) );
+
+    for( size_t first = 0U; first < count; first += laneCount )
+    {
+        laneCount = count - first;
+
+        if( laneCount > IMAGE_DIGEST_LANES )
+        {
+            laneCount = IMAGE_DIGEST_LANES;
+        }
+
+        updateLanes( &contexts[ first ],
+                     &data[ first ],
+                     &lengths[ first ],
+                     laneCount );
+    }
+
+    return IMAGE_DIGEST_SUCCESS;
+}
+/*-----------------------------------------------------------*/
+
+static ImageDigestStatus_t portableFinal( ImageDigestContext_t * context,
+                                          uint8_t * digest )
+{
+    uint64_t bitLength = 0U;
+
+    assert( context != NULL );
+    assert( digest != NULL );
+
+    bitLength = context->length * 8U;
+
+    /* A one bit, zeros up to the last 8 bytes of a block, then the length
+     * in bits. */
+    context->block[ context->blockLength ] = 0x80U;
+    context->blockLength++;
+
+    if( context->blockLength > ( IMAGE_DIGEST_BLOCK_SIZE - 8U ) )
+    {
+        memset( &context->block[ context->blockLength ],
+                0,
+                IMAGE_DIGEST_BLOCK_SIZE - context->blockLength );
+        compress( context->state, context->block );
+        context->blockLength = 0U;
+    }
+
+    memset( &context->block[ context->blockLength ],
+            0,
+            IMAGE_DIGEST_BLOCK_SIZE - 8U - context->blockLength );
+
+    for( uint32_t i = 0U; i < 8U; i++ )
+    {
+        context->block[ IMAGE_DIGEST_BLOCK_SIZE - 1U - i ] =
+            ( uint8_t ) ( bitLength >> ( 8U * i ) );
+    }
+
+    compress( context->state, context->block );
+    context->blockLength = 0U;
+
+    for( uint32_t word = 0U; word < 8U; word++ )
+    {
+        digest[ 4U * word ] = ( uint8_t ) ( context->state[ word ] >> 24 );
+        digest[ ( 4U * word ) + 1U ] = ( uint8_t ) ( context->state[ word ] >> 16 );
+        digest[ ( 4U * word ) + 2U ] = ( uint8_t ) ( context->state[ word ] >> 8 );
+        digest[ ( 4U * word ) + 3U ] = ( uint8_t ) context->state[ word ];
+    }
+
+    return IMAGE_DIGEST_SUCCESS;
+}
+/*-----------------------------------------------------------*/
+
+static void portableCleanup( ImageDigestContext_t * context )
+{
+    assert( context != NULL );
+
+    /* Nothing is allocated. */
+    ( void ) context;
+}
+/*-----------------------------------------------------------*/
+
+void imageDigest_initPortable( ImageDigest_t * digest )
+{
+    assert( digest != NULL );
+
+    digest->name = "portable";
+    digest->init = portableInit;
+    digest->update = portableUpdate;
+    digest->updateMany = portableUpdateMany;
+    digest->final = portableFinal;
+    digest->cleanup = portableCleanup;
+}
+/*-----------------------------------------------------------*/
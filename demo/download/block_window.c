@@ -0,0 +1,215 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file block_window.c
+ * @brief Implementation of the sliding window used by the download path.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <string.h>
+
+#include "block_window.h"
+
+/*-----------------------------------------------------------*/
+
+static bool isBlockReceived( const BlockWindow_t * window, uint32_t blockId )
+{
+    return ( window->receivedBitmap[ blockId / 8U ] &
+             ( uint8_t ) ( 1U << ( blockId % 8U ) ) ) != 0U;
+}
+/*-----------------------------------------------------------*/
+
+bool blockWindow_init( BlockWindow_t * window,
+                       uint32_t fileSize,
+                       uint32_t blockSize,
+                       uint32_t maxBlocksInFlight,
+                       uint32_t blocksPerRequest )
+{
+    assert( window != NULL );
+    assert( blockSize > 0U );
+    assert( blocksPerRequest > 0U );
+    assert( maxBlocksInFlight >= blocksPerRequest );
+
+    memset( window, 0, sizeof( BlockWindow_t ) );
+
+    window->fileSize = fileSize;
+    window->blockSize = blockSize;
+    window->totalBlocks = ( fileSize / blockSize ) +
+                          ( ( ( fileSize % blockSize ) > 0U ) ? 1U : 0U );
+    window->maxBlocksInFlight = maxBlocksInFlight;
+    window->blocksPerRequest = blocksPerRequest;
+
+    return window->totalBlocks <= BLOCK_WINDOW_MAX_BLOCKS;
+}
+/*-----------------------------------------------------------*/
+
+void blockWindow_setLimits( BlockWindow_t * window,
+                            uint32_t maxBlocksInFlight,
+                            uint32_t blocksPerRequest )
+{
+    assert( window != NULL );
+    assert( blocksPerRequest > 0U );
+    assert( maxBlocksInFlight >= blocksPerRequest );
+
+    window->maxBlocksInFlight = maxBlocksInFlight;
+    window->blocksPerRequest = blocksPerRequest;
+}
+/*-----------------------------------------------------------*/
+
+bool blockWindow_nextRequest( BlockWindow_t * window,
+                              uint32_t * blockOffset,
+                              uint32_t * numBlocks )
+{
+    uint32_t freeSlots = 0U;
+    uint32_t count = 0U;
+
+    assert( window != NULL );
+    assert( blockOffset != NULL );
+    assert( numBlocks != NULL );
+
+    while( ( window->nextBlock < window->totalBlocks ) &&
+           isBlockReceived( window, window->nextBlock ) )
+    {
+        window->nextBlock++;
+    }
+
+    if( window->blocksInFlight < window->maxBlocksInFlight )
+    {
+        freeSlots = window->maxBlocksInFlight - window->blocksInFlight;
+    }
+
+    while( ( count < freeSlots ) && ( count < window->blocksPerRequest ) &&
+           ( ( window->nextBlock + count ) < window->totalBlocks ) &&
+           !isBlockReceived( window, window->nextBlock + count ) )
+    {
+        count++;
+    }
+
+    /* Hold back a short run while blocks are still in flight, unless it
+     * reaches the end of the file or a block that has already arrived. */
+    if( ( count < window->blocksPerRequest ) && ( count == freeSlots ) &&
+        ( window->blocksInFlight > 0U ) )
+    {
+        count = 0U;
+    }
+
+    if( count > 0U )
+    {
+        *blockOffset = window->nextBlock;
+        *numBlocks = count;
+        window->nextBlock += count;
+        window->blocksInFlight += count;
+    }
+
+    return count > 0U;
+}
+/*-----------------------------------------------------------*/
+
+bool blockWindow_nextMissing( const BlockWindow_t * window,
+                              uint32_t * blockOffset,
+                              uint32_t endBlock,
+                              uint32_t * numBlocks )
+{
+    uint32_t start = 0U;
+    uint32_t end = 0U;
+
+    assert( window != NULL );
+    assert( blockOffset != NULL );
+    assert( numBlocks != NULL );
+
+    start = *blockOffset;
+    end = ( endBlock < window->totalBlocks ) ? endBlock : window->totalBlocks;
+
+    while( ( start < end ) && isBlockReceived( window, start ) )
+    {
+        start++;
+    }
+
+    *blockOffset = start;
+    *numBlocks = 0U;
+
+    while( ( ( start + *numBlocks ) < end ) &&
+           !isBlockReceived( window, start + *numBlocks ) )
+    {
+        ( *numBlocks )++;
+    }
+
+    return *numBlocks > 0U;
+}
+/*-----------------------------------------------------------*/
+
+bool blockWindow_markReceived( BlockWindow_t * window, uint32_t blockId )
+{
+    bool isNew = false;
+
+    assert( window != NULL );
+
+    if( ( blockId < window->totalBlocks ) &&
+        !isBlockReceived( window, blockId ) )
+    {
+        uint8_t mask = ( uint8_t ) ( 1U << ( blockId % 8U ) );
+
+        window->receivedBitmap[ blockId / 8U ] |= mask;
+        window->blocksReceived++;
+
+        if( window->blocksInFlight > 0U )
+        {
+            window->blocksInFlight--;
+        }
+
+        isNew = true;
+    }
+
+    return isNew;
+}
+/*-----------------------------------------------------------*/
+
+uint32_t blockWindow_blockLength( const BlockWindow_t * window,
+                                  uint32_t blockId )
+{
+    uint32_t remaining = 0U;
+
+    assert( window != NULL );
+
+    if( blockId < window->totalBlocks )
+    {
+        remaining = window->fileSize - ( blockId * window->blockSize );
+    }
+
+    return ( remaining < window->blockSize ) ? remaining : window->blockSize;
+}
+/*-----------------------------------------------------------*/
+
+bool blockWindow_isReceived( const BlockWindow_t * window, uint32_t blockId )
+{
+    assert( window != NULL );
+
+    return ( blockId < window->totalBlocks ) &&
+           isBlockReceived( window, blockId );
+}
+/*-----------------------------------------------------------*/
+
+void blockWindow_rewind( BlockWindow_t * window )
+{
+    assert( window != NULL );
+
+    window->nextBlock = 0U;
+    window->blocksInFlight = 0U;
+}
+/*-----------------------------------------------------------*/
+
+bool blockWindow_isComplete( const BlockWindow_t * window )
+{
+    assert( window != NULL );
+
+    return window->blocksReceived == window->totalBlocks;
+}
+/*-----------------------------------------------------------*/
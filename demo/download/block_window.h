@@ -0,0 +1,191 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file block_window.h
+ * @brief Sliding window bookkeeping for pipelined MQTT stream downloads.
+ */
+
+#ifndef BLOCK_WINDOW_H_
+#define BLOCK_WINDOW_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stdint.h>
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* *INDENT-ON* */
+
+/**
+ * @brief Largest number of blocks a single file may be split into.
+ *
+ * One bit of RAM is used per block to remember which blocks have arrived.
+ */
+#ifndef BLOCK_WINDOW_MAX_BLOCKS
+    #define BLOCK_WINDOW_MAX_BLOCKS ( 65536U )
+#endif
+
+/**
+ * @brief Size of the received-block bitmap in bytes.
+ */
+#define BLOCK_WINDOW_BITMAP_SIZE ( ( BLOCK_WINDOW_MAX_BLOCKS + 7U ) / 8U )
+
+/**
+ * @brief Tracks which blocks of a file have been requested and received.
+ *
+ * Blocks may arrive in any order. The window only limits how many requested
+ * blocks may be outstanding at once so that the broker round trip is
+ * overlapped with the transfer of earlier blocks.
+ */
+typedef struct BlockWindow
+{
+    uint32_t fileSize;          /**< @brief Size of the file in bytes. */
+    uint32_t blockSize;         /**< @brief Size of every block but the last. */
+    uint32_t totalBlocks;       /**< @brief Number of blocks in the file. */
+    uint32_t nextBlock;         /**< @brief Lowest block never requested. */
+    uint32_t blocksInFlight;    /**< @brief Requested, not yet received. */
+    uint32_t blocksReceived;    /**< @brief Distinct blocks received. */
+    uint32_t maxBlocksInFlight; /**< @brief Upper bound on blocksInFlight. */
+    uint32_t blocksPerRequest;  /**< @brief Blocks asked for per request. */
+    uint8_t receivedBitmap[ BLOCK_WINDOW_BITMAP_SIZE ]; /**< @brief One bit
+                                                           per block. */
+} BlockWindow_t;
+
+/**
+ * @brief Reset the window for a new file download.
+ *
+ * @param[out] window Window to initialize.
+ * @param[in] fileSize Size of the file in bytes.
+ * @param[in] blockSize Size of a block in bytes.
+ * @param[in] maxBlocksInFlight Maximum number of outstanding blocks.
+ * @param[in] blocksPerRequest Number of blocks to ask for in one request.
+ *
+ * @return true if the file fits in the window; false otherwise.
+ */
+bool blockWindow_init( BlockWindow_t * window,
+                       uint32_t fileSize,
+                       uint32_t blockSize,
+                       uint32_t maxBlocksInFlight,
+                       uint32_t blocksPerRequest );
+
+/**
+ * @brief Change how many blocks may be in flight and asked for at once.
+ *
+ * Takes effect on the next request. Blocks already in flight above a
+ * smaller limit are not cancelled, no new ones are requested until they
+ * have arrived.
+ *
+ * @param[in, out] window Window to resize.
+ * @param[in] maxBlocksInFlight Maximum number of outstanding blocks.
+ * @param[in] blocksPerRequest Number of blocks to ask for in one request.
+ */
+void blockWindow_setLimits( BlockWindow_t * window,
+                            uint32_t maxBlocksInFlight,
+                            uint32_t blocksPerRequest );
+
+/**
+ * @brief Get the next run of blocks to request, if the window has room.
+ *
+ * Blocks that have already been received are skipped. A run shorter than
+ * blocksPerRequest is only returned for the tail of the file, so that free
+ * window slots are batched into full-sized requests.
+ *
+ * @param[in, out] window Window to take the blocks from.
+ * @param[out] blockOffset Index of the first block to request.
+ * @param[out] numBlocks Number of consecutive blocks to request.
+ *
+ * @return true if a request should be sent; false if the window is full or
+ * every block has been requested.
+ */
+bool blockWindow_nextRequest( BlockWindow_t * window,
+                              uint32_t * blockOffset,
+                              uint32_t * numBlocks );
+
+/**
+ * @brief Find the next run of blocks that have not arrived in a range.
+ *
+ * Used to request again the blocks of a request that went unanswered. The
+ * blocks stay counted as in flight.
+ *
+ * @param[in] window Window to search.
+ * @param[in, out] blockOffset In, the first block of the range to search;
+ * out, the first block of the run.
+ * @param[in] endBlock One past the last block of the range.
+ * @param[out] numBlocks Number of consecutive missing blocks.
+ *
+ * @return true if a run was found; false if every block of the range has
+ * arrived.
+ */
+bool blockWindow_nextMissing( const BlockWindow_t * window,
+                              uint32_t * blockOffset,
+                              uint32_t endBlock,
+                              uint32_t * numBlocks );
+
+/**
+ * @brief Record the arrival of a block.
+ *
+ * @param[in, out] window Window the block belongs to.
+ * @param[in] blockId Index of the block that arrived.
+ *
+ * @return true if the block is new; false if it is a duplicate or out of
+ * range and should be dropped.
+ */
+bool blockWindow_markReceived( BlockWindow_t * window, uint32_t blockId );
+
+/**
+ * @brief Get the length a block of the file must have.
+ *
+ * @param[in] window Window the block belongs to.
+ * @param[in] blockId Index of the block.
+ *
+ * @return blockSize, what is left of the file for the last block, or 0 if
+ * the block is not in the file.
+ */
+uint32_t blockWindow_blockLength( const BlockWindow_t * window,
+                                  uint32_t blockId );
+
+/**
+ * @brief Check whether a block has been received.
+ *
+ * @param[in] window Window the block belongs to.
+ * @param[in] blockId Index of the block.
+ *
+ * @return true if the block is in the file and has been received.
+ */
+bool blockWindow_isReceived( const BlockWindow_t * window, uint32_t blockId );
+
+/**
+ * @brief Forget every outstanding request.
+ *
+ * Blocks that have not been received yet are handed out again by
+ * blockWindow_nextRequest(), for example after their responses were dropped.
+ *
+ * @param[in, out] window Window to rewind.
+ */
+void blockWindow_rewind( BlockWindow_t * window );
+
+/**
+ * @brief Check whether every block of the file has been received.
+ *
+ * @param[in] window Window to check.
+ *
+ * @return true if the download is complete.
+ */
+bool blockWindow_isComplete( const BlockWindow_t * window );
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+}
+#endif
+/* *INDENT-ON* */
+
+#endif /* ifndef BLOCK_WINDOW_H_ */
@@ -0,0 +1,353 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file download_checkpoint.c
+ * @brief Implementation of the persisted download checkpoint.
+ */
+
+#define LIBRARY_LOG_NAME  "Checkpoint"
+#define LIBRARY_LOG_LEVEL LOG_INFO
+#include "csdk_logging/logging.h"
+
+/* Standard includes. */
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+/* POSIX includes. */
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "download_checkpoint.h"
+
+/**
+ * @brief Identifies version 1 of the checkpoint format, "OCK1".
+ */
+#define CHECKPOINT_MAGIC 0x314B434FU
+
+/**
+ * @brief Bitmap bytes read per call when a checkpoint is restored.
+ */
+#define RESTORE_CHUNK_SIZE 64U
+
+_Static_assert( sizeof( DownloadCheckpointHeader_t ) ==
+                ( 16U + DOWNLOAD_CHECKPOINT_MAX_JOB_ID_LENGTH +
+                  DOWNLOAD_CHECKPOINT_MAX_STREAM_NAME_LENGTH ),
+                "The checkpoint header must not contain padding" );
+
+/*-----------------------------------------------------------*/
+
+static size_t bitmapSize( const BlockWindow_t * window )
+{
+    return ( ( size_t ) window->totalBlocks + 7U ) / 8U;
+}
+/*-----------------------------------------------------------*/
+
+static void closeCheckpoint( DownloadCheckpoint_t * checkpoint )
+{
+    if( checkpoint->fileDescriptor >= 0 )
+    {
+        ( void ) close( checkpoint->fileDescriptor );
+        checkpoint->fileDescriptor = -1;
+    }
+}
+/*-----------------------------------------------------------*/
+
+/* The image must still be there, at its full size, for the blocks the
+ * checkpoint records to be worth keeping. */
+static bool imageExists( const char * imagePath, uint32_t fileSize )
+{
+    struct stat imageStat;
+
+    return ( stat( imagePath, &imageStat ) == 0 ) &&
+           ( imageStat.st_size == ( off_t ) fileSize );
+}
+/*-----------------------------------------------------------*/
+
+static bool readHeader( const DownloadCheckpoint_t * checkpoint,
+                        DownloadCheckpointHeader_t * header )
+{
+    return pread( checkpoint->fileDescriptor,
+                  header,
+                  sizeof( DownloadCheckpointHeader_t ),
+                  0 ) == ( ssize_t ) sizeof( DownloadCheckpointHeader_t );
+}
+/*-----------------------------------------------------------*/
+
+static uint32_t restoreBitmap( const DownloadCheckpoint_t * checkpoint,
+                               BlockWindow_t * window )
+{
+    uint8_t chunk[ RESTORE_CHUNK_SIZE ];
+    size_t size = bitmapSize( window );
+    size_t offset = 0U;
+    size_t chunkLength = 0U;
+    bool readFailed = false;
+
+    while( !readFailed && ( offset < size ) )
+    {
+        chunkLength = size - offset;
+
+        if( chunkLength > sizeof( chunk ) )
+        {
+            chunkLength = sizeof( chunk );
+        }
+
+        readFailed = pread( checkpoint->fileDescriptor,
+                            chunk,
+                            chunkLength,
+                            ( off_t ) ( sizeof( DownloadCheckpointHeader_t ) +
+                                        offset ) ) !=
+                     ( ssize_t ) chunkLength;
+
+        for( size_t i = 0U; !readFailed && ( i < chunkLength ); i++ )
+        {
+            for( uint32_t bit = 0U; ( chunk[ i ] >> bit ) != 0U; bit++ )
+            {
+                if( ( chunk[ i ] & ( 1U << bit ) ) != 0U )
+                {
+                    /* Bits past the last block are ignored by the window. */
+                    ( void ) blockWindow_markReceived(
+                        window,
+                        ( uint32_t ) ( ( offset + i ) * 8U ) + bit );
+                }
+            }
+        }
+
+        offset += chunkLength;
+    }
+
+    return window->blocksReceived;
+}
+/*-----------------------------------------------------------*/
+
+static bool startOver( DownloadCheckpoint_t * checkpoint,
+                       const DownloadCheckpointHeader_t * header,
+                       const BlockWindow_t * window )
+{
+    size_t fileLength = sizeof( DownloadCheckpointHeader_t ) +
+                        bitmapSize( window );
+
+    /* Truncating first zeroes the whole bitmap when the file is sized. */
+    return ( ftruncate( checkpoint->fileDescriptor, 0 ) == 0 ) &&
+           ( pwrite( checkpoint->fileDescriptor,
+                     header,
+                     sizeof( DownloadCheckpointHeader_t ),
+                     0 ) == ( ssize_t ) sizeof( DownloadCheckpointHeader_t ) ) &&
+           ( ftruncate( checkpoint->fileDescriptor,
+                        ( off_t ) fileLength ) == 0 ) &&
+           ( fdatasync( checkpoint->fileDescriptor ) == 0 );
+}
+/*-----------------------------------------------------------*/
+
+/* Every bit set in the window refers to a block already written through the
+ * sink, so once the sink is flushed the changed bytes can be copied as they
+ * are. */
+static bool flushBitmap( DownloadCheckpoint_t * checkpoint,
+                         const BlockWindow_t * window,
+                         const ImageSink_t * sink )
+{
+    size_t length = ( size_t ) checkpoint->dirtyEnd - checkpoint->dirtyStart;
+    bool flushed = false;
+
+    flushed = ( sink->sync( sink->pContext ) == IMAGE_SINK_SUCCESS ) &&
+              ( pwrite( checkpoint->fileDescriptor,
+                        &window->receivedBitmap[ checkpoint->dirtyStart ],
+                        length,
+                        ( off_t ) ( sizeof( DownloadCheckpointHeader_t ) +
+                                    checkpoint->dirtyStart ) ) ==
+                ( ssize_t ) length ) &&
+              ( fdatasync( checkpoint->fileDescriptor ) == 0 );
+
+    checkpoint->blocksSinceSync = 0U;
+    checkpoint->dirtyStart = 0U;
+    checkpoint->dirtyEnd = 0U;
+
+    return flushed;
+}
+/*-----------------------------------------------------------*/
+
+bool downloadCheckpoint_open( DownloadCheckpoint_t * checkpoint,
+                              const char * imagePath,
+                              const char * jobId,
+                              size_t jobIdLength,
+                              const char * streamName,
+                              size_t streamNameLength,
+                              uint8_t fileId,
+                              uint32_t fileSize,
+                              BlockWindow_t * window )
+{
+    DownloadCheckpointHeader_t expected;
+    DownloadCheckpointHeader_t stored;
+    bool opened = true;
+
+    assert( checkpoint != NULL );
+    assert( imagePath != NULL );
+    assert( window != NULL );
+
+    memset( checkpoint, 0, sizeof( DownloadCheckpoint_t ) );
+    checkpoint->fileDescriptor = -1;
+
+    if( ( jobId == NULL ) || ( jobIdLength == 0U ) ||
+        ( jobIdLength > DOWNLOAD_CHECKPOINT_MAX_JOB_ID_LENGTH ) ||
+        ( streamName == NULL ) ||
+        ( streamNameLength > DOWNLOAD_CHECKPOINT_MAX_STREAM_NAME_LENGTH ) )
+    {
+        LogWarn( ( "Job ID or stream name does not fit a checkpoint." ) );
+        opened = false;
+    }
+    else if( !downloadCheckpoint_getPath( imagePath,
+                                          checkpoint->path,
+                                          sizeof( checkpoint->path ) ) )
+    {
+        LogWarn( ( "Checkpoint path of %s is too long.", imagePath ) );
+        opened = false;
+    }
+    else
+    {
+        checkpoint->fileDescriptor = open( checkpoint->path,
+                                           O_RDWR | O_CREAT,
+                                           0644 );
+
+        if( checkpoint->fileDescriptor < 0 )
+        {
+            LogWarn( ( "Failed to open checkpoint %s: %s",
+                       checkpoint->path,
+                       strerror( errno ) ) );
+            opened = false;
+        }
+    }
+
+    if( opened )
+    {
+        memset( &expected, 0, sizeof( expected ) );
+        expected.magic = CHECKPOINT_MAGIC;
+        expected.fileSize = fileSize;
+        expected.blockSize = window->blockSize;
+        expected.fileId = fileId;
+        expected.jobIdLength = ( uint8_t ) jobIdLength;
+        expected.streamNameLength = ( uint8_t ) streamNameLength;
+        memcpy( expected.jobId, jobId, jobIdLength );
+        memcpy( expected.streamName, streamName, streamNameLength );
+
+        if( readHeader( checkpoint, &stored ) &&
+            ( memcmp( &stored, &expected, sizeof( expected ) ) == 0 ) &&
+            imageExists( imagePath, fileSize ) )
+        {
+            LogInfo( ( "Resuming download, %u of %u blocks already stored.",
+                       restoreBitmap( checkpoint, window ),
+                       window->totalBlocks ) );
+        }
+        else if( !startOver( checkpoint, &expected, window ) )
+        {
+            LogWarn( ( "Failed to initialize checkpoint %s: %s",
+                       checkpoint->path,
+                       strerror( errno ) ) );
+            closeCheckpoint( checkpoint );
+            opened = false;
+        }
+        else
+        {
+            /* Empty else. */
+        }
+    }
+
+    return opened;
+}
+/*-----------------------------------------------------------*/
+
+bool downloadCheckpoint_record( DownloadCheckpoint_t * checkpoint,
+                                const BlockWindow_t * window,
+                                uint32_t blockId,
+                                const ImageSink_t * sink )
+{
+    uint32_t byteIndex = blockId / 8U;
+    bool recorded = true;
+
+    assert( checkpoint != NULL );
+    assert( window != NULL );
+    assert( sink != NULL );
+
+    if( ( checkpoint->fileDescriptor < 0 ) ||
+        ( blockId >= window->totalBlocks ) )
+    {
+        recorded = false;
+    }
+    else
+    {
+        if( ( checkpoint->dirtyEnd == 0U ) ||
+            ( byteIndex < checkpoint->dirtyStart ) )
+        {
+            checkpoint->dirtyStart = byteIndex;
+        }
+
+        if( byteIndex >= checkpoint->dirtyEnd )
+        {
+            checkpoint->dirtyEnd = byteIndex + 1U;
+        }
+
+        checkpoint->blocksSinceSync++;
+    }
+
+    /* The image goes to storage before the bitmap bytes are written, so a
+     * bit in the checkpoint always refers to a block that is on storage. */
+    if( recorded &&
+        ( checkpoint->blocksSinceSync >= DOWNLOAD_CHECKPOINT_SYNC_BLOCKS ) &&
+        !flushBitmap( checkpoint, window, sink ) )
+    {
+        LogWarn( ( "Failed to flush checkpoint %s: %s",
+                   checkpoint->path,
+                   strerror( errno ) ) );
+        closeCheckpoint( checkpoint );
+        recorded = false;
+    }
+
+    return recorded;
+}
+/*-----------------------------------------------------------*/
+
+void downloadCheckpoint_remove( DownloadCheckpoint_t * checkpoint )
+{
+    assert( checkpoint != NULL );
+
+    closeCheckpoint( checkpoint );
+
+    if( ( checkpoint->path[ 0 ] != '\0' ) &&
+        ( unlink( checkpoint->path ) != 0 ) && ( errno != ENOENT ) )
+    {
+        LogWarn( ( "Failed to remove checkpoint %s: %s",
+                   checkpoint->path,
+                   strerror( errno ) ) );
+    }
+
+    checkpoint->path[ 0 ] = '\0';
+}
+/*-----------------------------------------------------------*/
+
+bool downloadCheckpoint_getPath( const char * imagePath,
+                                 char * pathBuffer,
+                                 size_t pathBufferSize )
+{
+    int pathLength = 0;
+
+    assert( imagePath != NULL );
+    assert( pathBuffer != NULL );
+
+    pathLength = snprintf( pathBuffer,
+                           pathBufferSize,
+                           "%s%s",
+                           imagePath,
+                           DOWNLOAD_CHECKPOINT_SUFFIX );
+
+    return ( pathLength > 0 ) && ( ( size_t ) pathLength < pathBufferSize );
+}
+/*-----------------------------------------------------------*/
@@ -0,0 +1,185 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file download_checkpoint.h
+ * @brief Persisted record of the blocks of an image that have been stored.
+ *
+ * The checkpoint lives next to the image, in a file of the same name with
+ * #DOWNLOAD_CHECKPOINT_SUFFIX appended. It holds the identity of the download
+ * followed by the received-block bitmap of its BlockWindow_t. Every
+ * #DOWNLOAD_CHECKPOINT_SYNC_BLOCKS stored blocks the image is flushed, then the
+ * bitmap bytes that changed are written and flushed, so a download restarted
+ * for the same job only requests the blocks it is missing.
+ */
+
+#ifndef DOWNLOAD_CHECKPOINT_H_
+#define DOWNLOAD_CHECKPOINT_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "download/block_window.h"
+#include "storage/image_sink.h"
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* *INDENT-ON* */
+
+/**
+ * @brief Appended to the image path to name its checkpoint.
+ */
+#define DOWNLOAD_CHECKPOINT_SUFFIX ".ckpt"
+
+/**
+ * @brief Longest checkpoint path, excluding the terminator.
+ */
+#define DOWNLOAD_CHECKPOINT_MAX_PATH_LENGTH \
+    ( IMAGE_SINK_MAX_PATH_LENGTH + sizeof( DOWNLOAD_CHECKPOINT_SUFFIX ) - 1U )
+
+/**
+ * @brief Number of stored blocks between two flushes of the checkpoint.
+ *
+ * At most this many blocks are downloaded again after a crash or a power
+ * loss.
+ */
+#ifndef DOWNLOAD_CHECKPOINT_SYNC_BLOCKS
+    #define DOWNLOAD_CHECKPOINT_SYNC_BLOCKS 32U
+#endif
+
+/**
+ * @brief Longest job ID a checkpoint can identify.
+ */
+#define DOWNLOAD_CHECKPOINT_MAX_JOB_ID_LENGTH 64U
+
+/**
+ * @brief Longest stream name a checkpoint can identify.
+ */
+#define DOWNLOAD_CHECKPOINT_MAX_STREAM_NAME_LENGTH 128U
+
+/**
+ * @brief Identity of a download, stored at the start of its checkpoint.
+ *
+ * A checkpoint is only resumed if every field matches the download being
+ * started. The layout has no padding so it can be compared with memcmp().
+ */
+typedef struct DownloadCheckpointHeader
+{
+    uint32_t magic;            /**< @brief Format of the checkpoint. */
+    uint32_t fileSize;         /**< @brief Size of the image in bytes. */
+    uint32_t blockSize;        /**< @brief Size of a block in bytes. */
+    uint8_t fileId;            /**< @brief File ID within the stream. */
+    uint8_t jobIdLength;       /**< @brief Length of jobId. */
+    uint8_t streamNameLength;  /**< @brief Length of streamName. */
+    uint8_t reserved;          /**< @brief Always zero. */
+    char jobId[ DOWNLOAD_CHECKPOINT_MAX_JOB_ID_LENGTH ]; /**< @brief Job ID. */
+    char streamName[ DOWNLOAD_CHECKPOINT_MAX_STREAM_NAME_LENGTH ]; /**< @brief
+                                                                      Stream. */
+} DownloadCheckpointHeader_t;
+
+/**
+ * @brief State of an open checkpoint.
+ */
+typedef struct DownloadCheckpoint
+{
+    int32_t fileDescriptor;    /**< @brief Descriptor, -1 when not open. */
+    uint32_t blocksSinceSync;  /**< @brief Blocks recorded since a flush. */
+    uint32_t dirtyStart;       /**< @brief First bitmap byte changed since a
+                                * flush. */
+    uint32_t dirtyEnd;         /**< @brief Past the last bitmap byte changed
+                                * since a flush, 0 when none has. */
+    char path[ DOWNLOAD_CHECKPOINT_MAX_PATH_LENGTH + 1U ]; /**< @brief Path. */
+} DownloadCheckpoint_t;
+
+/**
+ * @brief Open the checkpoint of an image and restore the blocks it records.
+ *
+ * Must be called after @p window has been initialized for the download and
+ * before the image itself is opened. If the checkpoint belongs to another
+ * download, or the image it describes no longer exists, it is started over
+ * and @p window is left empty.
+ *
+ * @param[out] checkpoint Checkpoint to open.
+ * @param[in] imagePath Path the image is downloaded to.
+ * @param[in] jobId ID of the job the image belongs to.
+ * @param[in] jobIdLength Length of @p jobId.
+ * @param[in] streamName Name of the stream the image is downloaded from.
+ * @param[in] streamNameLength Length of @p streamName.
+ * @param[in] fileId File ID of the image within the stream.
+ * @param[in] fileSize Size of the image in bytes.
+ * @param[in, out] window Window the stored blocks are marked received in.
+ *
+ * @return true if the checkpoint is open; false if the download cannot be
+ * checkpointed and will not be resumable.
+ */
+bool downloadCheckpoint_open( DownloadCheckpoint_t * checkpoint,
+                              const char * imagePath,
+                              const char * jobId,
+                              size_t jobIdLength,
+                              const char * streamName,
+                              size_t streamNameLength,
+                              uint8_t fileId,
+                              uint32_t fileSize,
+                              BlockWindow_t * window );
+
+/**
+ * @brief Record that a block has been stored in the image.
+ *
+ * The bitmap byte of the block is kept in @p window until the next flush.
+ * Every #DOWNLOAD_CHECKPOINT_SYNC_BLOCKS blocks the image is flushed through
+ * @p sink, and only then are the changed bitmap bytes written and flushed, so
+ * the checkpoint never claims a block that is not on storage. Does nothing if
+ * the checkpoint is not open.
+ *
+ * @param[in, out] checkpoint Checkpoint of the download.
+ * @param[in] window Window the block was marked received in.
+ * @param[in] blockId Index of the stored block.
+ * @param[in] sink Sink the block was stored through.
+ *
+ * @return true if the block was recorded; false if the checkpoint failed and
+ * was closed, the download carries on without it.
+ */
+bool downloadCheckpoint_record( DownloadCheckpoint_t * checkpoint,
+                                const BlockWindow_t * window,
+                                uint32_t blockId,
+                                const ImageSink_t * sink );
+
+/**
+ * @brief Close and delete the checkpoint once the download has ended.
+ *
+ * Used both when the image has been committed and when it was discarded.
+ *
+ * @param[in, out] checkpoint Checkpoint to remove.
+ */
+void downloadCheckpoint_remove( DownloadCheckpoint_t * checkpoint );
+
+/**
+ * @brief Build the path of the checkpoint of an image.
+ *
+ * @param[in] imagePath Path the image is downloaded to.
+ * @param[out] pathBuffer Buffer for the NULL-terminated path.
+ * @param[in] pathBufferSize Size of @p pathBuffer.
+ *
+ * @return true if the path fits in @p pathBuffer; false otherwise.
+ */
+bool downloadCheckpoint_getPath( const char * imagePath,
+                                 char * pathBuffer,
+                                 size_t pathBufferSize );
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+}
+#endif
+/* *INDENT-ON* */
+
+#endif /* ifndef DOWNLOAD_CHECKPOINT_H_ */
@@ -0,0 +1,303 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file flow_control.c
+ * @brief Adaptive sizing of the download window from measured RTT and loss.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <string.h>
+
+#include "flow_control.h"
+
+/**
+ * @brief A window of this many blocks per block of a request.
+ *
+ * Keeps several requests in flight whatever the window, so the broker always
+ * has the next request when it finishes one.
+ */
+#define WINDOW_BLOCKS_PER_REQUEST_BLOCK 4U
+
+/*-----------------------------------------------------------*/
+
+static uint32_t clamp( uint32_t value, uint32_t min, uint32_t max )
+{
+    uint32_t clamped = value;
+
+    if( clamped < min )
+    {
+        clamped = min;
+    }
+    else if( clamped > max )
+    {
+        clamped = max;
+    }
+    else
+    {
+        /* Empty else. */
+    }
+
+    return clamped;
+}
+/*-----------------------------------------------------------*/
+
+static void removeRequest( FlowControl_t * flowControl, uint32_t index )
+{
+    /* Requests stay in the order they were sent, so the first one is always
+     * the oldest. */
+    flowControl->requestCount--;
+    memmove( &flowControl->requests[ index ],
+             &flowControl->requests[ index + 1U ],
+             ( flowControl->requestCount - index ) * sizeof( FlowRequest_t ) );
+}
+/*-----------------------------------------------------------*/
+
+/* RFC 6298, section 2 */
+static void sampleRtt( FlowControl_t * flowControl, uint32_t rttMs )
+{
+    uint32_t deviationMs = 0U;
+
+    if( flowControl->smoothedRttMs == 0U )
+    {
+        flowControl->smoothedRttMs = ( rttMs > 0U ) ? rttMs : 1U;
+        flowControl->rttVariationMs = rttMs / 2U;
+    }
+    else
+    {
+        deviationMs = ( flowControl->smoothedRttMs > rttMs ) ?
+                      ( flowControl->smoothedRttMs - rttMs ) :
+                      ( rttMs - flowControl->smoothedRttMs );
+        flowControl->rttVariationMs = ( ( 3U * flowControl->rttVariationMs ) +
+                                        deviationMs ) / 4U;
+        flowControl->smoothedRttMs = ( ( 7U * flowControl->smoothedRttMs ) +
+                                       rttMs ) / 8U;
+    }
+
+    flowControl->timeoutMs = clamp( flowControl->smoothedRttMs +
+                                    ( 4U * flowControl->rttVariationMs ),
+                                    FLOW_CONTROL_MIN_TIMEOUT_MS,
+                                    FLOW_CONTROL_MAX_TIMEOUT_MS );
+}
+/*-----------------------------------------------------------*/
+
+static void growWindow( FlowControl_t * flowControl )
+{
+    if( flowControl->window < flowControl->slowStartThreshold )
+    {
+        flowControl->window++;
+    }
+    else
+    {
+        flowControl->blocksSinceGrowth++;
+
+        if( flowControl->blocksSinceGrowth >= flowControl->window )
+        {
+            flowControl->blocksSinceGrowth = 0U;
+            flowControl->window++;
+        }
+    }
+
+    if( flowControl->window > flowControl->maxWindow )
+    {
+        flowControl->window = flowControl->maxWindow;
+    }
+}
+/*-----------------------------------------------------------*/
+
+void flowControl_init( FlowControl_t * flowControl,
+                       uint32_t maxWindow,
+                       uint32_t maxBlocksPerRequest )
+{
+    assert( flowControl != NULL );
+    assert( ( maxWindow >= FLOW_CONTROL_MIN_WINDOW ) &&
+            ( maxWindow <= FLOW_CONTROL_MAX_REQUESTS ) );
+    assert( maxBlocksPerRequest > 0U );
+
+    memset( flowControl, 0, sizeof( FlowControl_t ) );
+
+    flowControl->maxWindow = maxWindow;
+    flowControl->maxBlocksPerRequest = maxBlocksPerRequest;
+    flowControl->window = clamp( FLOW_CONTROL_INITIAL_WINDOW,
+                                 FLOW_CONTROL_MIN_WINDOW,
+                                 maxWindow );
+    flowControl->slowStartThreshold = maxWindow;
+    flowControl->timeoutMs = FLOW_CONTROL_INITIAL_TIMEOUT_MS;
+}
+/*-----------------------------------------------------------*/
+
+void flowControl_apply( const FlowControl_t * flowControl,
+                        BlockWindow_t * window )
+{
+    assert( flowControl != NULL );
+    assert( window != NULL );
+
+    blockWindow_setLimits( window,
+                           flowControl->window,
+                           clamp( flowControl->window /
+                                  WINDOW_BLOCKS_PER_REQUEST_BLOCK,
+                                  1U,
+                                  flowControl->maxBlocksPerRequest ) );
+}
+/*-----------------------------------------------------------*/
+
+bool flowControl_canRequest( const FlowControl_t * flowControl )
+{
+    assert( flowControl != NULL );
+
+    return flowControl->requestCount < FLOW_CONTROL_MAX_REQUESTS;
+}
+/*-----------------------------------------------------------*/
+
+bool flowControl_onRequest( FlowControl_t * flowControl,
+                            uint32_t firstBlock,
+                            uint32_t numBlocks,
+                            uint32_t nowMs )
+{
+    FlowRequest_t * request = NULL;
+    bool timed = false;
+
+    assert( flowControl != NULL );
+
+    /* Every timed request has a block in flight, so this cannot happen while
+     * the window is within FLOW_CONTROL_MAX_REQUESTS. */
+    if( !flowControl_canRequest( flowControl ) )
+    {
+        flowControl->untimedRequests++;
+    }
+    else
+    {
+        request = &flowControl->requests[ flowControl->requestCount ];
+        request->firstBlock = firstBlock;
+        request->numBlocks = numBlocks;
+        request->blocksPending = numBlocks;
+        request->sentAtMs = nowMs;
+        request->sequence = flowControl->nextSequence;
+        flowControl->nextSequence++;
+
+        /* Karn's algorithm: a block asked for twice cannot tell which request
+         * it answers. */
+        request->retransmission = firstBlock < flowControl->highestRequested;
+
+        flowControl->requestCount++;
+        timed = true;
+    }
+
+    if( ( firstBlock + numBlocks ) > flowControl->highestRequested )
+    {
+        flowControl->highestRequested = firstBlock + numBlocks;
+    }
+
+    return timed;
+}
+/*-----------------------------------------------------------*/
+
+void flowControl_onBlock( FlowControl_t * flowControl,
+                          uint32_t blockId,
+                          uint32_t nowMs )
+{
+    FlowRequest_t * request = NULL;
+    uint32_t index = 0U;
+
+    assert( flowControl != NULL );
+
+    for( index = 0U; index < flowControl->requestCount; index++ )
+    {
+        request = &flowControl->requests[ index ];
+
+        if( ( blockId >= request->firstBlock ) &&
+            ( ( blockId - request->firstBlock ) < request->numBlocks ) )
+        {
+            break;
+        }
+    }
+
+    /* A block of a request that timed out is still worth its growth. */
+    if( index < flowControl->requestCount )
+    {
+        if( !request->retransmission )
+        {
+            sampleRtt( flowControl, nowMs - request->sentAtMs );
+        }
+
+        request->blocksPending--;
+
+        if( request->blocksPending == 0U )
+        {
+            removeRequest( flowControl, index );
+        }
+    }
+
+    growWindow( flowControl );
+}
+/*-----------------------------------------------------------*/
+
+bool flowControl_hasExpired( const FlowControl_t * flowControl,
+                             uint32_t nowMs )
+{
+    assert( flowControl != NULL );
+
+    return ( flowControl->requestCount > 0U ) &&
+           ( ( nowMs - flowControl->requests[ 0 ].sentAtMs ) >=
+             flowControl->timeoutMs );
+}
+/*-----------------------------------------------------------*/
+
+bool flowControl_takeExpired( FlowControl_t * flowControl,
+                              uint32_t nowMs,
+                              uint32_t * firstBlock,
+                              uint32_t * numBlocks )
+{
+    const FlowRequest_t * oldest = NULL;
+    bool expired = false;
+
+    assert( flowControl != NULL );
+    assert( ( firstBlock != NULL ) && ( numBlocks != NULL ) );
+
+    expired = flowControl_hasExpired( flowControl, nowMs );
+
+    if( expired )
+    {
+        oldest = &flowControl->requests[ 0 ];
+
+        /* Sequence numbers wrap, so they are compared by difference. */
+        if( ( int32_t ) ( oldest->sequence -
+                          flowControl->recoverSequence ) >= 0 )
+        {
+            /* Multiplicative decrease, and exponential backoff of the
+             * timeout until a request is answered again. */
+            flowControl->window = clamp( flowControl->window / 2U,
+                                         FLOW_CONTROL_MIN_WINDOW,
+                                         flowControl->maxWindow );
+            flowControl->slowStartThreshold = flowControl->window;
+            flowControl->blocksSinceGrowth = 0U;
+            flowControl->timeoutMs = clamp( flowControl->timeoutMs * 2U,
+                                            FLOW_CONTROL_MIN_TIMEOUT_MS,
+                                            FLOW_CONTROL_MAX_TIMEOUT_MS );
+            flowControl->recoverSequence = flowControl->nextSequence;
+        }
+
+        *firstBlock = oldest->firstBlock;
+        *numBlocks = oldest->numBlocks;
+        flowControl->timeouts++;
+        removeRequest( flowControl, 0U );
+    }
+
+    return expired;
+}
+/*-----------------------------------------------------------*/
+
+void flowControl_clearRequests( FlowControl_t * flowControl )
+{
+    assert( flowControl != NULL );
+
+    flowControl->requestCount = 0U;
+}
+/*-----------------------------------------------------------*/
@@ -0,0 +1,244 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file flow_control.h
+ * @brief Adaptive sizing of the download window from measured RTT and loss.
+ *
+ * Each block request is timed until its blocks arrive. The round trip times
+ * give a retransmission timeout as in RFC 6298, and the window of blocks in
+ * flight grows by one block per block received until the first loss (slow
+ * start), then by one block per window (congestion avoidance). A request
+ * that is not answered within the timeout is handed back so that only its
+ * missing blocks are requested again, and halves the window and doubles the
+ * timeout once per loss. Requests ask for more consecutive blocks as the
+ * window grows, so a fast link needs fewer of them.
+ *
+ * Every request is given the same timeout, so requests expire in the order
+ * they were sent and the oldest one is the only one to check.
+ */
+
+#ifndef FLOW_CONTROL_H_
+#define FLOW_CONTROL_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "download/block_window.h"
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* *INDENT-ON* */
+
+/**
+ * @brief Most requests that can be timed at once.
+ *
+ * Every request asks for at least one block, so this bounds the largest
+ * window a controller can be given.
+ */
+#ifndef FLOW_CONTROL_MAX_REQUESTS
+    #define FLOW_CONTROL_MAX_REQUESTS 32U
+#endif
+
+/**
+ * @brief Window the download starts with, in blocks.
+ */
+#ifndef FLOW_CONTROL_INITIAL_WINDOW
+    #define FLOW_CONTROL_INITIAL_WINDOW 4U
+#endif
+
+/**
+ * @brief Smallest window, in blocks.
+ */
+#ifndef FLOW_CONTROL_MIN_WINDOW
+    #define FLOW_CONTROL_MIN_WINDOW 1U
+#endif
+
+/**
+ * @brief Timeout used until the first round trip has been measured.
+ */
+#ifndef FLOW_CONTROL_INITIAL_TIMEOUT_MS
+    #define FLOW_CONTROL_INITIAL_TIMEOUT_MS 1000U
+#endif
+
+/**
+ * @brief Lower bound on the timeout.
+ */
+#ifndef FLOW_CONTROL_MIN_TIMEOUT_MS
+    #define FLOW_CONTROL_MIN_TIMEOUT_MS 200U
+#endif
+
+/**
+ * @brief Upper bound on the timeout, including its backoff.
+ */
+#ifndef FLOW_CONTROL_MAX_TIMEOUT_MS
+    #define FLOW_CONTROL_MAX_TIMEOUT_MS 8000U
+#endif
+
+/**
+ * @brief A request whose blocks have not all arrived.
+ */
+typedef struct FlowRequest
+{
+    uint32_t firstBlock;      /**< @brief First block asked for. */
+    uint32_t numBlocks;       /**< @brief Blocks asked for. */
+    uint32_t blocksPending;   /**< @brief Blocks that have not arrived. */
+    uint32_t sentAtMs;        /**< @brief Time the request was sent. */
+    uint32_t sequence;        /**< @brief Order in which it was sent. */
+    bool retransmission;      /**< @brief Asks for blocks asked for before, so
+                               * its round trip is not measured. */
+} FlowRequest_t;
+
+/**
+ * @brief State of the controller of one download.
+ */
+typedef struct FlowControl
+{
+    FlowRequest_t requests[ FLOW_CONTROL_MAX_REQUESTS ]; /**< @brief Timed
+                                                            requests. */
+    uint32_t requestCount;       /**< @brief Requests in use. */
+    uint32_t highestRequested;   /**< @brief One past the highest block ever
+                                  * requested. */
+    uint32_t smoothedRttMs;      /**< @brief SRTT, 0 before the first
+                                  * sample. */
+    uint32_t rttVariationMs;     /**< @brief RTTVAR. */
+    uint32_t timeoutMs;          /**< @brief Retransmission timeout. */
+    uint32_t window;             /**< @brief Blocks allowed in flight. */
+    uint32_t slowStartThreshold; /**< @brief Window where slow start ends. */
+    uint32_t blocksSinceGrowth;  /**< @brief Blocks received since the window
+                                  * last grew in congestion avoidance. */
+    uint32_t maxWindow;          /**< @brief Largest window. */
+    uint32_t maxBlocksPerRequest; /**< @brief Largest request. */
+    uint32_t nextSequence;       /**< @brief Sequence of the next request. */
+    uint32_t recoverSequence;    /**< @brief Requests sent before this one
+                                  * belong to the last loss. */
+    uint32_t timeouts;           /**< @brief Requests that expired since the
+                                  * start. */
+    uint32_t untimedRequests;    /**< @brief Requests refused by
+                                  * flowControl_onRequest() since the start. */
+} FlowControl_t;
+
+/**
+ * @brief Start controlling a new download.
+ *
+ * @param[out] flowControl Controller to initialize.
+ * @param[in] maxWindow Largest number of blocks in flight, at most
+ * #FLOW_CONTROL_MAX_REQUESTS.
+ * @param[in] maxBlocksPerRequest Largest number of blocks in one request.
+ */
+void flowControl_init( FlowControl_t * flowControl,
+                       uint32_t maxWindow,
+                       uint32_t maxBlocksPerRequest );
+
+/**
+ * @brief Size a block window to the current window of the controller.
+ *
+ * Called before blocks are requested from @p window.
+ *
+ * @param[in] flowControl Controller of the download.
+ * @param[in, out] window Window whose limits are set.
+ */
+void flowControl_apply( const FlowControl_t * flowControl,
+                        BlockWindow_t * window );
+
+/**
+ * @brief Check whether another request can be timed.
+ *
+ * New requests are deferred while this is false, they are sent again once a
+ * request has been answered.
+ *
+ * @param[in] flowControl Controller of the download.
+ *
+ * @return true if fewer than #FLOW_CONTROL_MAX_REQUESTS requests are timed.
+ */
+bool flowControl_canRequest( const FlowControl_t * flowControl );
+
+/**
+ * @brief Start timing a request that has just been sent.
+ *
+ * A request that does not fit is refused and counted in untimedRequests,
+ * the requests already timed are kept. Its blocks are not requested again
+ * if they are lost.
+ *
+ * @param[in, out] flowControl Controller of the download.
+ * @param[in] firstBlock First block asked for.
+ * @param[in] numBlocks Number of blocks asked for.
+ * @param[in] nowMs Current time in milliseconds.
+ *
+ * @return true if the request is timed; false if every request slot is in
+ * use.
+ */
+bool flowControl_onRequest( FlowControl_t * flowControl,
+                            uint32_t firstBlock,
+                            uint32_t numBlocks,
+                            uint32_t nowMs );
+
+/**
+ * @brief Account for a new block and grow the window.
+ *
+ * @param[in, out] flowControl Controller of the download.
+ * @param[in] blockId Index of the block that arrived.
+ * @param[in] nowMs Current time in milliseconds.
+ */
+void flowControl_onBlock( FlowControl_t * flowControl,
+                          uint32_t blockId,
+                          uint32_t nowMs );
+
+/**
+ * @brief Check whether the oldest request has gone unanswered too long.
+ *
+ * @param[in] flowControl Controller of the download.
+ * @param[in] nowMs Current time in milliseconds.
+ *
+ * @return true if flowControl_takeExpired() would return a request.
+ */
+bool flowControl_hasExpired( const FlowControl_t * flowControl,
+                             uint32_t nowMs );
+
+/**
+ * @brief Take the oldest request if it has gone unanswered too long.
+ *
+ * The first request to expire after a loss halves the window and doubles the
+ * timeout. Requests sent before that belong to the same loss and are handed
+ * back without shrinking the window again. The caller requests the blocks of
+ * the request that have still not arrived, and calls this again until it
+ * returns false.
+ *
+ * @param[in, out] flowControl Controller of the download.
+ * @param[in] nowMs Current time in milliseconds.
+ * @param[out] firstBlock First block of the expired request.
+ * @param[out] numBlocks Number of blocks of the expired request.
+ *
+ * @return true if a request expired; false otherwise.
+ */
+bool flowControl_takeExpired( FlowControl_t * flowControl,
+                              uint32_t nowMs,
+                              uint32_t * firstBlock,
+                              uint32_t * numBlocks );
+
+/**
+ * @brief Forget every request in flight without shrinking the window.
+ *
+ * Used when the requests were lost for a reason other than congestion, such
+ * as a reconnect.
+ *
+ * @param[in, out] flowControl Controller of the download.
+ */
+void flowControl_clearRequests( FlowControl_t * flowControl );
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+}
+#endif
+/* *INDENT-ON* */
+
+#endif /* ifndef FLOW_CONTROL_H_ */
@@ -0,0 +1,361 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file image_verifier.c
+ * @brief Implementation of the streaming image verification.
+ */
+
+#define LIBRARY_LOG_NAME  "ImageVerifier"
+#define LIBRARY_LOG_LEVEL LOG_INFO
+#include "csdk_logging/logging.h"
+
+/* Standard includes. */
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+/* OpenSSL includes. */
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+
+#include "image_verifier.h"
+#include "utils/base64.h"
+
+/**
+ * @brief Size of the hexadecimal text of a digest.
+ */
+#define DIGEST_TEXT_SIZE ( ( 2U * IMAGE_DIGEST_LENGTH ) + 1U )
+
+/*-----------------------------------------------------------*/
+
+static uint32_t blockLength( const ImageVerifier_t * verifier,
+                             uint32_t blockId )
+{
+    uint32_t offset = blockId * verifier->blockSize;
+    uint32_t remaining = verifier->fileSize - offset;
+
+    return ( remaining < verifier->blockSize ) ? remaining :
+           verifier->blockSize;
+}
+/*-----------------------------------------------------------*/
+
+/* Hashes blocks in file order for as long as the next one is in, from the
+ * reorder buffer or else from storage, and stops before stopBlock. */
+static bool hashReceivedBlocks( ImageVerifier_t * verifier,
+                                const BlockWindow_t * window,
+                                const ImageSink_t * sink,
+                                uint32_t stopBlock )
+{
+    uint32_t slot = 0U;
+    uint32_t length = 0U;
+    bool success = true;
+
+    while( success && ( verifier->nextBlock != stopBlock ) &&
+           blockWindow_isReceived( window, verifier->nextBlock ) )
+    {
+        slot = verifier->nextBlock % IMAGE_VERIFIER_REORDER_BLOCKS;
+        length = blockLength( verifier, verifier->nextBlock );
+
+        /* Blocks waiting in the buffer are never more than a buffer ahead,
+         * so the slot of the next block holds nothing else. */
+        if( !verifier->slotsUsed[ slot ] ||
+            ( verifier->slotBlocks[ slot ] != verifier->nextBlock ) )
+        {
+            success = sink->read( sink->pContext,
+                                  ( size_t ) verifier->nextBlock *
+                                  verifier->blockSize,
+                                  verifier->slots[ slot ],
+                                  length ) == IMAGE_SINK_SUCCESS;
+            verifier->blocksRead++;
+        }
+
+        success = success &&
+                  ( verifier->digest.update( &verifier->digestContext,
+                                             verifier->slots[ slot ],
+                                             length ) == IMAGE_DIGEST_SUCCESS );
+        verifier->slotsUsed[ slot ] = false;
+        verifier->nextBlock++;
+    }
+
+    return success;
+}
+/*-----------------------------------------------------------*/
+
+static void logDigest( const ImageVerifier_t * verifier,
+                       const ImageSink_t * sink,
+                       const uint8_t * digest )
+{
+    char digestText[ DIGEST_TEXT_SIZE ] = { 0 };
+
+    for( size_t i = 0U; i < IMAGE_DIGEST_LENGTH; i++ )
+    {
+        ( void ) snprintf( &digestText[ 2U * i ], 3U, "%02x", digest[ i ] );
+    }
+
+    LogInfo( ( "SHA-256 of %s is %s, %u blocks were read back from storage.",
+               sink->getPath( sink->pContext ),
+               digestText,
+               verifier->blocksRead ) );
+}
+/*-----------------------------------------------------------*/
+
+static bool verifySignature( const ImageVerifier_t * verifier,
+                             const uint8_t * digest )
+{
+    FILE * certFile = NULL;
+    X509 * cert = NULL;
+    EVP_PKEY * key = NULL;
+    EVP_PKEY_CTX * keyContext = NULL;
+    bool verified = false;
+
+    certFile = fopen( verifier->certPath, "r" );
+
+    if( certFile != NULL )
+    {
+        cert = PEM_read_X509( certFile, NULL, NULL, NULL );
+        ( void ) fclose( certFile );
+    }
+
+    if( cert != NULL )
+    {
+        key = X509_get_pubkey( cert );
+    }
+
+    if( key != NULL )
+    {
+        keyContext = EVP_PKEY_CTX_new( key, NULL );
+    }
+
+    /* The signature is over the SHA-256 digest, with ECDSA or RSA according
+     * to the key of the certificate. */
+    if( keyContext == NULL )
+    {
+        LogError( ( "Failed to load the code signing certificate %s.",
+                    verifier->certPath ) );
+    }
+    else
+    {
+        verified = ( EVP_PKEY_verify_init( keyContext ) == 1 ) &&
+                   ( EVP_PKEY_CTX_set_signature_md( keyContext,
+                                                    EVP_sha256() ) == 1 ) &&
+                   ( EVP_PKEY_verify( keyContext,
+                                      verifier->signature,
+                                      verifier->signatureLength,
+                                      digest,
+                                      IMAGE_DIGEST_LENGTH ) == 1 );
+    }
+
+    EVP_PKEY_CTX_free( keyContext );
+    EVP_PKEY_free( key );
+    X509_free( cert );
+
+    return verified;
+}
+/*-----------------------------------------------------------*/
+
+bool imageVerifier_init( ImageVerifier_t * verifier,
+                         const BlockWindow_t * window,
+                         uint32_t fileSize,
+                         const char * signature,
+                         size_t signatureLength,
+                         const char * certPath,
+                         size_t certPathLength )
+{
+    bool success = true;
+
+    assert( verifier != NULL );
+    assert( window != NULL );
+
+    imageVerifier_cleanup( verifier );
+
+    verifier->fileSize = fileSize;
+    verifier->blockSize = window->blockSize;
+    verifier->nextBlock = 0U;
+    verifier->blocksRead = 0U;
+    verifier->signatureLength = 0U;
+    verifier->certPath[ 0 ] = '\0';
+    memset( verifier->slotsUsed, 0, sizeof( verifier->slotsUsed ) );
+
+    if( window->blockSize > IMAGE_VERIFIER_MAX_BLOCK_SIZE )
+    {
+        LogError( ( "Blocks of %u bytes are too large to verify.",
+                    window->blockSize ) );
+        success = false;
+    }
+    else if( ( signature != NULL ) && ( signatureLength > 0U ) &&
+             !base64_decode( ( const uint8_t * ) signature,
+                             signatureLength,
+                             verifier->signature,
+                             sizeof( verifier->signature ),
+                             &verifier->signatureLength ) )
+    {
+        LogError( ( "Signature of the image is not valid base64 or too "
+                    "long." ) );
+        success = false;
+    }
+    else if( ( verifier->signatureLength > 0U ) &&
+             ( ( certPath == NULL ) || ( certPathLength == 0U ) ||
+               ( certPathLength > IMAGE_VERIFIER_MAX_CERT_PATH_LENGTH ) ) )
+    {
+        LogError( ( "Code signing certificate path is missing or too "
+                    "long." ) );
+        success = false;
+    }
+    else
+    {
+        if( verifier->signatureLength > 0U )
+        {
+            memcpy( verifier->certPath, certPath, certPathLength );
+            verifier->certPath[ certPathLength ] = '\0';
+        }
+
+        imageDigest_select( &verifier->digest );
+        success = verifier->digest.init( &verifier->digestContext ) ==
+                  IMAGE_DIGEST_SUCCESS;
+
+        if( !success )
+        {
+            LogError( ( "Failed to start the image digest." ) );
+            imageVerifier_cleanup( verifier );
+        }
+    }
+
+    return success;
+}
+/*-----------------------------------------------------------*/
+
+bool imageVerifier_addBlock( ImageVerifier_t * verifier,
+                             const BlockWindow_t * window,
+                             const ImageSink_t * sink,
+                             uint32_t blockId,
+                             const uint8_t * data,
+                             size_t length )
+{
+    uint32_t slot = blockId % IMAGE_VERIFIER_REORDER_BLOCKS;
+    bool success = false;
+
+    assert( verifier != NULL );
+    assert( verifier->digest.update != NULL );
+    assert( window != NULL );
+    assert( sink != NULL );
+    assert( data != NULL );
+
+    /* Blocks restored from a checkpoint are caught up with first, so the
+     * new block is placed against the real start of the buffer. */
+    success = hashReceivedBlocks( verifier, window, sink, blockId );
+
+    if( success && ( blockId == verifier->nextBlock ) )
+    {
+        /* In order, hashed straight from the caller's buffer. */
+        success = verifier->digest.update( &verifier->digestContext,
+                                           data,
+                                           length ) == IMAGE_DIGEST_SUCCESS;
+        verifier->nextBlock++;
+    }
+    else if( success && ( blockId > verifier->nextBlock ) &&
+             ( ( blockId - verifier->nextBlock ) <
+               IMAGE_VERIFIER_REORDER_BLOCKS ) &&
+             ( length <= IMAGE_VERIFIER_MAX_BLOCK_SIZE ) )
+    {
+        memcpy( verifier->slots[ slot ], data, length );
+        verifier->slotBlocks[ slot ] = blockId;
+        verifier->slotsUsed[ slot ] = true;
+    }
+    else
+    {
+        /* Too far ahead, it is read back from storage when its turn
+         * comes. */
+    }
+
+    return success &&
+           hashReceivedBlocks( verifier, window, sink, window->totalBlocks );
+}
+/*-----------------------------------------------------------*/
+
+bool imageVerifier_finish( ImageVerifier_t * verifier,
+                           const BlockWindow_t * window,
+                           const ImageSink_t * sink )
+{
+    uint8_t digest[ IMAGE_DIGEST_LENGTH ];
+    bool success = false;
+
+    assert( verifier != NULL );
+    assert( verifier->digest.update != NULL );
+    assert( window != NULL );
+    assert( sink != NULL );
+
+    /* Only blocks restored from a checkpoint and never followed by a new
+     * block are still to hash here. */
+    success = hashReceivedBlocks( verifier,
+                                  window,
+                                  sink,
+                                  window->totalBlocks ) &&
+              ( verifier->nextBlock == window->totalBlocks ) &&
+              ( verifier->digest.final( &verifier->digestContext,
+                                        digest ) == IMAGE_DIGEST_SUCCESS );
+
+    if( !success )
+    {
+        LogError( ( "Failed to compute the digest of %s.",
+                    sink->getPath( sink->pContext ) ) );
+    }
+    else if( verifier->signatureLength > 0U )
+    {
+        logDigest( verifier, sink, digest );
+        success = verifySignature( verifier, digest );
+
+        if( success )
+        {
+            LogInfo( ( "Signature of %s verified with %s.",
+                       sink->getPath( sink->pContext ),
+                       verifier->certPath ) );
+        }
+        else
+        {
+            LogError( ( "Signature of %s does not match.",
+                        sink->getPath( sink->pContext ) ) );
+        }
+    }
+    else
+    {
+        logDigest( verifier, sink, digest );
+        success = IMAGE_VERIFIER_REQUIRE_SIGNATURE == 0;
+
+        if( success )
+        {
+            LogWarn( ( "Image %s is not signed.",
+                       sink->getPath( sink->pContext ) ) );
+        }
+        else
+        {
+            LogError( ( "Image %s is not signed, rejecting it.",
+                        sink->getPath( sink->pContext ) ) );
+        }
+    }
+
+    imageVerifier_cleanup( verifier );
+
+    return success;
+}
+/*-----------------------------------------------------------*/
+
+void imageVerifier_cleanup( ImageVerifier_t * verifier )
+{
+    assert( verifier != NULL );
+
+    /* Nothing to release before the first image. */
+    if( verifier->digest.cleanup != NULL )
+    {
+        verifier->digest.cleanup( &verifier->digestContext );
+    }
+
+    memset( &verifier->digest, 0, sizeof( verifier->digest ) );
+}
+/*-----------------------------------------------------------*/
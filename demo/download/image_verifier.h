@@ -0,0 +1,192 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file image_verifier.h
+ * @brief SHA-256 of an image computed while it downloads, and verification
+ * of its code signature.
+ *
+ * Blocks are hashed in file order as they arrive. A block that arrives ahead
+ * of the next one to hash is kept in a small reorder buffer until the blocks
+ * before it are in. Blocks that are not in memory when their turn comes,
+ * because they were stored by an earlier run or arrived too far ahead, are
+ * read back from the image sink. Once the last block is in, only the
+ * signature check is left.
+ */
+
+#ifndef IMAGE_VERIFIER_H_
+#define IMAGE_VERIFIER_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "MQTTFileDownloader.h"
+#include "digest/image_digest.h"
+#include "download/block_window.h"
+#include "storage/image_sink.h"
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* *INDENT-ON* */
+
+/**
+ * @brief Blocks that can wait in memory for the blocks before them.
+ *
+ * Matches the largest window of the demos, so blocks only come back from
+ * storage after a loss that the window outran.
+ */
+#ifndef IMAGE_VERIFIER_REORDER_BLOCKS
+    #define IMAGE_VERIFIER_REORDER_BLOCKS 16U
+#endif
+
+/**
+ * @brief Largest block that can be hashed.
+ */
+#ifndef IMAGE_VERIFIER_MAX_BLOCK_SIZE
+    #define IMAGE_VERIFIER_MAX_BLOCK_SIZE mqttFileDownloader_CONFIG_BLOCK_SIZE
+#endif
+
+/**
+ * @brief Largest decoded signature, enough for RSA-4096.
+ */
+#ifndef IMAGE_VERIFIER_MAX_SIGNATURE_LENGTH
+    #define IMAGE_VERIFIER_MAX_SIGNATURE_LENGTH 512U
+#endif
+
+/**
+ * @brief Longest path of a code signing certificate.
+ */
+#ifndef IMAGE_VERIFIER_MAX_CERT_PATH_LENGTH
+    #define IMAGE_VERIFIER_MAX_CERT_PATH_LENGTH 255U
+#endif
+
+/**
+ * @brief Set to 0 to accept images whose job document carries no signature.
+ *
+ * On by default, so an image is only committed once its signature has been
+ * checked. The digest of an unsigned image is logged either way.
+ */
+#ifndef IMAGE_VERIFIER_REQUIRE_SIGNATURE
+    #define IMAGE_VERIFIER_REQUIRE_SIGNATURE 1
+#endif
+
+/**
+ * @brief State of the verification of one image.
+ */
+typedef struct ImageVerifier
+{
+    ImageDigest_t digest;       /**< @brief Backend hashing the image. */
+    ImageDigestContext_t digestContext; /**< @brief SHA-256 of the blocks
+                                         * hashed. */
+    uint32_t fileSize;          /**< @brief Size of the image. */
+    uint32_t blockSize;         /**< @brief Size of every block but the last. */
+    uint32_t nextBlock;         /**< @brief Blocks before it are hashed. */
+    uint32_t blocksRead;        /**< @brief Blocks hashed from storage. */
+    size_t signatureLength;     /**< @brief 0 for an unsigned image. */
+
+    /** @brief Block held by each slot of the reorder buffer. */
+    uint32_t slotBlocks[ IMAGE_VERIFIER_REORDER_BLOCKS ];
+
+    /** @brief Slots of the reorder buffer that hold a block. */
+    bool slotsUsed[ IMAGE_VERIFIER_REORDER_BLOCKS ];
+
+    /** @brief Reorder buffer, a block waits in slot blockId modulo
+     * #IMAGE_VERIFIER_REORDER_BLOCKS. */
+    uint8_t slots[ IMAGE_VERIFIER_REORDER_BLOCKS ][ IMAGE_VERIFIER_MAX_BLOCK_SIZE ];
+
+    /** @brief Decoded signature. */
+    uint8_t signature[ IMAGE_VERIFIER_MAX_SIGNATURE_LENGTH ];
+
+    /** @brief Code signing certificate, NULL terminated. */
+    char certPath[ IMAGE_VERIFIER_MAX_CERT_PATH_LENGTH + 1U ];
+} ImageVerifier_t;
+
+/**
+ * @brief Start verifying an image.
+ *
+ * Called once the window of the download has been restored from its
+ * checkpoint, if any. The signature and certificate path are copied, so the
+ * job document they come from may be released.
+ *
+ * @param[in, out] verifier Verifier to initialize. A verifier still in use
+ * is released first.
+ * @param[in] window Window of the download.
+ * @param[in] fileSize Size of the image in bytes.
+ * @param[in] signature Base64 signature from the job document, may be NULL.
+ * @param[in] signatureLength Length of @p signature.
+ * @param[in] certPath Path of the code signing certificate from the job
+ * document.
+ * @param[in] certPathLength Length of @p certPath.
+ *
+ * @return true if the verifier is ready; false if the signature, the
+ * certificate path or the block size do not fit.
+ */
+bool imageVerifier_init( ImageVerifier_t * verifier,
+                         const BlockWindow_t * window,
+                         uint32_t fileSize,
+                         const char * signature,
+                         size_t signatureLength,
+                         const char * certPath,
+                         size_t certPathLength );
+
+/**
+ * @brief Hash a new block and every block after it that is already in.
+ *
+ * Called after the block has been marked received and stored.
+ *
+ * @param[in, out] verifier Verifier of the image.
+ * @param[in] window Window of the download.
+ * @param[in] sink Sink the image is stored in.
+ * @param[in] blockId Index of the block.
+ * @param[in] data Content of the block.
+ * @param[in] length Length of @p data.
+ *
+ * @return true on success; false if a block could not be read back or
+ * hashed.
+ */
+bool imageVerifier_addBlock( ImageVerifier_t * verifier,
+                             const BlockWindow_t * window,
+                             const ImageSink_t * sink,
+                             uint32_t blockId,
+                             const uint8_t * data,
+                             size_t length );
+
+/**
+ * @brief Finish the digest of a complete image and check its signature.
+ *
+ * Called before the sink is closed. The verifier is released.
+ *
+ * @param[in, out] verifier Verifier of the image.
+ * @param[in] window Window of the download, complete.
+ * @param[in] sink Sink the image is stored in.
+ *
+ * @return true if the image may be used; false otherwise.
+ */
+bool imageVerifier_finish( ImageVerifier_t * verifier,
+                           const BlockWindow_t * window,
+                           const ImageSink_t * sink );
+
+/**
+ * @brief Release a verifier whose download was abandoned.
+ *
+ * @param[in, out] verifier Verifier to release.
+ */
+void imageVerifier_cleanup( ImageVerifier_t * verifier );
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+}
+#endif
+/* *INDENT-ON* */
+
+#endif /* ifndef IMAGE_VERIFIER_H_ */
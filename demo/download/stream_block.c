@@ -0,0 +1,338 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file stream_block.c
+ * @brief In place decoding of MQTT stream data block messages.
+ *
+ * A data block message is a map with the keys "f" (file id), "i" (block id),
+ * "l" (block length) and "p" (payload). CBOR messages are walked with a small
+ * reader that only understands the items such a map contains, which lets the
+ * payload byte string be used where it lies in the receive buffer.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <string.h>
+
+#include "core_json.h"
+
+#include "stream_block.h"
+#include "utils/base64.h"
+
+/**
+ * @brief CBOR major types used by data block messages.
+ */
+#define CBOR_MAJOR_UNSIGNED    0U
+#define CBOR_MAJOR_NEGATIVE    1U
+#define CBOR_MAJOR_BYTE_STRING 2U
+#define CBOR_MAJOR_TEXT_STRING 3U
+#define CBOR_MAJOR_MAP         5U
+#define CBOR_MAJOR_SIMPLE      7U
+
+/**
+ * @brief Largest additional information value that holds an argument inline.
+ */
+#define CBOR_INLINE_ARGUMENT_MAX 23U
+
+/**
+ * @brief Additional information value for an 8-byte argument.
+ */
+#define CBOR_ARGUMENT_8_BYTES    27U
+
+/**
+ * @brief Keys of a data block message.
+ */
+#define KEY_FILE_ID      'f'
+#define KEY_BLOCK_ID     'i'
+#define KEY_BLOCK_LENGTH 'l'
+#define KEY_PAYLOAD      'p'
+
+/**
+ * @brief Read position in a CBOR message.
+ */
+typedef struct CborReader
+{
+    const uint8_t * data;
+    size_t length;
+    size_t offset;
+} CborReader_t;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Read the head of the next CBOR data item.
+ *
+ * Indefinite length items are rejected, the service never sends them.
+ */
+static bool readCborHead( CborReader_t * reader,
+                          uint8_t * majorType,
+                          uint64_t * argument )
+{
+    bool valid = reader->offset < reader->length;
+    uint8_t initialByte = 0U;
+    uint8_t additionalInfo = 0U;
+    size_t argumentLength = 0U;
+
+    if( valid )
+    {
+        initialByte = reader->data[ reader->offset ];
+        reader->offset++;
+        *majorType = initialByte >> 5;
+        additionalInfo = initialByte & 0x1FU;
+        *argument = additionalInfo;
+
+        if( additionalInfo > CBOR_ARGUMENT_8_BYTES )
+        {
+            valid = false;
+        }
+        else if( additionalInfo > CBOR_INLINE_ARGUMENT_MAX )
+        {
+            argumentLength = ( size_t ) 1U <<
+                             ( additionalInfo - CBOR_INLINE_ARGUMENT_MAX - 1U );
+            valid = argumentLength <= ( reader->length - reader->offset );
+            *argument = 0U;
+
+            for( size_t i = 0U; valid && ( i < argumentLength ); i++ )
+            {
+                *argument = ( *argument << 8 ) |
+                            reader->data[ reader->offset + i ];
+            }
+
+            reader->offset += valid ? argumentLength : 0U;
+        }
+        else
+        {
+            /* Empty else. */
+        }
+    }
+
+    return valid;
+}
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Step over the contents of a string whose head was just read.
+ */
+static bool skipCborString( CborReader_t * reader,
+                            uint64_t stringLength,
+                            const uint8_t ** string )
+{
+    bool valid = stringLength <= ( reader->length - reader->offset );
+
+    if( valid )
+    {
+        *string = &reader->data[ reader->offset ];
+        reader->offset += ( size_t ) stringLength;
+    }
+
+    return valid;
+}
+/*-----------------------------------------------------------*/
+
+static bool decodeCborBlock( const uint8_t * message,
+                             size_t messageLength,
+                             StreamBlock_t * block )
+{
+    CborReader_t reader = { message, messageLength, 0U };
+    uint8_t majorType = 0U;
+    uint64_t pairCount = 0U;
+    uint64_t argument = 0U;
+    uint64_t blockLength = 0U;
+    const uint8_t * key = NULL;
+    const uint8_t * string = NULL;
+    bool keyMatched = false;
+    bool foundFileId = false;
+    bool foundBlockId = false;
+    bool foundBlockLength = false;
+    bool foundPayload = false;
+    bool valid = readCborHead( &reader, &majorType, &pairCount ) &&
+                 ( majorType == CBOR_MAJOR_MAP );
+
+    for( uint64_t pair = 0U; valid && ( pair < pairCount ); pair++ )
+    {
+        /* Every key is a one character text string. */
+        valid = readCborHead( &reader, &majorType, &argument ) &&
+                ( majorType == CBOR_MAJOR_TEXT_STRING ) &&
+                skipCborString( &reader, argument, &key );
+        keyMatched = valid && ( argument == 1U );
+
+        if( valid )
+        {
+            valid = readCborHead( &reader, &majorType, &argument );
+        }
+
+        if( !valid )
+        {
+            /* Empty if. */
+        }
+        else if( majorType == CBOR_MAJOR_UNSIGNED )
+        {
+            if( keyMatched && ( key[ 0 ] == KEY_FILE_ID ) )
+            {
+                block->fileId = ( uint32_t ) argument;
+                foundFileId = argument <= UINT32_MAX;
+            }
+            else if( keyMatched && ( key[ 0 ] == KEY_BLOCK_ID ) )
+            {
+                block->blockId = ( uint32_t ) argument;
+                foundBlockId = argument <= UINT32_MAX;
+            }
+            else if( keyMatched && ( key[ 0 ] == KEY_BLOCK_LENGTH ) )
+            {
+                blockLength = argument;
+                foundBlockLength = true;
+            }
+            else
+            {
+                /* Empty else. */
+            }
+        }
+        else if( ( majorType == CBOR_MAJOR_BYTE_STRING ) ||
+                 ( majorType == CBOR_MAJOR_TEXT_STRING ) )
+        {
+            valid = skipCborString( &reader, argument, &string );
+
+            if( valid && keyMatched && ( key[ 0 ] == KEY_PAYLOAD ) &&
+                ( majorType == CBOR_MAJOR_BYTE_STRING ) )
+            {
+                block->payload = string;
+                block->payloadLength = ( size_t ) argument;
+                foundPayload = true;
+            }
+        }
+        else if( ( majorType == CBOR_MAJOR_NEGATIVE ) ||
+                 ( majorType == CBOR_MAJOR_SIMPLE ) )
+        {
+            /* The whole item was the head, nothing left to skip. */
+        }
+        else
+        {
+            /* Arrays, maps and tags never appear in a data block message. */
+            valid = false;
+        }
+    }
+
+    /* The block length is optional, but the payload must match it. */
+    return valid && foundFileId && foundBlockId && foundPayload &&
+           ( !foundBlockLength || ( block->payloadLength == blockLength ) );
+}
+/*-----------------------------------------------------------*/
+
+static bool searchJsonUnsigned( char * message,
+                                size_t messageLength,
+                                const char * key,
+                                uint32_t * value )
+{
+    char * digits = NULL;
+    size_t digitsLength = 0U;
+    uint64_t result = 0U;
+    bool valid = JSON_Search( message,
+                              messageLength,
+                              key,
+                              strlen( key ),
+                              &digits,
+                              &digitsLength ) == JSONSuccess;
+
+    valid = valid && ( digitsLength > 0U ) && ( digitsLength <= 10U );
+
+    for( size_t i = 0U; valid && ( i < digitsLength ); i++ )
+    {
+        valid = ( digits[ i ] >= '0' ) && ( digits[ i ] <= '9' );
+        result = ( result * 10U ) + ( uint64_t ) ( digits[ i ] - '0' );
+    }
+
+    if( valid && ( result <= UINT32_MAX ) )
+    {
+        *value = ( uint32_t ) result;
+    }
+    else
+    {
+        valid = false;
+    }
+
+    return valid;
+}
+/*-----------------------------------------------------------*/
+
+static bool decodeJsonBlock( uint8_t * message,
+                             size_t messageLength,
+                             StreamBlock_t * block )
+{
+    char * document = ( char * ) message;
+    char * payload = NULL;
+    size_t payloadLength = 0U;
+    uint32_t blockLength = 0U;
+    bool foundBlockLength = false;
+    bool valid = ( JSON_Validate( document, messageLength ) == JSONSuccess ) &&
+                 searchJsonUnsigned( document,
+                                     messageLength,
+                                     "f",
+                                     &block->fileId ) &&
+                 searchJsonUnsigned( document,
+                                     messageLength,
+                                     "i",
+                                     &block->blockId ) &&
+                 ( JSON_Search( document,
+                                messageLength,
+                                "p",
+                                1U,
+                                &payload,
+                                &payloadLength ) == JSONSuccess );
+
+    /* The document stops being valid JSON once the payload is decoded, so
+     * every other key is read first. */
+    if( valid )
+    {
+        foundBlockLength = searchJsonUnsigned( document,
+                                               messageLength,
+                                               "l",
+                                               &blockLength );
+
+        /* Decoding shrinks the payload, so it is decoded over its own
+         * text. */
+        valid = base64_decode( ( const uint8_t * ) payload,
+                               payloadLength,
+                               ( uint8_t * ) payload,
+                               payloadLength,
+                               &block->payloadLength );
+        block->payload = ( const uint8_t * ) payload;
+    }
+
+    return valid &&
+           ( !foundBlockLength || ( block->payloadLength == blockLength ) );
+}
+/*-----------------------------------------------------------*/
+
+bool streamBlock_decode( DataType_t dataType,
+                         uint8_t * message,
+                         size_t messageLength,
+                         StreamBlock_t * block )
+{
+    bool valid = false;
+
+    assert( block != NULL );
+
+    if( message != NULL )
+    {
+        memset( block, 0, sizeof( StreamBlock_t ) );
+
+        if( dataType == DATA_TYPE_CBOR )
+        {
+            valid = decodeCborBlock( message, messageLength, block );
+        }
+        else
+        {
+            valid = decodeJsonBlock( message, messageLength, block );
+        }
+    }
+
+    return valid;
+}
+/*-----------------------------------------------------------*/
@@ -0,0 +1,72 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file stream_block.h
+ * @brief In place decoding of MQTT stream data block messages.
+ *
+ * The payload of a block is located inside the received message instead of
+ * being copied out, so it can be handed straight to the image sink.
+ */
+
+#ifndef STREAM_BLOCK_H_
+#define STREAM_BLOCK_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "MQTTFileDownloader.h"
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* *INDENT-ON* */
+
+/**
+ * @brief A data block located inside a stream data message.
+ */
+typedef struct StreamBlock
+{
+    uint32_t fileId;          /**< @brief File the block belongs to. */
+    uint32_t blockId;         /**< @brief Index of the block in the file. */
+    const uint8_t * payload;  /**< @brief Block data, points into the message. */
+    size_t payloadLength;     /**< @brief Length of the block data. */
+} StreamBlock_t;
+
+/**
+ * @brief Locate the block in a stream data message.
+ *
+ * CBOR messages are only read. The base64 payload of a JSON message is
+ * decoded over itself, so @p message is modified and must stay alive for as
+ * long as @p block is used. The payload must match the block length of the
+ * message, if it has one; it is up to the caller to check that it matches
+ * the length of the block in the file, see blockWindow_blockLength().
+ *
+ * @param[in] dataType Encoding the stream was requested in.
+ * @param[in] message Received message.
+ * @param[in] messageLength Length of @p message.
+ * @param[out] block Location and identity of the block.
+ *
+ * @return true if the message holds a block; false if it is malformed.
+ */
+bool streamBlock_decode( DataType_t dataType,
+                         uint8_t * message,
+                         size_t messageLength,
+                         StreamBlock_t * block );
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+}
+#endif
+/* *INDENT-ON* */
+
+#endif /* ifndef STREAM_BLOCK_H_ */
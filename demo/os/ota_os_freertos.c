@@ -13,6 +13,16 @@
  * FreeRTOS.
  */
 
+/* Every event passes through here, so routine traffic is only logged at the
+ * debug level. */
+#ifndef OTA_OS_LOG_LEVEL
+    #define OTA_OS_LOG_LEVEL LOG_INFO
+#endif
+
+#define LIBRARY_LOG_NAME  "OtaOs"
+#define LIBRARY_LOG_LEVEL OTA_OS_LOG_LEVEL
+#include "csdk_logging/logging.h"
+
 /* FreeRTOS includes. */
 #include "FreeRTOS.h"
 #include "queue.h"
@@ -50,14 +60,14 @@ OtaOsStatus_t OtaInitEvent_FreeRTOS()
     {
         otaOsStatus = OtaOsEventQueueCreateFailed;
 
-        printf( "Failed to create OTA Event Queue: "
-                "xQueueCreateStatic returned error: "
-                "OtaOsStatus_t=%d \n",
-                ( int ) otaOsStatus );
+        LogError( ( "Failed to create OTA Event Queue: "
+                    "xQueueCreateStatic returned error: "
+                    "OtaOsStatus_t=%d",
+                    ( int ) otaOsStatus ) );
     }
     else
     {
-        printf( "OTA Event Queue created.\n" );
+        LogDebug( ( "OTA Event Queue created." ) );
     }
 
     return otaOsStatus;
@@ -73,16 +83,16 @@ OtaOsStatus_t OtaSendEvent_FreeRTOS( const void * pEventMsg )
 
     if( retVal == pdTRUE )
     {
-        printf( "OTA Event Sent.\n" );
+        LogDebug( ( "OTA Event Sent." ) );
     }
     else
     {
         otaOsStatus = OtaOsEventQueueSendFailed;
 
-        printf( "Failed to send event to OTA Event Queue: "
-                "xQueueSendToBack returned error: "
-                "OtaOsStatus_t=%d \n",
-                ( int ) otaOsStatus );
+        LogError( ( "Failed to send event to OTA Event Queue: "
+                    "xQueueSendToBack returned error: "
+                    "OtaOsStatus_t=%d",
+                    ( int ) otaOsStatus ) );
     }
 
     return otaOsStatus;
@@ -97,16 +107,32 @@ OtaOsStatus_t OtaReceiveEvent_FreeRTOS( void * pEventMsg )
 
     if( retVal == pdTRUE )
     {
-        printf( "OTA Event received \n" );
+        LogDebug( ( "OTA Event received." ) );
     }
     else
     {
         otaOsStatus = OtaOsEventQueueReceiveFailed;
 
-        printf( "Failed to receive event or timeout from OTA Event Queue: "
-                "xQueueReceive returned error: "
-                "OtaOsStatus_t=%d \n",
-                ( int ) otaOsStatus );
+        /* A timeout is expected whenever the agent is idle. */
+        LogDebug( ( "Failed to receive event or timeout from OTA Event Queue: "
+                    "xQueueReceive returned error: "
+                    "OtaOsStatus_t=%d",
+                    ( int ) otaOsStatus ) );
+    }
+
+    return otaOsStatus;
+}
+
+OtaOsStatus_t OtaPollEvent_FreeRTOS( void * pEventMsg )
+{
+    OtaOsStatus_t otaOsStatus = OtaOsSuccess;
+
+    /* An empty queue is the normal end of a batch, so it is not logged. */
+    if( xQueueReceive( otaEventQueue,
+                       ( OtaEventMsg_t * ) pEventMsg,
+                       ( TickType_t ) 0 ) != pdTRUE )
+    {
+        otaOsStatus = OtaOsEventQueueReceiveFailed;
     }
 
     return otaOsStatus;
@@ -117,6 +143,6 @@ void OtaDeinitEvent_FreeRTOS()
 
     vQueueDelete( otaEventQueue );
 
-    printf( "OTA Event Queue Deleted. \n" );
+    LogDebug( ( "OTA Event Queue Deleted." ) );
 
 }
@@ -86,6 +86,19 @@ OtaOsStatus_t OtaSendEvent_FreeRTOS( const void * pEventMsg );
  */
 OtaOsStatus_t OtaReceiveEvent_FreeRTOS( void * pEventMsg );
 
+/**
+ * @brief Receive an OTA event if one is already pending.
+ *
+ * This function never blocks, it is used to drain the events that queued up
+ * while the previous ones were being handled.
+ *
+ * @param[pEventMsg]     Pointer to store message.
+ *
+ * @return               OtaOsStatus_t, OtaOsSuccess if an event was received,
+ * OtaOsEventQueueReceiveFailed if the queue is empty.
+ */
+OtaOsStatus_t OtaPollEvent_FreeRTOS( void * pEventMsg );
+
 /**
  * @brief Deinitialize the OTA Events mechanism.
  *
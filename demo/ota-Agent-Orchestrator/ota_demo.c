@@ -7,118 +7,255 @@
  * the License.
  */
 
+/* Per-block messages are debug only, so at the default level the block path
+ * does no formatted output. */
+#ifndef OTA_DEMO_LOG_LEVEL
+    #define OTA_DEMO_LOG_LEVEL LOG_INFO
+#endif
+
+#define LIBRARY_LOG_NAME  "OtaDemo"
+#define LIBRARY_LOG_LEVEL OTA_DEMO_LOG_LEVEL
+#include "csdk_logging/logging.h"
+
 #include <assert.h>
-#include <stdio.h>
+#include <stdatomic.h>
 #include <string.h>
 
 #include "MQTTFileDownloader.h"
+#include "download/block_window.h"
+#include "download/download_checkpoint.h"
+#include "download/flow_control.h"
+#include "download/image_verifier.h"
+#include "download/stream_block.h"
 #include "jobs.h"
 #include "mqtt_wrapper.h"
 #include "ota_demo.h"
 #include "ota_job_processor.h"
 #include "os/ota_os_freertos.h"
+#include "storage/image_sink.h"
+#include "storage/image_sink_mmap.h"
+#include "storage/image_sink_posix.h"
+#include "utils/clock.h"
+#include "utils/job_index.h"
+#include "utils/ota_topics.h"
+#include "utils/progress_report.h"
+#include "utils/topic_router.h"
 #include "FreeRTOS.h"
 #include "semphr.h"
 
-#define CONFIG_MAX_FILE_SIZE    65536U
-#define NUM_OF_BLOCKS_REQUESTED 1U
+#ifndef NUM_OF_BLOCKS_REQUESTED
+    #define NUM_OF_BLOCKS_REQUESTED 4U
+#endif
 #define START_JOB_MSG_LENGTH    147U
 #define MAX_THING_NAME_SIZE     128U
 #define MAX_JOB_ID_LENGTH       64U
 #define UPDATE_JOB_MSG_LENGTH   48U
-#define MAX_NUM_OF_OTA_DATA_BUFFERS 5U
+
+/* Must be a power of two so the ring indexes can wrap freely */
+#ifndef MAX_NUM_OF_OTA_DATA_BUFFERS
+    #define MAX_NUM_OF_OTA_DATA_BUFFERS 8U
+#endif
+
+/* Every block in flight may need a ring slot when it arrives */
+#define MAX_NUM_OF_BLOCKS_IN_FLIGHT MAX_NUM_OF_OTA_DATA_BUFFERS
+
+/* Upper bound on the events handled before the agent loop yields */
+#define MAX_EVENTS_PER_WAKEUP 20U
+
+/* Minimum time between two download progress messages */
+#ifndef PROGRESS_REPORT_INTERVAL_MS
+    #define PROGRESS_REPORT_INTERVAL_MS 1000U
+#endif
+
+/* Set to 1 to store images through a shared file mapping instead of pwrite */
+#ifndef USE_MMAP_IMAGE_SINK
+    #define USE_MMAP_IMAGE_SINK 0
+#endif
 
 MqttFileDownloaderContext_t mqttFileDownloaderContext = { 0 };
-static uint32_t numOfBlocksRemaining = 0;
-static uint32_t currentBlockOffset = 0;
+static BlockWindow_t blockWindow = { 0 };
+static FlowControl_t flowControl = { 0 };
+static ProgressReport_t downloadProgress = { 0 };
 static uint8_t currentFileId = 0;
 static uint32_t totalBytesReceived = 0;
-static uint8_t downloadedData[ CONFIG_MAX_FILE_SIZE ] = { 0 };
+static ImageSink_t imageSink = { 0 };
+#if USE_MMAP_IMAGE_SINK
+static ImageSinkMmapContext_t imageSinkContext = { 0 };
+#else
+static ImageSinkPosixContext_t imageSinkContext = { 0 };
+#endif
+static DownloadCheckpoint_t downloadCheckpoint = { 0 };
+static ImageVerifier_t imageVerifier = { 0 };
 char globalJobId[ MAX_JOB_ID_LENGTH ] = { 0 };
 
+/* Blocks are handed from the MQTT task to the OTA task through a single
+ * producer, single consumer ring. Only the MQTT task moves the head and only
+ * the OTA task moves the tail, so neither side takes a lock. */
 static OtaDataEvent_t dataBuffers[MAX_NUM_OF_OTA_DATA_BUFFERS] = { 0 };
+static atomic_uint dataBufferHead = 0U;
+static atomic_uint dataBufferTail = 0U;
+static uint32_t droppedBlocks = 0U;
 static OtaJobEventData_t jobDocBuffer = { 0 };
-static SemaphoreHandle_t bufferSemaphore;
+
+/* Created by main.c, coreMQTT takes it around its state updates */
+extern SemaphoreHandle_t MQTTStateUpdateLock;
+
+/* Topics are built once per job, so a message costs one comparison */
+static TopicRouter_t topicRouter = { 0 };
+
+static DataType_t streamDataType = OTA_STREAM_DATA_TYPE;
+
+/* Built once per job message, then read for every file of the job */
+static JobIndex_t jobIndex = { 0 };
 
 static OtaState_t otaAgentState = OtaAgentStateInit;
 
+/* Counters reported at the end of a download */
+static uint32_t eventWakeups = 0U;
+static uint32_t eventsProcessed = 0U;
+static uint32_t blockRequestsSent = 0U;
+
 static void finishDownload( void );
 
+static bool setRoute( const char * topic,
+                      size_t topicLength,
+                      TopicHandler_t handler );
+
 static void processOTAEvents( void );
 
+static bool processOTAEvent( OtaEventMsg_t * recvEvent );
+
 static void requestJobDocumentHandler( void );
 
 static bool receivedJobDocumentHandler( OtaJobEventData_t * jobDoc );
 
-static bool jobDocumentParser( char * message, size_t messageLength, AfrOtaJobDocumentFields_t *jobFields );
+static bool jobDocumentParser( AfrOtaJobDocumentFields_t *jobFields );
+
+static bool initMqttDownloader( AfrOtaJobDocumentFields_t *jobFields );
 
-static void initMqttDownloader( AfrOtaJobDocumentFields_t *jobFields );
+static bool openImageSink( AfrOtaJobDocumentFields_t *jobFields );
 
 static OtaDataEvent_t * getOtaDataEventBuffer( void );
 
+static void commitOtaDataEventBuffer( void );
+
 static void freeOtaDataEventBuffer( OtaDataEvent_t * const buffer );
 
-static void handleMqttStreamsBlockArrived( uint8_t *data, size_t dataLength );
+static bool handleMqttStreamsBlockArrived( uint32_t blockId,
+                                          const uint8_t *data,
+                                          size_t dataLength );
+
+static void requestDataBlock( uint32_t blockOffset, uint32_t numBlocks );
+
+static void requestDataBlocks( void );
+
+static bool handleStartNextAccepted( uint8_t * message, size_t messageLength );
 
-static void requestDataBlock( void );
+static bool handleDataBlockMessage( uint8_t * message, size_t messageLength );
 
 
+_Static_assert( ( MAX_NUM_OF_OTA_DATA_BUFFERS &
+                  ( MAX_NUM_OF_OTA_DATA_BUFFERS - 1U ) ) == 0U,
+                "MAX_NUM_OF_OTA_DATA_BUFFERS must be a power of two" );
+
+/* Called by the OTA task once it is done with the oldest block */
 static void freeOtaDataEventBuffer( OtaDataEvent_t * const pxBuffer )
 {
-    if( xSemaphoreTake( bufferSemaphore, portMAX_DELAY ) == pdTRUE )
-    {
-        pxBuffer->bufferUsed = false;
-        ( void ) xSemaphoreGive( bufferSemaphore );
-    }
-    else
-    {
-        printf( "Failed to get buffer semaphore.\n" );
-    }
+    unsigned int tail = atomic_load_explicit( &dataBufferTail,
+                                              memory_order_relaxed );
+
+    /* Events are handled in the order they were posted, so the buffer
+     * released is always the one at the tail. */
+    assert( pxBuffer == &dataBuffers[ tail &
+                                      ( MAX_NUM_OF_OTA_DATA_BUFFERS - 1U ) ] );
+    ( void ) pxBuffer;
+
+    atomic_store_explicit( &dataBufferTail, tail + 1U, memory_order_release );
 }
 
+/* Called by the MQTT task, returns NULL while the ring is full */
 static OtaDataEvent_t * getOtaDataEventBuffer( void )
 {
-    uint32_t ulIndex = 0;
+    unsigned int head = atomic_load_explicit( &dataBufferHead,
+                                              memory_order_relaxed );
+    unsigned int tail = atomic_load_explicit( &dataBufferTail,
+                                              memory_order_acquire );
     OtaDataEvent_t * freeBuffer = NULL;
 
-    if( xSemaphoreTake( bufferSemaphore, portMAX_DELAY ) == pdTRUE )
-    {
-        for( ulIndex = 0; ulIndex < MAX_NUM_OF_OTA_DATA_BUFFERS; ulIndex++ )
-        {
-            if( dataBuffers[ ulIndex ].bufferUsed == false )
-            {
-                dataBuffers[ ulIndex ].bufferUsed = true;
-                freeBuffer = &dataBuffers[ ulIndex ];
-                break;
-            }
-        }
-
-        ( void ) xSemaphoreGive( bufferSemaphore );
-    }
-    else
+    if( ( head - tail ) < MAX_NUM_OF_OTA_DATA_BUFFERS )
     {
-        printf("Failed to get buffer semaphore. \n" );
+        freeBuffer = &dataBuffers[ head & ( MAX_NUM_OF_OTA_DATA_BUFFERS - 1U ) ];
     }
 
     return freeBuffer;
 }
 
+/* Called by the MQTT task once the buffer from getOtaDataEventBuffer() has
+ * been handed to the OTA task */
+static void commitOtaDataEventBuffer( void )
+{
+    unsigned int head = atomic_load_explicit( &dataBufferHead,
+                                              memory_order_relaxed );
+
+    atomic_store_explicit( &dataBufferHead, head + 1U, memory_order_release );
+}
+
+void otaDemo_setDataType( DataType_t dataType )
+{
+    streamDataType = dataType;
+}
+
 void otaDemo_start( void )
 {
     OtaEventMsg_t initEvent = { 0 };
+    char thingName[ MAX_THING_NAME_SIZE + 1 ] = { 0 };
+    size_t thingNameLength = 0U;
+    char topicBuffer[ TOPIC_BUFFER_SIZE + 1 ] = { 0 };
+    size_t topicLength = 0U;
 
     if( !mqttWrapper_isConnected() )
     {
         return;
     }
 
-    bufferSemaphore = xSemaphoreCreateMutex();
+    mqttWrapper_getThingName( thingName, &thingNameLength );
+    topicRouter_init( &topicRouter );
+
+    LogInfo( ( "Requesting stream blocks in %s.",
+               otaTopics_dataTypeName( streamDataType ) ) );
+
+    /* Later subscriptions to the data topic of the stream, made when the
+     * downloader starts, are covered by the stream wildcard once it is
+     * granted. The job update responses are not routed, so they are left
+     * out. */
+    if( !otaTopics_subscribe( thingName,
+                              thingNameLength,
+                              streamDataType,
+                              false ) )
+    {
+        LogWarn( ( "Failed to subscribe to the OTA topics." ) );
+    }
 
-    if( bufferSemaphore != NULL )
+    /*
+     * AWS IoT Jobs library:
+     * Creates the start-next/accepted topic the job document arrives on.
+     */
+    if( ( Jobs_GetTopic( topicBuffer,
+                         TOPIC_BUFFER_SIZE,
+                         thingName,
+                         ( uint16_t ) thingNameLength,
+                         JobsStartNextSuccess,
+                         &topicLength ) != JobsSuccess ) ||
+        !setRoute( topicBuffer, topicLength, handleStartNextAccepted ) )
     {
-        memset( dataBuffers, 0x00, sizeof( dataBuffers ) );
+        LogError( ( "Failed to route the start-next response topic." ) );
+        return;
     }
 
+    atomic_store( &dataBufferHead, 0U );
+    atomic_store( &dataBufferTail, 0U );
+    droppedBlocks = 0U;
+
     OtaInitEvent_FreeRTOS();
 
     initEvent.eventId = OtaAgentEventRequestJobDocument;
@@ -164,25 +301,110 @@ static void requestJobDocumentHandler()
                                              messageBuffer,
                                              START_JOB_MSG_LENGTH );
 
-    mqttWrapper_publish(topicBuffer,
-                        topicLength,
-                        ( uint8_t * ) messageBuffer,
-                        messageLength);
+    /* The broker acknowledges the job request. Block requests stay at
+     * QoS 0, the downloader times them itself. */
+    mqttWrapper_publishWithQos( topicBuffer,
+                                topicLength,
+                                ( uint8_t * ) messageBuffer,
+                                messageLength,
+                                MQTTQoS1 );
+
+}
+
+static bool openImageSink( AfrOtaJobDocumentFields_t *jobFields )
+{
+    char imagePath[ IMAGE_SINK_MAX_PATH_LENGTH + 1U ] = { 0 };
+    bool opened = false;
+
+#if USE_MMAP_IMAGE_SINK
+    imageSink_initMmap( &imageSink, &imageSinkContext );
+#else
+    imageSink_initPosix( &imageSink, &imageSinkContext );
+#endif
+
+    if( imageSink_getDownloadPath( jobFields->filepath,
+                                   jobFields->filepathLen,
+                                   imagePath,
+                                   sizeof( imagePath ) ) )
+    {
+        /* Blocks stored by an earlier run of the same job are marked
+         * received, so only the missing ones are requested. */
+        if( !downloadCheckpoint_open( &downloadCheckpoint,
+                                      imagePath,
+                                      globalJobId,
+                                      strnlen( globalJobId, MAX_JOB_ID_LENGTH ),
+                                      jobFields->imageRef,
+                                      jobFields->imageRefLen,
+                                      ( uint8_t ) jobFields->fileId,
+                                      jobFields->fileSize,
+                                      &blockWindow ) )
+        {
+            LogWarn( ( "Download of %s will not be resumable.", imagePath ) );
+        }
+
+        opened = imageSink.open( imageSink.pContext,
+                                 imagePath,
+                                 jobFields->fileSize ) == IMAGE_SINK_SUCCESS;
+    }
 
+    if( opened )
+    {
+        LogInfo( ( "Downloading image to %s.", imagePath ) );
+    }
+    else
+    {
+        LogError( ( "Failed to open storage for the downloaded image." ) );
+    }
+
+    return opened;
 }
 
-static void initMqttDownloader( AfrOtaJobDocumentFields_t *jobFields )
+static bool initMqttDownloader( AfrOtaJobDocumentFields_t *jobFields )
 {
     char thingName[ MAX_THING_NAME_SIZE + 1 ] = { 0 };
     size_t thingNameLength = 0U;
 
-    numOfBlocksRemaining = jobFields->fileSize /
-                            mqttFileDownloader_CONFIG_BLOCK_SIZE;
-    numOfBlocksRemaining += ( jobFields->fileSize %
-                            mqttFileDownloader_CONFIG_BLOCK_SIZE > 0 ) ? 1 : 0;
+    if( !blockWindow_init( &blockWindow,
+                           jobFields->fileSize,
+                           mqttFileDownloader_CONFIG_BLOCK_SIZE,
+                           MAX_NUM_OF_BLOCKS_IN_FLIGHT,
+                           NUM_OF_BLOCKS_REQUESTED ) )
+    {
+        LogError( ( "File of %u bytes has too many blocks to download.",
+                    jobFields->fileSize ) );
+        return false;
+    }
+
+    if( !openImageSink( jobFields ) )
+    {
+        downloadCheckpoint_remove( &downloadCheckpoint );
+        return false;
+    }
+
+    /* Blocks are hashed as they arrive, so the image is verified as soon as
+     * the last one is in. */
+    if( !imageVerifier_init( &imageVerifier,
+                             &blockWindow,
+                             jobFields->fileSize,
+                             jobFields->signature,
+                             jobFields->signatureLen,
+                             jobFields->certfile,
+                             jobFields->certfileLen ) )
+    {
+        ( void ) imageSink.abort( imageSink.pContext );
+        downloadCheckpoint_remove( &downloadCheckpoint );
+        return false;
+    }
+
     currentFileId = jobFields->fileId;
-    currentBlockOffset = 0;
     totalBytesReceived = 0;
+    progressReport_init( &downloadProgress, PROGRESS_REPORT_INTERVAL_MS );
+    flowControl_init( &flowControl,
+                      MAX_NUM_OF_BLOCKS_IN_FLIGHT,
+                      NUM_OF_BLOCKS_REQUESTED );
+    eventWakeups = 0U;
+    eventsProcessed = 0U;
+    blockRequestsSent = 0U;
 
     mqttWrapper_getThingName( thingName, &thingNameLength );
 
@@ -197,29 +419,59 @@ static void initMqttDownloader( AfrOtaJobDocumentFields_t *jobFields )
                         jobFields->imageRefLen,
                         thingName,
                         thingNameLength,
-                        DATA_TYPE_JSON );
+                        streamDataType );
+
+    if( !setRoute( mqttFileDownloaderContext.topicStreamData,
+                   mqttFileDownloaderContext.topicStreamDataLength,
+                   handleDataBlockMessage ) )
+    {
+        LogError( ( "Failed to route the stream data topic." ) );
+        imageVerifier_cleanup( &imageVerifier );
+        ( void ) imageSink.abort( imageSink.pContext );
+        downloadCheckpoint_remove( &downloadCheckpoint );
+        return false;
+    }
+
+    return true;
 }
 
 static bool receivedJobDocumentHandler( OtaJobEventData_t * jobDoc )
 {
     bool parseJobDocument = false;
     bool handled = false;
-    char * jobId;
+    const char * jobId = NULL;
     size_t jobIdLength = 0U;
     AfrOtaJobDocumentFields_t jobFields = { 0 };
 
-    /*
-     * AWS IoT Jobs library:
-     * Extracting the job ID from the received OTA job document.
-     */
-    jobIdLength = Jobs_GetJobId( (char *)jobDoc->jobData, jobDoc->jobDataLength, &jobId );
+    /* The message is walked once here. The job ID, the job document and
+     * the fields of every file are then read from the index. A job that
+     * cannot be indexed is not handled. */
+    if( !jobIndex_build( &jobIndex,
+                         ( const char * ) jobDoc->jobData,
+                         jobDoc->jobDataLength ) )
+    {
+        LogError( ( "Failed to parse the job message, it is not valid JSON "
+                    "or lists more than %u files.",
+                    ( unsigned int ) JOB_INDEX_MAX_FILES ) );
+        return false;
+    }
 
-    if ( jobIdLength )
+    jobIdLength = jobIndex_getValue( &jobIndex, &jobIndex.jobId, &jobId );
+
+    if ( jobIdLength >= MAX_JOB_ID_LENGTH )
+    {
+        LogError( ( "Job ID is longer than %u characters.",
+                    ( unsigned int ) MAX_JOB_ID_LENGTH - 1U ) );
+    }
+    else if ( jobIdLength )
     {
-        if ( strncmp( globalJobId, jobId, jobIdLength ) )
+        /* A job whose ID starts with the current one is another job. */
+        if ( ( strnlen( globalJobId, MAX_JOB_ID_LENGTH ) != jobIdLength ) ||
+             ( memcmp( globalJobId, jobId, jobIdLength ) != 0 ) )
         {
             parseJobDocument = true;
-            strncpy( globalJobId, jobId, jobIdLength );
+            memcpy( globalJobId, jobId, jobIdLength );
+            globalJobId[ jobIdLength ] = '\0';
         }
         else
         {
@@ -229,17 +481,17 @@ static bool receivedJobDocumentHandler( OtaJobEventData_t * jobDoc )
 
     if ( parseJobDocument )
     {
-        handled = jobDocumentParser( (char * )jobDoc->jobData, jobDoc->jobDataLength, &jobFields );
+        handled = jobDocumentParser( &jobFields );
         if (handled)
         {
-            initMqttDownloader( &jobFields );
+            handled = initMqttDownloader( &jobFields );
         }
     }
 
     return handled;
 }
 
-static void requestDataBlock( void )
+static void requestDataBlock( uint32_t blockOffset, uint32_t numBlocks )
 {
     char getStreamRequest[ GET_STREAM_REQUEST_BUFFER_SIZE ];
     size_t getStreamRequestLength = 0U;
@@ -253,8 +505,8 @@ static void requestDataBlock( void )
     getStreamRequestLength = mqttDownloader_createGetDataBlockRequest( mqttFileDownloaderContext.dataType,
                                         currentFileId,
                                         mqttFileDownloader_CONFIG_BLOCK_SIZE,
-                                        currentBlockOffset,
-                                        NUM_OF_BLOCKS_REQUESTED,
+                                        blockOffset,
+                                        numBlocks,
                                         getStreamRequest,
                                         GET_STREAM_REQUEST_BUFFER_SIZE );
 
@@ -262,138 +514,375 @@ static void requestDataBlock( void )
                          mqttFileDownloaderContext.topicGetStreamLength,
                          ( uint8_t * ) getStreamRequest,
                          getStreamRequestLength );
+    blockRequestsSent++;
 }
 
+/* Keeps the window full so the broker round trip overlaps earlier blocks */
+static void requestDataBlocks( void )
+{
+    uint32_t blockOffset = 0U;
+    uint32_t numBlocks = 0U;
+
+    flowControl_apply( &flowControl, &blockWindow );
+
+    /* A request that could not be timed waits for an answered one. */
+    while( flowControl_canRequest( &flowControl ) &&
+           blockWindow_nextRequest( &blockWindow, &blockOffset, &numBlocks ) )
+    {
+        requestDataBlock( blockOffset, numBlocks );
+        ( void ) flowControl_onRequest( &flowControl,
+                                        blockOffset,
+                                        numBlocks,
+                                        Clock_GetTimeMs() );
+    }
 
-static void processOTAEvents() {
+    otaAgentState = OtaAgentStateWaitingForFileBlock;
+}
+
+/* Requests again the blocks of requests that went unanswered, and only
+ * those, the blocks that did arrive are not asked for twice */
+static void requestExpiredBlocks( void )
+{
+    uint32_t nowMs = Clock_GetTimeMs();
+    uint32_t firstBlock = 0U;
+    uint32_t numBlocks = 0U;
+    uint32_t blockOffset = 0U;
+    uint32_t runLength = 0U;
+
+    while( flowControl_takeExpired( &flowControl,
+                                    nowMs,
+                                    &firstBlock,
+                                    &numBlocks ) )
+    {
+        blockOffset = firstBlock;
+
+        while( blockWindow_nextMissing( &blockWindow,
+                                        &blockOffset,
+                                        firstBlock + numBlocks,
+                                        &runLength ) )
+        {
+            LogDebug( ( "Requesting blocks %u to %u again.",
+                        blockOffset,
+                        blockOffset + runLength - 1U ) );
+            requestDataBlock( blockOffset, runLength );
+
+            if( !flowControl_onRequest( &flowControl,
+                                        blockOffset,
+                                        runLength,
+                                        nowMs ) )
+            {
+                LogWarn( ( "Too many requests in flight, blocks %u to %u "
+                           "were requested again untimed (%u so far).",
+                           blockOffset,
+                           blockOffset + runLength - 1U,
+                           flowControl.untimedRequests ) );
+            }
+
+            blockOffset += runLength;
+        }
+    }
+}
+
+/* Drains every pending event in one wakeup. Handlers only ask for a refill,
+ * so a run of received blocks costs a single pass over the window instead of
+ * a RequestFileBlock event per block. */
+static void processOTAEvents( void )
+{
     OtaEventMsg_t recvEvent = { 0 };
-    OtaEvent_t recvEventId = 0;
+    OtaEventMsg_t timeoutEvent = { 0 };
+    uint32_t eventsInBatch = 0U;
+    bool refillRequested = false;
+
+    if( OtaReceiveEvent_FreeRTOS( &recvEvent ) == OtaOsSuccess )
+    {
+        eventWakeups++;
+
+        do
+        {
+            refillRequested = processOTAEvent( &recvEvent ) || refillRequested;
+            eventsInBatch++;
+        } while( ( eventsInBatch < MAX_EVENTS_PER_WAKEUP ) &&
+                 ( otaAgentState != OtaAgentStateStopped ) &&
+                 ( OtaPollEvent_FreeRTOS( &recvEvent ) == OtaOsSuccess ) );
+
+        eventsProcessed += eventsInBatch;
+    }
+
+    /* Blocks dropped on the way, by the network or by a full ring, are
+     * only noticed by their request going unanswered. The queue wait is
+     * bounded, so this is checked at least once a second. */
+    if( ( otaAgentState == OtaAgentStateWaitingForFileBlock ) &&
+        flowControl_hasExpired( &flowControl, Clock_GetTimeMs() ) )
+    {
+        timeoutEvent.eventId = OtaAgentEventFileBlockTimeout;
+        refillRequested = processOTAEvent( &timeoutEvent ) || refillRequested;
+    }
+
+    if( refillRequested &&
+        ( ( otaAgentState == OtaAgentStateRequestingFileBlock ) ||
+          ( otaAgentState == OtaAgentStateWaitingForFileBlock ) ) )
+    {
+        requestDataBlocks();
+    }
+}
+
+/* Returns true when more file blocks should be requested */
+static bool processOTAEvent( OtaEventMsg_t * recvEvent )
+{
+    OtaEvent_t recvEventId = recvEvent->eventId;
     OtaEventMsg_t nextEvent = { 0 };
+    bool refillRequested = false;
 
-    OtaReceiveEvent_FreeRTOS(&recvEvent);
-    recvEventId = recvEvent.eventId;
-    printf("Received Event is %d \n", recvEventId);
+    LogDebug( ( "Received event %d.", recvEventId ) );
 
     switch (recvEventId)
     {
     case OtaAgentEventRequestJobDocument:
-        printf("Request Job Document event Received \n");
-        printf("-------------------------------------\n");
         requestJobDocumentHandler();
         otaAgentState = OtaAgentStateRequestingJob;
         break;
     case OtaAgentEventReceivedJobDocument:
-        printf("Received Job Document event Received \n");
-        printf("-------------------------------------\n");
-
         if (otaAgentState == OtaAgentStateSuspended)
         {
-            printf("OTA-Agent is in Suspend State. Hence dropping Job Document. \n");
+            LogWarn( ( "OTA-Agent is in Suspend State. Hence dropping Job Document." ) );
             break;
         }
 
-        if ( receivedJobDocumentHandler(recvEvent.jobEvent) )
+        if ( receivedJobDocumentHandler(recvEvent->jobEvent) )
         {
-            printf( "Received OTA Job. \n" );
+            LogInfo( ( "Received OTA Job." ) );
             nextEvent.eventId = OtaAgentEventRequestFileBlock;
             OtaSendEvent_FreeRTOS( &nextEvent );
         }
         else
         {
-            printf("This is not an OTA job \n");
+            LogInfo( ( "This is not an OTA job." ) );
         }
         otaAgentState = OtaAgentStateCreatingFile;
         break;
     case OtaAgentEventRequestFileBlock:
         otaAgentState = OtaAgentStateRequestingFileBlock;
-        printf("Request File Block event Received \n");
-        printf("-----------------------------------\n");
-        if (currentBlockOffset == 0)
+        if (blockWindow.blocksReceived == 0)
         {
-            printf( "Starting The Download. \n" );
+            LogInfo( ( "Starting The Download." ) );
+        }
+
+        /* A resumed download may already have every block. */
+        if( blockWindow_isComplete( &blockWindow ) )
+        {
+            nextEvent.eventId = OtaAgentEventCloseFile;
+            OtaSendEvent_FreeRTOS( &nextEvent );
+        }
+        else
+        {
+            refillRequested = true;
         }
-        requestDataBlock();
         break;
     case OtaAgentEventReceivedFileBlock:
-        printf("Received File Block event Received \n");
-        printf("---------------------------------------\n");
         if (otaAgentState == OtaAgentStateSuspended)
         {
-            printf("OTA-Agent is in Suspend State. Hence dropping File Block. \n");
-            freeOtaDataEventBuffer(recvEvent.dataEvent);
+            LogDebug( ( "OTA-Agent is in Suspend State. Hence dropping File Block." ) );
+            freeOtaDataEventBuffer(recvEvent->dataEvent);
+            break;
+        }
+        StreamBlock_t block = { 0 };
+
+        /* The block is decoded inside the event buffer and stored from
+         * there. */
+        if( !streamBlock_decode( mqttFileDownloaderContext.dataType,
+                                 recvEvent->dataEvent->data,
+                                 recvEvent->dataEvent->dataLength,
+                                 &block ) ||
+            ( block.fileId != currentFileId ) ||
+            ( block.payloadLength !=
+              blockWindow_blockLength( &blockWindow, block.blockId ) ) ||
+            !blockWindow_markReceived( &blockWindow, block.blockId ) )
+        {
+            /* A block of the wrong length would overwrite its neighbours or
+             * leave a hole, so it is never stored. */
+            LogDebug( ( "Dropping malformed, duplicate or unexpected file "
+                        "block." ) );
+            freeOtaDataEventBuffer( recvEvent->dataEvent );
+            break;
+        }
+        flowControl_onBlock( &flowControl, block.blockId, Clock_GetTimeMs() );
+        if( !handleMqttStreamsBlockArrived( block.blockId,
+                                            block.payload,
+                                            block.payloadLength ) )
+        {
+            freeOtaDataEventBuffer( recvEvent->dataEvent );
+            imageVerifier_cleanup( &imageVerifier );
+            ( void ) imageSink.abort( imageSink.pContext );
+            downloadCheckpoint_remove( &downloadCheckpoint );
+            otaAgentState = OtaAgentStateStopped;
             break;
         }
-        uint8_t decodedData[ mqttFileDownloader_CONFIG_BLOCK_SIZE ];
-        size_t decodedDataLength = 0;
-        /*
-         * MQTT streams Library:
-         * Extracting and decoding the received data block from the incoming MQTT message.
-         */
-        mqttDownloader_processReceivedDataBlock(
-            &mqttFileDownloaderContext,
-            recvEvent.dataEvent->data,
-            recvEvent.dataEvent->dataLength,
-            decodedData,
-            &decodedDataLength );
-        handleMqttStreamsBlockArrived(decodedData, decodedDataLength);
-        freeOtaDataEventBuffer(recvEvent.dataEvent);
-        numOfBlocksRemaining--;
-        currentBlockOffset++;
-
-        if( numOfBlocksRemaining == 0 )
+        freeOtaDataEventBuffer(recvEvent->dataEvent);
+
+        if( blockWindow_isComplete( &blockWindow ) )
         {
             nextEvent.eventId = OtaAgentEventCloseFile;
             OtaSendEvent_FreeRTOS( &nextEvent );
         }
         else
         {
-            nextEvent.eventId = OtaAgentEventRequestFileBlock;
-            OtaSendEvent_FreeRTOS( &nextEvent );
+            refillRequested = true;
+        }
+        break;
+    case OtaAgentEventFileBlockTimeout:
+        if( otaAgentState == OtaAgentStateWaitingForFileBlock )
+        {
+            requestExpiredBlocks();
+            LogInfo( ( "File block request timed out, window is now %u "
+                       "blocks.",
+                       flowControl.window ) );
         }
         break;
     case OtaAgentEventCloseFile:
-        printf("Close file event Received \n");
-        printf("-----------------------\n");
-        printf( "Downloaded Data %s \n", ( char * ) downloadedData );
-        finishDownload();
+        /* Verified while the image is still open, blocks restored from a
+         * checkpoint may have to be read back. */
+        if( !imageVerifier_finish( &imageVerifier, &blockWindow, &imageSink ) )
+        {
+            LogError( ( "The downloaded image failed verification, "
+                        "discarding it." ) );
+            ( void ) imageSink.abort( imageSink.pContext );
+            downloadCheckpoint_remove( &downloadCheckpoint );
+        }
+        else if( imageSink.close( imageSink.pContext ) == IMAGE_SINK_SUCCESS )
+        {
+            downloadCheckpoint_remove( &downloadCheckpoint );
+            LogInfo( ( "Downloaded %u bytes to %s.",
+                       totalBytesReceived,
+                       imageSink.getPath( imageSink.pContext ) ) );
+            LogInfo( ( "Handled %u events in %u wakeups, sent %u block "
+                       "requests.",
+                       eventsProcessed,
+                       eventWakeups,
+                       blockRequestsSent ) );
+            LogInfo( ( "Ended with a window of %u blocks, a round trip of "
+                       "%u ms and %u timeouts.",
+                       flowControl.window,
+                       flowControl.smoothedRttMs,
+                       flowControl.timeouts ) );
+            finishDownload();
+        }
+        else
+        {
+            LogError( ( "Failed to commit the downloaded image." ) );
+        }
         otaAgentState = OtaAgentStateStopped;
         break;
     case OtaAgentEventSuspend:
-        printf("Suspend Event Received \n");
-        printf("-----------------------\n");
+        LogInfo( ( "Suspending the OTA agent." ) );
         otaAgentState = OtaAgentStateSuspended;
         break;
     case OtaAgentEventResume:
-        printf("Resume Event Received \n");
-        printf("---------------------\n");
+        LogInfo( ( "Resuming the OTA agent." ) );
+        /* Blocks that arrived while suspended were dropped, so everything
+         * still missing is requested again. */
+        blockWindow_rewind( &blockWindow );
+        flowControl_clearRequests( &flowControl );
         otaAgentState = OtaAgentStateRequestingJob;
         nextEvent.eventId = OtaAgentEventRequestJobDocument;
         OtaSendEvent_FreeRTOS( &nextEvent );
     default:
         break;
     }
+
+    return refillRequested;
+}
+
+void otaDemo_handleReconnect( void )
+{
+    OtaEventMsg_t nextEvent = { 0 };
+    OtaState_t state = getOtaAgentState();
+
+    /* Requests and blocks in flight were lost with the connection. Resuming
+     * fetches the job again and requests only the blocks still missing. A
+     * suspended agent is left alone, it does the same when it is resumed. */
+    if( ( state != OtaAgentStateInit ) && ( state != OtaAgentStateStopped ) &&
+        ( state != OtaAgentStateSuspended ) )
+    {
+        nextEvent.eventId = OtaAgentEventResume;
+        OtaSendEvent_FreeRTOS( &nextEvent );
+    }
 }
 
 /* Implemented for use by the MQTT library */
+/* Routes change on the OTA task while the MQTT task dispatches, so the
+ * router is held under the lock coreMQTT takes for its own state. */
+static void lockRouter( void )
+{
+    if( MQTTStateUpdateLock != NULL )
+    {
+        xSemaphoreTake( MQTTStateUpdateLock, portMAX_DELAY );
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void unlockRouter( void )
+{
+    if( MQTTStateUpdateLock != NULL )
+    {
+        xSemaphoreGive( MQTTStateUpdateLock );
+    }
+}
+/*-----------------------------------------------------------*/
+
+static bool setRoute( const char * topic,
+                      size_t topicLength,
+                      TopicHandler_t handler )
+{
+    bool set = false;
+
+    lockRouter();
+    set = topicRouter_set( &topicRouter, topic, topicLength, handler );
+    unlockRouter();
+
+    return set;
+}
+/*-----------------------------------------------------------*/
+
 bool otaDemo_handleIncomingMQTTMessage( char * topic,
                                         size_t topicLength,
                                         uint8_t * message,
                                         size_t messageLength )
 {
-    OtaEventMsg_t nextEvent = { 0 };
-    char thingName[ MAX_THING_NAME_SIZE + 1 ] = { 0 };
-    size_t thingNameLength = 0U;
+    TopicHandler_t handler = NULL;
+    bool handled = false;
 
-    mqttWrapper_getThingName(thingName, &thingNameLength);
+    lockRouter();
+    handler = topicRouter_find( &topicRouter, topic, topicLength );
+    unlockRouter();
 
-    /*
-     * AWS IoT Jobs library:
-     * Checks if a message comes from the start-next/accepted reserved topic.
-     */
-    bool handled = Jobs_IsStartNextAccepted( topic,
-                                             topicLength,
-                                             thingName,
-                                             thingNameLength );
+    if( handler == NULL )
+    {
+        LogWarn( ( "No route for the incoming MQTT message on topic: %.*s",
+                   ( unsigned int ) topicLength,
+                   topic ) );
+    }
+    else if( !handler( message, messageLength ) )
+    {
+        LogWarn( ( "Rejected incoming MQTT message on topic: "
+                   "%.*s\nMessage: %.*s",
+                   ( unsigned int ) topicLength,
+                   topic,
+                   ( unsigned int ) messageLength,
+                   ( char * ) message ) );
+    }
+    else
+    {
+        handled = true;
+    }
+
+    return handled;
+}
+
+/* Routed from the start-next/accepted reserved topic */
+static bool handleStartNextAccepted( uint8_t * message, size_t messageLength )
+{
+    OtaEventMsg_t nextEvent = { 0 };
+    bool handled = messageLength <= sizeof( jobDocBuffer.jobData );
 
     if( handled )
     {
@@ -405,60 +894,69 @@ bool otaDemo_handleIncomingMQTTMessage( char * topic,
     }
     else
     {
-        /*
-         * MQTT streams Library:
-         * Checks if the incoming message contains the requested data block. It is performed by
-         * comparing the incoming MQTT message topic with MQTT streams topics.
-         */
-        handled = mqttDownloader_isDataBlockReceived(&mqttFileDownloaderContext, topic, topicLength);
-        if (handled)
-        {
-            nextEvent.eventId = OtaAgentEventReceivedFileBlock;
-            OtaDataEvent_t * dataBuf = getOtaDataEventBuffer();
-            memcpy(dataBuf->data, message, messageLength);
-            nextEvent.dataEvent = dataBuf;
-            dataBuf->dataLength = messageLength;
-            OtaSendEvent_FreeRTOS( &nextEvent );
-        }
+        LogError( ( "Job document of %u bytes does not fit the buffer.",
+                    ( unsigned int ) messageLength ) );
     }
 
-    if( !handled )
+    return handled;
+}
+
+/* Routed from the data topic of the stream being downloaded */
+static bool handleDataBlockMessage( uint8_t * message, size_t messageLength )
+{
+    OtaEventMsg_t nextEvent = { 0 };
+    OtaDataEvent_t * dataBuf = NULL;
+    bool queued = false;
+
+    /* The receive buffer is reused as soon as this returns, so this
+     * is the one copy a block makes before it is stored. */
+    if( messageLength <= sizeof( dataBuf->data ) )
     {
-        printf( "Unrecognized incoming MQTT message received on topic: "
-                "%.*s\nMessage: %.*s\n",
-                ( unsigned int ) topicLength,
-                topic,
-                ( unsigned int ) messageLength,
-                ( char * ) message );
+        dataBuf = getOtaDataEventBuffer();
     }
-    return handled;
+
+    if( dataBuf != NULL )
+    {
+        nextEvent.eventId = OtaAgentEventReceivedFileBlock;
+        memcpy(dataBuf->data, message, messageLength);
+        nextEvent.dataEvent = dataBuf;
+        dataBuf->dataLength = messageLength;
+        queued = OtaSendEvent_FreeRTOS( &nextEvent ) == OtaOsSuccess;
+    }
+
+    /* The slot is only committed once its event is queued, so a
+     * failed send leaves it free for the next block. */
+    if( queued )
+    {
+        commitOtaDataEventBuffer();
+    }
+    else
+    {
+        /* A full ring means the OTA task is behind. The block is
+         * dropped rather than stalling the MQTT task. */
+        droppedBlocks++;
+        LogWarn( ( "Dropping file block of %u bytes, %u dropped so "
+                   "far.",
+                   ( unsigned int ) messageLength,
+                   droppedBlocks ) );
+    }
+
+    /* A dropped block is requested again, the message was still ours. */
+    return true;
 }
 
-static bool jobDocumentParser( char * message, size_t messageLength, AfrOtaJobDocumentFields_t *jobFields )
+/* Reads the files of the job message last indexed */
+static bool jobDocumentParser( AfrOtaJobDocumentFields_t *jobFields )
 {
-    char * jobDoc;
-    size_t jobDocLength = 0U;
     int8_t fileIndex = 0;
 
-    /*
-     * AWS IoT Jobs library:
-     * Extracting the OTA job document from the jobs message recevied from AWS IoT core.
-     */
-    jobDocLength = Jobs_GetJobDocument( message, messageLength, &jobDoc );
-
-    if( jobDocLength != 0U )
+    if( jobIndex.jobDocument.offset != 0U )
     {
         do
         {
-            /*
-             * AWS IoT Jobs library:
-             * Parsing the OTA job document to extract all of the parameters needed to download
-             * the new firmware.
-             */
-            fileIndex = otaParser_parseJobDocFile( jobDoc,
-                                                jobDocLength,
-                                                fileIndex,
-                                                jobFields );
+            fileIndex = jobIndex_getFile( &jobIndex,
+                                          ( uint8_t ) fileIndex,
+                                          jobFields );
         } while( fileIndex > 0 );
     }
 
@@ -468,25 +966,66 @@ static bool jobDocumentParser( char * message, size_t messageLength, AfrOtaJobDo
 }
 
 /* Stores the received data blocks in the flash partition reserved for OTA */
-static void handleMqttStreamsBlockArrived(
-    uint8_t *data, size_t dataLength )
+static bool handleMqttStreamsBlockArrived( uint32_t blockId,
+                                          const uint8_t *data,
+                                          size_t dataLength )
 {
-    assert( ( totalBytesReceived + dataLength ) <
-            CONFIG_MAX_FILE_SIZE );
+    size_t blockOffsetBytes = ( size_t ) blockId * blockWindow.blockSize;
+    bool stored = false;
 
-    printf( "Downloaded block %u of %u. \n", currentBlockOffset, (currentBlockOffset + numOfBlocksRemaining) );
+    LogDebug( ( "Downloaded block %u (%u of %u).",
+                blockId,
+                blockWindow.blocksReceived,
+                blockWindow.totalBlocks ) );
 
-    memcpy( downloadedData + totalBytesReceived,
-            data,
-            dataLength );
+    stored = imageSink.write( imageSink.pContext,
+                              blockOffsetBytes,
+                              data,
+                              dataLength ) == IMAGE_SINK_SUCCESS;
 
-    totalBytesReceived += dataLength;
+    if( !stored )
+    {
+        LogError( ( "Failed to store block %u. Aborting the download.",
+                    blockId ) );
+    }
+    else if( !imageVerifier_addBlock( &imageVerifier,
+                                      &blockWindow,
+                                      &imageSink,
+                                      blockId,
+                                      data,
+                                      dataLength ) )
+    {
+        LogError( ( "Failed to hash block %u. Aborting the download.",
+                    blockId ) );
+        stored = false;
+    }
+    else
+    {
+        totalBytesReceived += dataLength;
+        ( void ) downloadCheckpoint_record( &downloadCheckpoint,
+                                            &blockWindow,
+                                            blockId,
+                                            &imageSink );
+
+        if( progressReport_isDue( &downloadProgress,
+                                  Clock_GetTimeMs(),
+                                  blockWindow.blocksReceived,
+                                  blockWindow.totalBlocks ) )
+        {
+            LogInfo( ( "Download progress: %u%% (%u of %u blocks).",
+                       progressReport_percent( blockWindow.blocksReceived,
+                                               blockWindow.totalBlocks ),
+                       blockWindow.blocksReceived,
+                       blockWindow.totalBlocks ) );
+        }
+    }
 
+    return stored;
 }
 
 static void finishDownload()
 {
-    /* TODO: Do something with the completed download */
+    /* The image has been verified by the CloseFile event */
     /* Start the bootloader */
     char thingName[ MAX_THING_NAME_SIZE + 1 ] = { 0 };
     size_t thingNameLength = 0U;
@@ -505,7 +1044,7 @@ static void finishDownload()
                 thingName,
                 thingNameLength,
                 globalJobId,
-                strnlen( globalJobId, 1000U ),
+                strnlen( globalJobId, MAX_JOB_ID_LENGTH ),
                 &topicBufferLength);
 
     /*
@@ -519,10 +1058,13 @@ static void finishDownload()
                                                 messageBuffer,
                                                 UPDATE_JOB_MSG_LENGTH );
 
-    mqttWrapper_publish(topicBuffer,
-                        topicBufferLength,
-                        ( uint8_t * ) messageBuffer,
-                        messageBufferLength);
-    printf( "\033[1;32mOTA Completed successfully!\033[0m\n" );
+    /* The status update is what completes the job, so the broker
+     * acknowledges it. */
+    mqttWrapper_publishWithQos( topicBuffer,
+                                topicBufferLength,
+                                ( uint8_t * ) messageBuffer,
+                                messageBufferLength,
+                                MQTTQoS1 );
+    LogInfo( ( "OTA Completed successfully!" ) );
     globalJobId[ 0 ] = 0U;
 }
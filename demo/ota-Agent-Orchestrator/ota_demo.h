@@ -13,7 +13,12 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-#define OTA_DATA_BLOCK_SIZE 256U
+#include "MQTTFileDownloader.h"
+
+/* Should match the block size the downloader requests */
+#ifndef OTA_DATA_BLOCK_SIZE
+    #define OTA_DATA_BLOCK_SIZE 256U
+#endif
 #define JOB_DOC_SIZE 2048U
 
 typedef enum OtaEvent
@@ -24,6 +29,7 @@ typedef enum OtaEvent
     OtaAgentEventCreateFile,          /*!< @brief Event to create a file. */
     OtaAgentEventRequestFileBlock,    /*!< @brief Event to request file blocks. */
     OtaAgentEventReceivedFileBlock,   /*!< @brief Event to trigger when file block is received. */
+    OtaAgentEventFileBlockTimeout,    /*!< @brief Event to trigger when a file block request went unanswered. */
     OtaAgentEventCloseFile,           /*!< @brief Event to trigger closing file. */
     OtaAgentEventSuspend,             /*!< @brief Event to suspend ota task */
     OtaAgentEventResume,              /*!< @brief Event to resume suspended task */
@@ -62,7 +68,6 @@ typedef struct OtaDataEvent
 {
     uint8_t data[ OTA_DATA_BLOCK_SIZE * 2 ]; /*!< Buffer for storing event information. */
     size_t dataLength;                 /*!< Total space required for the event. */
-    bool bufferUsed;                     /*!< Flag set when buffer is used otherwise cleared. */
 } OtaDataEvent_t;
 
 typedef struct OtaJobEventData
@@ -83,6 +88,10 @@ typedef struct OtaEventMsg
 } OtaEventMsg_t;
 
 
+/* Encoding the stream blocks are requested in, OTA_STREAM_DATA_TYPE unless
+ * set before otaDemo_start() */
+void otaDemo_setDataType( DataType_t dataType );
+
 void otaDemo_start( void );
 
 bool otaDemo_handleIncomingMQTTMessage( char * topic,
@@ -90,5 +99,8 @@ bool otaDemo_handleIncomingMQTTMessage( char * topic,
                                         uint8_t * message,
                                         size_t messageLength );
 
+/* Called from the MQTT task once a lost connection has been replaced */
+void otaDemo_handleReconnect( void );
+
 OtaState_t getOtaAgentState();
 #endif
@@ -20,11 +20,25 @@
 #include "core_mqtt.h"
 #include "mqtt_wrapper.h"
 #include "ota_demo.h"
+#include "transport/connection_manager.h"
 #include "transport/transport_wrapper.h"
 #include "utils/clock.h"
+#include "utils/ota_topics.h"
+
+#ifdef LOGGING_ASYNC
+    #include "csdk_logging/async_log.h"
+#endif
 
 #define MAX_THING_NAME_SIZE 128U
 
+/* Longest time the MQTT task waits in the socket. A task in poll() is still
+ * running as far as the scheduler knows, so the wait is kept under a tick and
+ * the task then blocks for a tick to let the lower priority OTA task run. */
+#define MQTT_RECV_WAIT_MS   5U
+
+/* Stack depth of each task, in words */
+#define TASK_STACK_DEPTH    6000U
+
 static TransportInterface_t transport = { 0 };
 static MQTTContext_t mqttContext = { 0 };
 static uint8_t networkBuffer[ 5000U ];
@@ -34,6 +48,11 @@ static StaticSemaphore_t MQTTStateUpdateLockBuffer;
 SemaphoreHandle_t MQTTAgentLock = NULL;
 SemaphoreHandle_t MQTTStateUpdateLock = NULL;
 
+static StaticTask_t otaTaskBuffer;
+static StaticTask_t mqttProcessLoopTaskBuffer;
+static StackType_t otaTaskStack[ TASK_STACK_DEPTH ];
+static StackType_t mqttProcessLoopTaskStack[ TASK_STACK_DEPTH ];
+
 static void otaTask( void * parameters );
 
 static void mqttProcessLoopTask( void * parameters );
@@ -51,15 +70,20 @@ int main( int argc, char * argv[] )
 {
     MQTTStatus_t mqttResult;
     MQTTFixedBuffer_t fixedBuffer = { 0 };
+    DataType_t dataType = OTA_STREAM_DATA_TYPE;
 
-    if( argc != 6 )
+    /* The stream encoding is optional and defaults to the one built in. */
+    if( ( ( argc != 6 ) && ( argc != 7 ) ) ||
+        ( ( argc == 7 ) && !otaTopics_parseDataType( argv[ 6 ], &dataType ) ) )
     {
         printf( "Usage: %s certificateFilePath privateKeyFilePath "
-                "rootCAFilePath endpoint thingName\n",
+                "rootCAFilePath endpoint thingName [cbor|json]\n",
                 argv[ 0 ] );
         return 1;
     }
 
+    otaDemo_setDataType( dataType );
+
     MQTTAgentLock = xSemaphoreCreateRecursiveMutexStatic(
         &MQTTAgentLockBuffer );
     MQTTStateUpdateLock = xSemaphoreCreateMutexStatic(
@@ -76,13 +100,31 @@ int main( int argc, char * argv[] )
                             &fixedBuffer );
     assert( mqttResult == MQTTSuccess );
 
-    xTaskCreate( otaTask, "T_OTA", 6000, ( void * ) argv, 1, NULL );
-    xTaskCreate( mqttProcessLoopTask, "T_MQTT", 6000, NULL, 2, NULL );
+    xTaskCreateStatic( otaTask,
+                       "T_OTA",
+                       TASK_STACK_DEPTH,
+                       ( void * ) argv,
+                       1,
+                       otaTaskStack,
+                       &otaTaskBuffer );
+    /* Above the OTA task, so keep-alives and acknowledgements are handled
+     * however busy the OTA task is. */
+    xTaskCreateStatic( mqttProcessLoopTask,
+                       "T_MQTT",
+                       TASK_STACK_DEPTH,
+                       NULL,
+                       2,
+                       mqttProcessLoopTaskStack,
+                       &mqttProcessLoopTaskBuffer );
 
     mqttWrapper_setCoreMqttContext( &mqttContext );
     mqttWrapper_setThingName( argv[ 5 ],
                               strnlen( argv[ 5 ], MAX_THING_NAME_SIZE ) );
 
+#ifdef LOGGING_ASYNC
+    ( void ) asyncLog_start( 1 );
+#endif
+
     vTaskStartScheduler();
 
     return 0;
@@ -96,15 +138,43 @@ static void mqttProcessLoopTask( void * parameters )
     {
         if( mqttWrapper_isConnected() )
         {
-            MQTTStatus_t status = MQTT_ProcessLoop( &mqttContext );
+            MQTTStatus_t status = MQTTSuccess;
+
+            /* Wake as soon as a record arrives, then drain every record that
+             * is already buffered before waiting again. */
+            ( void ) transport_waitForData( MQTT_RECV_WAIT_MS );
 
-            if( status == MQTTRecvFailed )
+            do
             {
-                printf( "ERROR: MQTT Receive failed. Closing connection.\n" );
-                exit( 1 );
+                status = MQTT_ProcessLoop( &mqttContext );
+            } while( ( ( status == MQTTSuccess ) ||
+                       ( status == MQTTNeedMoreBytes ) ) &&
+                     transport_waitForData( 0U ) );
+
+            /* The demo carries on from where it was once the connection
+             * is back, rather than starting over. */
+            if( ( status == MQTTRecvFailed ) || ( status == MQTTSendFailed ) ||
+                ( status == MQTTKeepAliveTimeout ) )
+            {
+                if( !connectionManager_reconnect() )
+                {
+                    printf( "ERROR: Failed to reconnect to IoT Core.\n" );
+                    exit( 1 );
+                }
+
+                otaDemo_handleReconnect();
             }
+
+            otaDemo_checkTimeouts();
+
+            /* Let the OTA task, woken by the received messages, run before
+             * this task goes back to waiting in the socket. */
+            vTaskDelay( 1 );
+        }
+        else
+        {
+            vTaskDelay( 10 );
         }
-        vTaskDelay( 10 );
     }
 }
 
@@ -141,6 +211,8 @@ static void mqttEventCallback( MQTTContext_t * mqttContext,
             case MQTT_PACKET_TYPE_SUBACK:
                 printf( "SUBACK received with packet id: %u\n",
                         ( unsigned int ) deserializedInfo->packetIdentifier );
+                mqttWrapper_handleSubAck( packetInfo,
+                                          deserializedInfo->packetIdentifier );
                 break;
 
             case MQTT_PACKET_TYPE_UNSUBACK:
@@ -160,19 +232,11 @@ static void handleIncomingMQTTMessage( char * topic,
                                        size_t messageLength )
 
 {
-    bool messageHandled = otaDemo_handleIncomingMQTTMessage( topic,
-                                                             topicLength,
-                                                             message,
-                                                             messageLength );
-    if( !messageHandled )
-    {
-        printf( "Unhandled incoming PUBLISH received on topic, message: "
-                "%.*s\n%.*s\n",
-                ( unsigned int ) topicLength,
-                topic,
-                ( unsigned int ) messageLength,
-                ( char * ) message );
-    }
+    /* The demo logs the messages it could not route or handle. */
+    ( void ) otaDemo_handleIncomingMQTTMessage( topic,
+                                                topicLength,
+                                                message,
+                                                messageLength );
 }
 
 static void otaTask( void * parameters )
@@ -184,15 +248,17 @@ static void otaTask( void * parameters )
     char * endpoint = commandLineArgs[ 4 ];
     char * thingName = commandLineArgs[ 5 ];
 
-    bool result = transport_tlsConnect( certificateFilePath,
-                                        privateKeyFilePath,
-                                        rootCAFilePath,
-                                        endpoint );
-    assert( result );
+    connectionManager_init( certificateFilePath,
+                            privateKeyFilePath,
+                            rootCAFilePath,
+                            endpoint,
+                            thingName );
 
-    result = mqttWrapper_connect( thingName,
-                                  strnlen( thingName, MAX_THING_NAME_SIZE ) );
-    assert( result );
+    if( !connectionManager_connect() )
+    {
+        printf( "ERROR: Failed to connect to IoT Core.\n" );
+        exit( 1 );
+    }
     printf( "Successfully connected to IoT Core\n" );
 
     otaDemo_start();
@@ -7,36 +7,138 @@
  * the License.
  */
 
+/* Per-block messages are debug only, so at the default level the block path
+ * does no formatted output. */
+#ifndef OTA_DEMO_LOG_LEVEL
+    #define OTA_DEMO_LOG_LEVEL LOG_INFO
+#endif
+
+#define LIBRARY_LOG_NAME  "OtaDemo"
+#define LIBRARY_LOG_LEVEL OTA_DEMO_LOG_LEVEL
+#include "csdk_logging/logging.h"
+
 #include <assert.h>
-#include <stdio.h>
 #include <string.h>
 
 #include "MQTTFileDownloader.h"
+#include "download/block_window.h"
+#include "download/download_checkpoint.h"
+#include "download/flow_control.h"
+#include "download/image_verifier.h"
+#include "download/stream_block.h"
 #include "jobs.h"
 #include "mqtt_wrapper.h"
 #include "ota_demo.h"
 #include "ota_job_processor.h"
+#include "storage/image_sink.h"
+#include "storage/image_sink_mmap.h"
+#include "storage/image_sink_posix.h"
+#include "utils/clock.h"
+#include "utils/job_index.h"
+#include "utils/ota_topics.h"
+#include "utils/progress_report.h"
+#include "utils/topic_router.h"
+#include "FreeRTOS.h"
+#include "semphr.h"
 
-#define CONFIG_MAX_FILE_SIZE    65536U
-#define NUM_OF_BLOCKS_REQUESTED 1U
+#define NUM_OF_BLOCKS_REQUESTED 4U
+#define MAX_NUM_OF_BLOCKS_IN_FLIGHT 16U
 #define MAX_THING_NAME_SIZE     128U
 #define MAX_JOB_ID_LENGTH       64U
 #define START_JOB_MSG_LENGTH  147U
 #define UPDATE_JOB_MSG_LENGTH 48U
 
-MqttFileDownloaderContext_t mqttFileDownloaderContext = { 0 };
-static uint32_t numOfBlocksRemaining = 0;
-static uint32_t currentBlockOffset = 0;
-static uint8_t currentFileId = 0;
-static uint32_t totalBytesReceived = 0;
-static uint8_t downloadedData[ CONFIG_MAX_FILE_SIZE ] = { 0 };
+/* Files of a job downloaded at the same time, each with its own window */
+#ifndef MAX_NUM_OF_FILE_DOWNLOADS
+    #define MAX_NUM_OF_FILE_DOWNLOADS 4U
+#endif
+
+/* Minimum time between two download progress messages */
+#ifndef PROGRESS_REPORT_INTERVAL_MS
+    #define PROGRESS_REPORT_INTERVAL_MS 1000U
+#endif
+
+/* Set to 1 to store images through a shared file mapping instead of pwrite */
+#ifndef USE_MMAP_IMAGE_SINK
+    #define USE_MMAP_IMAGE_SINK 0
+#endif
+
+/* State of the download of one file of the job */
+typedef struct FileDownload
+{
+    MqttFileDownloaderContext_t downloaderContext;
+    BlockWindow_t window;
+    FlowControl_t flowControl;
+    ProgressReport_t progress;
+    ImageSink_t sink;
+#if USE_MMAP_IMAGE_SINK
+    ImageSinkMmapContext_t sinkContext;
+#else
+    ImageSinkPosixContext_t sinkContext;
+#endif
+    DownloadCheckpoint_t checkpoint;
+    ImageVerifier_t verifier;
+    uint32_t bytesReceived;
+    uint8_t fileId;
+    bool active;
+} FileDownload_t;
+
+/* The files of a job share the stream of the job and the MQTT connection,
+ * their blocks are told apart by file ID. */
+static FileDownload_t fileDownloads[ MAX_NUM_OF_FILE_DOWNLOADS ] = { 0 };
+static uint32_t failedDownloads = 0;
 char globalJobId[ MAX_JOB_ID_LENGTH ] = { 0 };
 
-static void handleMqttStreamsBlockArrived( uint8_t * data, size_t dataLength );
-static void processJobFile( AfrOtaJobDocumentFields_t * params );
+/* Created by main.c, coreMQTT takes it around its state updates */
+extern SemaphoreHandle_t MQTTStateUpdateLock;
+
+/* Topics are built once per job, so a message costs one comparison */
+static TopicRouter_t topicRouter = { 0 };
+
+static DataType_t streamDataType = OTA_STREAM_DATA_TYPE;
+
+/* Built once per job message, then read for every file of the job */
+static JobIndex_t jobIndex = { 0 };
+
+/* Status update that completes the job, published again after a reconnect
+ * until the job service answers it. Empty when no update is pending. */
+static char pendingUpdateTopic[ TOPIC_BUFFER_SIZE + 1 ] = { 0 };
+static size_t pendingUpdateTopicLength = 0U;
+static char pendingUpdateMessage[ UPDATE_JOB_MSG_LENGTH ] = { 0 };
+static size_t pendingUpdateMessageLength = 0U;
+
+static void handleMqttStreamsBlockArrived( FileDownload_t * download,
+                                          uint32_t blockId,
+                                          const uint8_t * data,
+                                          size_t dataLength );
+static bool processJobFile( AfrOtaJobDocumentFields_t * params );
+static void startDownload( FileDownload_t * download );
+static void requestDataBlocks( FileDownload_t * download );
+static void requestExpiredBlocks( FileDownload_t * download, uint32_t nowMs );
+static bool openImageSink( FileDownload_t * download,
+                           AfrOtaJobDocumentFields_t * params );
+static void commitImage( FileDownload_t * download );
+static void abortDownload( FileDownload_t * download );
+static void endDownload( FileDownload_t * download );
+static FileDownload_t * findDownload( uint8_t fileId );
+static bool isDownloading( void );
 static void finishDownload();
-static bool jobMetadataHandlerChain( char * topic, size_t topicLength );
+static void publishPendingUpdate( void );
 static bool jobHandlerChain( char * message, size_t messageLength );
+static bool routeJobUpdateStatus( void );
+static bool handleStartNextAccepted( uint8_t * message, size_t messageLength );
+static bool handleJobUpdateAccepted( uint8_t * message, size_t messageLength );
+static bool handleJobUpdateRejected( uint8_t * message, size_t messageLength );
+static bool setRoute( const char * topic,
+                      size_t topicLength,
+                      TopicHandler_t handler );
+static void removeRoute( TopicHandler_t handler );
+static bool handleDataBlockMessage( uint8_t * message, size_t messageLength );
+
+void otaDemo_setDataType( DataType_t dataType )
+{
+    streamDataType = dataType;
+}
 
 void otaDemo_start( void )
 {
@@ -48,6 +150,34 @@ void otaDemo_start( void )
         char messageBuffer[ START_JOB_MSG_LENGTH ] = { 0 };
         size_t topicLength = 0U;
         mqttWrapper_getThingName( thingName, &thingNameLength );
+        topicRouter_init( &topicRouter );
+
+        LogInfo( ( "Requesting stream blocks in %s.",
+                   otaTopics_dataTypeName( streamDataType ) ) );
+
+        if( !otaTopics_subscribe( thingName,
+                                  thingNameLength,
+                                  streamDataType,
+                                  true ) )
+        {
+            LogWarn( ( "Failed to subscribe to the OTA topics." ) );
+        }
+
+        /*
+         * AWS IoT Jobs library:
+         * Creates the start-next/accepted topic the job document arrives on.
+         */
+        if( ( Jobs_GetTopic( topicBuffer,
+                             TOPIC_BUFFER_SIZE,
+                             thingName,
+                             ( uint16_t ) thingNameLength,
+                             JobsStartNextSuccess,
+                             &topicLength ) != JobsSuccess ) ||
+            !setRoute( topicBuffer, topicLength, handleStartNextAccepted ) )
+        {
+            LogError( ( "Failed to route the start-next response topic." ) );
+            return;
+        }
 
         /*
          * AWS IoT Jobs library:
@@ -70,126 +200,290 @@ void otaDemo_start( void )
                                                  messageBuffer,
                                                  START_JOB_MSG_LENGTH );
 
-        mqttWrapper_publish(topicBuffer,
-                            topicLength,
-                            ( uint8_t * ) messageBuffer,
-                            messageLength);
+        /* The broker acknowledges the job request. Block requests stay at
+         * QoS 0, the downloader times them itself. */
+        mqttWrapper_publishWithQos( topicBuffer,
+                                    topicLength,
+                                    ( uint8_t * ) messageBuffer,
+                                    messageLength,
+                                    MQTTQoS1 );
+
+
+
+    }
+}
+
+void otaDemo_handleReconnect( void )
+{
+    /* Requests and blocks in flight were lost with the connection, so every
+     * block still missing is requested again. Without a job in progress the
+     * job is asked for again, in case the request or its answer was lost. */
+    if( isDownloading() )
+    {
+        for( size_t i = 0U; i < MAX_NUM_OF_FILE_DOWNLOADS; i++ )
+        {
+            if( fileDownloads[ i ].active )
+            {
+                LogInfo( ( "Resuming file %u at %u of %u blocks.",
+                           fileDownloads[ i ].fileId,
+                           fileDownloads[ i ].window.blocksReceived,
+                           fileDownloads[ i ].window.totalBlocks ) );
+                blockWindow_rewind( &fileDownloads[ i ].window );
+                flowControl_clearRequests( &fileDownloads[ i ].flowControl );
+                requestDataBlocks( &fileDownloads[ i ] );
+            }
+        }
+    }
+    else if( globalJobId[ 0 ] == 0 )
+    {
+        otaDemo_start();
+    }
+    else if( pendingUpdateTopicLength > 0U )
+    {
+        /* The clean session dropped the update if it had not been answered,
+         * the job service takes the same status twice. */
+        LogInfo( ( "Publishing the status of the job again." ) );
+        publishPendingUpdate();
+    }
+    else
+    {
+        /* Empty else. */
+    }
+}
 
+void otaDemo_checkTimeouts( void )
+{
+    uint32_t nowMs = Clock_GetTimeMs();
+    FileDownload_t * download = NULL;
 
+    /* Blocks lost on the way are only noticed by their request going
+     * unanswered. */
+    for( size_t i = 0U; i < MAX_NUM_OF_FILE_DOWNLOADS; i++ )
+    {
+        download = &fileDownloads[ i ];
 
+        if( download->active &&
+            flowControl_hasExpired( &download->flowControl, nowMs ) )
+        {
+            requestExpiredBlocks( download, nowMs );
+            LogInfo( ( "Block request of file %u timed out, window is now %u "
+                       "blocks.",
+                       download->fileId,
+                       download->flowControl.window ) );
+        }
     }
 }
 
 /* Implemented for use by the MQTT library */
+/* Routes change on the OTA task while the MQTT task dispatches, so the
+ * router is held under the lock coreMQTT takes for its own state. */
+static void lockRouter( void )
+{
+    if( MQTTStateUpdateLock != NULL )
+    {
+        xSemaphoreTake( MQTTStateUpdateLock, portMAX_DELAY );
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void unlockRouter( void )
+{
+    if( MQTTStateUpdateLock != NULL )
+    {
+        xSemaphoreGive( MQTTStateUpdateLock );
+    }
+}
+/*-----------------------------------------------------------*/
+
+static bool setRoute( const char * topic,
+                      size_t topicLength,
+                      TopicHandler_t handler )
+{
+    bool set = false;
+
+    lockRouter();
+    set = topicRouter_set( &topicRouter, topic, topicLength, handler );
+    unlockRouter();
+
+    return set;
+}
+/*-----------------------------------------------------------*/
+
+static void removeRoute( TopicHandler_t handler )
+{
+    lockRouter();
+    topicRouter_remove( &topicRouter, handler );
+    unlockRouter();
+}
+/*-----------------------------------------------------------*/
+
 bool otaDemo_handleIncomingMQTTMessage( char * topic,
                                         size_t topicLength,
                                         uint8_t * message,
                                         size_t messageLength )
 {
+    TopicHandler_t handler = NULL;
     bool handled = false;
 
-    handled = jobMetadataHandlerChain( topic, topicLength );
+    lockRouter();
+    handler = topicRouter_find( &topicRouter, topic, topicLength );
+    unlockRouter();
 
-    if( !handled )
+    if( handler == NULL )
     {
-        char thingName[ MAX_THING_NAME_SIZE + 1 ] = { 0 };
-        size_t thingNameLength = 0U;
+        LogWarn( ( "No route for the incoming MQTT message on topic: %.*s",
+                   ( unsigned int ) topicLength,
+                   topic ) );
+    }
+    else if( !handler( message, messageLength ) )
+    {
+        LogWarn( ( "Rejected incoming MQTT message on topic: "
+                   "%.*s\nMessage: %.*s",
+                   ( unsigned int ) topicLength,
+                   topic,
+                   ( unsigned int ) messageLength,
+                   ( char * ) message ) );
+    }
+    else
+    {
+        handled = true;
+    }
 
-        mqttWrapper_getThingName( thingName, &thingNameLength );
+    return handled;
+}
 
-        /*
-         * AWS IoT Jobs library:
-         * Checks if a message comes from the start-next/accepted reserved topic.
-         */
-        handled = Jobs_IsStartNextAccepted( topic, topicLength, thingName, thingNameLength );
+/* Routes the update responses of the job held in globalJobId */
+static bool routeJobUpdateStatus( void )
+{
+    static const char acceptedSuffix[] = "/accepted";
+    static const char rejectedSuffix[] = "/rejected";
+    char thingName[ MAX_THING_NAME_SIZE + 1 ] = { 0 };
+    size_t thingNameLength = 0U;
+    char topicBuffer[ TOPIC_BUFFER_SIZE + 1 ] = { 0 };
+    size_t topicLength = 0U;
+    bool routed = false;
 
-        if( handled )
-        {
-            handled = jobHandlerChain( ( char * ) message, messageLength );
-        }
-        else
-        {
-            /*
-             * MQTT streams Library:
-             * Checks if the incoming message contains the requested data block. It is performed by
-             * comparing the incoming MQTT message topic with MQTT streams topics.
-             */
-            handled = mqttDownloader_isDataBlockReceived( &mqttFileDownloaderContext,
-                                                      topic,
-                                                      topicLength );
-            if( handled )
-            {
-                uint8_t decodedData[ mqttFileDownloader_CONFIG_BLOCK_SIZE ];
-                size_t decodedDataLength = 0;
-
-                /*
-                 * MQTT streams Library:
-                 * Extracting and decoding the received data block from the incoming MQTT message.
-                 */
-                handled = mqttDownloader_processReceivedDataBlock(
-                    &mqttFileDownloaderContext,
-                    message,
-                    messageLength,
-                    decodedData,
-                    &decodedDataLength );
-                handleMqttStreamsBlockArrived( decodedData, decodedDataLength );
-            }
-        }
-    }
+    mqttWrapper_getThingName( thingName, &thingNameLength );
 
-    if( !handled )
+    /*
+     * AWS IoT Jobs library:
+     * Creates the update topic of the job, the responses arrive on it with
+     * an accepted or rejected suffix.
+     */
+    if( ( Jobs_Update( topicBuffer,
+                       TOPIC_BUFFER_SIZE,
+                       thingName,
+                       ( uint16_t ) thingNameLength,
+                       globalJobId,
+                       ( uint16_t ) strnlen( globalJobId, MAX_JOB_ID_LENGTH ),
+                       &topicLength ) == JobsSuccess ) &&
+        ( topicLength + sizeof( acceptedSuffix ) <= sizeof( topicBuffer ) ) )
     {
-        printf( "Unrecognized incoming MQTT message received on topic: "
-                "%.*s\nMessage: %.*s\n",
-                ( unsigned int ) topicLength,
-                topic,
-                ( unsigned int ) messageLength,
-                ( char * ) message );
+        memcpy( &topicBuffer[ topicLength ],
+                acceptedSuffix,
+                sizeof( acceptedSuffix ) - 1U );
+        routed = setRoute( topicBuffer,
+                           topicLength + sizeof( acceptedSuffix ) - 1U,
+                           handleJobUpdateAccepted );
+
+        /* Sends nothing once the update wildcard of otaDemo_start() is
+         * granted, and takes its place if the broker refused it. */
+        ( void ) mqttWrapper_subscribe( topicBuffer,
+                                        topicLength +
+                                        sizeof( acceptedSuffix ) - 1U );
+
+        memcpy( &topicBuffer[ topicLength ],
+                rejectedSuffix,
+                sizeof( rejectedSuffix ) - 1U );
+        routed = routed &&
+                 setRoute( topicBuffer,
+                           topicLength + sizeof( rejectedSuffix ) - 1U,
+                           handleJobUpdateRejected );
+
+        ( void ) mqttWrapper_subscribe( topicBuffer,
+                                        topicLength +
+                                        sizeof( rejectedSuffix ) - 1U );
     }
-    return handled;
+
+    return routed;
+}
+
+/* Routed from the start-next/accepted reserved topic */
+static bool handleStartNextAccepted( uint8_t * message, size_t messageLength )
+{
+    return jobHandlerChain( ( char * ) message, messageLength );
 }
 
-static bool jobMetadataHandlerChain( char * topic, size_t topicLength )
+/* Routed from the update/accepted topic of the current job */
+static bool handleJobUpdateAccepted( uint8_t * message, size_t messageLength )
 {
+    ( void ) message;
+    ( void ) messageLength;
+
+    LogInfo( ( "Job was accepted! Clearing Job ID." ) );
+    globalJobId[ 0 ] = 0;
+    pendingUpdateTopicLength = 0U;
+    removeRoute( handleJobUpdateAccepted );
+    removeRoute( handleJobUpdateRejected );
+
+    return true;
+}
+
+/* Routed from the update/rejected topic of the current job */
+static bool handleJobUpdateRejected( uint8_t * message, size_t messageLength )
+{
+    ( void ) message;
+    ( void ) messageLength;
+
+    LogWarn( ( "Job was rejected! Clearing Job ID." ) );
+    globalJobId[ 0 ] = 0;
+    pendingUpdateTopicLength = 0U;
+    removeRoute( handleJobUpdateAccepted );
+    removeRoute( handleJobUpdateRejected );
+
+    return true;
+}
+
+/* Routed from the data topic of the stream being downloaded */
+static bool handleDataBlockMessage( uint8_t * message, size_t messageLength )
+{
+    StreamBlock_t block = { 0 };
+    FileDownload_t * download = NULL;
     bool handled = false;
 
-    if( globalJobId[ 0 ] != 0 )
+    /* Every file of the job comes from the same stream, so any download
+     * tells how its blocks are encoded. */
+    for( size_t i = 0U; ( download == NULL ) &&
+         ( i < MAX_NUM_OF_FILE_DOWNLOADS ); i++ )
     {
-        char thingName[ MAX_THING_NAME_SIZE + 1 ] = { 0 };
-        size_t thingNameLength = 0U;
-
-        mqttWrapper_getThingName( thingName, &thingNameLength );
-        handled = Jobs_IsJobUpdateStatus( topic,
-                                              topicLength,
-                                              ( const char * ) &globalJobId,
-                                              strnlen( globalJobId,
-                                                       MAX_JOB_ID_LENGTH ),
-                                              thingName,
-                                              thingNameLength,
-                                              JobUpdateStatus_Accepted );
-
-        if( handled )
+        if( fileDownloads[ i ].active )
         {
-            printf( "Job was accepted! Clearing Job ID.\n" );
-            globalJobId[ 0 ] = 0;
-        }
-        else
-        {
-            handled = Jobs_IsJobUpdateStatus( topic,
-                                                  topicLength,
-                                                  ( const char * ) &globalJobId,
-                                                  strnlen( globalJobId,
-                                                           MAX_JOB_ID_LENGTH ),
-                                                  thingName,
-                                                  thingNameLength,
-                                                  JobUpdateStatus_Rejected );
+            download = &fileDownloads[ i ];
         }
+    }
 
-        if( handled )
-        {
-            printf( "Job was rejected! Clearing Job ID.\n" );
-            globalJobId[ 0 ] = 0;
-        }
+    /* The block is located inside the MQTT receive buffer and stored from
+     * there, no intermediate copy is made. Blocks of a pipelined download
+     * may arrive in any order, so the block index is taken from the message
+     * itself. */
+    if( download != NULL )
+    {
+        handled = streamBlock_decode( download->downloaderContext.dataType,
+                                      message,
+                                      messageLength,
+                                      &block );
+    }
+
+    /* Blocks of a file that is no longer downloaded are still handled, they
+     * were requested before it completed or failed. */
+    download = handled ? findDownload( block.fileId ) : NULL;
+
+    if( download != NULL )
+    {
+        handleMqttStreamsBlockArrived( download,
+                                       block.blockId,
+                                       block.payload,
+                                       block.payloadLength );
     }
 
     return handled;
@@ -197,51 +491,75 @@ static bool jobMetadataHandlerChain( char * topic, size_t topicLength )
 
 static bool jobHandlerChain( char * message, size_t messageLength )
 {
-    char * jobDoc;
+    const char * jobDoc = NULL;
     size_t jobDocLength = 0U;
-    char * jobId;
+    const char * jobId = NULL;
     size_t jobIdLength = 0U;
     int8_t fileIndex = 0;
 
-    /*
-     * AWS IoT Jobs library:
-     * Extracting the OTA job document from the jobs message recevied from AWS IoT core.
-     */
-    jobDocLength = Jobs_GetJobDocument( message, messageLength, &jobDoc );
+    /* The message is walked once here. The job ID, the job document and
+     * the fields of every file are then read from the index. A job that
+     * cannot be indexed is not handled. */
+    if( !jobIndex_build( &jobIndex, message, messageLength ) )
+    {
+        LogError( ( "Failed to parse the job message, it is not valid JSON "
+                    "or lists more than %u files.",
+                    ( unsigned int ) JOB_INDEX_MAX_FILES ) );
+        return false;
+    }
 
-    /*
-     * AWS IoT Jobs library:
-     * Extracting the job ID from the received OTA job document.
-     */
-    jobIdLength = Jobs_GetJobId( message, messageLength, &jobId );
+    jobDocLength = jobIndex_getValue( &jobIndex,
+                                      &jobIndex.jobDocument,
+                                      &jobDoc );
+    jobIdLength = jobIndex_getValue( &jobIndex, &jobIndex.jobId, &jobId );
 
-    if( globalJobId[ 0 ] == 0 )
+    if( ( globalJobId[ 0 ] == 0 ) && ( jobIdLength < MAX_JOB_ID_LENGTH ) )
     {
-        strncpy( globalJobId, jobId, jobIdLength );
+        /* Only the first byte is cleared between jobs, so the end of the
+         * ID is marked whatever the length of the previous one. */
+        memcpy( globalJobId, jobId, jobIdLength );
+        globalJobId[ jobIdLength ] = '\0';
+
+        if( !routeJobUpdateStatus() )
+        {
+            LogWarn( ( "Failed to route the job update response topics." ) );
+        }
     }
 
     if( jobDocLength != 0U && jobIdLength != 0U )
     {
         AfrOtaJobDocumentFields_t jobFields = { 0 };
+        FileDownload_t * started[ MAX_NUM_OF_FILE_DOWNLOADS ] = { 0 };
+        size_t startedCount = 0U;
+
+        /* A job document received again while its files are downloaded
+         * starts nothing, and must not forget the files that failed. */
+        if( !isDownloading() )
+        {
+            failedDownloads = 0U;
+        }
 
         do
         {
-            /*
-             * AWS IoT Jobs library:
-             * Parsing the OTA job document to extract all of the parameters needed to download
-             * the new firmware.
-             */
-            fileIndex = otaParser_parseJobDocFile( jobDoc,
-                                                   jobDocLength,
-                                                   fileIndex,
-                                                   &jobFields );
-
-            if( fileIndex >= 0 )
+            fileIndex = jobIndex_getFile( &jobIndex,
+                                          ( uint8_t ) fileIndex,
+                                          &jobFields );
+
+            if( ( fileIndex >= 0 ) && processJobFile( &jobFields ) )
             {
-                printf("Received OTA Job \n");
-                processJobFile( &jobFields );
+                LogInfo( ( "Received OTA Job." ) );
+                started[ startedCount ] = findDownload(
+                    ( uint8_t ) jobFields.fileId );
+                startedCount++;
             }
         } while( fileIndex > 0 );
+
+        /* Every file is set up before any is requested, so one that is
+         * already complete cannot end the job before the others start. */
+        for( size_t i = 0U; i < startedCount; i++ )
+        {
+            startDownload( started[ i ] );
+        }
     }
 
     // File index will be -1 if an error occured, and 0 if all files were
@@ -249,7 +567,9 @@ static bool jobHandlerChain( char * message, size_t messageLength )
     return fileIndex == 0;
 }
 
-static void requestDataBlock( void )
+static void requestDataBlock( FileDownload_t * download,
+                              uint32_t blockOffset,
+                              uint32_t numBlocks )
 {
     char getStreamRequest[ GET_STREAM_REQUEST_BUFFER_SIZE ];
     size_t getStreamRequestLength = 0U;
@@ -260,92 +580,479 @@ static void requestDataBlock( void )
      * creates the get block request. To publish the request, MQTT libraries
      * like coreMQTT are required.
      */
-    getStreamRequestLength = mqttDownloader_createGetDataBlockRequest( mqttFileDownloaderContext.dataType,
-                                        currentFileId,
+    getStreamRequestLength = mqttDownloader_createGetDataBlockRequest( download->downloaderContext.dataType,
+                                        download->fileId,
                                         mqttFileDownloader_CONFIG_BLOCK_SIZE,
-                                        currentBlockOffset,
-                                        NUM_OF_BLOCKS_REQUESTED,
+                                        blockOffset,
+                                        numBlocks,
                                         getStreamRequest,
                                         GET_STREAM_REQUEST_BUFFER_SIZE );
 
-    mqttWrapper_publish( mqttFileDownloaderContext.topicGetStream,
-                         mqttFileDownloaderContext.topicGetStreamLength,
+    mqttWrapper_publish( download->downloaderContext.topicGetStream,
+                         download->downloaderContext.topicGetStreamLength,
                          ( uint8_t * ) getStreamRequest,
                          getStreamRequestLength );
 }
 
+/* Keeps the window full so the broker round trip overlaps earlier blocks */
+static void requestDataBlocks( FileDownload_t * download )
+{
+    uint32_t blockOffset = 0U;
+    uint32_t numBlocks = 0U;
+
+    flowControl_apply( &download->flowControl, &download->window );
+
+    /* A request that could not be timed waits for an answered one. */
+    while( flowControl_canRequest( &download->flowControl ) &&
+           blockWindow_nextRequest( &download->window,
+                                    &blockOffset,
+                                    &numBlocks ) )
+    {
+        requestDataBlock( download, blockOffset, numBlocks );
+        ( void ) flowControl_onRequest( &download->flowControl,
+                                        blockOffset,
+                                        numBlocks,
+                                        Clock_GetTimeMs() );
+    }
+}
+
+/* Requests again the blocks of requests that went unanswered, and only
+ * those, the blocks that did arrive are not asked for twice */
+static void requestExpiredBlocks( FileDownload_t * download, uint32_t nowMs )
+{
+    uint32_t firstBlock = 0U;
+    uint32_t numBlocks = 0U;
+    uint32_t blockOffset = 0U;
+    uint32_t runLength = 0U;
+
+    while( flowControl_takeExpired( &download->flowControl,
+                                    nowMs,
+                                    &firstBlock,
+                                    &numBlocks ) )
+    {
+        blockOffset = firstBlock;
+
+        while( blockWindow_nextMissing( &download->window,
+                                        &blockOffset,
+                                        firstBlock + numBlocks,
+                                        &runLength ) )
+        {
+            LogDebug( ( "Requesting blocks %u to %u of file %u again.",
+                        blockOffset,
+                        blockOffset + runLength - 1U,
+                        download->fileId ) );
+            requestDataBlock( download, blockOffset, runLength );
+
+            if( !flowControl_onRequest( &download->flowControl,
+                                        blockOffset,
+                                        runLength,
+                                        nowMs ) )
+            {
+                LogWarn( ( "Too many requests in flight, blocks %u to %u of "
+                           "file %u were requested again untimed (%u so far).",
+                           blockOffset,
+                           blockOffset + runLength - 1U,
+                           download->fileId,
+                           download->flowControl.untimedRequests ) );
+            }
+
+            blockOffset += runLength;
+        }
+    }
+}
+
+static FileDownload_t * findDownload( uint8_t fileId )
+{
+    FileDownload_t * download = NULL;
+
+    for( size_t i = 0U; ( download == NULL ) &&
+         ( i < MAX_NUM_OF_FILE_DOWNLOADS ); i++ )
+    {
+        if( fileDownloads[ i ].active &&
+            ( fileDownloads[ i ].fileId == fileId ) )
+        {
+            download = &fileDownloads[ i ];
+        }
+    }
+
+    return download;
+}
+
+static bool isDownloading( void )
+{
+    bool downloading = false;
+
+    for( size_t i = 0U; !downloading && ( i < MAX_NUM_OF_FILE_DOWNLOADS );
+         i++ )
+    {
+        downloading = fileDownloads[ i ].active;
+    }
+
+    return downloading;
+}
+
+static bool openImageSink( FileDownload_t * download,
+                           AfrOtaJobDocumentFields_t * params )
+{
+    char imagePath[ IMAGE_SINK_MAX_PATH_LENGTH + 1U ] = { 0 };
+    bool opened = false;
+
+#if USE_MMAP_IMAGE_SINK
+    imageSink_initMmap( &download->sink, &download->sinkContext );
+#else
+    imageSink_initPosix( &download->sink, &download->sinkContext );
+#endif
+
+    if( imageSink_getDownloadPath( params->filepath,
+                                   params->filepathLen,
+                                   imagePath,
+                                   sizeof( imagePath ) ) )
+    {
+        /* Blocks stored by an earlier run of the same job are marked
+         * received, so only the missing ones are requested. */
+        if( !downloadCheckpoint_open( &download->checkpoint,
+                                      imagePath,
+                                      globalJobId,
+                                      strnlen( globalJobId, MAX_JOB_ID_LENGTH ),
+                                      params->imageRef,
+                                      params->imageRefLen,
+                                      ( uint8_t ) params->fileId,
+                                      params->fileSize,
+                                      &download->window ) )
+        {
+            LogWarn( ( "Download of %s will not be resumable.", imagePath ) );
+        }
+
+        opened = download->sink.open( download->sink.pContext,
+                                      imagePath,
+                                      params->fileSize ) == IMAGE_SINK_SUCCESS;
+    }
+
+    if( opened )
+    {
+        LogInfo( ( "Downloading file %u to %s.",
+                   ( unsigned int ) params->fileId,
+                   imagePath ) );
+    }
+
+    return opened;
+}
+
 /* AFR OTA library callback */
-static void processJobFile( AfrOtaJobDocumentFields_t * params )
+static bool processJobFile( AfrOtaJobDocumentFields_t * params )
 {
     char thingName[ MAX_THING_NAME_SIZE + 1 ] = { 0 };
     size_t thingNameLength = 0U;
+    FileDownload_t * download = NULL;
+    FileDownload_t * streamDownload = NULL;
+
+    if( findDownload( ( uint8_t ) params->fileId ) != NULL )
+    {
+        LogInfo( ( "File %u is already being downloaded.",
+                   ( unsigned int ) params->fileId ) );
+        return false;
+    }
+
+    for( size_t i = 0U; i < MAX_NUM_OF_FILE_DOWNLOADS; i++ )
+    {
+        if( !fileDownloads[ i ].active )
+        {
+            download = ( download == NULL ) ? &fileDownloads[ i ] : download;
+        }
+        else
+        {
+            streamDownload = &fileDownloads[ i ];
+        }
+    }
+
+    if( download == NULL )
+    {
+        LogError( ( "No room to download file %u, at most %u files are "
+                    "downloaded at once.",
+                    ( unsigned int ) params->fileId,
+                    MAX_NUM_OF_FILE_DOWNLOADS ) );
+        failedDownloads++;
+        return false;
+    }
 
     mqttWrapper_getThingName( thingName, &thingNameLength );
+    memset( download, 0, sizeof( FileDownload_t ) );
+
+    if( !blockWindow_init( &download->window,
+                           params->fileSize,
+                           mqttFileDownloader_CONFIG_BLOCK_SIZE,
+                           MAX_NUM_OF_BLOCKS_IN_FLIGHT,
+                           NUM_OF_BLOCKS_REQUESTED ) )
+    {
+        LogError( ( "File of %u bytes has too many blocks to download.",
+                    params->fileSize ) );
+        failedDownloads++;
+        return false;
+    }
+
+    if( !openImageSink( download, params ) )
+    {
+        LogError( ( "Failed to open storage for the downloaded image." ) );
+        downloadCheckpoint_remove( &download->checkpoint );
+        failedDownloads++;
+        return false;
+    }
 
-    numOfBlocksRemaining = params->fileSize /
-                           mqttFileDownloader_CONFIG_BLOCK_SIZE;
-    numOfBlocksRemaining += ( params->fileSize %
-                                  mqttFileDownloader_CONFIG_BLOCK_SIZE >
-                              0 )
-                                ? 1
-                                : 0;
-    currentFileId = params->fileId;
-    currentBlockOffset = 0;
-    totalBytesReceived = 0;
+    /* Blocks are hashed as they arrive, so the image is verified as soon as
+     * the last one is in. */
+    if( !imageVerifier_init( &download->verifier,
+                             &download->window,
+                             params->fileSize,
+                             params->signature,
+                             params->signatureLen,
+                             params->certfile,
+                             params->certfileLen ) )
+    {
+        LogError( ( "Failed to set up the verification of file %u.",
+                    ( unsigned int ) params->fileId ) );
+        ( void ) download->sink.abort( download->sink.pContext );
+        downloadCheckpoint_remove( &download->checkpoint );
+        failedDownloads++;
+        return false;
+    }
+
+    download->fileId = ( uint8_t ) params->fileId;
+    progressReport_init( &download->progress, PROGRESS_REPORT_INTERVAL_MS );
+    flowControl_init( &download->flowControl,
+                      MAX_NUM_OF_BLOCKS_IN_FLIGHT,
+                      NUM_OF_BLOCKS_REQUESTED );
     /*
      * MQTT streams Library:
      * Initializing the MQTT streams downloader. Passing the
      * parameters extracted from the AWS IoT OTA jobs document
      * using OTA jobs parser.
      */
-    mqttDownloader_init( &mqttFileDownloaderContext,
+    mqttDownloader_init( &download->downloaderContext,
                          params->imageRef,
                          params->imageRefLen,
                          thingName,
                          thingNameLength,
-                         DATA_TYPE_CBOR );
+                         streamDataType );
+
+    /* The data topic is routed once for the whole job. Its subscription
+     * sends nothing once the stream wildcard of otaDemo_start() is granted,
+     * and takes its place if the broker refused it. */
+    if( streamDownload == NULL )
+    {
+        if( !setRoute( download->downloaderContext.topicStreamData,
+                       download->downloaderContext.topicStreamDataLength,
+                       handleDataBlockMessage ) )
+        {
+            LogError( ( "Failed to route the stream data topic." ) );
+            abortDownload( download );
+            return false;
+        }
+
+        mqttWrapper_subscribe( download->downloaderContext.topicStreamData,
+                               download->downloaderContext.topicStreamDataLength );
+    }
+    else if( ( streamDownload->downloaderContext.topicStreamDataLength !=
+               download->downloaderContext.topicStreamDataLength ) ||
+             ( memcmp( streamDownload->downloaderContext.topicStreamData,
+                       download->downloaderContext.topicStreamData,
+                       download->downloaderContext.topicStreamDataLength ) != 0 ) )
+    {
+        LogError( ( "File %u is not in the stream of the job.",
+                    download->fileId ) );
+        abortDownload( download );
+        return false;
+    }
+    else
+    {
+        /* Empty else. */
+    }
+
+    download->active = true;
 
-    mqttWrapper_subscribe( mqttFileDownloaderContext.topicStreamData,
-                            mqttFileDownloaderContext.topicStreamDataLength );
+    return true;
+}
 
-    printf("Starting The Download. \n");
-    /* Request the first block */
-    requestDataBlock();
+static void startDownload( FileDownload_t * download )
+{
+    /* A resumed download may already have every block. */
+    if( blockWindow_isComplete( &download->window ) )
+    {
+        commitImage( download );
+    }
+    else
+    {
+        LogInfo( ( "Starting the download of file %u.", download->fileId ) );
+        /* Fill the window with the first requests */
+        requestDataBlocks( download );
+    }
 }
 
 /* Implemented for the MQTT Streams library */
-static void handleMqttStreamsBlockArrived( uint8_t * data, size_t dataLength )
+static void handleMqttStreamsBlockArrived( FileDownload_t * download,
+                                          uint32_t blockId,
+                                          const uint8_t * data,
+                                          size_t dataLength )
 {
-    assert( ( totalBytesReceived + dataLength ) < CONFIG_MAX_FILE_SIZE );
+    BlockWindow_t * window = &download->window;
+    size_t blockOffsetBytes = ( size_t ) blockId * window->blockSize;
+
+    /* A block of the wrong length would overwrite its neighbours or leave a
+     * hole, so it is never stored. */
+    if( dataLength != blockWindow_blockLength( window, blockId ) )
+    {
+        LogWarn( ( "Dropping block %u of file %u, its %u bytes do not match "
+                   "the block.",
+                   blockId,
+                   download->fileId,
+                   ( unsigned int ) dataLength ) );
+    }
+    else if( !blockWindow_markReceived( window, blockId ) )
+    {
+        LogDebug( ( "Dropping duplicate or unexpected block %u.", blockId ) );
+    }
+    else
+    {
+        flowControl_onBlock( &download->flowControl,
+                             blockId,
+                             Clock_GetTimeMs() );
+
+        /* Blocks go straight to storage, so RAM use does not grow with the
+         * size of the image. */
+        if( download->sink.write( download->sink.pContext,
+                                  blockOffsetBytes,
+                                  data,
+                                  dataLength ) != IMAGE_SINK_SUCCESS )
+        {
+            LogError( ( "Failed to store block %u of file %u. Aborting its "
+                        "download.",
+                        blockId,
+                        download->fileId ) );
+            abortDownload( download );
+        }
+        else if( !imageVerifier_addBlock( &download->verifier,
+                                          window,
+                                          &download->sink,
+                                          blockId,
+                                          data,
+                                          dataLength ) )
+        {
+            LogError( ( "Failed to hash block %u of file %u. Aborting its "
+                        "download.",
+                        blockId,
+                        download->fileId ) );
+            abortDownload( download );
+        }
+        else
+        {
+            download->bytesReceived += dataLength;
+            ( void ) downloadCheckpoint_record( &download->checkpoint,
+                                                window,
+                                                blockId,
+                                                &download->sink );
 
-    memcpy( downloadedData + totalBytesReceived, data, dataLength );
+            LogDebug( ( "Downloaded block %u of file %u (%u of %u).",
+                        blockId,
+                        download->fileId,
+                        window->blocksReceived,
+                        window->totalBlocks ) );
 
-    totalBytesReceived += dataLength;
-    numOfBlocksRemaining--;
+            if( progressReport_isDue( &download->progress,
+                                      Clock_GetTimeMs(),
+                                      window->blocksReceived,
+                                      window->totalBlocks ) )
+            {
+                LogInfo( ( "File %u progress: %u%% (%u of %u blocks).",
+                           download->fileId,
+                           progressReport_percent( window->blocksReceived,
+                                                   window->totalBlocks ),
+                           window->blocksReceived,
+                           window->totalBlocks ) );
+            }
 
-    printf( "Downloaded block %u of %u. \n", currentBlockOffset, (currentBlockOffset + numOfBlocksRemaining) );
+            if( !blockWindow_isComplete( window ) )
+            {
+                requestDataBlocks( download );
+            }
+            else
+            {
+                commitImage( download );
+            }
+        }
+    }
+}
 
-    if( numOfBlocksRemaining == 0 )
+static void commitImage( FileDownload_t * download )
+{
+    /* Verified while the image is still open, blocks restored from a
+     * checkpoint may have to be read back. */
+    if( !imageVerifier_finish( &download->verifier,
+                               &download->window,
+                               &download->sink ) )
+    {
+        LogError( ( "File %u failed verification, discarding it.",
+                    download->fileId ) );
+        ( void ) download->sink.abort( download->sink.pContext );
+        downloadCheckpoint_remove( &download->checkpoint );
+        failedDownloads++;
+    }
+    else if( download->sink.close( download->sink.pContext ) !=
+             IMAGE_SINK_SUCCESS )
     {
-        printf( "Downloaded Data %s \n", ( char * ) downloadedData );
-        finishDownload();
+        LogError( ( "Failed to commit file %u.", download->fileId ) );
+        failedDownloads++;
     }
     else
     {
-        currentBlockOffset++;
-        requestDataBlock();
+        downloadCheckpoint_remove( &download->checkpoint );
+        LogInfo( ( "Downloaded %u bytes to %s.",
+                   download->bytesReceived,
+                   download->sink.getPath( download->sink.pContext ) ) );
+        LogInfo( ( "Ended with a window of %u blocks, a round trip of %u ms "
+                   "and %u timeouts.",
+                   download->flowControl.window,
+                   download->flowControl.smoothedRttMs,
+                   download->flowControl.timeouts ) );
+    }
+
+    endDownload( download );
+}
+
+static void abortDownload( FileDownload_t * download )
+{
+    imageVerifier_cleanup( &download->verifier );
+    ( void ) download->sink.abort( download->sink.pContext );
+    downloadCheckpoint_remove( &download->checkpoint );
+    failedDownloads++;
+    endDownload( download );
+}
+
+/* The job is reported once the last of its files has ended */
+static void endDownload( FileDownload_t * download )
+{
+    download->active = false;
+
+    if( !isDownloading() )
+    {
+        removeRoute( handleDataBlockMessage );
+
+        if( failedDownloads == 0U )
+        {
+            finishDownload();
+        }
+        else
+        {
+            LogError( ( "%u files of the job failed to download.",
+                        failedDownloads ) );
+        }
     }
 }
 
 static void finishDownload()
 {
-    /* TODO: Do something with the completed download */
+    /* Every file of the job has been verified by commitImage() */
     /* Start the bootloader */
     char thingName[ MAX_THING_NAME_SIZE + 1 ] = { 0 };
     size_t thingNameLength = 0U;
-    char topicBuffer[ TOPIC_BUFFER_SIZE + 1 ] = { 0 };
-    size_t topicBufferLength = 0U;
-    char messageBuffer[ UPDATE_JOB_MSG_LENGTH ] = { 0 };
 
     mqttWrapper_getThingName( thingName, &thingNameLength );
 
@@ -353,30 +1060,37 @@ static void finishDownload()
      * AWS IoT Jobs library:
      * Creating the MQTT topic to update the status of OTA job.
      */
-    Jobs_Update(topicBuffer,
+    Jobs_Update(pendingUpdateTopic,
                 TOPIC_BUFFER_SIZE,
                 thingName,
                 thingNameLength,
                 globalJobId,
-                strnlen( globalJobId, 1000U ),
-                &topicBufferLength);
+                strnlen( globalJobId, MAX_JOB_ID_LENGTH ),
+                &pendingUpdateTopicLength);
 
     /*
      * AWS IoT Jobs library:
      * Creating the message which contains the status of OTA job.
      * It will be published on the topic created in the previous step.
      */
-    size_t messageBufferLength = Jobs_UpdateMsg(Succeeded,
+    pendingUpdateMessageLength = Jobs_UpdateMsg(Succeeded,
                                                 "2",
                                                 1U,
-                                                messageBuffer,
+                                                pendingUpdateMessage,
                                                 UPDATE_JOB_MSG_LENGTH );
 
-    mqttWrapper_publish(topicBuffer,
-                        topicBufferLength,
-                        ( uint8_t * ) messageBuffer,
-                        messageBufferLength);
+    publishPendingUpdate();
 
+    LogInfo( ( "OTA Completed successfully!" ) );
+}
 
-    printf( "\033[1;32mOTA Completed successfully!\033[0m\n" );
+static void publishPendingUpdate( void )
+{
+    /* The status update is what completes the job, so the broker
+     * acknowledges it. */
+    mqttWrapper_publishWithQos( pendingUpdateTopic,
+                                pendingUpdateTopicLength,
+                                ( uint8_t * ) pendingUpdateMessage,
+                                pendingUpdateMessageLength,
+                                MQTTQoS1 );
 }
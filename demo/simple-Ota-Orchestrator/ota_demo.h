@@ -10,10 +10,23 @@
 #ifndef OTA_DEMO_H
 #define OTA_DEMO_H
 
+#include "MQTTFileDownloader.h"
+
+/* Encoding the stream blocks are requested in, OTA_STREAM_DATA_TYPE unless
+ * set before otaDemo_start() */
+void otaDemo_setDataType( DataType_t dataType );
+
 void otaDemo_start( void );
 
 bool otaDemo_handleIncomingMQTTMessage( char * topic,
                                         size_t topicLength,
                                         uint8_t * message,
                                         size_t messageLength );
+
+/* Called from the MQTT task once a lost connection has been replaced */
+void otaDemo_handleReconnect( void );
+
+/* Called from the MQTT task after each receive, requests again the blocks of
+ * requests that went unanswered */
+void otaDemo_checkTimeouts( void );
 #endif
@@ -0,0 +1,148 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file image_sink.h
+ * @brief Interface used by the orchestrators to store a downloaded image.
+ *
+ * The state of an open image belongs to the backend, which defines its own
+ * context type in its header. The caller provides one context per image.
+ */
+
+#ifndef IMAGE_SINK_H_
+#define IMAGE_SINK_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* *INDENT-ON* */
+
+/**
+ * @brief Directory the downloaded images are written to.
+ */
+#ifndef IMAGE_SINK_DOWNLOAD_DIR
+    #define IMAGE_SINK_DOWNLOAD_DIR "."
+#endif
+
+/**
+ * @brief Longest path, excluding the terminator, a sink can open.
+ */
+#define IMAGE_SINK_MAX_PATH_LENGTH 255U
+
+/**
+ * @brief Image sink return status.
+ */
+typedef enum ImageSinkStatus
+{
+    IMAGE_SINK_SUCCESS = 0,        /**< Function successfully completed. */
+    IMAGE_SINK_INVALID_PARAMETER,  /**< At least one parameter was invalid. */
+    IMAGE_SINK_OPEN_FAILED,        /**< The image could not be created. */
+    IMAGE_SINK_WRITE_FAILED,       /**< A block could not be stored. */
+    IMAGE_SINK_CLOSE_FAILED,       /**< The image could not be committed. */
+    IMAGE_SINK_READ_FAILED         /**< Stored bytes could not be read back. */
+} ImageSinkStatus_t;
+
+/**
+ * @brief Open a sink for an image of a known size.
+ *
+ * An existing file at @p path is reused rather than truncated, so the blocks
+ * already stored in it are kept.
+ */
+typedef ImageSinkStatus_t ( * ImageSinkOpen_t )( void * context,
+                                                 const char * path,
+                                                 size_t imageSize );
+
+/**
+ * @brief Store a block at its byte offset in the image.
+ *
+ * Blocks may be written in any order.
+ */
+typedef ImageSinkStatus_t ( * ImageSinkWrite_t )( void * context,
+                                                  size_t offset,
+                                                  const uint8_t * data,
+                                                  size_t length );
+
+/**
+ * @brief Read back bytes stored in the open image.
+ *
+ * Used to hash blocks that are no longer in memory, such as the blocks of a
+ * resumed download.
+ */
+typedef ImageSinkStatus_t ( * ImageSinkRead_t )( void * context,
+                                                 size_t offset,
+                                                 uint8_t * data,
+                                                 size_t length );
+
+/**
+ * @brief Flush the blocks stored so far without closing the image.
+ */
+typedef ImageSinkStatus_t ( * ImageSinkSync_t )( void * context );
+
+/**
+ * @brief Flush and close a completely written image.
+ */
+typedef ImageSinkStatus_t ( * ImageSinkClose_t )( void * context );
+
+/**
+ * @brief Close and discard a partially written image.
+ */
+typedef ImageSinkStatus_t ( * ImageSinkAbort_t )( void * context );
+
+/**
+ * @brief Path the image was opened at, for logs.
+ */
+typedef const char * ( * ImageSinkGetPath_t )( void * context );
+
+/**
+ * @brief Pluggable storage backend for downloaded images.
+ */
+typedef struct ImageSink
+{
+    ImageSinkOpen_t open;           /**< @brief Create or reopen the image. */
+    ImageSinkWrite_t write;         /**< @brief Store a block at an offset. */
+    ImageSinkRead_t read;           /**< @brief Read stored bytes back. */
+    ImageSinkSync_t sync;           /**< @brief Flush the stored blocks. */
+    ImageSinkClose_t close;         /**< @brief Commit the image. */
+    ImageSinkAbort_t abort;         /**< @brief Discard the image. */
+    ImageSinkGetPath_t getPath;     /**< @brief Path of the image. */
+    void * pContext;                /**< @brief State of the backend, passed
+                                     * to every function. */
+} ImageSink_t;
+
+/**
+ * @brief Build the path an image is downloaded to.
+ *
+ * Only the last component of the file path from the job document is used,
+ * and it is placed in #IMAGE_SINK_DOWNLOAD_DIR.
+ *
+ * @param[in] filePath File path from the job document, may be NULL.
+ * @param[in] filePathLength Length of @p filePath.
+ * @param[out] pathBuffer Buffer for the NULL-terminated path.
+ * @param[in] pathBufferSize Size of @p pathBuffer.
+ *
+ * @return true if the path fits in @p pathBuffer; false otherwise.
+ */
+bool imageSink_getDownloadPath( const char * filePath,
+                                size_t filePathLength,
+                                char * pathBuffer,
+                                size_t pathBufferSize );
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+}
+#endif
+/* *INDENT-ON* */
+
+#endif /* ifndef IMAGE_SINK_H_ */
@@ -0,0 +1,277 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file image_sink_mmap.c
+ * @brief Image sink that stores blocks in a shared mapping of the image file.
+ *
+ * The file itself is created, flushed and removed by a POSIX sink held in the
+ * context of the image; this sink only maps it so blocks are stored with a
+ * memcpy().
+ */
+
+#define LIBRARY_LOG_NAME  "ImageSinkMmap"
+#define LIBRARY_LOG_LEVEL LOG_INFO
+#include "csdk_logging/logging.h"
+
+/* Standard includes. */
+#include <assert.h>
+#include <string.h>
+
+/* POSIX includes. */
+#include <errno.h>
+#include <sys/mman.h>
+
+#include "image_sink_mmap.h"
+
+/*-----------------------------------------------------------*/
+
+static void unmapImage( ImageSinkMmapContext_t * context )
+{
+    if( context->mapping != NULL )
+    {
+        ( void ) munmap( context->mapping, context->file.imageSize );
+        context->mapping = NULL;
+    }
+}
+/*-----------------------------------------------------------*/
+
+static ImageSinkStatus_t mmapOpen( void * pContext,
+                                   const char * path,
+                                   size_t imageSize )
+{
+    ImageSinkMmapContext_t * context = ( ImageSinkMmapContext_t * ) pContext;
+    ImageSinkStatus_t returnStatus = IMAGE_SINK_INVALID_PARAMETER;
+    void * mapping = MAP_FAILED;
+
+    if( context == NULL )
+    {
+        LogError( ( "Parameter check failed: context is NULL." ) );
+    }
+    else
+    {
+        context->mapping = NULL;
+        returnStatus = context->fileSink.open( context->fileSink.pContext,
+                                               path,
+                                               imageSize );
+    }
+
+    /* An empty image has nothing to map. */
+    if( ( returnStatus == IMAGE_SINK_SUCCESS ) && ( imageSize > 0U ) )
+    {
+        mapping = mmap( NULL,
+                        imageSize,
+                        PROT_READ | PROT_WRITE,
+                        MAP_SHARED,
+                        context->file.fileDescriptor,
+                        0 );
+
+        if( mapping == MAP_FAILED )
+        {
+            LogError( ( "Failed to map image file %s: %s",
+                        path,
+                        strerror( errno ) ) );
+            ( void ) context->fileSink.abort( context->fileSink.pContext );
+            returnStatus = IMAGE_SINK_OPEN_FAILED;
+        }
+        else
+        {
+            context->mapping = ( uint8_t * ) mapping;
+        }
+    }
+
+    return returnStatus;
+}
+/*-----------------------------------------------------------*/
+
+static ImageSinkStatus_t mmapWrite( void * pContext,
+                                    size_t offset,
+                                    const uint8_t * data,
+                                    size_t length )
+{
+    ImageSinkMmapContext_t * context = ( ImageSinkMmapContext_t * ) pContext;
+    ImageSinkStatus_t returnStatus = IMAGE_SINK_SUCCESS;
+
+    if( ( context == NULL ) || ( data == NULL ) ||
+        ( ( context->mapping == NULL ) && ( length > 0U ) ) )
+    {
+        LogError( ( "Parameter check failed: sink is not open." ) );
+        returnStatus = IMAGE_SINK_INVALID_PARAMETER;
+    }
+    else if( ( offset > context->file.imageSize ) ||
+             ( length > ( context->file.imageSize - offset ) ) )
+    {
+        LogError( ( "Block at offset %lu with length %lu is outside the "
+                    "image.",
+                    ( unsigned long ) offset,
+                    ( unsigned long ) length ) );
+        returnStatus = IMAGE_SINK_INVALID_PARAMETER;
+    }
+    else if( length > 0U )
+    {
+        memcpy( &context->mapping[ offset ], data, length );
+    }
+    else
+    {
+        /* Empty else. */
+    }
+
+    return returnStatus;
+}
+/*-----------------------------------------------------------*/
+
+static ImageSinkStatus_t mmapRead( void * pContext,
+                                   size_t offset,
+                                   uint8_t * data,
+                                   size_t length )
+{
+    ImageSinkMmapContext_t * context = ( ImageSinkMmapContext_t * ) pContext;
+    ImageSinkStatus_t returnStatus = IMAGE_SINK_SUCCESS;
+
+    if( ( context == NULL ) || ( data == NULL ) ||
+        ( ( context->mapping == NULL ) && ( length > 0U ) ) )
+    {
+        LogError( ( "Parameter check failed: sink is not open." ) );
+        returnStatus = IMAGE_SINK_INVALID_PARAMETER;
+    }
+    else if( ( offset > context->file.imageSize ) ||
+             ( length > ( context->file.imageSize - offset ) ) )
+    {
+        LogError( ( "Read at offset %lu with length %lu is outside the "
+                    "image.",
+                    ( unsigned long ) offset,
+                    ( unsigned long ) length ) );
+        returnStatus = IMAGE_SINK_INVALID_PARAMETER;
+    }
+    else if( length > 0U )
+    {
+        memcpy( data, &context->mapping[ offset ], length );
+    }
+    else
+    {
+        /* Empty else. */
+    }
+
+    return returnStatus;
+}
+/*-----------------------------------------------------------*/
+
+static ImageSinkStatus_t mmapSync( void * pContext )
+{
+    ImageSinkMmapContext_t * context = ( ImageSinkMmapContext_t * ) pContext;
+    ImageSinkStatus_t returnStatus = IMAGE_SINK_SUCCESS;
+
+    if( context == NULL )
+    {
+        LogError( ( "Parameter check failed: context is NULL." ) );
+        returnStatus = IMAGE_SINK_INVALID_PARAMETER;
+    }
+    else if( ( context->mapping != NULL ) &&
+             ( msync( context->mapping,
+                      context->file.imageSize,
+                      MS_SYNC ) != 0 ) )
+    {
+        LogError( ( "Failed to flush mapping of %s: %s",
+                    context->file.path,
+                    strerror( errno ) ) );
+        returnStatus = IMAGE_SINK_WRITE_FAILED;
+    }
+    else
+    {
+        /* Empty else. */
+    }
+
+    return returnStatus;
+}
+/*-----------------------------------------------------------*/
+
+static ImageSinkStatus_t mmapClose( void * pContext )
+{
+    ImageSinkMmapContext_t * context = ( ImageSinkMmapContext_t * ) pContext;
+    ImageSinkStatus_t returnStatus = IMAGE_SINK_SUCCESS;
+
+    if( context == NULL )
+    {
+        LogError( ( "Parameter check failed: context is NULL." ) );
+        returnStatus = IMAGE_SINK_INVALID_PARAMETER;
+    }
+    else
+    {
+        if( ( context->mapping != NULL ) &&
+            ( msync( context->mapping,
+                     context->file.imageSize,
+                     MS_SYNC ) != 0 ) )
+        {
+            LogError( ( "Failed to flush mapping of %s: %s",
+                        context->file.path,
+                        strerror( errno ) ) );
+            returnStatus = IMAGE_SINK_CLOSE_FAILED;
+        }
+
+        unmapImage( context );
+
+        if( context->fileSink.close( context->fileSink.pContext ) !=
+            IMAGE_SINK_SUCCESS )
+        {
+            returnStatus = IMAGE_SINK_CLOSE_FAILED;
+        }
+    }
+
+    return returnStatus;
+}
+/*-----------------------------------------------------------*/
+
+static ImageSinkStatus_t mmapAbort( void * pContext )
+{
+    ImageSinkMmapContext_t * context = ( ImageSinkMmapContext_t * ) pContext;
+    ImageSinkStatus_t returnStatus = IMAGE_SINK_INVALID_PARAMETER;
+
+    if( context == NULL )
+    {
+        LogError( ( "Parameter check failed: context is NULL." ) );
+    }
+    else
+    {
+        unmapImage( context );
+        returnStatus = context->fileSink.abort( context->fileSink.pContext );
+    }
+
+    return returnStatus;
+}
+/*-----------------------------------------------------------*/
+
+static const char * mmapGetPath( void * pContext )
+{
+    ImageSinkMmapContext_t * context = ( ImageSinkMmapContext_t * ) pContext;
+
+    assert( context != NULL );
+
+    return context->fileSink.getPath( context->fileSink.pContext );
+}
+/*-----------------------------------------------------------*/
+
+void imageSink_initMmap( ImageSink_t * sink,
+                         ImageSinkMmapContext_t * context )
+{
+    assert( sink != NULL );
+    assert( context != NULL );
+
+    imageSink_initPosix( &context->fileSink, &context->file );
+    context->mapping = NULL;
+
+    sink->open = mmapOpen;
+    sink->write = mmapWrite;
+    sink->read = mmapRead;
+    sink->sync = mmapSync;
+    sink->close = mmapClose;
+    sink->abort = mmapAbort;
+    sink->getPath = mmapGetPath;
+    sink->pContext = context;
+}
+/*-----------------------------------------------------------*/
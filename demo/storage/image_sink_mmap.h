@@ -0,0 +1,57 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file image_sink_mmap.h
+ * @brief Image sink that stores blocks in a shared mapping of the image file.
+ */
+
+#ifndef IMAGE_SINK_MMAP_H_
+#define IMAGE_SINK_MMAP_H_
+
+/* Standard includes. */
+#include <stdint.h>
+
+#include "image_sink.h"
+#include "image_sink_posix.h"
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* *INDENT-ON* */
+
+/**
+ * @brief State of an image stored through a file mapping.
+ *
+ * The file itself is managed by a POSIX sink of its own.
+ */
+typedef struct ImageSinkMmapContext
+{
+    ImageSink_t fileSink;         /**< @brief Sink of the file. */
+    ImageSinkPosixContext_t file; /**< @brief State of the file. */
+    uint8_t * mapping;            /**< @brief Mapped image, NULL if none. */
+} ImageSinkMmapContext_t;
+
+/**
+ * @brief Set up a sink that stores blocks in a shared file mapping.
+ *
+ * @param[out] sink Sink to initialize.
+ * @param[in] context Storage for the state of the image, one per image.
+ */
+void imageSink_initMmap( ImageSink_t * sink,
+                         ImageSinkMmapContext_t * context );
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+}
+#endif
+/* *INDENT-ON* */
+
+#endif /* ifndef IMAGE_SINK_MMAP_H_ */
@@ -0,0 +1,417 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file image_sink_posix.c
+ * @brief Image sink that stores blocks in a regular file with pwrite().
+ */
+
+#define LIBRARY_LOG_NAME  "ImageSink"
+#define LIBRARY_LOG_LEVEL LOG_INFO
+#include "csdk_logging/logging.h"
+
+/* Standard includes. */
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+/* POSIX includes. */
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "image_sink_posix.h"
+
+/**
+ * @brief Name used when the job document does not provide a usable one.
+ */
+#define DEFAULT_IMAGE_NAME "ota_image.bin"
+
+/*-----------------------------------------------------------*/
+
+static ImageSinkStatus_t posixOpen( void * pContext,
+                                    const char * path,
+                                    size_t imageSize );
+
+static ImageSinkStatus_t posixWrite( void * pContext,
+                                     size_t offset,
+                                     const uint8_t * data,
+                                     size_t length );
+
+static ImageSinkStatus_t posixRead( void * pContext,
+                                    size_t offset,
+                                    uint8_t * data,
+                                    size_t length );
+
+static ImageSinkStatus_t posixSync( void * pContext );
+
+static ImageSinkStatus_t posixClose( void * pContext );
+
+static ImageSinkStatus_t posixAbort( void * pContext );
+
+static const char * posixGetPath( void * pContext );
+
+/*-----------------------------------------------------------*/
+
+static bool isUsableName( const char * name, size_t nameLength )
+{
+    bool usable = nameLength > 0U;
+
+    if( ( nameLength == 1U ) && ( name[ 0 ] == '.' ) )
+    {
+        usable = false;
+    }
+    else if( ( nameLength == 2U ) && ( name[ 0 ] == '.' ) &&
+             ( name[ 1 ] == '.' ) )
+    {
+        usable = false;
+    }
+    else
+    {
+        /* Empty else. */
+    }
+
+    return usable;
+}
+/*-----------------------------------------------------------*/
+
+static ImageSinkStatus_t posixOpen( void * pContext,
+                                    const char * path,
+                                    size_t imageSize )
+{
+    ImageSinkPosixContext_t * context = ( ImageSinkPosixContext_t * ) pContext;
+    ImageSinkStatus_t returnStatus = IMAGE_SINK_SUCCESS;
+    size_t pathLength = 0U;
+
+    if( ( context == NULL ) || ( path == NULL ) )
+    {
+        LogError( ( "Parameter check failed: context or path is NULL." ) );
+        returnStatus = IMAGE_SINK_INVALID_PARAMETER;
+    }
+    else
+    {
+        pathLength = strnlen( path, IMAGE_SINK_MAX_PATH_LENGTH + 1U );
+
+        if( pathLength > IMAGE_SINK_MAX_PATH_LENGTH )
+        {
+            LogError( ( "Parameter check failed: path is too long." ) );
+            returnStatus = IMAGE_SINK_INVALID_PARAMETER;
+        }
+    }
+
+    if( returnStatus == IMAGE_SINK_SUCCESS )
+    {
+        memcpy( context->path, path, pathLength );
+        context->path[ pathLength ] = '\0';
+        context->imageSize = imageSize;
+        context->fileDescriptor = open( path, O_RDWR | O_CREAT, 0644 );
+
+        if( context->fileDescriptor < 0 )
+        {
+            LogError( ( "Failed to open image file %s: %s",
+                        path,
+                        strerror( errno ) ) );
+            returnStatus = IMAGE_SINK_OPEN_FAILED;
+        }
+    }
+
+    /* Size the file up front so blocks can be written at any offset. */
+    if( ( returnStatus == IMAGE_SINK_SUCCESS ) &&
+        ( ftruncate( context->fileDescriptor, ( off_t ) imageSize ) != 0 ) )
+    {
+        LogError( ( "Failed to size image file %s to %lu bytes: %s",
+                    path,
+                    ( unsigned long ) imageSize,
+                    strerror( errno ) ) );
+        ( void ) close( context->fileDescriptor );
+        context->fileDescriptor = -1;
+        returnStatus = IMAGE_SINK_OPEN_FAILED;
+    }
+
+    return returnStatus;
+}
+/*-----------------------------------------------------------*/
+
+static ImageSinkStatus_t posixWrite( void * pContext,
+                                     size_t offset,
+                                     const uint8_t * data,
+                                     size_t length )
+{
+    ImageSinkPosixContext_t * context = ( ImageSinkPosixContext_t * ) pContext;
+    ImageSinkStatus_t returnStatus = IMAGE_SINK_SUCCESS;
+    size_t bytesWritten = 0U;
+    ssize_t writeStatus = 0;
+
+    if( ( context == NULL ) || ( data == NULL ) ||
+        ( context->fileDescriptor < 0 ) )
+    {
+        LogError( ( "Parameter check failed: sink is not open." ) );
+        returnStatus = IMAGE_SINK_INVALID_PARAMETER;
+    }
+    else if( ( offset > context->imageSize ) ||
+             ( length > ( context->imageSize - offset ) ) )
+    {
+        LogError( ( "Block at offset %lu with length %lu is outside the "
+                    "image.",
+                    ( unsigned long ) offset,
+                    ( unsigned long ) length ) );
+        returnStatus = IMAGE_SINK_INVALID_PARAMETER;
+    }
+    else
+    {
+        /* Empty else. */
+    }
+
+    while( ( returnStatus == IMAGE_SINK_SUCCESS ) && ( bytesWritten < length ) )
+    {
+        writeStatus = pwrite( context->fileDescriptor,
+                              data + bytesWritten,
+                              length - bytesWritten,
+                              ( off_t ) ( offset + bytesWritten ) );
+
+        if( writeStatus > 0 )
+        {
+            bytesWritten += ( size_t ) writeStatus;
+        }
+        else if( ( writeStatus < 0 ) && ( errno == EINTR ) )
+        {
+            /* Retry the interrupted write. */
+        }
+        else
+        {
+            LogError( ( "Failed to write image file %s: %s",
+                        context->path,
+                        strerror( errno ) ) );
+            returnStatus = IMAGE_SINK_WRITE_FAILED;
+        }
+    }
+
+    return returnStatus;
+}
+/*-----------------------------------------------------------*/
+
+static ImageSinkStatus_t posixRead( void * pContext,
+                                    size_t offset,
+                                    uint8_t * data,
+                                    size_t length )
+{
+    ImageSinkPosixContext_t * context = ( ImageSinkPosixContext_t * ) pContext;
+    ImageSinkStatus_t returnStatus = IMAGE_SINK_SUCCESS;
+    size_t bytesRead = 0U;
+    ssize_t readStatus = 0;
+
+    if( ( context == NULL ) || ( data == NULL ) ||
+        ( context->fileDescriptor < 0 ) )
+    {
+        LogError( ( "Parameter check failed: sink is not open." ) );
+        returnStatus = IMAGE_SINK_INVALID_PARAMETER;
+    }
+    else if( ( offset > context->imageSize ) ||
+             ( length > ( context->imageSize - offset ) ) )
+    {
+        LogError( ( "Read at offset %lu with length %lu is outside the "
+                    "image.",
+                    ( unsigned long ) offset,
+                    ( unsigned long ) length ) );
+        returnStatus = IMAGE_SINK_INVALID_PARAMETER;
+    }
+    else
+    {
+        /* Empty else. */
+    }
+
+    while( ( returnStatus == IMAGE_SINK_SUCCESS ) && ( bytesRead < length ) )
+    {
+        readStatus = pread( context->fileDescriptor,
+                            data + bytesRead,
+                            length - bytesRead,
+                            ( off_t ) ( offset + bytesRead ) );
+
+        if( readStatus > 0 )
+        {
+            bytesRead += ( size_t ) readStatus;
+        }
+        else if( ( readStatus < 0 ) && ( errno == EINTR ) )
+        {
+            /* Retry the interrupted read. */
+        }
+        else
+        {
+            /* The file is sized when opened, so end of file is an error. */
+            LogError( ( "Failed to read image file %s: %s",
+                        context->path,
+                        ( readStatus == 0 ) ? "end of file" :
+                        strerror( errno ) ) );
+            returnStatus = IMAGE_SINK_READ_FAILED;
+        }
+    }
+
+    return returnStatus;
+}
+/*-----------------------------------------------------------*/
+
+static ImageSinkStatus_t posixSync( void * pContext )
+{
+    ImageSinkPosixContext_t * context = ( ImageSinkPosixContext_t * ) pContext;
+    ImageSinkStatus_t returnStatus = IMAGE_SINK_SUCCESS;
+
+    if( ( context == NULL ) || ( context->fileDescriptor < 0 ) )
+    {
+        LogError( ( "Parameter check failed: sink is not open." ) );
+        returnStatus = IMAGE_SINK_INVALID_PARAMETER;
+    }
+    else if( fdatasync( context->fileDescriptor ) != 0 )
+    {
+        LogError( ( "Failed to flush image file %s: %s",
+                    context->path,
+                    strerror( errno ) ) );
+        returnStatus = IMAGE_SINK_WRITE_FAILED;
+    }
+    else
+    {
+        /* Empty else. */
+    }
+
+    return returnStatus;
+}
+/*-----------------------------------------------------------*/
+
+static ImageSinkStatus_t posixClose( void * pContext )
+{
+    ImageSinkPosixContext_t * context = ( ImageSinkPosixContext_t * ) pContext;
+    ImageSinkStatus_t returnStatus = IMAGE_SINK_SUCCESS;
+
+    if( ( context == NULL ) || ( context->fileDescriptor < 0 ) )
+    {
+        LogError( ( "Parameter check failed: sink is not open." ) );
+        returnStatus = IMAGE_SINK_INVALID_PARAMETER;
+    }
+    else
+    {
+        if( fsync( context->fileDescriptor ) != 0 )
+        {
+            LogError( ( "Failed to flush image file %s: %s",
+                        context->path,
+                        strerror( errno ) ) );
+            returnStatus = IMAGE_SINK_CLOSE_FAILED;
+        }
+
+        if( close( context->fileDescriptor ) != 0 )
+        {
+            returnStatus = IMAGE_SINK_CLOSE_FAILED;
+        }
+
+        context->fileDescriptor = -1;
+    }
+
+    return returnStatus;
+}
+/*-----------------------------------------------------------*/
+
+static ImageSinkStatus_t posixAbort( void * pContext )
+{
+    ImageSinkPosixContext_t * context = ( ImageSinkPosixContext_t * ) pContext;
+    ImageSinkStatus_t returnStatus = IMAGE_SINK_SUCCESS;
+
+    if( context == NULL )
+    {
+        LogError( ( "Parameter check failed: context is NULL." ) );
+        returnStatus = IMAGE_SINK_INVALID_PARAMETER;
+    }
+    else
+    {
+        if( context->fileDescriptor >= 0 )
+        {
+            ( void ) close( context->fileDescriptor );
+            context->fileDescriptor = -1;
+        }
+
+        if( ( context->path[ 0 ] != '\0' ) && ( unlink( context->path ) != 0 ) )
+        {
+            LogWarn( ( "Failed to remove image file %s: %s",
+                       context->path,
+                       strerror( errno ) ) );
+        }
+    }
+
+    return returnStatus;
+}
+/*-----------------------------------------------------------*/
+
+static const char * posixGetPath( void * pContext )
+{
+    const ImageSinkPosixContext_t * context =
+        ( const ImageSinkPosixContext_t * ) pContext;
+
+    assert( context != NULL );
+
+    return context->path;
+}
+/*-----------------------------------------------------------*/
+
+void imageSink_initPosix( ImageSink_t * sink,
+                          ImageSinkPosixContext_t * context )
+{
+    assert( sink != NULL );
+    assert( context != NULL );
+
+    memset( context, 0, sizeof( ImageSinkPosixContext_t ) );
+    context->fileDescriptor = -1;
+
+    sink->open = posixOpen;
+    sink->write = posixWrite;
+    sink->read = posixRead;
+    sink->sync = posixSync;
+    sink->close = posixClose;
+    sink->abort = posixAbort;
+    sink->getPath = posixGetPath;
+    sink->pContext = context;
+}
+/*-----------------------------------------------------------*/
+
+bool imageSink_getDownloadPath( const char * filePath,
+                                size_t filePathLength,
+                                char * pathBuffer,
+                                size_t pathBufferSize )
+{
+    const char * name = DEFAULT_IMAGE_NAME;
+    size_t nameLength = sizeof( DEFAULT_IMAGE_NAME ) - 1U;
+    size_t index = filePathLength;
+    int pathLength = 0;
+
+    assert( pathBuffer != NULL );
+
+    /* Keep only the last path component so the job document cannot direct
+     * the download outside of the download directory. */
+    if( filePath != NULL )
+    {
+        while( ( index > 0U ) && ( filePath[ index - 1U ] != '/' ) )
+        {
+            index--;
+        }
+
+        if( isUsableName( &filePath[ index ], filePathLength - index ) )
+        {
+            name = &filePath[ index ];
+            nameLength = filePathLength - index;
+        }
+    }
+
+    pathLength = snprintf( pathBuffer,
+                           pathBufferSize,
+                           "%s/%.*s",
+                           IMAGE_SINK_DOWNLOAD_DIR,
+                           ( int ) nameLength,
+                           name );
+
+    return ( pathLength > 0 ) && ( ( size_t ) pathLength < pathBufferSize );
+}
+/*-----------------------------------------------------------*/
@@ -0,0 +1,55 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file image_sink_posix.h
+ * @brief Image sink that stores blocks in a regular file with pwrite().
+ */
+
+#ifndef IMAGE_SINK_POSIX_H_
+#define IMAGE_SINK_POSIX_H_
+
+/* Standard includes. */
+#include <stddef.h>
+#include <stdint.h>
+
+#include "image_sink.h"
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* *INDENT-ON* */
+
+/**
+ * @brief State of an image stored with pwrite().
+ */
+typedef struct ImageSinkPosixContext
+{
+    int32_t fileDescriptor; /**< @brief Descriptor of the image file. */
+    size_t imageSize;       /**< @brief Size the image was opened with. */
+    char path[ IMAGE_SINK_MAX_PATH_LENGTH + 1U ]; /**< @brief Image path. */
+} ImageSinkPosixContext_t;
+
+/**
+ * @brief Set up a sink that stores blocks with pwrite().
+ *
+ * @param[out] sink Sink to initialize.
+ * @param[in] context Storage for the state of the image, one per image.
+ */
+void imageSink_initPosix( ImageSink_t * sink,
+                          ImageSinkPosixContext_t * context );
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+}
+#endif
+/* *INDENT-ON* */
+
+#endif /* ifndef IMAGE_SINK_POSIX_H_ */
@@ -0,0 +1,161 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file connection_manager.c
+ * @brief Connection and reconnection with jittered exponential backoff.
+ */
+
+#define LIBRARY_LOG_NAME  "Connection"
+#define LIBRARY_LOG_LEVEL LOG_INFO
+#include "csdk_logging/logging.h"
+
+/* Standard includes. */
+#include <stdlib.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "backoff_algorithm.h"
+#include "mqtt_wrapper.h"
+#include "transport/transport_wrapper.h"
+#include "utils/clock.h"
+
+#include "connection_manager.h"
+
+#define MAX_THING_NAME_SIZE 128U
+
+static char * certificatePath = NULL;
+static char * privateKeyPath = NULL;
+static char * rootCAPath = NULL;
+static char * brokerEndpoint = NULL;
+static char * clientThingName = NULL;
+
+/*-----------------------------------------------------------*/
+
+static bool tryConnect( void )
+{
+    bool connected = transport_tlsConnect( certificatePath,
+                                           privateKeyPath,
+                                           rootCAPath,
+                                           brokerEndpoint );
+
+    if( !connected )
+    {
+        LogWarn( ( "TLS connection to %s failed.", brokerEndpoint ) );
+    }
+    else if( !mqttWrapper_connect( clientThingName,
+                                   strnlen( clientThingName,
+                                            MAX_THING_NAME_SIZE ) ) )
+    {
+        LogWarn( ( "MQTT connection to %s failed.", brokerEndpoint ) );
+        transport_tlsDisconnect();
+        connected = false;
+    }
+    else
+    {
+        /* Empty else. */
+    }
+
+    return connected;
+}
+/*-----------------------------------------------------------*/
+
+void connectionManager_init( char * certificateFilePath,
+                             char * privateKeyFilePath,
+                             char * rootCAFilePath,
+                             char * endpoint,
+                             char * thingName )
+{
+    certificatePath = certificateFilePath;
+    privateKeyPath = privateKeyFilePath;
+    rootCAPath = rootCAFilePath;
+    brokerEndpoint = endpoint;
+    clientThingName = thingName;
+
+    /* Only the jitter comes from rand(), it needs no strong seed. */
+    srand( ( unsigned int ) Clock_GetTimeMs() );
+}
+/*-----------------------------------------------------------*/
+
+bool connectionManager_connect( void )
+{
+    BackoffAlgorithmContext_t backoff;
+    BackoffAlgorithmStatus_t backoffStatus = BackoffAlgorithmSuccess;
+    uint16_t nextDelayMs = 0U;
+    bool connected = false;
+
+    BackoffAlgorithm_InitializeParams( &backoff,
+                                       CONNECTION_RETRY_BACKOFF_BASE_MS,
+                                       CONNECTION_RETRY_MAX_BACKOFF_DELAY_MS,
+                                       CONNECTION_RETRY_MAX_ATTEMPTS );
+
+    connected = tryConnect();
+
+    while( !connected && ( backoffStatus == BackoffAlgorithmSuccess ) )
+    {
+        backoffStatus = BackoffAlgorithm_GetNextBackoff( &backoff,
+                                                         ( uint32_t ) rand(),
+                                                         &nextDelayMs );
+
+        if( backoffStatus == BackoffAlgorithmSuccess )
+        {
+            LogInfo( ( "Retrying the connection in %u ms.",
+                       ( unsigned int ) nextDelayMs ) );
+            vTaskDelay( pdMS_TO_TICKS( nextDelayMs ) );
+            connected = tryConnect();
+        }
+        else
+        {
+            LogError( ( "Giving up after %u connection attempts.",
+                        ( unsigned int ) backoff.attemptsDone + 1U ) );
+
+            /* The demos exit when no connection can be made, so the cached
+             * SSL context is freed rather than kept for another attempt. */
+            transport_tlsFree();
+        }
+    }
+
+    if( connected )
+    {
+        LogInfo( ( "Connected to %s.", brokerEndpoint ) );
+    }
+
+    return connected;
+}
+/*-----------------------------------------------------------*/
+
+bool connectionManager_reconnect( void )
+{
+    bool connected = false;
+    bool subscribed = false;
+
+    LogWarn( ( "Connection to %s lost, reconnecting.", brokerEndpoint ) );
+
+    do
+    {
+        mqttWrapper_resetConnection();
+        transport_tlsDisconnect();
+
+        connected = connectionManager_connect();
+
+        /* A clean session was started, so nothing is subscribed yet. A
+         * failure here means the new connection was lost as well. */
+        subscribed = connected && mqttWrapper_resubscribe();
+
+        if( connected && !subscribed )
+        {
+            LogWarn( ( "Failed to restore the subscriptions." ) );
+        }
+    } while( connected && !subscribed );
+
+    return subscribed;
+}
+/*-----------------------------------------------------------*/
@@ -0,0 +1,95 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file connection_manager.h
+ * @brief Establishes and re-establishes the TLS and MQTT sessions to AWS IoT.
+ *
+ * Failed attempts are retried after a jittered, exponentially growing delay,
+ * so a fleet that loses its connection at once does not reconnect in step.
+ */
+
+#ifndef CONNECTION_MANAGER_H_
+#define CONNECTION_MANAGER_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* *INDENT-ON* */
+
+/**
+ * @brief Delay before the first retry, in milliseconds.
+ */
+#ifndef CONNECTION_RETRY_BACKOFF_BASE_MS
+    #define CONNECTION_RETRY_BACKOFF_BASE_MS 500U
+#endif
+
+/**
+ * @brief Upper bound on the delay between two attempts, in milliseconds.
+ */
+#ifndef CONNECTION_RETRY_MAX_BACKOFF_DELAY_MS
+    #define CONNECTION_RETRY_MAX_BACKOFF_DELAY_MS 30000U
+#endif
+
+/**
+ * @brief Number of retries before giving up, or
+ * BACKOFF_ALGORITHM_RETRY_FOREVER.
+ */
+#ifndef CONNECTION_RETRY_MAX_ATTEMPTS
+    #define CONNECTION_RETRY_MAX_ATTEMPTS BACKOFF_ALGORITHM_RETRY_FOREVER
+#endif
+
+/**
+ * @brief Remember where and as whom to connect.
+ *
+ * The strings are not copied and must outlive the connection manager.
+ *
+ * @param[in] certificateFilePath Path of the client certificate.
+ * @param[in] privateKeyFilePath Path of the client private key.
+ * @param[in] rootCAFilePath Path of the root CA certificate.
+ * @param[in] endpoint AWS IoT endpoint to connect to.
+ * @param[in] thingName Thing name, used as the MQTT client identifier.
+ */
+void connectionManager_init( char * certificateFilePath,
+                             char * privateKeyFilePath,
+                             char * rootCAFilePath,
+                             char * endpoint,
+                             char * thingName );
+
+/**
+ * @brief Connect, retrying with backoff until it succeeds.
+ *
+ * Blocks the calling task between attempts. When every attempt fails the
+ * cached TLS context is freed, a later call loads the credentials again.
+ *
+ * @return true once connected; false if every attempt failed.
+ */
+bool connectionManager_connect( void );
+
+/**
+ * @brief Replace a lost connection and restore its subscriptions.
+ *
+ * Must be called from the task that runs the MQTT process loop.
+ *
+ * @return true once connected and subscribed again; false if every attempt
+ * failed.
+ */
+bool connectionManager_reconnect( void );
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+}
+#endif
+/* *INDENT-ON* */
+
+#endif /* ifndef CONNECTION_MANAGER_H_ */
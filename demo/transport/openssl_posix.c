@@ -13,6 +13,7 @@
 
 /* Standard includes. */
 #include <assert.h>
+#include <errno.h>
 #include <string.h>
 
 /* POSIX socket includes. */
@@ -103,6 +104,36 @@ static void setOptionalConfigurations(
     SSL * ssl,
     const OpensslCredentials_t * opensslCredentials );
 
+/**
+ * @brief Build the SSL_CTX shared by every connection.
+ *
+ * @param[out] opensslParams Parameters to store the SSL_CTX in.
+ * @param[in] opensslCredentials TLS credentials to parse into the SSL_CTX.
+ *
+ * @return #OPENSSL_SUCCESS, #OPENSSL_API_ERROR, and
+ * #OPENSSL_INVALID_CREDENTIALS.
+ */
+static OpensslStatus_t createSslContext(
+    OpensslParams_t * opensslParams,
+    const OpensslCredentials_t * opensslCredentials );
+
+#if OPENSSL_SESSION_RESUMPTION
+
+/**
+ * @brief Keep a session the server has made resumable.
+ *
+ * Called by OpenSSL once the handshake has completed, and again for each
+ * TLS 1.3 ticket, which only arrives after the handshake.
+ *
+ * @param[in] ssl Connection the session belongs to.
+ * @param[in] session New session, owned by the callee if 1 is returned.
+ *
+ * @return 1, the session is always kept.
+ */
+static int storeSession( SSL * ssl, SSL_SESSION * session );
+
+#endif
+
 /**
  * @brief Converts the sockets wrapper status to openssl status.
  *
@@ -162,6 +193,76 @@ static OpensslStatus_t convertToOpensslStatus( SocketStatus_t socketStatus )
 }
 /*-----------------------------------------------------------*/
 
+static OpensslStatus_t createSslContext(
+    OpensslParams_t * opensslParams,
+    const OpensslCredentials_t * opensslCredentials )
+{
+    OpensslStatus_t returnStatus = OPENSSL_SUCCESS;
+    SSL_CTX * sslContext = SSL_CTX_new( TLS_client_method() );
+
+    if( sslContext == NULL )
+    {
+        LogError( ( "Creation of a new SSL_CTX object failed." ) );
+        returnStatus = OPENSSL_API_ERROR;
+    }
+    else
+    {
+        /* Enable partial writes for blocking calls to SSL_write to allow a
+         * payload larger than the maximum fragment length.
+         * The mask returned by SSL_CTX_set_mode does not need to be checked. */
+
+        /* MISRA Directive 4.6 flags the following line for using basic
+         * numerical type long. This directive is suppressed because openssl
+         * function #SSL_CTX_set_mode takes an argument of type long. */
+        /* coverity[misra_c_2012_directive_4_6_violation] */
+        ( void ) SSL_CTX_set_mode( sslContext,
+                                   ( long ) SSL_MODE_ENABLE_PARTIAL_WRITE );
+
+        if( setCredentials( sslContext, opensslCredentials ) != 1 )
+        {
+            LogError( ( "Setting up credentials failed." ) );
+            SSL_CTX_free( sslContext );
+            returnStatus = OPENSSL_INVALID_CREDENTIALS;
+        }
+    }
+
+    if( returnStatus == OPENSSL_SUCCESS )
+    {
+#if OPENSSL_SESSION_RESUMPTION
+        /* Sessions are handed to storeSession() rather than to the internal
+         * cache, which a client that talks to one server does not need. */
+        ( void ) SSL_CTX_set_session_cache_mode(
+            sslContext,
+            SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE );
+        SSL_CTX_sess_set_new_cb( sslContext, storeSession );
+#endif
+        opensslParams->sslContext = sslContext;
+    }
+
+    return returnStatus;
+}
+/*-----------------------------------------------------------*/
+
+#if OPENSSL_SESSION_RESUMPTION
+
+static int storeSession( SSL * ssl, SSL_SESSION * session )
+{
+    OpensslParams_t * opensslParams = ( OpensslParams_t * ) SSL_get_app_data(
+        ssl );
+
+    if( opensslParams->session != NULL )
+    {
+        SSL_SESSION_free( opensslParams->session );
+    }
+
+    opensslParams->session = session;
+
+    return 1;
+}
+/*-----------------------------------------------------------*/
+
+#endif
+
 static OpensslStatus_t tlsHandshake(
     const ServerInfo_t * serverInfo,
     OpensslParams_t * opensslParams,
@@ -201,6 +302,19 @@ static OpensslStatus_t tlsHandshake(
     {
         setOptionalConfigurations( opensslParams->ssl, opensslCredentials );
 
+#if OPENSSL_SESSION_RESUMPTION
+        /* The server falls back to a full handshake by itself if it no
+         * longer accepts the session. */
+        SSL_set_app_data( opensslParams->ssl, opensslParams );
+
+        if( ( opensslParams->session != NULL ) &&
+            ( SSL_set_session( opensslParams->ssl,
+                               opensslParams->session ) != 1 ) )
+        {
+            LogWarn( ( "SSL_set_session failed, doing a full handshake." ) );
+        }
+#endif
+
         sslStatus = SSL_connect( opensslParams->ssl );
 
         if( sslStatus != 1 )
@@ -238,6 +352,25 @@ static OpensslStatus_t tlsHandshake(
         }
     }
 
+#if OPENSSL_SESSION_RESUMPTION
+    if( returnStatus == OPENSSL_SUCCESS )
+    {
+        LogDebug( ( "TLS session %s.",
+                    ( SSL_session_reused( opensslParams->ssl ) == 1 ) ?
+                    "resumed" : "negotiated" ) );
+    }
+    else if( opensslParams->session != NULL )
+    {
+        /* The session may be what the server objected to. */
+        SSL_SESSION_free( opensslParams->session );
+        opensslParams->session = NULL;
+    }
+    else
+    {
+        /* Empty else. */
+    }
+#endif
+
     return returnStatus;
 }
 
@@ -480,15 +613,14 @@ static void setOptionalConfigurations(
 OpensslStatus_t Openssl_Connect( NetworkContext_t * networkContext,
                                  const ServerInfo_t * serverInfo,
                                  const OpensslCredentials_t * opensslCredentials,
+                                 const SocketOptions_t * socketOptions,
                                  uint32_t sendTimeoutMs,
                                  uint32_t recvTimeoutMs )
 {
     OpensslParams_t * opensslParams = NULL;
     SocketStatus_t socketStatus = SOCKETS_SUCCESS;
     OpensslStatus_t returnStatus = OPENSSL_SUCCESS;
-    int32_t sslStatus = 0;
     uint8_t sslObjectCreated = 0;
-    SSL_CTX * sslContext = NULL;
 
     sigset_t old_set;
     sigset_t set;
@@ -519,8 +651,11 @@ OpensslStatus_t Openssl_Connect( NetworkContext_t * networkContext,
     if( returnStatus == OPENSSL_SUCCESS )
     {
         opensslParams = networkContext->params;
+        opensslParams->quickAck = ( socketOptions != NULL ) &&
+                                  socketOptions->quickAck;
         socketStatus = Sockets_Connect( &opensslParams->socketDescriptor,
                                         serverInfo,
+                                        socketOptions,
                                         sendTimeoutMs,
                                         recvTimeoutMs );
 
@@ -528,45 +663,18 @@ OpensslStatus_t Openssl_Connect( NetworkContext_t * networkContext,
         returnStatus = convertToOpensslStatus( socketStatus );
     }
 
-    /* Create SSL context. */
-    if( returnStatus == OPENSSL_SUCCESS )
+    /* Create the SSL context on the first connection only, parsing the
+     * credentials is most of the cost of a reconnect otherwise. */
+    if( ( returnStatus == OPENSSL_SUCCESS ) &&
+        ( opensslParams->sslContext == NULL ) )
     {
-        sslContext = SSL_CTX_new( TLS_client_method() );
-
-        if( sslContext == NULL )
-        {
-            LogError( ( "Creation of a new SSL_CTX object failed." ) );
-            returnStatus = OPENSSL_API_ERROR;
-        }
-    }
-
-    /* Setup credentials. */
-    if( returnStatus == OPENSSL_SUCCESS )
-    {
-        /* Enable partial writes for blocking calls to SSL_write to allow a
-         * payload larger than the maximum fragment length.
-         * The mask returned by SSL_CTX_set_mode does not need to be checked. */
-
-        /* MISRA Directive 4.6 flags the following line for using basic
-         * numerical type long. This directive is suppressed because openssl
-         * function #SSL_CTX_set_mode takes an argument of type long. */
-        /* coverity[misra_c_2012_directive_4_6_violation] */
-        ( void ) SSL_CTX_set_mode( sslContext,
-                                   ( long ) SSL_MODE_ENABLE_PARTIAL_WRITE );
-
-        sslStatus = setCredentials( sslContext, opensslCredentials );
-
-        if( sslStatus != 1 )
-        {
-            LogError( ( "Setting up credentials failed." ) );
-            returnStatus = OPENSSL_INVALID_CREDENTIALS;
-        }
+        returnStatus = createSslContext( opensslParams, opensslCredentials );
     }
 
     /* Create a new SSL session. */
     if( returnStatus == OPENSSL_SUCCESS )
     {
-        opensslParams->ssl = SSL_new( sslContext );
+        opensslParams->ssl = SSL_new( opensslParams->sslContext );
 
         if( opensslParams->ssl == NULL )
         {
@@ -587,13 +695,6 @@ OpensslStatus_t Openssl_Connect( NetworkContext_t * networkContext,
                                      opensslCredentials );
     }
 
-    /* Free the SSL context. */
-    if( sslContext != NULL )
-    {
-        SSL_CTX_free( sslContext );
-        sslContext = NULL;
-    }
-
     /* Clean up on error. */
     if( ( returnStatus != OPENSSL_SUCCESS ) && ( sslObjectCreated == 1u ) )
     {
@@ -664,6 +765,33 @@ OpensslStatus_t Openssl_Disconnect( const NetworkContext_t * networkContext )
 }
 /*-----------------------------------------------------------*/
 
+void Openssl_FreeContext( NetworkContext_t * networkContext )
+{
+    OpensslParams_t * opensslParams = NULL;
+
+    if( ( networkContext == NULL ) || ( networkContext->params == NULL ) )
+    {
+        LogError( ( "Parameter check failed: networkContext is NULL." ) );
+    }
+    else
+    {
+        opensslParams = networkContext->params;
+
+        if( opensslParams->session != NULL )
+        {
+            SSL_SESSION_free( opensslParams->session );
+            opensslParams->session = NULL;
+        }
+
+        if( opensslParams->sslContext != NULL )
+        {
+            SSL_CTX_free( opensslParams->sslContext );
+            opensslParams->sslContext = NULL;
+        }
+    }
+}
+/*-----------------------------------------------------------*/
+
 /* MISRA Rule 8.13 flags the following line for not using the const qualifier
  * on `networkContext`. Indeed, the object pointed by it is not modified
  * by OpenSSL, but other implementations of `TransportRecv_t` may do so. */
@@ -757,6 +885,13 @@ int32_t Openssl_Recv( NetworkContext_t * networkContext,
             if( readStatus > 0 )
             {
                 bytesReceived = readStatus;
+
+                /* Keeps the broker from waiting on a delayed ACK before it
+                 * sends the next segment of a block. */
+                if( opensslParams->quickAck )
+                {
+                    Sockets_QuickAck( opensslParams->socketDescriptor );
+                }
             }
         }
 
@@ -797,6 +932,58 @@ int32_t Openssl_Recv( NetworkContext_t * networkContext,
 }
 /*-----------------------------------------------------------*/
 
+int32_t Openssl_WaitForData( NetworkContext_t * networkContext,
+                             uint32_t timeoutMs )
+{
+    int32_t pollStatus = -1;
+
+    if( ( networkContext == NULL ) || ( networkContext->params == NULL ) )
+    {
+        LogError( ( "Parameter check failed: networkContext is NULL." ) );
+    }
+    else if( networkContext->params->ssl == NULL )
+    {
+        LogError( ( "Failed to wait for data on network: "
+                    "SSL object in network context is NULL." ) );
+    }
+    else if( SSL_pending( networkContext->params->ssl ) > 0 )
+    {
+        /* A decrypted record is still buffered inside OpenSSL. */
+        pollStatus = 1;
+    }
+    else
+    {
+        struct pollfd pollFds;
+
+        pollFds.events = POLLIN | POLLPRI;
+        pollFds.revents = 0;
+        pollFds.fd = networkContext->params->socketDescriptor;
+
+        /* Unlike the send and receive paths, signals are not masked here.
+         * The FreeRTOS POSIX port delivers its tick as a signal, which lets
+         * other tasks run while this one sleeps in the socket. */
+        pollStatus = poll( &pollFds, 1, ( int ) timeoutMs );
+
+        if( ( pollStatus < 0 ) && ( errno == EINTR ) )
+        {
+            pollStatus = 0;
+        }
+        else if( pollStatus < 0 )
+        {
+            LogError( ( "Failed to wait for data on network: "
+                        "poll failed: %s.",
+                        strerror( errno ) ) );
+        }
+        else
+        {
+            /* Empty else. */
+        }
+    }
+
+    return pollStatus;
+}
+/*-----------------------------------------------------------*/
+
 /* MISRA Rule 8.13 flags the following line for not using the const qualifier
  * on `networkContext`. Indeed, the object pointed by it is not modified
  * by OpenSSL, but other implementations of `TransportSend_t` may do so. */
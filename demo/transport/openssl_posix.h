@@ -25,17 +25,33 @@ extern "C" {
 /* Socket include. */
 #include "sockets_posix.h"
 
+/**
+ * @brief Set to 0 to do a full TLS handshake on every connection.
+ *
+ * Otherwise the session of the last connection, or the ticket the server
+ * issued for it, is offered on the next one so that an abbreviated handshake
+ * can be done.
+ */
+#ifndef OPENSSL_SESSION_RESUMPTION
+    #define OPENSSL_SESSION_RESUMPTION 1
+#endif
+
 /**
  * @brief Parameters for the transport-interface
  * implementation that uses OpenSSL and POSIX sockets.
  *
  * @note For this transport implementation, the socket descriptor and
- * SSL context is used.
+ * SSL context is used. The SSL_CTX, with the credentials parsed into it, and
+ * the last session are kept across disconnects, so zero-initialize the
+ * parameters once and reuse them for every connection.
  */
 typedef struct OpensslParams
 {
     int32_t socketDescriptor;
     SSL * ssl;
+    SSL_CTX * sslContext;  /**< @brief Built on the first connection. */
+    SSL_SESSION * session; /**< @brief Offered on the next connection. */
+    bool quickAck;         /**< @brief Re-arm TCP_QUICKACK after reads. */
 } OpensslParams_t;
 
 /* Each compilation unit must define the NetworkContext struct. */
@@ -129,6 +145,7 @@ typedef struct OpensslCredentials
  * network context.
  * @param[in] serverInfo Server connection info.
  * @param[in] opensslCredentials Credentials for the TLS connection.
+ * @param[in] socketOptions Tuning of the TCP socket, NULL for system defaults.
  * @param[in] sendTimeoutMs Timeout for transport send.
  * @param[in] recvTimeoutMs Timeout for transport recv.
  *
@@ -138,9 +155,16 @@ typedef struct OpensslCredentials
  * #OPENSSL_INVALID_PARAMETER, #OPENSSL_INVALID_CREDENTIALS,
  * #OPENSSL_INVALID_CREDENTIALS, #OPENSSL_SYSTEM_ERROR on failure.
  */
+/**
+ * @brief Set up a TLS connection to a server.
+ *
+ * The credentials are only parsed on the first call. Later calls reuse the
+ * SSL_CTX built from them, and only need the optional configurations.
+ */
 OpensslStatus_t Openssl_Connect( NetworkContext_t * networkContext,
                                  const ServerInfo_t * serverInfo,
                                  const OpensslCredentials_t * opensslCredentials,
+                                 const SocketOptions_t * socketOptions,
                                  uint32_t sendTimeoutMs,
                                  uint32_t recvTimeoutMs );
 
@@ -154,8 +178,19 @@ OpensslStatus_t Openssl_Connect( NetworkContext_t * networkContext,
  * @return #OPENSSL_SUCCESS on success; #OPENSSL_INVALID_PARAMETER on
  * failure.
  */
+/**
+ * @brief Close the TLS connection, keeping the SSL_CTX and the session.
+ */
 OpensslStatus_t Openssl_Disconnect( const NetworkContext_t * networkContext );
 
+/**
+ * @brief Free the SSL_CTX and the session kept for later connections.
+ *
+ * The next Openssl_Connect() parses the credentials again and does a full
+ * handshake.
+ */
+void Openssl_FreeContext( NetworkContext_t * networkContext );
+
 /**
  * @brief Receives data over an established TLS session using the OpenSSL
  * API.
@@ -176,6 +211,23 @@ int32_t Openssl_Recv( NetworkContext_t * networkContext,
                       void * buffer,
                       size_t bytesToRecv );
 
+/**
+ * @brief Waits until data can be read from an established TLS session.
+ *
+ * Application data already decrypted by OpenSSL counts as readable, so a
+ * caller draining the session does not block while records are buffered.
+ * The wait is left open to signals so the scheduler tick may preempt it.
+ *
+ * @param[in] networkContext The network context created using
+ * Openssl_Connect API.
+ * @param[in] timeoutMs Maximum time to wait. Zero polls without blocking.
+ *
+ * @return 1 if data is ready to be read; 0 if the wait timed out or was
+ * interrupted; negative value on error.
+ */
+int32_t Openssl_WaitForData( NetworkContext_t * networkContext,
+                             uint32_t timeoutMs );
+
 /**
  * @brief Sends data over an established TLS session using the OpenSSL API.
  *
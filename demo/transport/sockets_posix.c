@@ -19,6 +19,8 @@
 #include <arpa/inet.h>
 #include <errno.h>
 #include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <time.h>
@@ -70,8 +72,21 @@ static SocketStatus_t attemptConnection( struct addrinfo * listHead,
                                          const char * hostName,
                                          size_t hostNameLength,
                                          uint16_t port,
+                                         const SocketOptions_t * socketOptions,
                                          int32_t * tcpSocket );
 
+/**
+ * @brief Apply the tuning options to a socket that is not connected yet.
+ *
+ * Buffer sizes must be set before connecting for the TCP window scale to
+ * take them into account. A failure is logged and the option left as is.
+ *
+ * @param[in] tcpSocket The socket descriptor.
+ * @param[in] socketOptions Options to apply.
+ */
+static void applySocketOptions( int32_t tcpSocket,
+                                const SocketOptions_t * socketOptions );
+
 /**
  * @brief Connect to server using the provided address record.
  *
@@ -136,6 +151,101 @@ static SocketStatus_t resolveHostName( const char * hostName,
 }
 /*-----------------------------------------------------------*/
 
+static void setIntOption( int32_t tcpSocket,
+                          int32_t level,
+                          int32_t optionName,
+                          const char * optionString,
+                          int32_t value )
+{
+    if( setsockopt( tcpSocket,
+                    level,
+                    optionName,
+                    &value,
+                    ( socklen_t ) sizeof( value ) ) < 0 )
+    {
+        LogWarn( ( "Setting %s to %d failed: %s",
+                   optionString,
+                   ( int ) value,
+                   strerror( errno ) ) );
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void applySocketOptions( int32_t tcpSocket,
+                                const SocketOptions_t * socketOptions )
+{
+    assert( socketOptions != NULL );
+
+    if( socketOptions->noDelay )
+    {
+        setIntOption( tcpSocket, IPPROTO_TCP, TCP_NODELAY, "TCP_NODELAY", 1 );
+    }
+
+#ifdef TCP_QUICKACK
+    if( socketOptions->quickAck )
+    {
+        setIntOption( tcpSocket, IPPROTO_TCP, TCP_QUICKACK, "TCP_QUICKACK", 1 );
+    }
+#endif
+
+    if( socketOptions->receiveBufferSize > 0U )
+    {
+        setIntOption( tcpSocket,
+                      SOL_SOCKET,
+                      SO_RCVBUF,
+                      "SO_RCVBUF",
+                      ( int32_t ) socketOptions->receiveBufferSize );
+    }
+
+    if( socketOptions->sendBufferSize > 0U )
+    {
+        setIntOption( tcpSocket,
+                      SOL_SOCKET,
+                      SO_SNDBUF,
+                      "SO_SNDBUF",
+                      ( int32_t ) socketOptions->sendBufferSize );
+    }
+
+    if( socketOptions->keepAlive )
+    {
+        setIntOption( tcpSocket, SOL_SOCKET, SO_KEEPALIVE, "SO_KEEPALIVE", 1 );
+
+#ifdef TCP_KEEPIDLE
+        if( socketOptions->keepAliveIdleSeconds > 0U )
+        {
+            setIntOption( tcpSocket,
+                          IPPROTO_TCP,
+                          TCP_KEEPIDLE,
+                          "TCP_KEEPIDLE",
+                          ( int32_t ) socketOptions->keepAliveIdleSeconds );
+        }
+#endif
+
+#ifdef TCP_KEEPINTVL
+        if( socketOptions->keepAliveIntervalSeconds > 0U )
+        {
+            setIntOption( tcpSocket,
+                          IPPROTO_TCP,
+                          TCP_KEEPINTVL,
+                          "TCP_KEEPINTVL",
+                          ( int32_t ) socketOptions->keepAliveIntervalSeconds );
+        }
+#endif
+
+#ifdef TCP_KEEPCNT
+        if( socketOptions->keepAliveProbes > 0U )
+        {
+            setIntOption( tcpSocket,
+                          IPPROTO_TCP,
+                          TCP_KEEPCNT,
+                          "TCP_KEEPCNT",
+                          ( int32_t ) socketOptions->keepAliveProbes );
+        }
+#endif
+    }
+}
+/*-----------------------------------------------------------*/
+
 static SocketStatus_t connectToAddress( struct sockaddr * addrInfo,
                                         uint16_t port,
                                         int32_t tcpSocket )
@@ -215,6 +325,7 @@ static SocketStatus_t attemptConnection( struct addrinfo * listHead,
                                          const char * hostName,
                                          size_t hostNameLength,
                                          uint16_t port,
+                                         const SocketOptions_t * socketOptions,
                                          int32_t * tcpSocket )
 {
     SocketStatus_t returnStatus = SOCKETS_CONNECT_FAILURE;
@@ -245,6 +356,11 @@ static SocketStatus_t attemptConnection( struct addrinfo * listHead,
             continue;
         }
 
+        if( socketOptions != NULL )
+        {
+            applySocketOptions( *tcpSocket, socketOptions );
+        }
+
         /* Attempt to connect to a resolved DNS address of the host. */
         returnStatus = connectToAddress( index->ai_addr, port, *tcpSocket );
 
@@ -300,6 +416,7 @@ static SocketStatus_t retrieveError( int32_t errorNumber )
 
 SocketStatus_t Sockets_Connect( int32_t * tcpSocket,
                                 const ServerInfo_t * serverInfo,
+                                const SocketOptions_t * socketOptions,
                                 uint32_t sendTimeoutMs,
                                 uint32_t recvTimeoutMs )
 {
@@ -347,6 +464,7 @@ SocketStatus_t Sockets_Connect( int32_t * tcpSocket,
                                           serverInfo->hostName,
                                           serverInfo->hostNameLength,
                                           serverInfo->port,
+                                          socketOptions,
                                           tcpSocket );
     }
 
@@ -418,3 +536,19 @@ SocketStatus_t Sockets_Disconnect( int32_t tcpSocket )
     return returnStatus;
 }
 /*-----------------------------------------------------------*/
+
+void Sockets_QuickAck( int32_t tcpSocket )
+{
+#ifdef TCP_QUICKACK
+    int32_t enable = 1;
+
+    ( void ) setsockopt( tcpSocket,
+                         IPPROTO_TCP,
+                         TCP_QUICKACK,
+                         &enable,
+                         ( socklen_t ) sizeof( enable ) );
+#else
+    ( void ) tcpSocket;
+#endif
+}
+/*-----------------------------------------------------------*/
@@ -16,6 +16,9 @@ extern "C" {
 #endif
 /* *INDENT-ON* */
 
+/* Standard includes. */
+#include <stdbool.h>
+
 /* Transport interface include. */
 #include "transport_interface.h"
 
@@ -44,12 +47,35 @@ typedef struct ServerInfo
     uint16_t port;         /**< @brief Server port in host-order. */
 } ServerInfo_t;
 
+/**
+ * @brief Tuning applied to a socket before it connects.
+ *
+ * Options left at zero or false keep the system default. Options the platform
+ * does not support are ignored.
+ */
+typedef struct SocketOptions
+{
+    bool noDelay;   /**< @brief Send small writes at once (TCP_NODELAY). */
+    bool quickAck;  /**< @brief Acknowledge without delay (TCP_QUICKACK). */
+    bool keepAlive; /**< @brief Probe an idle connection (SO_KEEPALIVE). */
+    uint32_t keepAliveIdleSeconds;     /**< @brief Idle time before the first
+                                          probe (TCP_KEEPIDLE). */
+    uint32_t keepAliveIntervalSeconds; /**< @brief Time between probes
+                                          (TCP_KEEPINTVL). */
+    uint32_t keepAliveProbes;          /**< @brief Unanswered probes before the
+                                          connection is dropped
+                                          (TCP_KEEPCNT). */
+    uint32_t receiveBufferSize;        /**< @brief SO_RCVBUF in bytes. */
+    uint32_t sendBufferSize;           /**< @brief SO_SNDBUF in bytes. */
+} SocketOptions_t;
+
 /**
  * @brief Establish a connection to server.
  *
  * @param[out] tcpSocket The output parameter to return the created socket
  * descriptor.
  * @param[in] serverInfo Server connection info.
+ * @param[in] socketOptions Tuning of the socket, NULL for system defaults.
  * @param[in] sendTimeoutMs Timeout for transport send.
  * @param[in] recvTimeoutMs Timeout for transport recv.
  *
@@ -61,6 +87,7 @@ typedef struct ServerInfo
  */
 SocketStatus_t Sockets_Connect( int32_t * tcpSocket,
                                 const ServerInfo_t * serverInfo,
+                                const SocketOptions_t * socketOptions,
                                 uint32_t sendTimeoutMs,
                                 uint32_t recvTimeoutMs );
 
@@ -74,6 +101,16 @@ SocketStatus_t Sockets_Connect( int32_t * tcpSocket,
  */
 SocketStatus_t Sockets_Disconnect( int32_t tcpSocket );
 
+/**
+ * @brief Acknowledge the data received next without delay.
+ *
+ * Linux clears TCP_QUICKACK as it goes, so a socket connected with
+ * SocketOptions_t::quickAck set needs this after each read to keep it.
+ *
+ * @param[in] tcpSocket The socket descriptor.
+ */
+void Sockets_QuickAck( int32_t tcpSocket );
+
 /* *INDENT-OFF* */
 #ifdef __cplusplus
 }
@@ -19,6 +19,18 @@
 static NetworkContext_t networkContext = { 0 };
 static OpensslParams_t opensslParams = { 0 };
 
+static const SocketOptions_t socketOptions =
+{
+    .noDelay                  = ( TRANSPORT_TCP_NODELAY != 0 ),
+    .quickAck                 = ( TRANSPORT_TCP_QUICKACK != 0 ),
+    .keepAlive                = ( TRANSPORT_TCP_KEEPALIVE != 0 ),
+    .keepAliveIdleSeconds     = TRANSPORT_TCP_KEEPIDLE_SECONDS,
+    .keepAliveIntervalSeconds = TRANSPORT_TCP_KEEPINTVL_SECONDS,
+    .keepAliveProbes          = TRANSPORT_TCP_KEEPCNT,
+    .receiveBufferSize        = TRANSPORT_SO_RCVBUF,
+    .sendBufferSize           = TRANSPORT_SO_SNDBUF
+};
+
 #define TRANSPORT_TIMEOUT_MS ( 750U )
 
 #define MAX_FILE_SIZE        4096U
@@ -35,64 +47,36 @@ void transport_tlsInit( TransportInterface_t * transport )
                          NULL );
 }
 
-bool transport_tlsConnect( char * certificateFilePath,
-                           char * privateKeyFilePath,
-                           char * rootCAFilePath,
-                           char * endpoint )
+/* Reads a PEM file into a NULL-terminated buffer */
+static size_t readCredentialFile( const char * path,
+                                  char * buffer,
+                                  size_t bufferSize )
 {
-    ServerInfo_t serverInfo;
-    OpensslCredentials_t opensslCredentials = { 0 };
-    OpensslStatus_t opensslStatus = OPENSSL_SUCCESS;
-    char certificate[ MAX_FILE_SIZE ] = { 0 };
-    char rootCA[ MAX_FILE_SIZE ] = { 0 };
-    char privateKey[ MAX_FILE_SIZE ] = { 0 };
+    size_t length = 0U;
+    FILE * file = fopen( path, "r" );
 
-    FILE * certificateFile = fopen( certificateFilePath, "r" );
-    if( certificateFile == NULL )
-    {
-        printf( "Error opening certificate file: %s\n", certificateFilePath );
-        assert( false );
-    }
-    size_t certificateLength = fread( certificate,
-                                      sizeof( char ),
-                                      MAX_FILE_SIZE,
-                                      certificateFile );
-    fclose( certificateFile );
-    certificate[ certificateLength ] = '\0';
-
-    FILE * privateKeyFile = fopen( privateKeyFilePath, "r" );
-    if( privateKeyFile == NULL )
+    if( file == NULL )
     {
-        printf( "Error opening private key file: %s\n", privateKeyFilePath );
+        printf( "Error opening credential file: %s\n", path );
         assert( false );
     }
-    size_t privateKeyLength = fread( privateKey,
-                                     sizeof( char ),
-                                     MAX_FILE_SIZE,
-                                     privateKeyFile );
-    fclose( privateKeyFile );
-    privateKey[ privateKeyLength ] = '\0';
-
-    FILE * rootCAFile = fopen( rootCAFilePath, "r" );
-    if( rootCAFile == NULL )
+    else
     {
-        printf( "Error opening root CA file: %s\n", rootCAFilePath );
-        assert( false );
+        length = fread( buffer, sizeof( char ), bufferSize - 1U, file );
+        fclose( file );
     }
-    size_t rootCALength = fread( rootCA,
-                                 sizeof( char ),
-                                 MAX_FILE_SIZE,
-                                 rootCAFile );
-    fclose( rootCAFile );
-    rootCA[ rootCALength ] = '\0';
-
-    opensslCredentials.sniHostName = endpoint;
-    opensslCredentials.clientCertBuffer = certificate;
-    opensslCredentials.clientCertLength = certificateLength;
-    opensslCredentials.rootCaBuffer = rootCA;
-    opensslCredentials.rootCaLength = rootCALength;
-    opensslCredentials.privateKeyBuffer = privateKey;
-    opensslCredentials.privateKeyLength = privateKeyLength;
+
+    buffer[ length ] = '\0';
+    return length;
+}
+
+static OpensslStatus_t connectToEndpoint(
+    char * endpoint,
+    OpensslCredentials_t * opensslCredentials )
+{
+    ServerInfo_t serverInfo;
+
+    opensslCredentials->sniHostName = endpoint;
 
     serverInfo.hostName = endpoint;
     serverInfo.hostNameLength = strlen( endpoint );
@@ -100,15 +84,77 @@ bool transport_tlsConnect( char * certificateFilePath,
 
     networkContext.params = &opensslParams;
 
-    opensslStatus = Openssl_Connect( &networkContext,
-                                     &serverInfo,
-                                     &opensslCredentials,
-                                     TRANSPORT_TIMEOUT_MS,
-                                     TRANSPORT_TIMEOUT_MS );
+    return Openssl_Connect( &networkContext,
+                            &serverInfo,
+                            opensslCredentials,
+                            &socketOptions,
+                            TRANSPORT_TIMEOUT_MS,
+                            TRANSPORT_TIMEOUT_MS );
+}
+
+/* Kept out of line, so the credential buffers only take stack space on the
+ * connection that parses them. */
+__attribute__( ( noinline ) )
+static OpensslStatus_t connectWithCredentialFiles( char * certificateFilePath,
+                                                   char * privateKeyFilePath,
+                                                   char * rootCAFilePath,
+                                                   char * endpoint )
+{
+    OpensslCredentials_t opensslCredentials = { 0 };
+    char certificate[ MAX_FILE_SIZE ] = { 0 };
+    char rootCA[ MAX_FILE_SIZE ] = { 0 };
+    char privateKey[ MAX_FILE_SIZE ] = { 0 };
+
+    opensslCredentials.clientCertBuffer = certificate;
+    opensslCredentials.clientCertLength = ( int ) readCredentialFile(
+        certificateFilePath,
+        certificate,
+        MAX_FILE_SIZE );
+    opensslCredentials.privateKeyBuffer = privateKey;
+    opensslCredentials.privateKeyLength = ( int ) readCredentialFile(
+        privateKeyFilePath,
+        privateKey,
+        MAX_FILE_SIZE );
+    opensslCredentials.rootCaBuffer = rootCA;
+    opensslCredentials.rootCaLength = ( int ) readCredentialFile(
+        rootCAFilePath,
+        rootCA,
+        MAX_FILE_SIZE );
+
+    return connectToEndpoint( endpoint, &opensslCredentials );
+}
+
+bool transport_tlsConnect( char * certificateFilePath,
+                           char * privateKeyFilePath,
+                           char * rootCAFilePath,
+                           char * endpoint )
+{
+    OpensslCredentials_t opensslCredentials = { 0 };
+    OpensslStatus_t opensslStatus = OPENSSL_SUCCESS;
+
+    /* Once a connection has been made the credentials live, parsed, in the
+     * SSL context it kept, so a reconnect does not touch the files. */
+    if( opensslParams.sslContext == NULL )
+    {
+        opensslStatus = connectWithCredentialFiles( certificateFilePath,
+                                                    privateKeyFilePath,
+                                                    rootCAFilePath,
+                                                    endpoint );
+    }
+    else
+    {
+        opensslStatus = connectToEndpoint( endpoint, &opensslCredentials );
+    }
 
     return opensslStatus == OPENSSL_SUCCESS;
 }
 
+/* Returns true on errors as well, so the next receive call reports them */
+bool transport_waitForData( uint32_t timeoutMs )
+{
+    return Openssl_WaitForData( &networkContext, timeoutMs ) != 0;
+}
+
 void transport_tlsDisconnect( void )
 {
     if( networkContext.params != NULL )
@@ -116,3 +162,11 @@ void transport_tlsDisconnect( void )
         ( void ) Openssl_Disconnect( &networkContext );
     }
 }
+
+void transport_tlsFree( void )
+{
+    if( networkContext.params != NULL )
+    {
+        Openssl_FreeContext( &networkContext );
+    }
+}
@@ -12,6 +12,71 @@
 
 #include "transport_interface.h"
 
+/**
+ * @brief Send MQTT packets without waiting to coalesce them (TCP_NODELAY).
+ *
+ * Block requests are small and every one of them stalls a round trip if
+ * Nagle's algorithm holds it back.
+ */
+#ifndef TRANSPORT_TCP_NODELAY
+    #define TRANSPORT_TCP_NODELAY 1
+#endif
+
+/**
+ * @brief Acknowledge received data without delay (TCP_QUICKACK, Linux only).
+ */
+#ifndef TRANSPORT_TCP_QUICKACK
+    #define TRANSPORT_TCP_QUICKACK 0
+#endif
+
+/**
+ * @brief Socket receive buffer in bytes, 0 for the system default.
+ *
+ * A buffer of at least the bandwidth-delay product lets a window of blocks
+ * arrive without the TCP window closing.
+ */
+#ifndef TRANSPORT_SO_RCVBUF
+    #define TRANSPORT_SO_RCVBUF 0U
+#endif
+
+/**
+ * @brief Socket send buffer in bytes, 0 for the system default.
+ */
+#ifndef TRANSPORT_SO_SNDBUF
+    #define TRANSPORT_SO_SNDBUF 0U
+#endif
+
+/**
+ * @brief Detect a dead connection with TCP keepalive probes.
+ *
+ * The MQTT keep-alive detects it as well, this only does it sooner when the
+ * probes are more frequent than PINGREQ.
+ */
+#ifndef TRANSPORT_TCP_KEEPALIVE
+    #define TRANSPORT_TCP_KEEPALIVE 0
+#endif
+
+/**
+ * @brief Idle seconds before the first keepalive probe, 0 for the default.
+ */
+#ifndef TRANSPORT_TCP_KEEPIDLE_SECONDS
+    #define TRANSPORT_TCP_KEEPIDLE_SECONDS 30U
+#endif
+
+/**
+ * @brief Seconds between keepalive probes, 0 for the default.
+ */
+#ifndef TRANSPORT_TCP_KEEPINTVL_SECONDS
+    #define TRANSPORT_TCP_KEEPINTVL_SECONDS 10U
+#endif
+
+/**
+ * @brief Unanswered keepalive probes before the connection is dropped.
+ */
+#ifndef TRANSPORT_TCP_KEEPCNT
+    #define TRANSPORT_TCP_KEEPCNT 3U
+#endif
+
 void transport_tlsInit( TransportInterface_t * transport );
 
 bool transport_tlsConnect( char * certificateFilePath,
@@ -21,4 +86,10 @@ bool transport_tlsConnect( char * certificateFilePath,
 
 void transport_tlsDisconnect( void );
 
+/* Frees the SSL context and the session kept for the next connection, which
+ * then parses the credential files again. Called once disconnected. */
+void transport_tlsFree( void );
+
+bool transport_waitForData( uint32_t timeoutMs );
+
 #endif
@@ -0,0 +1,530 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file base64.c
+ * @brief Table driven base64 decoder, with vector decoders for x86 and ARMv8.
+ *
+ * The vector decoders follow W. Mula and D. Lemire, "Faster Base64 Encoding
+ * and Decoding Using AVX2 Instructions". The high and low nibbles of each
+ * symbol index two small tables whose entries share a bit only for symbols
+ * outside of the alphabet, and the high nibble indexes a third table giving
+ * the offset from the symbol to its value. The x86 decoders are compiled for
+ * their instruction set whatever the build flags and are only called when
+ * the CPU has it. NEON is part of every ARMv8 CPU.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+    #define BASE64_X86 1
+    #include <immintrin.h>
+#elif defined( __aarch64__ )
+    #define BASE64_NEON 1
+    #include <arm_neon.h>
+#endif
+
+#include "base64.h"
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Maps an input character to its 6-bit value plus one.
+ *
+ * Characters outside of the base64 alphabet map to zero.
+ */
+static const uint8_t symbolValues[ 256 ] =
+{
+    [ 'A' ] = 1, [ 'B' ] = 2, [ 'C' ] = 3, [ 'D' ] = 4, [ 'E' ] = 5,
+    [ 'F' ] = 6, [ 'G' ] = 7, [ 'H' ] = 8, [ 'I' ] = 9, [ 'J' ] = 10,
+    [ 'K' ] = 11, [ 'L' ] = 12, [ 'M' ] = 13, [ 'N' ] = 14, [ 'O' ] = 15,
+    [ 'P' ] = 16, [ 'Q' ] = 17, [ 'R' ] = 18, [ 'S' ] = 19, [ 'T' ] = 20,
+    [ 'U' ] = 21, [ 'V' ] = 22, [ 'W' ] = 23, [ 'X' ] = 24, [ 'Y' ] = 25,
+    [ 'Z' ] = 26, [ 'a' ] = 27, [ 'b' ] = 28, [ 'c' ] = 29, [ 'd' ] = 30,
+    [ 'e' ] = 31, [ 'f' ] = 32, [ 'g' ] = 33, [ 'h' ] = 34, [ 'i' ] = 35,
+    [ 'j' ] = 36, [ 'k' ] = 37, [ 'l' ] = 38, [ 'm' ] = 39, [ 'n' ] = 40,
+    [ 'o' ] = 41, [ 'p' ] = 42, [ 'q' ] = 43, [ 'r' ] = 44, [ 's' ] = 45,
+    [ 't' ] = 46, [ 'u' ] = 47, [ 'v' ] = 48, [ 'w' ] = 49, [ 'x' ] = 50,
+    [ 'y' ] = 51, [ 'z' ] = 52, [ '0' ] = 53, [ '1' ] = 54, [ '2' ] = 55,
+    [ '3' ] = 56, [ '4' ] = 57, [ '5' ] = 58, [ '6' ] = 59, [ '7' ] = 60,
+    [ '8' ] = 61, [ '9' ] = 62, [ '+' ] = 63, [ '/' ] = 64
+};
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Combine four symbols into a 24-bit quantum.
+ *
+ * @return false if any of the symbols is outside of the base64 alphabet.
+ */
+static bool decodeQuantum( const uint8_t * symbols, uint32_t * quantum )
+{
+    bool valid = true;
+    uint8_t value = 0U;
+
+    *quantum = 0U;
+
+    for( size_t i = 0U; i < 4U; i++ )
+    {
+        value = symbolValues[ symbols[ i ] ];
+        valid = valid && ( value != 0U );
+        *quantum = ( *quantum << 6 ) | ( ( value - 1U ) & 0x3FU );
+    }
+
+    return valid;
+}
+/*-----------------------------------------------------------*/
+
+#ifdef BASE64_X86
+
+/* Symbols of 16 at a time. Each chunk is stored as 16 bytes of which the
+ * last 4 are overwritten by the next chunk, so there must be room for them
+ * in the output. Returns the number of symbols decoded, stopping before the
+ * first chunk with a symbol outside of the alphabet. */
+__attribute__( ( target( "ssse3" ) ) )
+static size_t decodeSsse3( const uint8_t * encoded,
+                           size_t encodedLength,
+                           uint8_t * decoded,
+                           size_t decodedSize )
+{
+    const __m128i lowNibbleBits = _mm_setr_epi8( 0x15, 0x11, 0x11, 0x11,
+                                                 0x11, 0x11, 0x11, 0x11,
+                                                 0x11, 0x11, 0x13, 0x1A,
+                                                 0x1B, 0x1B, 0x1B, 0x1A );
+    const __m128i highNibbleBits = _mm_setr_epi8( 0x10, 0x10, 0x01, 0x02,
+                                                  0x04, 0x08, 0x04, 0x08,
+                                                  0x10, 0x10, 0x10, 0x10,
+                                                  0x10, 0x10, 0x10, 0x10 );
+    const __m128i offsets = _mm_setr_epi8( 0, 16, 19, 4, -65, -65, -71, -71,
+                                           0, 0, 0, 0, 0, 0, 0, 0 );
+    const __m128i slashes = _mm_set1_epi8( 0x2F );
+    const __m128i pack = _mm_setr_epi8( 2, 1, 0, 6, 5, 4, 10, 9,
+                                        8, 14, 13, 12, -1, -1, -1, -1 );
+    __m128i symbols, highNibbles, invalid, values;
+    size_t readIndex = 0U;
+    size_t writeIndex = 0U;
+    bool valid = true;
+
+    while( valid && ( ( encodedLength - readIndex ) >= 16U ) &&
+           ( ( decodedSize - writeIndex ) >= 16U ) )
+    {
+        symbols = _mm_loadu_si128( ( const __m128i * ) &encoded[ readIndex ] );
+
+        /* Bits from the next byte are shifted in, masked off by 0x2F except
+         * for bit 5, which the table lookups ignore. */
+        highNibbles = _mm_and_si128( _mm_srli_epi32( symbols, 4 ), slashes );
+        invalid = _mm_and_si128( _mm_shuffle_epi8( lowNibbleBits,
+                                                   _mm_and_si128( symbols,
+                                                                  slashes ) ),
+                                 _mm_shuffle_epi8( highNibbleBits,
+                                                   highNibbles ) );
+        valid = _mm_movemask_epi8( _mm_cmpgt_epi8( invalid,
+                                                   _mm_setzero_si128() ) ) == 0;
+
+        if( valid )
+        {
+            /* '/' shares its high nibble with '+', it takes the offset of the
+             * previous entry. */
+            values = _mm_add_epi8( symbols,
+                                   _mm_shuffle_epi8( offsets,
+                                                     _mm_add_epi8( _mm_cmpeq_epi8( symbols,
+                                                                                   slashes ),
+                                                                   highNibbles ) ) );
+
+            /* 4 x 6 bits into 24 bits per 32-bit word, then the 3 bytes of
+             * every word in big endian order. */
+            values = _mm_madd_epi16( _mm_maddubs_epi16( values,
+                                                        _mm_set1_epi32( 0x01400140 ) ),
+                                     _mm_set1_epi32( 0x00011000 ) );
+            _mm_storeu_si128( ( __m128i * ) &decoded[ writeIndex ],
+                              _mm_shuffle_epi8( values, pack ) );
+            readIndex += 16U;
+            writeIndex += 12U;
+        }
+    }
+
+    return readIndex;
+}
+/*-----------------------------------------------------------*/
+
+/* As decodeSsse3(), 32 symbols at a time into 24 bytes stored as 32. */
+__attribute__( ( target( "avx2" ) ) )
+static size_t decodeAvx2( const uint8_t * encoded,
+                          size_t encodedLength,
+                          uint8_t * decoded,
+                          size_t decodedSize )
+{
+    const __m256i lowNibbleBits = _mm256_broadcastsi128_si256(
+        _mm_setr_epi8( 0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                       0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A ) );
+    const __m256i highNibbleBits = _mm256_broadcastsi128_si256(
+        _mm_setr_epi8( 0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                       0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10 ) );
+    const __m256i offsets = _mm256_broadcastsi128_si256(
+        _mm_setr_epi8( 0, 16, 19, 4, -65, -65, -71, -71,
+                       0, 0, 0, 0, 0, 0, 0, 0 ) );
+    const __m256i slashes = _mm256_set1_epi8( 0x2F );
+    const __m256i pack = _mm256_broadcastsi128_si256(
+        _mm_setr_epi8( 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1 ) );
+
+    /* The 12 bytes of the upper lane follow those of the lower lane. */
+    const __m256i join = _mm256_setr_epi32( 0, 1, 2, 4, 5, 6, 3, 7 );
+    __m256i symbols, highNibbles, invalid, values;
+    size_t readIndex = 0U;
+    size_t writeIndex = 0U;
+    bool valid = true;
+
+    while( valid && ( ( encodedLength - readIndex ) >= 32U ) &&
+           ( ( decodedSize - writeIndex ) >= 32U ) )
+    {
+        symbols = _mm256_loadu_si256( ( const __m256i * ) &encoded[ readIndex ] );
+        highNibbles = _mm256_and_si256( _mm256_srli_epi32( symbols, 4 ),
+                                        slashes );
+        invalid = _mm256_and_si256( _mm256_shuffle_epi8( lowNibbleBits,
+                                                         _mm256_and_si256( symbols,
+                                                                           slashes ) ),
+                                    _mm256_shuffle_epi8( highNibbleBits,
+                                                         highNibbles ) );
+        valid = _mm256_testz_si256( invalid, invalid ) != 0;
+
+        if( valid )
+        {
+            values = _mm256_add_epi8( symbols,
+                                      _mm256_shuffle_epi8( offsets,
+                                                           _mm256_add_epi8( _mm256_cmpeq_epi8( symbols,
+                                                                                               slashes ),
+                                                                            highNibbles ) ) );
+            values = _mm256_madd_epi16( _mm256_maddubs_epi16( values,
+                                                              _mm256_set1_epi32( 0x01400140 ) ),
+                                        _mm256_set1_epi32( 0x00011000 ) );
+            values = _mm256_permutevar8x32_epi32( _mm256_shuffle_epi8( values,
+                                                                       pack ),
+                                                  join );
+            _mm256_storeu_si256( ( __m256i * ) &decoded[ writeIndex ], values );
+            readIndex += 32U;
+            writeIndex += 24U;
+        }
+    }
+
+    return readIndex;
+}
+/*-----------------------------------------------------------*/
+
+#endif /* ifdef BASE64_X86 */
+
+#ifdef BASE64_NEON
+
+static uint8x16_t translateNeon( uint8x16_t symbols,
+                                 uint8x16_t * invalid )
+{
+    const uint8_t lowNibbleBits[ 16 ] =
+    {
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+        0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A
+    };
+    const uint8_t highNibbleBits[ 16 ] =
+    {
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+        0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10
+    };
+    const uint8_t offsets[ 16 ] =
+    {
+        0, 16, 19, 4, 191, 191, 185, 185, 0, 0, 0, 0, 0, 0, 0, 0
+    };
+    uint8x16_t highNibbles = vshrq_n_u8( symbols, 4 );
+
+    *invalid = vorrq_u8( *invalid,
+                         vandq_u8( vqtbl1q_u8( vld1q_u8( lowNibbleBits ),
+                                               vandq_u8( symbols,
+                                                         vdupq_n_u8( 0x0FU ) ) ),
+                                   vqtbl1q_u8( vld1q_u8( highNibbleBits ),
+                                               highNibbles ) ) );
+
+    return vaddq_u8( symbols,
+                     vqtbl1q_u8( vld1q_u8( offsets ),
+                                 vaddq_u8( vceqq_u8( symbols,
+                                                     vdupq_n_u8( 0x2FU ) ),
+                                           highNibbles ) ) );
+}
+/*-----------------------------------------------------------*/
+
+/* As decodeSsse3(), 64 symbols at a time. vld4q_u8() splits them by their
+ * place in a quantum, so the bytes are rebuilt with shifts and vst3q_u8()
+ * stores exactly 48 of them. */
+static size_t decodeNeon( const uint8_t * encoded,
+                          size_t encodedLength,
+                          uint8_t * decoded,
+                          size_t decodedSize )
+{
+    uint8x16x4_t symbols;
+    uint8x16x3_t bytes;
+    uint8x16_t invalid;
+    size_t readIndex = 0U;
+    size_t writeIndex = 0U;
+    bool valid = true;
+
+    while( valid && ( ( encodedLength - readIndex ) >= 64U ) &&
+           ( ( decodedSize - writeIndex ) >= 48U ) )
+    {
+        symbols = vld4q_u8( &encoded[ readIndex ] );
+        invalid = vdupq_n_u8( 0U );
+
+        for( size_t i = 0U; i < 4U; i++ )
+        {
+            symbols.val[ i ] = translateNeon( symbols.val[ i ], &invalid );
+        }
+
+        valid = vmaxvq_u8( invalid ) == 0U;
+
+        if( valid )
+        {
+            bytes.val[ 0 ] = vorrq_u8( vshlq_n_u8( symbols.val[ 0 ], 2 ),
+                                       vshrq_n_u8( symbols.val[ 1 ], 4 ) );
+            bytes.val[ 1 ] = vorrq_u8( vshlq_n_u8( symbols.val[ 1 ], 4 ),
+                                       vshrq_n_u8( symbols.val[ 2 ], 2 ) );
+            bytes.val[ 2 ] = vorrq_u8( vshlq_n_u8( symbols.val[ 2 ], 6 ),
+                                       symbols.val[ 3 ] );
+            vst3q_u8( &decoded[ writeIndex ], bytes );
+            readIndex += 64U;
+            writeIndex += 48U;
+        }
+    }
+
+    return readIndex;
+}
+/*-----------------------------------------------------------*/
+
+#endif /* ifdef BASE64_NEON */
+
+static Base64Decoder_t bestDecoder( void )
+{
+    Base64Decoder_t decoder = BASE64_DECODER_SCALAR;
+
+    if( base64_isSupported( BASE64_DECODER_AVX2 ) )
+    {
+        decoder = BASE64_DECODER_AVX2;
+    }
+    else if( base64_isSupported( BASE64_DECODER_NEON ) )
+    {
+        decoder = BASE64_DECODER_NEON;
+    }
+    else if( base64_isSupported( BASE64_DECODER_SSSE3 ) )
+    {
+        decoder = BASE64_DECODER_SSSE3;
+    }
+    else
+    {
+        /* Empty else. */
+    }
+
+    return decoder;
+}
+/*-----------------------------------------------------------*/
+
+/* Decodes whole chunks of symbols with a vector decoder, and returns the
+ * number of symbols it decoded. The chunks are whole quanta, so the scalar
+ * decoder carries on from there. */
+static size_t decodeVector( Base64Decoder_t decoder,
+                            const uint8_t * encoded,
+                            size_t encodedLength,
+                            uint8_t * decoded,
+                            size_t decodedSize )
+{
+    size_t readLength = 0U;
+
+    /* Unused when no vector decoder is built in. */
+    ( void ) encoded;
+    ( void ) encodedLength;
+    ( void ) decoded;
+    ( void ) decodedSize;
+
+    switch( decoder )
+    {
+        #ifdef BASE64_X86
+            case BASE64_DECODER_SSSE3:
+                readLength = decodeSsse3( encoded,
+                                          encodedLength,
+                                          decoded,
+                                          decodedSize );
+                break;
+
+            case BASE64_DECODER_AVX2:
+                readLength = decodeAvx2( encoded,
+                                         encodedLength,
+                                         decoded,
+                                         decodedSize );
+                break;
+        #endif
+
+        #ifdef BASE64_NEON
+            case BASE64_DECODER_NEON:
+                readLength = decodeNeon( encoded,
+                                         encodedLength,
+                                         decoded,
+                                         decodedSize );
+                break;
+        #endif
+
+        default:
+            /* The scalar decoder does all the work. */
+            break;
+    }
+
+    return readLength;
+}
+/*-----------------------------------------------------------*/
+
+bool base64_isSupported( Base64Decoder_t decoder )
+{
+    bool supported = false;
+
+    switch( decoder )
+    {
+        case BASE64_DECODER_BEST:
+        case BASE64_DECODER_SCALAR:
+            supported = true;
+            break;
+
+        #ifdef BASE64_X86
+            case BASE64_DECODER_SSSE3:
+                supported = __builtin_cpu_supports( "ssse3" ) != 0;
+                break;
+
+            case BASE64_DECODER_AVX2:
+                supported = __builtin_cpu_supports( "avx2" ) != 0;
+                break;
+        #endif
+
+        #ifdef BASE64_NEON
+            case BASE64_DECODER_NEON:
+                supported = true;
+                break;
+        #endif
+
+        default:
+            /* Not built for this architecture. */
+            break;
+    }
+
+    return supported;
+}
+/*-----------------------------------------------------------*/
+
+bool base64_decode( const uint8_t * encoded,
+                    size_t encodedLength,
+                    uint8_t * decoded,
+                    size_t decodedSize,
+                    size_t * decodedLength )
+{
+    return base64_decodeWith( BASE64_DECODER_BEST,
+                              encoded,
+                              encodedLength,
+                              decoded,
+                              decodedSize,
+                              decodedLength );
+}
+/*-----------------------------------------------------------*/
+
+bool base64_decodeWith( Base64Decoder_t decoder,
+                        const uint8_t * encoded,
+                        size_t encodedLength,
+                        uint8_t * decoded,
+                        size_t decodedSize,
+                        size_t * decodedLength )
+{
+    bool valid = true;
+    size_t readIndex = 0U;
+    size_t writeIndex = 0U;
+    size_t tailLength = 0U;
+    size_t paddingLength = 0U;
+    uint32_t quantum = 0U;
+    uint8_t tail[ 4 ] = { 'A', 'A', 'A', 'A' };
+
+    assert( ( encoded != NULL ) || ( encodedLength == 0U ) );
+    assert( decoded != NULL );
+    assert( decodedLength != NULL );
+    assert( base64_isSupported( decoder ) );
+
+    /* Strip the padding so the input is whole quanta plus a 2 or 3 symbol
+     * tail. */
+    while( ( encodedLength > 0U ) && ( paddingLength < 2U ) &&
+           ( encoded[ encodedLength - 1U ] == '=' ) )
+    {
+        encodedLength--;
+        paddingLength++;
+    }
+
+    tailLength = encodedLength % 4U;
+
+    if( ( tailLength == 1U ) ||
+        ( ( ( ( encodedLength / 4U ) * 3U ) + ( ( tailLength * 3U ) / 4U ) ) >
+          decodedSize ) )
+    {
+        valid = false;
+    }
+
+    /* Every chunk is loaded before its bytes are stored, and a store never
+     * reaches past the end of the chunk, so in place decoding is safe. */
+    if( valid )
+    {
+        readIndex = decodeVector( ( decoder == BASE64_DECODER_BEST ) ?
+                                  bestDecoder() : decoder,
+                                  encoded,
+                                  encodedLength,
+                                  decoded,
+                                  decodedSize );
+        writeIndex = ( readIndex / 4U ) * 3U;
+    }
+
+    /* All four symbols of a quantum are read before its three bytes are
+     * written, and writes trail reads, so in place decoding is safe. */
+    while( valid && ( ( encodedLength - readIndex ) >= 4U ) )
+    {
+        valid = decodeQuantum( &encoded[ readIndex ], &quantum );
+
+        if( valid )
+        {
+            decoded[ writeIndex ] = ( uint8_t ) ( quantum >> 16 );
+            decoded[ writeIndex + 1U ] = ( uint8_t ) ( quantum >> 8 );
+            decoded[ writeIndex + 2U ] = ( uint8_t ) quantum;
+            readIndex += 4U;
+            writeIndex += 3U;
+        }
+    }
+
+    /* A short tail is padded with zero valued symbols and only the bytes it
+     * fully covers are kept. */
+    if( valid && ( tailLength > 0U ) )
+    {
+        for( size_t i = 0U; i < tailLength; i++ )
+        {
+            tail[ i ] = encoded[ readIndex + i ];
+        }
+
+        valid = decodeQuantum( tail, &quantum );
+
+        if( valid )
+        {
+            decoded[ writeIndex ] = ( uint8_t ) ( quantum >> 16 );
+            writeIndex++;
+
+            if( tailLength == 3U )
+            {
+                decoded[ writeIndex ] = ( uint8_t ) ( quantum >> 8 );
+                writeIndex++;
+            }
+        }
+    }
+
+    *decodedLength = valid ? writeIndex : 0U;
+
+    return valid;
+}
+/*-----------------------------------------------------------*/
@@ -0,0 +1,99 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file base64.h
+ * @brief Base64 decoding used by the JSON stream data path.
+ */
+
+#ifndef BASE64_H_
+#define BASE64_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* *INDENT-ON* */
+
+/**
+ * @brief Implementations of the decoder.
+ *
+ * The vector decoders translate and check many symbols per instruction and
+ * hand whatever is left, including the padded tail and any invalid symbol,
+ * to the scalar decoder.
+ */
+typedef enum Base64Decoder
+{
+    BASE64_DECODER_BEST = 0, /**< Fastest decoder the CPU supports. */
+    BASE64_DECODER_SCALAR,   /**< Table driven, one quantum at a time. */
+    BASE64_DECODER_SSSE3,    /**< x86 SSSE3, 16 symbols at a time. */
+    BASE64_DECODER_AVX2,     /**< x86 AVX2, 32 symbols at a time. */
+    BASE64_DECODER_NEON      /**< ARMv8 NEON, 64 symbols at a time. */
+} Base64Decoder_t;
+
+/**
+ * @brief Decode standard base64 text with the fastest decoder the CPU
+ * supports.
+ *
+ * The output is never longer than the input and is written front to back,
+ * so @p decoded may point at @p encoded to decode in place.
+ *
+ * @param[in] encoded Base64 text, with or without padding.
+ * @param[in] encodedLength Length of @p encoded.
+ * @param[out] decoded Buffer for the decoded bytes.
+ * @param[in] decodedSize Size of @p decoded.
+ * @param[out] decodedLength Number of bytes written to @p decoded.
+ *
+ * @return true on success; false if the text is not valid base64 or does not
+ * fit in @p decoded.
+ */
+bool base64_decode( const uint8_t * encoded,
+                    size_t encodedLength,
+                    uint8_t * decoded,
+                    size_t decodedSize,
+                    size_t * decodedLength );
+
+/**
+ * @brief Decode standard base64 text with a given decoder.
+ *
+ * Used to compare the decoders. See base64_decode() for the parameters.
+ *
+ * @param[in] decoder Decoder to use, supported by the CPU.
+ *
+ * @return true on success; false if the text is not valid base64 or does not
+ * fit in @p decoded.
+ */
+bool base64_decodeWith( Base64Decoder_t decoder,
+                        const uint8_t * encoded,
+                        size_t encodedLength,
+                        uint8_t * decoded,
+                        size_t decodedSize,
+                        size_t * decodedLength );
+
+/**
+ * @brief Check whether a decoder was built in and runs on this CPU.
+ *
+ * @param[in] decoder Decoder to check.
+ *
+ * @return true if @p decoder can be given to base64_decodeWith().
+ */
+bool base64_isSupported( Base64Decoder_t decoder );
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+}
+#endif
+/* *INDENT-ON* */
+
+#endif /* ifndef BASE64_H_ */
@@ -0,0 +1,417 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file job_index.c
+ * @brief Implementation of the job message index.
+ *
+ * Each object is walked with JSON_Iterate(), which skips over the values it
+ * does not descend into. A byte of the message is therefore read once per
+ * object level above it, whatever the number of files.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <string.h>
+
+#include "core_json.h"
+
+#include "job_index.h"
+
+/**
+ * @brief Longest decimal number of a 32-bit field.
+ */
+#define MAX_UNSIGNED_DIGITS 10U
+
+/**
+ * @brief Records a pair of an object or an array in the index.
+ *
+ * @p position is the number of pairs before this one in the collection.
+ */
+typedef bool ( * PairHandler_t )( JobIndex_t * index,
+                                  const JSONPair_t * pair,
+                                  size_t position );
+
+/*-----------------------------------------------------------*/
+
+/* Keys of a file, in the order of JobIndexFileField_t. */
+static const struct
+{
+    const char * key;
+    JSONTypes_t type;
+} fileKeys[ JOB_INDEX_FILE_FIELDS ] =
+{
+    { "filepath",         JSONString },
+    { "filesize",         JSONNumber },
+    { "fileid",           JSONNumber },
+    { "fileType",         JSONNumber },
+    { "certfile",         JSONString },
+    { "sig-sha256-ecdsa", JSONString },
+    { "update_data_url",  JSONString },
+    { "auth_scheme",      JSONString }
+};
+
+/*-----------------------------------------------------------*/
+
+static bool keyIs( const JSONPair_t * pair,
+                   const char * key )
+{
+    return ( pair->key != NULL ) && ( pair->keyLength == strlen( key ) ) &&
+           ( memcmp( pair->key, key, pair->keyLength ) == 0 );
+}
+/*-----------------------------------------------------------*/
+
+static bool valueIs( const JSONPair_t * pair,
+                     const char * value )
+{
+    return ( pair->jsonType == JSONString ) &&
+           ( pair->valueLength == strlen( value ) ) &&
+           ( memcmp( pair->value, value, pair->valueLength ) == 0 );
+}
+/*-----------------------------------------------------------*/
+
+/* Like JSON_Search(), the first of repeated keys is kept. */
+static void recordValue( const JobIndex_t * index,
+                         const JSONPair_t * pair,
+                         JSONTypes_t type,
+                         JobIndexValue_t * value )
+{
+    if( ( pair->jsonType == type ) && ( value->offset == 0U ) )
+    {
+        value->offset = ( uint32_t ) ( pair->value - index->message );
+        value->length = ( uint32_t ) pair->valueLength;
+    }
+}
+/*-----------------------------------------------------------*/
+
+static bool iterateCollection( JobIndex_t * index,
+                               const JSONPair_t * collection,
+                               PairHandler_t handler )
+{
+    size_t start = 0U;
+    size_t next = 0U;
+    size_t position = 0U;
+    JSONPair_t pair = { 0 };
+    JSONStatus_t status = JSONSuccess;
+    bool valid = true;
+
+    while( valid &&
+           ( ( status = JSON_Iterate( collection->value,
+                                      collection->valueLength,
+                                      &start,
+                                      &next,
+                                      &pair ) ) == JSONSuccess ) )
+    {
+        valid = handler( index, &pair, position );
+        position++;
+    }
+
+    return valid && ( status == JSONNotFound );
+}
+/*-----------------------------------------------------------*/
+
+/* A pair of the file being indexed, the last one counted. */
+static bool indexFileField( JobIndex_t * index,
+                            const JSONPair_t * pair,
+                            size_t position )
+{
+    JobIndexValue_t * file = index->files[ index->fileCount - 1U ];
+
+    ( void ) position;
+
+    for( size_t field = 0U; field < JOB_INDEX_FILE_FIELDS; field++ )
+    {
+        if( keyIs( pair, fileKeys[ field ].key ) )
+        {
+            recordValue( index, pair, fileKeys[ field ].type, &file[ field ] );
+        }
+    }
+
+    return true;
+}
+/*-----------------------------------------------------------*/
+
+static bool indexFile( JobIndex_t * index,
+                       const JSONPair_t * pair,
+                       size_t position )
+{
+    bool valid = ( position < JOB_INDEX_MAX_FILES );
+
+    if( valid )
+    {
+        index->fileCount = position + 1U;
+
+        /* A file that is not an object has no fields, and is rejected when
+         * it is read. */
+        if( pair->jsonType == JSONObject )
+        {
+            valid = iterateCollection( index, pair, indexFileField );
+        }
+    }
+
+    return valid;
+}
+/*-----------------------------------------------------------*/
+
+static bool indexProtocol( JobIndex_t * index,
+                           const JSONPair_t * pair,
+                           size_t position )
+{
+    ( void ) position;
+
+    index->mqtt = index->mqtt || valueIs( pair, "MQTT" );
+    index->http = index->http || valueIs( pair, "HTTP" );
+
+    return true;
+}
+/*-----------------------------------------------------------*/
+
+static bool indexOta( JobIndex_t * index,
+                      const JSONPair_t * pair,
+                      size_t position )
+{
+    bool valid = true;
+
+    ( void ) position;
+
+    if( keyIs( pair, "streamname" ) )
+    {
+        recordValue( index, pair, JSONString, &index->streamName );
+    }
+    else if( keyIs( pair, "protocols" ) && ( pair->jsonType == JSONArray ) )
+    {
+        valid = iterateCollection( index, pair, indexProtocol );
+    }
+    else if( keyIs( pair, "files" ) && ( pair->jsonType == JSONArray ) &&
+             ( index->fileCount == 0U ) )
+    {
+        valid = iterateCollection( index, pair, indexFile );
+    }
+    else
+    {
+        /* Empty else. */
+    }
+
+    return valid;
+}
+/*-----------------------------------------------------------*/
+
+static bool indexJobDocument( JobIndex_t * index,
+                              const JSONPair_t * pair,
+                              size_t position )
+{
+    ( void ) position;
+
+    return !( keyIs( pair, "afr_ota" ) && ( pair->jsonType == JSONObject ) ) ||
+           iterateCollection( index, pair, indexOta );
+}
+/*-----------------------------------------------------------*/
+
+static bool indexExecution( JobIndex_t * index,
+                            const JSONPair_t * pair,
+                            size_t position )
+{
+    bool valid = true;
+
+    ( void ) position;
+
+    if( keyIs( pair, "jobId" ) )
+    {
+        recordValue( index, pair, JSONString, &index->jobId );
+    }
+    else if( keyIs( pair, "status" ) )
+    {
+        recordValue( index, pair, JSONString, &index->status );
+    }
+    else if( keyIs( pair, "versionNumber" ) )
+    {
+        recordValue( index, pair, JSONNumber, &index->versionNumber );
+    }
+    else if( keyIs( pair, "executionNumber" ) )
+    {
+        recordValue( index, pair, JSONNumber, &index->executionNumber );
+    }
+    else if( keyIs( pair, "jobDocument" ) && ( pair->jsonType == JSONObject ) &&
+             ( index->jobDocument.offset == 0U ) )
+    {
+        recordValue( index, pair, JSONObject, &index->jobDocument );
+        valid = iterateCollection( index, pair, indexJobDocument );
+    }
+    else
+    {
+        /* Empty else. */
+    }
+
+    return valid;
+}
+/*-----------------------------------------------------------*/
+
+static bool indexMessage( JobIndex_t * index,
+                          const JSONPair_t * pair,
+                          size_t position )
+{
+    ( void ) position;
+
+    return !( keyIs( pair, "execution" ) && ( pair->jsonType == JSONObject ) ) ||
+           iterateCollection( index, pair, indexExecution );
+}
+/*-----------------------------------------------------------*/
+
+static bool getUnsigned( const JobIndex_t * index,
+                         const JobIndexValue_t * value,
+                         uint32_t * result )
+{
+    const char * digits = NULL;
+    size_t digitsLength = jobIndex_getValue( index, value, &digits );
+    uint64_t number = 0U;
+    bool valid = ( digitsLength > 0U ) &&
+                 ( digitsLength <= MAX_UNSIGNED_DIGITS );
+
+    for( size_t i = 0U; valid && ( i < digitsLength ); i++ )
+    {
+        valid = ( digits[ i ] >= '0' ) && ( digits[ i ] <= '9' );
+        number = ( number * 10U ) + ( uint64_t ) ( digits[ i ] - '0' );
+    }
+
+    if( valid && ( number <= UINT32_MAX ) )
+    {
+        *result = ( uint32_t ) number;
+    }
+    else
+    {
+        valid = false;
+    }
+
+    return valid;
+}
+/*-----------------------------------------------------------*/
+
+bool jobIndex_build( JobIndex_t * index,
+                     const char * message,
+                     size_t messageLength )
+{
+    JSONPair_t document = { 0 };
+    bool valid = false;
+
+    assert( index != NULL );
+    assert( message != NULL );
+
+    memset( index, 0, sizeof( *index ) );
+    index->message = message;
+
+    /* Validated once, JSON_Iterate() relies on it. */
+    valid = ( messageLength <= UINT32_MAX ) &&
+            ( JSON_Validate( message, messageLength ) == JSONSuccess );
+
+    if( valid )
+    {
+        document.value = message;
+        document.valueLength = messageLength;
+        document.jsonType = JSONObject;
+        valid = iterateCollection( index, &document, indexMessage );
+    }
+
+    /* Nothing is half indexed. */
+    if( !valid )
+    {
+        memset( index, 0, sizeof( *index ) );
+        index->message = message;
+    }
+
+    return valid;
+}
+/*-----------------------------------------------------------*/
+
+size_t jobIndex_getValue( const JobIndex_t * index,
+                          const JobIndexValue_t * value,
+                          const char ** start )
+{
+    assert( ( index != NULL ) && ( value != NULL ) && ( start != NULL ) );
+
+    *start = ( value->offset != 0U ) ? &index->message[ value->offset ] :
+             NULL;
+
+    return ( value->offset != 0U ) ? value->length : 0U;
+}
+/*-----------------------------------------------------------*/
+
+int8_t jobIndex_getFile( const JobIndex_t * index,
+                         uint8_t fileIndex,
+                         AfrOtaJobDocumentFields_t * fields )
+{
+    const JobIndexValue_t * file = NULL;
+    int8_t nextFileIndex = -1;
+    bool valid = false;
+
+    assert( ( index != NULL ) && ( fields != NULL ) );
+
+    if( fileIndex < index->fileCount )
+    {
+        file = index->files[ fileIndex ];
+        fields->filepathLen = jobIndex_getValue( index,
+                                                 &file[ JOB_INDEX_FILE_PATH ],
+                                                 &fields->filepath );
+        fields->certfileLen = jobIndex_getValue( index,
+                                                 &file[ JOB_INDEX_CERT_FILE ],
+                                                 &fields->certfile );
+        fields->signatureLen = jobIndex_getValue( index,
+                                                  &file[ JOB_INDEX_SIGNATURE ],
+                                                  &fields->signature );
+        fields->fileType = 0U;
+        valid = ( fields->filepath != NULL ) &&
+                ( fields->certfile != NULL ) &&
+                ( fields->signature != NULL ) &&
+                getUnsigned( index,
+                             &file[ JOB_INDEX_FILE_SIZE ],
+                             &fields->fileSize ) &&
+                getUnsigned( index,
+                             &file[ JOB_INDEX_FILE_ID ],
+                             &fields->fileId ) &&
+                ( ( file[ JOB_INDEX_FILE_TYPE ].offset == 0U ) ||
+                  getUnsigned( index,
+                               &file[ JOB_INDEX_FILE_TYPE ],
+                               &fields->fileType ) );
+    }
+
+    if( !valid )
+    {
+        /* Empty if. */
+    }
+    else if( index->mqtt && ( index->streamName.offset != 0U ) )
+    {
+        fields->imageRefLen = jobIndex_getValue( index,
+                                                 &index->streamName,
+                                                 &fields->imageRef );
+        fields->authScheme = NULL;
+        fields->authSchemeLen = 0U;
+    }
+    else if( index->http &&
+             ( file[ JOB_INDEX_UPDATE_DATA_URL ].offset != 0U ) )
+    {
+        fields->imageRefLen = jobIndex_getValue( index,
+                                                 &file[ JOB_INDEX_UPDATE_DATA_URL ],
+                                                 &fields->imageRef );
+        fields->authSchemeLen = jobIndex_getValue( index,
+                                                   &file[ JOB_INDEX_AUTH_SCHEME ],
+                                                   &fields->authScheme );
+    }
+    else
+    {
+        valid = false;
+    }
+
+    if( valid )
+    {
+        nextFileIndex = ( ( ( size_t ) fileIndex + 1U ) < index->fileCount ) ?
+                        ( int8_t ) ( fileIndex + 1U ) : 0;
+    }
+
+    return nextFileIndex;
+}
+/*-----------------------------------------------------------*/
@@ -0,0 +1,149 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file job_index.h
+ * @brief Index of the fields of a start-next job message, built in one walk.
+ *
+ * Looking up a field with JSON_Search() scans the message from its start, so
+ * reading every field of every file of a job costs a scan per field. The
+ * index walks each object of the message once and keeps where the fields of
+ * the job execution, the OTA job document and each of its files lie. Reading
+ * a field afterwards costs nothing, the values are slices of the message.
+ */
+
+#ifndef JOB_INDEX_H_
+#define JOB_INDEX_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ota_job_processor.h"
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* *INDENT-ON* */
+
+/**
+ * @brief Most files a job document may list.
+ */
+#ifndef JOB_INDEX_MAX_FILES
+    #define JOB_INDEX_MAX_FILES 10U
+#endif
+
+/**
+ * @brief Where a value lies in the message.
+ */
+typedef struct JobIndexValue
+{
+    uint32_t offset; /**< @brief Offset of the value, 0 when it is absent. A
+                      * string starts after its opening quote. */
+    uint32_t length; /**< @brief Length of the value, without the quotes of
+                      * a string. */
+} JobIndexValue_t;
+
+/**
+ * @brief Fields of a file of the job document.
+ */
+typedef enum JobIndexFileField
+{
+    JOB_INDEX_FILE_PATH = 0,   /**< "filepath" */
+    JOB_INDEX_FILE_SIZE,       /**< "filesize" */
+    JOB_INDEX_FILE_ID,         /**< "fileid" */
+    JOB_INDEX_FILE_TYPE,       /**< "fileType", optional. */
+    JOB_INDEX_CERT_FILE,       /**< "certfile" */
+    JOB_INDEX_SIGNATURE,       /**< "sig-sha256-ecdsa" */
+    JOB_INDEX_UPDATE_DATA_URL, /**< "update_data_url", HTTP only. */
+    JOB_INDEX_AUTH_SCHEME,     /**< "auth_scheme", HTTP only. */
+    JOB_INDEX_FILE_FIELDS      /**< Number of fields. */
+} JobIndexFileField_t;
+
+/**
+ * @brief Index of a start-next job message.
+ *
+ * Only valid as long as the message it was built from.
+ */
+typedef struct JobIndex
+{
+    const char * message;            /**< @brief Message indexed. */
+    JobIndexValue_t jobId;           /**< @brief "execution.jobId" */
+    JobIndexValue_t status;          /**< @brief "execution.status" */
+    JobIndexValue_t versionNumber;   /**< @brief "execution.versionNumber" */
+    JobIndexValue_t executionNumber; /**< @brief "execution.executionNumber" */
+    JobIndexValue_t jobDocument;     /**< @brief "execution.jobDocument" */
+    JobIndexValue_t streamName;      /**< @brief "afr_ota.streamname" */
+    bool mqtt;                       /**< @brief "afr_ota.protocols" has
+                                      * "MQTT". */
+    bool http;                       /**< @brief "afr_ota.protocols" has
+                                      * "HTTP". */
+    size_t fileCount;                /**< @brief Entries of "afr_ota.files". */
+    JobIndexValue_t files[ JOB_INDEX_MAX_FILES ][ JOB_INDEX_FILE_FIELDS ];
+} JobIndex_t;
+
+/**
+ * @brief Index a start-next job message.
+ *
+ * The message is validated once, then each object on the way to the fields
+ * is walked once. Fields missing from the message are left absent.
+ *
+ * @param[out] index Index to build.
+ * @param[in] message Start-next accepted message.
+ * @param[in] messageLength Length of @p message.
+ *
+ * @return true if the message was indexed; false if it is not valid JSON, or
+ * lists more than #JOB_INDEX_MAX_FILES files, in which case every field is
+ * left absent.
+ */
+bool jobIndex_build( JobIndex_t * index,
+                     const char * message,
+                     size_t messageLength );
+
+/**
+ * @brief Get a value of the message.
+ *
+ * @param[in] index Index of the message.
+ * @param[in] value Value to get, a member of @p index.
+ * @param[out] start Start of the value, NULL when it is absent.
+ *
+ * @return Length of the value; 0 when it is absent.
+ */
+size_t jobIndex_getValue( const JobIndex_t * index,
+                          const JobIndexValue_t * value,
+                          const char ** start );
+
+/**
+ * @brief Get the fields of a file of the job document.
+ *
+ * Takes the place of otaParser_parseJobDocFile(), and is called the same
+ * way, from file index 0 until it returns 0 or -1. The image is taken from
+ * the stream when the job allows MQTT, and from the URL of the file
+ * otherwise.
+ *
+ * @param[in] index Index of the message.
+ * @param[in] fileIndex Entry of "afr_ota.files".
+ * @param[out] fields Fields of the file.
+ *
+ * @return The next file index; 0 after the last file; -1 if the file is
+ * missing a field.
+ */
+int8_t jobIndex_getFile( const JobIndex_t * index,
+                         uint8_t fileIndex,
+                         AfrOtaJobDocumentFields_t * fields );
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+}
+#endif
+/* *INDENT-ON* */
+
+#endif /* ifndef JOB_INDEX_H_ */
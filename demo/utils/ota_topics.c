@@ -0,0 +1,158 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file ota_topics.c
+ * @brief Implementation of the OTA topic subscriptions.
+ */
+
+#define LIBRARY_LOG_NAME  "OtaTopics"
+#define LIBRARY_LOG_LEVEL LOG_INFO
+#include "csdk_logging/logging.h"
+
+/* Standard includes. */
+#include <assert.h>
+#include <stdio.h>
+#include <strings.h>
+
+#include "jobs.h"
+#include "mqtt_wrapper.h"
+#include "ota_topics.h"
+
+/**
+ * @brief Longest topic filter subscribed to.
+ */
+#define OTA_TOPIC_FILTER_LENGTH 256U
+
+/**
+ * @brief Most topic filters subscribed to.
+ */
+#define OTA_TOPIC_COUNT 4U
+
+/*-----------------------------------------------------------*/
+
+static bool formatFilter( char * filter,
+                          const char * format,
+                          const char * thingName,
+                          size_t thingNameLength,
+                          uint16_t * filterLength )
+{
+    int length = snprintf( filter,
+                           OTA_TOPIC_FILTER_LENGTH,
+                           format,
+                           ( int ) thingNameLength,
+                           thingName );
+
+    *filterLength = ( uint16_t ) length;
+
+    return ( length > 0 ) && ( length < ( int ) OTA_TOPIC_FILTER_LENGTH );
+}
+/*-----------------------------------------------------------*/
+
+bool otaTopics_subscribe( const char * thingName,
+                          size_t thingNameLength,
+                          DataType_t dataType,
+                          bool jobUpdates )
+{
+    char filters[ OTA_TOPIC_COUNT ][ OTA_TOPIC_FILTER_LENGTH ];
+    MQTTSubscribeInfo_t subscriptions[ OTA_TOPIC_COUNT ] = { 0 };
+    size_t topicLength = 0U;
+    size_t count = 1U;
+    bool success = false;
+    size_t index = 0U;
+
+    assert( thingName != NULL );
+
+    /*
+     * AWS IoT Jobs library:
+     * Creates the start-next/accepted topic the job document arrives on.
+     */
+    success = ( Jobs_GetTopic( filters[ 0 ],
+                               OTA_TOPIC_FILTER_LENGTH,
+                               thingName,
+                               ( uint16_t ) thingNameLength,
+                               JobsStartNextSuccess,
+                               &topicLength ) == JobsSuccess );
+    subscriptions[ 0 ].topicFilterLength = ( uint16_t ) topicLength;
+
+    /* The job ID and stream name are not known before the job document
+     * arrives, so those levels are wildcards. */
+    if( success && jobUpdates )
+    {
+        success = formatFilter( filters[ count ],
+                                "$aws/things/%.*s/jobs/+/update/accepted",
+                                thingName,
+                                thingNameLength,
+                                &subscriptions[ count ].topicFilterLength ) &&
+                  formatFilter( filters[ count + 1U ],
+                                "$aws/things/%.*s/jobs/+/update/rejected",
+                                thingName,
+                                thingNameLength,
+                                &subscriptions[ count + 1U ].topicFilterLength );
+        count += 2U;
+    }
+
+    success = success &&
+              formatFilter( filters[ count ],
+                            ( dataType == DATA_TYPE_CBOR ) ?
+                            "$aws/things/%.*s/streams/+/data/cbor" :
+                            "$aws/things/%.*s/streams/+/data/json",
+                            thingName,
+                            thingNameLength,
+                            &subscriptions[ count ].topicFilterLength );
+    count++;
+
+    if( !success )
+    {
+        LogError( ( "Thing name too long for the OTA topics." ) );
+    }
+    else
+    {
+        for( index = 0U; index < count; index++ )
+        {
+            subscriptions[ index ].qos = MQTTQoS0;
+            subscriptions[ index ].pTopicFilter = filters[ index ];
+        }
+
+        success = mqttWrapper_subscribeBatch( subscriptions, count );
+    }
+
+    return success;
+}
+/*-----------------------------------------------------------*/
+
+bool otaTopics_parseDataType( const char * name,
+                              DataType_t * dataType )
+{
+    bool valid = true;
+
+    assert( ( name != NULL ) && ( dataType != NULL ) );
+
+    if( strcasecmp( name, "cbor" ) == 0 )
+    {
+        *dataType = DATA_TYPE_CBOR;
+    }
+    else if( strcasecmp( name, "json" ) == 0 )
+    {
+        *dataType = DATA_TYPE_JSON;
+    }
+    else
+    {
+        valid = false;
+    }
+
+    return valid;
+}
+/*-----------------------------------------------------------*/
+
+const char * otaTopics_dataTypeName( DataType_t dataType )
+{
+    return ( dataType == DATA_TYPE_CBOR ) ? "CBOR" : "JSON";
+}
+/*-----------------------------------------------------------*/
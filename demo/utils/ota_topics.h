@@ -0,0 +1,93 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file ota_topics.h
+ * @brief Subscription to every topic of an OTA update at connect time.
+ *
+ * The start-next response, the job update responses of any job and the data
+ * of any stream are subscribed to in one SUBSCRIBE packet, before the job is
+ * asked for. The job document and the first block then arrive without
+ * waiting for a SUBACK, and once the wildcards are granted the later
+ * subscriptions of the downloader are covered by them and cost no packet. If
+ * the broker refuses a wildcard, those subscriptions are sent instead.
+ *
+ * The encoding of the stream blocks picks the data topic. It is set when
+ * building with #OTA_STREAM_DATA_TYPE, and may be given by name at run time.
+ */
+
+#ifndef OTA_TOPICS_H_
+#define OTA_TOPICS_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "MQTTFileDownloader.h"
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* *INDENT-ON* */
+
+/**
+ * @brief Encoding the stream blocks are requested in, unless another one is
+ * given at run time.
+ *
+ * CBOR carries the bytes of a block as they are, where JSON carries them
+ * base64 encoded and a third larger, so CBOR is the default.
+ */
+#ifndef OTA_STREAM_DATA_TYPE
+    #define OTA_STREAM_DATA_TYPE DATA_TYPE_CBOR
+#endif
+
+/**
+ * @brief Subscribe to the job and stream topics of a thing in one packet.
+ *
+ * @param[in] thingName Name of the thing.
+ * @param[in] thingNameLength Length of @p thingName.
+ * @param[in] dataType Encoding the stream blocks are requested in.
+ * @param[in] jobUpdates Whether to subscribe to the update responses of any
+ * job, for a demo that routes them.
+ *
+ * @return true if the subscriptions were sent; false otherwise.
+ */
+bool otaTopics_subscribe( const char * thingName,
+                          size_t thingNameLength,
+                          DataType_t dataType,
+                          bool jobUpdates );
+
+/**
+ * @brief Get the stream encoding of a name, "cbor" or "json".
+ *
+ * @param[in] name Name of the encoding, in any case.
+ * @param[out] dataType Encoding named.
+ *
+ * @return true if @p name is an encoding; false otherwise.
+ */
+bool otaTopics_parseDataType( const char * name,
+                              DataType_t * dataType );
+
+/**
+ * @brief Get the name of a stream encoding, for logs and reports.
+ *
+ * @param[in] dataType Encoding.
+ *
+ * @return "CBOR" or "JSON".
+ */
+const char * otaTopics_dataTypeName( DataType_t dataType );
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+}
+#endif
+/* *INDENT-ON* */
+
+#endif /* ifndef OTA_TOPICS_H_ */
@@ -0,0 +1,67 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file progress_report.c
+ * @brief Rate limiter for download progress messages.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <stddef.h>
+
+#include "progress_report.h"
+
+/*-----------------------------------------------------------*/
+
+void progressReport_init( ProgressReport_t * report, uint32_t intervalMs )
+{
+    assert( report != NULL );
+
+    report->intervalMs = intervalMs;
+    report->lastReportTimeMs = 0U;
+    report->reported = false;
+}
+/*-----------------------------------------------------------*/
+
+bool progressReport_isDue( ProgressReport_t * report,
+                           uint32_t nowMs,
+                           uint32_t done,
+                           uint32_t total )
+{
+    bool due = false;
+
+    assert( report != NULL );
+
+    /* Unsigned subtraction keeps the interval correct across a wrap of the
+     * millisecond clock. */
+    if( !report->reported || ( done >= total ) ||
+        ( ( nowMs - report->lastReportTimeMs ) >= report->intervalMs ) )
+    {
+        report->reported = true;
+        report->lastReportTimeMs = nowMs;
+        due = true;
+    }
+
+    return due;
+}
+/*-----------------------------------------------------------*/
+
+uint32_t progressReport_percent( uint32_t done, uint32_t total )
+{
+    uint32_t percent = 100U;
+
+    if( ( total > 0U ) && ( done < total ) )
+    {
+        percent = ( uint32_t ) ( ( ( uint64_t ) done * 100U ) / total );
+    }
+
+    return percent;
+}
+/*-----------------------------------------------------------*/
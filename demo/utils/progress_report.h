@@ -0,0 +1,80 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file progress_report.h
+ * @brief Rate limiter for download progress messages.
+ */
+
+#ifndef PROGRESS_REPORT_H_
+#define PROGRESS_REPORT_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stdint.h>
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* *INDENT-ON* */
+
+/**
+ * @brief State of a progress reporter.
+ */
+typedef struct ProgressReport
+{
+    uint32_t intervalMs;       /**< @brief Minimum time between reports. */
+    uint32_t lastReportTimeMs; /**< @brief Time of the last report. */
+    bool reported;             /**< @brief Set once the first report is due. */
+} ProgressReport_t;
+
+/**
+ * @brief Start reporting progress for a new transfer.
+ *
+ * @param[out] report Reporter to initialize.
+ * @param[in] intervalMs Minimum time between two reports.
+ */
+void progressReport_init( ProgressReport_t * report, uint32_t intervalMs );
+
+/**
+ * @brief Check whether progress should be reported now.
+ *
+ * The first update, the final update and at most one update per interval
+ * are reported.
+ *
+ * @param[in, out] report Reporter to check.
+ * @param[in] nowMs Current time in milliseconds.
+ * @param[in] done Units transferred so far.
+ * @param[in] total Units in the whole transfer.
+ *
+ * @return true if the caller should report progress.
+ */
+bool progressReport_isDue( ProgressReport_t * report,
+                           uint32_t nowMs,
+                           uint32_t done,
+                           uint32_t total );
+
+/**
+ * @brief Express progress as a whole percentage.
+ *
+ * @param[in] done Units transferred so far.
+ * @param[in] total Units in the whole transfer.
+ *
+ * @return Percentage in the range 0 to 100.
+ */
+uint32_t progressReport_percent( uint32_t done, uint32_t total );
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+}
+#endif
+/* *INDENT-ON* */
+
+#endif /* ifndef PROGRESS_REPORT_H_ */
@@ -0,0 +1,134 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file topic_router.c
+ * @brief Dispatch of incoming MQTT messages to handlers by exact topic.
+ */
+
+/* Standard includes. */
+#include <assert.h>
+#include <string.h>
+
+#include "topic_router.h"
+
+/*-----------------------------------------------------------*/
+
+static bool routeMatches( const TopicRoute_t * route,
+                          const char * topic,
+                          size_t topicLength )
+{
+    /* Every topic of a thing shares the "$aws/things/<thing>/" prefix, so
+     * the length rejects most mismatches before any byte is compared. */
+    return ( route->topicLength == topicLength ) &&
+           ( memcmp( route->topic, topic, topicLength ) == 0 );
+}
+/*-----------------------------------------------------------*/
+
+void topicRouter_init( TopicRouter_t * router )
+{
+    assert( router != NULL );
+
+    memset( router, 0, sizeof( TopicRouter_t ) );
+}
+/*-----------------------------------------------------------*/
+
+bool topicRouter_set( TopicRouter_t * router,
+                      const char * topic,
+                      size_t topicLength,
+                      TopicHandler_t handler )
+{
+    TopicRoute_t * route = NULL;
+    bool set = false;
+
+    assert( router != NULL );
+    assert( ( topic != NULL ) && ( handler != NULL ) );
+
+    for( size_t i = 0U; ( route == NULL ) && ( i < router->routeCount ); i++ )
+    {
+        if( router->routes[ i ].handler == handler )
+        {
+            route = &router->routes[ i ];
+        }
+    }
+
+    if( topicLength > TOPIC_ROUTER_MAX_TOPIC_LENGTH )
+    {
+        /* Empty if. */
+    }
+    else if( route != NULL )
+    {
+        memcpy( route->topic, topic, topicLength );
+        route->topicLength = topicLength;
+        set = true;
+    }
+    else if( router->routeCount < TOPIC_ROUTER_MAX_ROUTES )
+    {
+        route = &router->routes[ router->routeCount ];
+        memcpy( route->topic, topic, topicLength );
+        route->topicLength = topicLength;
+        route->handler = handler;
+        router->routeCount++;
+        set = true;
+    }
+    else
+    {
+        /* Empty else. */
+    }
+
+    return set;
+}
+/*-----------------------------------------------------------*/
+
+void topicRouter_remove( TopicRouter_t * router, TopicHandler_t handler )
+{
+    assert( router != NULL );
+
+    for( size_t i = 0U; i < router->routeCount; i++ )
+    {
+        if( router->routes[ i ].handler == handler )
+        {
+            /* Order does not matter, so the last route fills the gap. */
+            router->routeCount--;
+            router->routes[ i ] = router->routes[ router->routeCount ];
+            router->lastMatch = 0U;
+            break;
+        }
+    }
+}
+/*-----------------------------------------------------------*/
+
+TopicHandler_t topicRouter_find( TopicRouter_t * router,
+                                 const char * topic,
+                                 size_t topicLength )
+{
+    const TopicRoute_t * route = NULL;
+
+    assert( router != NULL );
+
+    if( ( router->lastMatch < router->routeCount ) &&
+        routeMatches( &router->routes[ router->lastMatch ],
+                      topic,
+                      topicLength ) )
+    {
+        route = &router->routes[ router->lastMatch ];
+    }
+
+    for( size_t i = 0U; ( route == NULL ) && ( i < router->routeCount ); i++ )
+    {
+        if( routeMatches( &router->routes[ i ], topic, topicLength ) )
+        {
+            route = &router->routes[ i ];
+            router->lastMatch = i;
+        }
+    }
+
+    return ( route != NULL ) ? route->handler : NULL;
+}
+/*-----------------------------------------------------------*/
@@ -0,0 +1,135 @@
+/*
+ * Copyright Amazon.com, Inc. and its affiliates. All Rights Reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Licensed under the MIT License. See the LICENSE accompanying this file
+ * for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+/**
+ * @file topic_router.h
+ * @brief Dispatch of incoming MQTT messages to handlers by exact topic.
+ *
+ * Topics are built once, when the job or download they belong to starts, and
+ * incoming topics are matched by length and then by content. The route that
+ * matched last is tried first, so a run of data blocks costs one comparison
+ * per message.
+ */
+
+#ifndef TOPIC_ROUTER_H_
+#define TOPIC_ROUTER_H_
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* *INDENT-ON* */
+
+/**
+ * @brief Maximum number of routes a router holds.
+ */
+#ifndef TOPIC_ROUTER_MAX_ROUTES
+    #define TOPIC_ROUTER_MAX_ROUTES 8U
+#endif
+
+/**
+ * @brief Longest topic a route can match.
+ */
+#ifndef TOPIC_ROUTER_MAX_TOPIC_LENGTH
+    #define TOPIC_ROUTER_MAX_TOPIC_LENGTH 256U
+#endif
+
+/**
+ * @brief Handler of the messages received on a topic.
+ *
+ * @param[in] message Payload of the message, in the MQTT receive buffer.
+ * @param[in] messageLength Length of @p message.
+ *
+ * @return true if the message was handled; false if it was malformed.
+ */
+typedef bool ( * TopicHandler_t )( uint8_t * message, size_t messageLength );
+
+/**
+ * @brief A topic and the handler of the messages received on it.
+ */
+typedef struct TopicRoute
+{
+    TopicHandler_t handler; /**< @brief Handler of the topic. */
+    size_t topicLength;     /**< @brief Length of topic. */
+    char topic[ TOPIC_ROUTER_MAX_TOPIC_LENGTH ]; /**< @brief Exact topic. */
+} TopicRoute_t;
+
+/**
+ * @brief Set of routes, one per handler.
+ */
+typedef struct TopicRouter
+{
+    TopicRoute_t routes[ TOPIC_ROUTER_MAX_ROUTES ]; /**< @brief Routes. */
+    size_t routeCount;  /**< @brief Routes in use. */
+    size_t lastMatch;   /**< @brief Route tried first by the next find. */
+} TopicRouter_t;
+
+/**
+ * @brief Remove every route.
+ *
+ * @param[out] router Router to initialize.
+ */
+void topicRouter_init( TopicRouter_t * router );
+
+/**
+ * @brief Route a topic to a handler.
+ *
+ * A handler has at most one topic, setting it again replaces the topic it
+ * was routed from. The router takes no lock, a router shared between tasks
+ * is locked by its owner around every call.
+ *
+ * @param[in, out] router Router to add the route to.
+ * @param[in] topic Topic to match exactly, copied into the router.
+ * @param[in] topicLength Length of @p topic.
+ * @param[in] handler Handler of the messages received on @p topic.
+ *
+ * @return true if the route was set; false if the topic is too long or the
+ * router is full.
+ */
+bool topicRouter_set( TopicRouter_t * router,
+                      const char * topic,
+                      size_t topicLength,
+                      TopicHandler_t handler );
+
+/**
+ * @brief Remove the route of a handler, if it has one.
+ *
+ * @param[in, out] router Router to remove the route from.
+ * @param[in] handler Handler whose route is removed.
+ */
+void topicRouter_remove( TopicRouter_t * router, TopicHandler_t handler );
+
+/**
+ * @brief Find the handler of a topic.
+ *
+ * The handler is returned rather than called, so the caller can release its
+ * lock first and the handler is free to change the routes.
+ *
+ * @param[in, out] router Router to match the topic against.
+ * @param[in] topic Topic a message was received on.
+ * @param[in] topicLength Length of @p topic.
+ *
+ * @return The handler routed from @p topic; NULL if no route matched.
+ */
+TopicHandler_t topicRouter_find( TopicRouter_t * router,
+                                 const char * topic,
+                                 size_t topicLength );
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+}
+#endif
+/* *INDENT-ON* */
+
+#endif /* ifndef TOPIC_ROUTER_H_ */
@@ -7,6 +7,10 @@
  * the License.
  */
 
+#define LIBRARY_LOG_NAME  "MQTTWrapper"
+#define LIBRARY_LOG_LEVEL LOG_INFO
+#include "csdk_logging/logging.h"
+
 #include <assert.h>
 #include <string.h>
 
@@ -14,13 +18,141 @@
 
 static MQTTContext_t * globalCoreMqttContext = NULL;
 
+/* State of the QoS 1 and 2 publishes awaiting acknowledgement */
+static MQTTPubAckInfo_t outgoingPublishRecords[ MQTT_WRAPPER_MAX_OUTGOING_PUBLISHES ];
+static MQTTPubAckInfo_t incomingPublishRecords[ MQTT_WRAPPER_MAX_INCOMING_PUBLISHES ];
+
 #define MAX_THING_NAME_SIZE 128U
 static char globalThingName[ MAX_THING_NAME_SIZE + 1 ];
 static size_t globalThingNameLength = 0U;
 
+/* Every topic filter subscribed to, restored after a reconnect. The wrapper
+ * cannot tell whether a filter is still in use, the OTA wildcards of the
+ * connection are the oldest, so none is forgotten to make room. */
+#define MAX_SUBSCRIPTIONS            MQTT_WRAPPER_MAX_SUBSCRIPTIONS
+#define MAX_TOPIC_FILTER_LENGTH      256U
+
+typedef struct Subscription
+{
+    char topicFilter[ MAX_TOPIC_FILTER_LENGTH ];
+    size_t topicFilterLength;
+    MQTTQoS_t qos;
+    bool granted;        /* The broker acknowledged it at qos */
+    uint16_t packetId;   /* SUBSCRIBE awaiting its SUBACK, if not granted */
+    size_t subAckIndex;  /* Position of the filter in that SUBSCRIBE */
+} Subscription_t;
+
+static Subscription_t subscriptions[ MAX_SUBSCRIPTIONS ];
+static size_t subscriptionCount = 0U;
+
+/* Returns the entry of the filter, NULL if it is too long to be kept or the
+ * table is full */
+static Subscription_t * rememberSubscription( const char * topic,
+                                              size_t topicLength,
+                                              MQTTQoS_t qos )
+{
+    Subscription_t * subscription = NULL;
+    size_t index = 0U;
+
+    for( index = 0U; ( index < subscriptionCount ) && ( subscription == NULL );
+         index++ )
+    {
+        if( ( subscriptions[ index ].topicFilterLength == topicLength ) &&
+            ( memcmp( subscriptions[ index ].topicFilter,
+                      topic,
+                      topicLength ) == 0 ) )
+        {
+            subscription = &subscriptions[ index ];
+        }
+    }
+
+    if( ( subscription == NULL ) && ( topicLength <= MAX_TOPIC_FILTER_LENGTH ) &&
+        ( subscriptionCount < MAX_SUBSCRIPTIONS ) )
+    {
+        subscription = &subscriptions[ subscriptionCount ];
+        memcpy( subscription->topicFilter, topic, topicLength );
+        subscription->topicFilterLength = topicLength;
+        subscriptionCount++;
+    }
+
+    if( subscription != NULL )
+    {
+        subscription->qos = qos;
+        subscription->granted = false;
+        subscription->packetId = MQTT_PACKET_ID_INVALID;
+    }
+
+    return subscription;
+}
+
+static void forgetSubscription( size_t index )
+{
+    memmove( &subscriptions[ index ],
+             &subscriptions[ index + 1U ],
+             ( subscriptionCount - index - 1U ) * sizeof( Subscription_t ) );
+    subscriptionCount--;
+}
+
+/* A filter granted by the broker, wildcards included, already delivers the
+ * topic at the same or a higher QoS. Filters still awaiting their SUBACK do
+ * not count, they may yet be refused. */
+static bool isSubscribed( const char * topic,
+                          size_t topicLength,
+                          MQTTQoS_t qos )
+{
+    size_t index = 0U;
+    bool covered = false;
+    bool isMatch = false;
+
+    for( index = 0U; ( index < subscriptionCount ) && !covered; index++ )
+    {
+        isMatch = false;
+        covered = subscriptions[ index ].granted &&
+                  ( subscriptions[ index ].qos >= qos ) &&
+                  ( MQTT_MatchTopic( topic,
+                                     ( uint16_t ) topicLength,
+                                     subscriptions[ index ].topicFilter,
+                                     ( uint16_t ) subscriptions[ index ].topicFilterLength,
+                                     &isMatch ) == MQTTSuccess ) &&
+                  isMatch;
+    }
+
+    return covered;
+}
+
+/* All the filters go in one SUBSCRIBE packet, acknowledged by one SUBACK */
+static bool sendSubscribe( const MQTTSubscribeInfo_t * subscriptionList,
+                           size_t count,
+                           uint16_t packetId )
+{
+    MQTTStatus_t mqttStatus = MQTTSuccess;
+
+    mqttStatus = MQTT_Subscribe( globalCoreMqttContext,
+                                 subscriptionList,
+                                 count,
+                                 packetId );
+    return mqttStatus == MQTTSuccess;
+}
+
+static void initStatefulQoS( void )
+{
+    MQTTStatus_t mqttStatus = MQTTSuccess;
+
+    memset( outgoingPublishRecords, 0, sizeof( outgoingPublishRecords ) );
+    memset( incomingPublishRecords, 0, sizeof( incomingPublishRecords ) );
+    mqttStatus = MQTT_InitStatefulQoS( globalCoreMqttContext,
+                                       outgoingPublishRecords,
+                                       MQTT_WRAPPER_MAX_OUTGOING_PUBLISHES,
+                                       incomingPublishRecords,
+                                       MQTT_WRAPPER_MAX_INCOMING_PUBLISHES );
+    assert( mqttStatus == MQTTSuccess );
+    ( void ) mqttStatus;
+}
+
 void mqttWrapper_setCoreMqttContext( MQTTContext_t * mqttContext )
 {
     globalCoreMqttContext = mqttContext;
+    initStatefulQoS();
 }
 
 MQTTContext_t * mqttWrapper_getCoreMqttContext( void )
@@ -77,10 +209,51 @@ bool mqttWrapper_isConnected( void )
     return isConnected;
 }
 
+void mqttWrapper_resetConnection( void )
+{
+    /* MQTT_Init() clears the context, so its arguments are copied out of it
+     * first. The publish records go with the session the broker dropped. */
+    TransportInterface_t transport = { 0 };
+    MQTTFixedBuffer_t networkBuffer = { 0 };
+    MQTTGetCurrentTimeFunc_t getTime = NULL;
+    MQTTEventCallback_t appCallback = NULL;
+    MQTTStatus_t mqttStatus = MQTTSuccess;
+
+    assert( globalCoreMqttContext != NULL );
+
+    transport = globalCoreMqttContext->transportInterface;
+    networkBuffer = globalCoreMqttContext->networkBuffer;
+    getTime = globalCoreMqttContext->getTime;
+    appCallback = globalCoreMqttContext->appCallback;
+
+    mqttStatus = MQTT_Init( globalCoreMqttContext,
+                            &transport,
+                            getTime,
+                            appCallback,
+                            &networkBuffer );
+    assert( mqttStatus == MQTTSuccess );
+    ( void ) mqttStatus;
+
+    initStatefulQoS();
+}
+
 bool mqttWrapper_publish( char * topic,
                           size_t topicLength,
                           uint8_t * message,
                           size_t messageLength )
+{
+    return mqttWrapper_publishWithQos( topic,
+                                       topicLength,
+                                       message,
+                                       messageLength,
+                                       MQTTQoS0 );
+}
+
+bool mqttWrapper_publishWithQos( char * topic,
+                                 size_t topicLength,
+                                 uint8_t * message,
+                                 size_t messageLength,
+                                 MQTTQoS_t qos )
 {
     bool success = false;
     assert( globalCoreMqttContext != NULL );
@@ -90,7 +263,15 @@ bool mqttWrapper_publish( char * topic,
     {
         MQTTStatus_t mqttStatus = MQTTSuccess;
         MQTTPublishInfo_t pubInfo = { 0 };
-        pubInfo.qos = 0;
+        uint16_t packetId = MQTT_PACKET_ID_INVALID;
+
+        /* Only a publish that is acknowledged needs a packet ID. */
+        if( qos != MQTTQoS0 )
+        {
+            packetId = MQTT_GetPacketId( globalCoreMqttContext );
+        }
+
+        pubInfo.qos = qos;
         pubInfo.retain = false;
         pubInfo.dup = false;
         pubInfo.pTopicName = topic;
@@ -100,7 +281,7 @@ bool mqttWrapper_publish( char * topic,
 
         mqttStatus = MQTT_Publish( globalCoreMqttContext,
                                    &pubInfo,
-                                   MQTT_GetPacketId( globalCoreMqttContext ) );
+                                   packetId );
         success = mqttStatus == MQTTSuccess;
     }
     return success;
@@ -108,24 +289,158 @@ bool mqttWrapper_publish( char * topic,
 
 bool mqttWrapper_subscribe( char * topic, size_t topicLength )
 {
+    return mqttWrapper_subscribeWithQos( topic, topicLength, MQTTQoS0 );
+}
+
+bool mqttWrapper_subscribeWithQos( char * topic,
+                                   size_t topicLength,
+                                   MQTTQoS_t qos )
+{
+    MQTTSubscribeInfo_t subscribeInfo = { 0 };
+
+    subscribeInfo.qos = qos;
+    subscribeInfo.pTopicFilter = topic;
+    subscribeInfo.topicFilterLength = ( uint16_t ) topicLength;
+
+    return mqttWrapper_subscribeBatch( &subscribeInfo, 1U );
+}
+
+bool mqttWrapper_subscribeBatch( const MQTTSubscribeInfo_t * subscriptionList,
+                                 size_t count )
+{
+    MQTTSubscribeInfo_t toSend[ MAX_SUBSCRIPTIONS ];
+    Subscription_t * remembered = NULL;
+    uint16_t packetId = MQTT_PACKET_ID_INVALID;
+    size_t sendCount = 0U;
+    size_t index = 0U;
     bool success = false;
+    bool dropped = false;
     assert( globalCoreMqttContext != NULL );
+    assert( subscriptionList != NULL );
+
+    packetId = MQTT_GetPacketId( globalCoreMqttContext );
+
+    for( index = 0U; index < count; index++ )
+    {
+        const MQTTSubscribeInfo_t * subscription = &subscriptionList[ index ];
+
+        /* Topics under a wildcard granted earlier cost no packet. */
+        if( !isSubscribed( subscription->pTopicFilter,
+                           subscription->topicFilterLength,
+                           subscription->qos ) )
+        {
+            remembered = rememberSubscription( subscription->pTopicFilter,
+                                               subscription->topicFilterLength,
+                                               subscription->qos );
+
+            /* A filter that would be lost on the next reconnect is not
+             * subscribed to at all. */
+            if( ( remembered == NULL ) || ( sendCount == MAX_SUBSCRIPTIONS ) )
+            {
+                LogError( ( "Cannot keep the subscription to %.*s.",
+                            ( int ) subscription->topicFilterLength,
+                            subscription->pTopicFilter ) );
+                dropped = true;
+            }
+            else
+            {
+                remembered->packetId = packetId;
+                remembered->subAckIndex = sendCount;
+                toSend[ sendCount ] = *subscription;
+                sendCount++;
+            }
+        }
+    }
 
     success = mqttWrapper_isConnected();
-    if( success )
+    if( success && ( sendCount > 0U ) )
     {
-        MQTTStatus_t mqttStatus = MQTTSuccess;
-        MQTTSubscribeInfo_t subscribeInfo = { 0 };
-        subscribeInfo.qos = 0;
-        subscribeInfo.pTopicFilter = topic;
-        subscribeInfo.topicFilterLength = topicLength;
-
-        mqttStatus = MQTT_Subscribe( globalCoreMqttContext,
-                                     &subscribeInfo,
-                                     1,
-                                     MQTT_GetPacketId(
-                                         globalCoreMqttContext ) );
-        success = mqttStatus == MQTTSuccess;
+        success = sendSubscribe( toSend, sendCount, packetId );
+    }
+    return success && !dropped;
+}
+
+bool mqttWrapper_resubscribe( void )
+{
+    MQTTSubscribeInfo_t toSend[ MAX_SUBSCRIPTIONS ];
+    uint16_t packetId = MQTT_PACKET_ID_INVALID;
+    bool success = false;
+    size_t index = 0U;
+    assert( globalCoreMqttContext != NULL );
+
+    packetId = MQTT_GetPacketId( globalCoreMqttContext );
+
+    /* The new connection starts without subscriptions, each filter is
+     * granted again by the SUBACK of this packet. */
+    for( index = 0U; index < subscriptionCount; index++ )
+    {
+        subscriptions[ index ].granted = false;
+        subscriptions[ index ].packetId = packetId;
+        subscriptions[ index ].subAckIndex = index;
+
+        toSend[ index ].qos = subscriptions[ index ].qos;
+        toSend[ index ].pTopicFilter = subscriptions[ index ].topicFilter;
+        toSend[ index ].topicFilterLength =
+            ( uint16_t ) subscriptions[ index ].topicFilterLength;
+    }
+
+    success = mqttWrapper_isConnected();
+    if( success && ( subscriptionCount > 0U ) )
+    {
+        success = sendSubscribe( toSend, subscriptionCount, packetId );
     }
     return success;
 }
+
+void mqttWrapper_handleSubAck( const MQTTPacketInfo_t * subAckPacket,
+                               uint16_t packetId )
+{
+    uint8_t * returnCodes = NULL;
+    size_t returnCodeCount = 0U;
+    size_t index = 0U;
+    Subscription_t * subscription = NULL;
+    uint8_t returnCode = 0U;
+    assert( subAckPacket != NULL );
+
+    if( MQTT_GetSubAckStatusCodes( subAckPacket,
+                                   &returnCodes,
+                                   &returnCodeCount ) != MQTTSuccess )
+    {
+        LogError( ( "Malformed SUBACK with packet id %u.",
+                    ( unsigned int ) packetId ) );
+        returnCodeCount = 0U;
+    }
+
+    while( ( returnCodeCount > 0U ) && ( index < subscriptionCount ) )
+    {
+        subscription = &subscriptions[ index ];
+
+        if( ( subscription->packetId != packetId ) ||
+            ( subscription->subAckIndex >= returnCodeCount ) )
+        {
+            index++;
+            continue;
+        }
+
+        returnCode = returnCodes[ subscription->subAckIndex ];
+
+        if( returnCode == ( uint8_t ) MQTTSubAckFailure )
+        {
+            /* Forgotten, so the topics under it are subscribed to on their
+             * own and it is not restored on a new connection. */
+            LogWarn( ( "Broker refused subscription to %.*s, return code "
+                       "0x%02X.",
+                       ( int ) subscription->topicFilterLength,
+                       subscription->topicFilter,
+                       ( unsigned int ) returnCode ) );
+            forgetSubscription( index );
+        }
+        else
+        {
+            subscription->qos = ( MQTTQoS_t ) returnCode;
+            subscription->granted = true;
+            subscription->packetId = MQTT_PACKET_ID_INVALID;
+            index++;
+        }
+    }
+}
@@ -12,6 +12,24 @@
 
 #include "core_mqtt.h"
 
+/* QoS 1 and 2 publishes that can await their acknowledgement at once, in each
+ * direction. */
+#ifndef MQTT_WRAPPER_MAX_OUTGOING_PUBLISHES
+    #define MQTT_WRAPPER_MAX_OUTGOING_PUBLISHES 8U
+#endif
+
+/* Topic filters remembered for mqttWrapper_resubscribe(). A filter is never
+ * forgotten to make room, so subscribing fails once they are all in use. */
+#ifndef MQTT_WRAPPER_MAX_SUBSCRIPTIONS
+    #define MQTT_WRAPPER_MAX_SUBSCRIPTIONS 8U
+#endif
+
+#ifndef MQTT_WRAPPER_MAX_INCOMING_PUBLISHES
+    #define MQTT_WRAPPER_MAX_INCOMING_PUBLISHES 8U
+#endif
+
+/* Also hands the publish records of the wrapper to coreMQTT, so the context
+ * must have just been initialized by MQTT_Init(). */
 void mqttWrapper_setCoreMqttContext( MQTTContext_t * mqttContext );
 
 MQTTContext_t * mqttWrapper_getCoreMqttContext( void );
@@ -25,11 +43,50 @@ bool mqttWrapper_connect( char * thingName, size_t thingNameLength );
 
 bool mqttWrapper_isConnected( void );
 
+/* Forgets a lost connection so it can be connected again, by initializing
+ * the context again with the same transport, clock, callback and buffer. No
+ * DISCONNECT is sent, the transport is expected to be gone already. */
+void mqttWrapper_resetConnection( void );
+
+/* Publishes at QoS 0. */
 bool mqttWrapper_publish( char * topic,
                           size_t topicLength,
                           uint8_t * message,
                           size_t messageLength );
 
+/* Fails with nothing sent if the publish needs an acknowledgement and
+ * MQTT_WRAPPER_MAX_OUTGOING_PUBLISHES are already awaiting theirs. */
+bool mqttWrapper_publishWithQos( char * topic,
+                                 size_t topicLength,
+                                 uint8_t * message,
+                                 size_t messageLength,
+                                 MQTTQoS_t qos );
+
+/* Subscribes at QoS 0. Topic filters are remembered, even if the
+ * subscription fails, so they can be restored by mqttWrapper_resubscribe()
+ * on a new connection, unless the broker refuses them or
+ * MQTT_WRAPPER_MAX_SUBSCRIPTIONS are already remembered. */
 bool mqttWrapper_subscribe( char * topic, size_t topicLength );
 
+bool mqttWrapper_subscribeWithQos( char * topic,
+                                   size_t topicLength,
+                                   MQTTQoS_t qos );
+
+/* Subscribes to every filter of the list with a single SUBSCRIBE packet.
+ * Filters already covered by one the broker granted, through its wildcards or
+ * an exact match, are left out, and nothing is sent if none is left. A filter
+ * that cannot be remembered is not sent either, and makes the call return
+ * false once the others are sent. */
+bool mqttWrapper_subscribeBatch( const MQTTSubscribeInfo_t * subscriptionList,
+                                 size_t count );
+
+/* Restores every remembered filter with a single SUBSCRIBE packet. */
+bool mqttWrapper_resubscribe( void );
+
+/* Must be given every SUBACK received. Marks the filters it grants as
+ * subscribed, and logs and forgets those it refuses, so the topics under a
+ * refused wildcard are subscribed to on their own. */
+void mqttWrapper_handleSubAck( const MQTTPacketInfo_t * subAckPacket,
+                               uint16_t packetId );
+
 #endif